@@ -105,6 +105,8 @@ void aws_iot_mqtt_internal_write_utf8_string(unsigned char **pptr, const char *s
 
 IoT_Error_t aws_iot_mqtt_internal_flushBuffers( AWS_IoT_Client *pClient );
 IoT_Error_t aws_iot_mqtt_internal_send_packet(AWS_IoT_Client *pClient, size_t length, Timer *pTimer);
+IoT_Error_t aws_iot_mqtt_internal_send_packet_vector(AWS_IoT_Client *pClient, const NetworkOutVector *pVectors,
+													 size_t count, Timer *pTimer);
 IoT_Error_t aws_iot_mqtt_internal_cycle_read(AWS_IoT_Client *pClient, Timer *pTimer, uint8_t *pPacketType);
 IoT_Error_t aws_iot_mqtt_internal_wait_for_read(AWS_IoT_Client *pClient, uint8_t packetType, Timer *pTimer);
 IoT_Error_t aws_iot_mqtt_internal_serialize_zero(unsigned char *pTxBuf, size_t txBufLen,
@@ -31,6 +31,33 @@ bool isJsonValidAndParse(const char *pJsonDocument, size_t jsonSize, void *pJson
 bool isJsonKeyMatchingAndUpdateValue(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount,
 									 jsonStruct_t *pDataStruct, uint32_t *pDataLength, int32_t *pDataPosition);
 
+/**
+ * @brief Called for a key of the last parsed document
+ *
+ * @param pKey The key, not NULL terminated
+ * @param keyLength Length of the key
+ * @param keyToken Token index to pass to updateValueFromJsonKey
+ * @param pContext Context given to forEachJsonKey
+ * @return false to stop visiting keys
+ */
+typedef bool (*jsonKeyVisitor_t)(const char *pKey, size_t keyLength, int32_t keyToken, void *pContext);
+
+/**
+ * @brief Visits the keys of the last parsed document in document order, in one pass
+ *
+ * Keys at every nesting level are visited, except those inside "metadata".
+ */
+void forEachJsonKey(const char *pJsonDocument, int32_t tokenCount, jsonKeyVisitor_t visitor, void *pContext);
+
+/**
+ * @brief Parses the value of a key found by forEachJsonKey into pDataStruct
+ *
+ * @param pDataLength Set to the length of the value in the document
+ * @param pDataPosition Set to the offset of the value in the document
+ */
+void updateValueFromJsonKey(const char *pJsonDocument, int32_t keyToken, jsonStruct_t *pDataStruct,
+							uint32_t *pDataLength, int32_t *pDataPosition);
+
 IoT_Error_t aws_iot_shadow_internal_get_request_json(char *pBuffer, size_t bufferSize);
 
 IoT_Error_t aws_iot_shadow_internal_delete_request_json(char *pBuffer, size_t bufferSize);
@@ -57,6 +57,18 @@ typedef struct {
 	bool ServerVerificationFlag;        ///< Boolean.  True = perform server certificate hostname validation.  False = skip validation \b NOT recommended.
 } TLSConnectParams;
 
+/**
+ * @brief Network Output Vector
+ *
+ * Describes one buffer of a scatter-gather write. A packet can be sent as a
+ * list of these so that large payloads are never copied into a contiguous
+ * transmit buffer first.
+ */
+typedef struct {
+	const unsigned char *pBase;    ///< Pointer to the first byte of the buffer
+	size_t len;                    ///< Number of bytes in the buffer
+} NetworkOutVector;
+
 /**
  * @brief Network Structure
  *
@@ -67,6 +79,7 @@ struct Network {
 
 	IoT_Error_t (*read)(Network *, unsigned char *, size_t, Timer *, size_t *);    ///< Function pointer pointing to the network function to read from the network
 	IoT_Error_t (*write)(Network *, unsigned char *, size_t, Timer *, size_t *);    ///< Function pointer pointing to the network function to write to the network
+	IoT_Error_t (*writev)(Network *, const NetworkOutVector *, size_t, Timer *, size_t *);    ///< Function pointer pointing to the network function to write a vector of buffers to the network. May be NULL if the platform has no scatter-gather support
 	IoT_Error_t (*disconnect)(Network *);    ///< Function pointer pointing to the network function to disconnect from the network
 	IoT_Error_t (*isConnected)(Network *);    ///< Function pointer pointing to the network function to check if TLS is connected
 	IoT_Error_t (*destroy)(Network *);        ///< Function pointer pointing to the network function to destroy the network object
@@ -120,6 +133,22 @@ IoT_Error_t iot_tls_connect(Network *pNetwork, TLSConnectParams *TLSParams);
  */
 IoT_Error_t iot_tls_write(Network *, unsigned char *, size_t, Timer *, size_t *);
 
+/**
+ * @brief Write a vector of buffers to the network socket
+ *
+ * Sends the buffers back-to-back as one byte stream. Small buffers are
+ * gathered so that they share a TLS record with the data that follows them,
+ * while large buffers are encrypted straight from where they are stored.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface.
+ * @param NetworkOutVector pointer - array of buffers to write to socket
+ * @param size_t - number of entries in the array
+ * @param Timer * - operation timer
+ * @param size_t - pointer to store the total number of bytes written
+ * @return IoT_Error_t - successful write or TLS error code
+ */
+IoT_Error_t iot_tls_writev(Network *, const NetworkOutVector *, size_t, Timer *, size_t *);
+
 /**
  * @brief Read bytes from the network socket
  *
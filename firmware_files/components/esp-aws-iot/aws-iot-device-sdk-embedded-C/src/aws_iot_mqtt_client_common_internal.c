@@ -363,6 +363,66 @@ IoT_Error_t aws_iot_mqtt_internal_send_packet(AWS_IoT_Client *pClient, size_t le
 	FUNC_EXIT_RC(rc);
 }
 
+/**
+ * @brief Send an MQTT packet made up of several buffers on the network
+ *
+ * The buffers are handed to the network layer in one writev call so that the
+ * packet does not have to be assembled in the client write buffer first.
+ *
+ * @param pClient MQTT client which holds packet
+ * @param pVectors Buffers that make up the packet, in wire order
+ * @param count Number of buffers
+ * @param pTimer Amount of time allowed to send packet
+ *
+ * @return IoT_Error_t of send status
+ */
+IoT_Error_t aws_iot_mqtt_internal_send_packet_vector(AWS_IoT_Client *pClient, const NetworkOutVector *pVectors,
+													 size_t count, Timer *pTimer) {
+
+	size_t sentLen = 0, length = 0, i;
+	IoT_Error_t rc;
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	IoT_Error_t threadRc;
+#endif
+
+	FUNC_ENTRY;
+
+	if(NULL == pClient || NULL == pVectors || NULL == pTimer) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	if(NULL == pClient->networkStack.writev) {
+		FUNC_EXIT_RC(FAILURE);
+	}
+
+	for(i = 0; i < count; i++) {
+		length += pVectors[i].len;
+	}
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	threadRc = aws_iot_mqtt_client_lock_mutex(pClient, &(pClient->clientData.tls_write_mutex));
+	if(SUCCESS != threadRc) {
+		FUNC_EXIT_RC(threadRc);
+	}
+#endif
+
+	rc = pClient->networkStack.writev(&(pClient->networkStack), pVectors, count, pTimer, &sentLen);
+
+#ifdef _ENABLE_THREAD_SUPPORT_
+	threadRc = aws_iot_mqtt_client_unlock_mutex(pClient, &(pClient->clientData.tls_write_mutex));
+	if((SUCCESS != threadRc) && ( SUCCESS == rc )) {
+		FUNC_EXIT_RC(threadRc);
+	}
+#endif
+
+	if(SUCCESS == rc && sentLen != length) {
+		rc = FAILURE;
+	}
+
+	FUNC_EXIT_RC(rc);
+}
+
 static IoT_Error_t _aws_iot_mqtt_internal_readWrapper( AWS_IoT_Client *pClient, size_t offset, size_t size, Timer *pTimer, size_t * read_len ) {
     IoT_Error_t rc;
     int byteToRead;
@@ -42,6 +42,9 @@ extern "C" {
 
 #include "aws_iot_mqtt_client_common_internal.h"
 
+/* Largest value the four byte MQTT remaining length field can encode */
+#define MAX_PACKET_REMAINING_LENGTH 268435455
+
 /**
  * @param stringVar pointer to the String into which the data is to be read
  * @param stringLen pointer to variable which has the length of the string
@@ -132,6 +135,91 @@ static IoT_Error_t _aws_iot_mqtt_internal_serialize_publish(unsigned char *pTxBu
 	FUNC_EXIT_RC(SUCCESS);
 }
 
+/**
+  * Serializes the fixed header, the topic length and the packet identifier of a
+  * publish into the supplied buffer and describes the complete packet as a list
+  * of output vectors. The topic and payload are referenced where they are
+  * stored instead of being copied, so only the few header bytes need room in
+  * the buffer.
+  * @param pTxBuf the buffer into which the header fields will be serialized
+  * @param txBufLen the length in bytes of the supplied buffer
+  * @param dup uint8_t - the MQTT dup flag
+  * @param qos QoS - the MQTT QoS value
+  * @param retained uint8_t - the MQTT retained flag
+  * @param packetId uint16_t - the MQTT packet identifier
+  * @param pTopicName char * - the MQTT topic in the publish
+  * @param topicNameLen uint16_t - the length of the Topic Name
+  * @param pPayload byte buffer - the MQTT publish payload
+  * @param payloadLen size_t - the length of the MQTT payload
+  * @param pVectors array of at least four vectors that receives the packet layout
+  * @param pVectorCount size_t - pointer to the variable that stores the number of vectors used
+  *
+  * @return An IoT Error Type defining successful/failed call
+  */
+static IoT_Error_t _aws_iot_mqtt_internal_serialize_publish_vector(unsigned char *pTxBuf, size_t txBufLen, uint8_t dup,
+																   QoS qos, uint8_t retained, uint16_t packetId,
+																   const char *pTopicName, uint16_t topicNameLen,
+																   const unsigned char *pPayload, size_t payloadLen,
+																   NetworkOutVector *pVectors, size_t *pVectorCount) {
+	unsigned char *ptr;
+	uint32_t rem_len;
+	size_t count = 0;
+	IoT_Error_t rc;
+	MQTTHeader header = {0};
+
+	FUNC_ENTRY;
+	if(NULL == pTxBuf || NULL == pPayload || NULL == pVectors || NULL == pVectorCount) {
+		FUNC_EXIT_RC(NULL_VALUE_ERROR);
+	}
+
+	ptr = pTxBuf;
+	rem_len = (uint32_t) (topicNameLen + payloadLen + 2);
+	if(qos > 0) {
+		rem_len += 2; /* packetId */
+	}
+	if(rem_len > MAX_PACKET_REMAINING_LENGTH) {
+		FUNC_EXIT_RC(MQTT_TX_BUFFER_TOO_SHORT_ERROR);
+	}
+
+	/* header byte, up to four length bytes, topic length and packetId */
+	if(txBufLen < 9) {
+		FUNC_EXIT_RC(MQTT_TX_BUFFER_TOO_SHORT_ERROR);
+	}
+
+	rc = aws_iot_mqtt_internal_init_header(&header, PUBLISH, qos, dup, retained);
+	if(SUCCESS != rc) {
+		FUNC_EXIT_RC(rc);
+	}
+	aws_iot_mqtt_internal_write_char(&ptr, header.byte); /* write header */
+
+	ptr += aws_iot_mqtt_internal_write_len_to_buffer(ptr, rem_len); /* write remaining length */
+
+	aws_iot_mqtt_internal_write_uint_16(&ptr, topicNameLen);
+
+	pVectors[count].pBase = pTxBuf;
+	pVectors[count].len = (size_t) (ptr - pTxBuf);
+	count++;
+
+	pVectors[count].pBase = (const unsigned char *) pTopicName;
+	pVectors[count].len = topicNameLen;
+	count++;
+
+	if(qos > 0) {
+		pVectors[count].pBase = ptr;
+		aws_iot_mqtt_internal_write_uint_16(&ptr, packetId);
+		pVectors[count].len = 2;
+		count++;
+	}
+
+	pVectors[count].pBase = pPayload;
+	pVectors[count].len = payloadLen;
+	count++;
+
+	*pVectorCount = count;
+
+	FUNC_EXIT_RC(SUCCESS);
+}
+
 /**
   * Serializes the ack packet into the supplied buffer.
   * @param pTxBuf the buffer into which the packet will be serialized
@@ -198,6 +286,8 @@ static IoT_Error_t _aws_iot_mqtt_internal_publish(AWS_IoT_Client *pClient, const
 												  uint16_t topicNameLen, IoT_Publish_Message_Params *pParams) {
 	Timer timer;
 	uint32_t len = 0;
+	NetworkOutVector vectors[4];
+	size_t vectorCount = 0;
 	uint16_t packet_id;
 	unsigned char dup, type;
 	IoT_Error_t rc;
@@ -211,18 +301,36 @@ static IoT_Error_t _aws_iot_mqtt_internal_publish(AWS_IoT_Client *pClient, const
 		pParams->id = aws_iot_mqtt_get_next_packet_id(pClient);
 	}
 
-	rc = _aws_iot_mqtt_internal_serialize_publish(pClient->clientData.writeBuf, pClient->clientData.writeBufSize, 0,
-												  pParams->qos, pParams->isRetained, pParams->id, pTopicName,
-												  topicNameLen, (unsigned char *) pParams->payload,
-												  pParams->payloadLen, &len);
-	if(SUCCESS != rc) {
-		FUNC_EXIT_RC(rc);
-	}
+	if(NULL != pClient->networkStack.writev) {
+		/* Send the header, topic and payload straight from where they are
+		 * stored so the payload is never copied into the write buffer. */
+		rc = _aws_iot_mqtt_internal_serialize_publish_vector(pClient->clientData.writeBuf,
+															 pClient->clientData.writeBufSize, 0, pParams->qos,
+															 pParams->isRetained, pParams->id, pTopicName,
+															 topicNameLen, (unsigned char *) pParams->payload,
+															 pParams->payloadLen, vectors, &vectorCount);
+		if(SUCCESS != rc) {
+			FUNC_EXIT_RC(rc);
+		}
 
-	/* send the publish packet */
-	rc = aws_iot_mqtt_internal_send_packet(pClient, len, &timer);
-	if(SUCCESS != rc) {
-		FUNC_EXIT_RC(rc);
+		rc = aws_iot_mqtt_internal_send_packet_vector(pClient, vectors, vectorCount, &timer);
+		if(SUCCESS != rc) {
+			FUNC_EXIT_RC(rc);
+		}
+	} else {
+		rc = _aws_iot_mqtt_internal_serialize_publish(pClient->clientData.writeBuf, pClient->clientData.writeBufSize, 0,
+													  pParams->qos, pParams->isRetained, pParams->id, pTopicName,
+													  topicNameLen, (unsigned char *) pParams->payload,
+													  pParams->payloadLen, &len);
+		if(SUCCESS != rc) {
+			FUNC_EXIT_RC(rc);
+		}
+
+		/* send the publish packet */
+		rc = aws_iot_mqtt_internal_send_packet(pClient, len, &timer);
+		if(SUCCESS != rc) {
+			FUNC_EXIT_RC(rc);
+		}
 	}
 
 	/* Wait for ack if QoS1 */
@@ -26,6 +26,7 @@ extern "C" {
 
 #include <string.h>
 #include <stdbool.h>
+#include <stdlib.h>
 
 #include "aws_iot_json_utils.h"
 #include "aws_iot_log.h"
@@ -374,17 +375,54 @@ static IoT_Error_t convertDataToString(char *pStringBuffer, size_t maxSizoString
 }
 
 static jsmn_parser shadowJsonParser;
-static jsmntok_t jsonTokenStruct[MAX_JSON_TOKEN_EXPECTED];
+
+/* Token arena shared by every parse. It starts out as the static array and
+ * moves to the heap, doubling in size, when a document has more than
+ * MAX_JSON_TOKEN_EXPECTED tokens. The larger arena is kept for later documents. */
+static jsmntok_t jsonTokenStatic[MAX_JSON_TOKEN_EXPECTED];
+static jsmntok_t *jsonTokenStruct = jsonTokenStatic;
+static uint32_t jsonTokenCapacity = MAX_JSON_TOKEN_EXPECTED;
+
+static int32_t parseJsonTokens(const char *pJsonDocument, size_t jsonSize) {
+	int32_t tokenCount;
+	uint32_t newCapacity;
+	jsmntok_t *pNewTokens;
+
+	jsmn_init(&shadowJsonParser);
+
+	for(;;) {
+		tokenCount = jsmn_parse(&shadowJsonParser, pJsonDocument, jsonSize, jsonTokenStruct, jsonTokenCapacity);
+		if(tokenCount != JSMN_ERROR_NOMEM) {
+			return tokenCount;
+		}
+
+		/* jsmn stops in front of the token it had no room for, so parsing
+		 * carries on from there once the arena is larger. */
+		newCapacity = jsonTokenCapacity * 2;
+		if(jsonTokenStruct == jsonTokenStatic) {
+			pNewTokens = (jsmntok_t *) malloc(newCapacity * sizeof(jsmntok_t));
+			if(pNewTokens != NULL) {
+				memcpy(pNewTokens, jsonTokenStatic, sizeof(jsonTokenStatic));
+			}
+		} else {
+			pNewTokens = (jsmntok_t *) realloc(jsonTokenStruct, newCapacity * sizeof(jsmntok_t));
+		}
+
+		if(pNewTokens == NULL) {
+			IOT_WARN("No memory for %u JSON tokens\n", (unsigned int) newCapacity);
+			return JSMN_ERROR_NOMEM;
+		}
+		jsonTokenStruct = pNewTokens;
+		jsonTokenCapacity = newCapacity;
+	}
+}
 
 bool isJsonValidAndParse(const char *pJsonDocument, size_t jsonSize, void *pJsonHandler, int32_t *pTokenCount) {
 	int32_t tokenCount;
 
 	IOT_UNUSED(pJsonHandler);
 
-	jsmn_init(&shadowJsonParser);
-
-	tokenCount = jsmn_parse(&shadowJsonParser, pJsonDocument, jsonSize, jsonTokenStruct,
-							sizeof(jsonTokenStruct) / sizeof(jsonTokenStruct[0]));
+	tokenCount = parseJsonTokens(pJsonDocument, jsonSize);
 
 	if(tokenCount < 0) {
 		IOT_WARN("Failed to parse JSON: %d\n", tokenCount);
@@ -429,61 +467,85 @@ static IoT_Error_t UpdateValueIfNoObject(const char *pJsonString, jsonStruct_t *
 	return ret_val;
 }
 
-bool isJsonKeyMatchingAndUpdateValue(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount,
-									 jsonStruct_t *pDataStruct, uint32_t *pDataLength, int32_t *pDataPosition) {
+void forEachJsonKey(const char *pJsonDocument, int32_t tokenCount, jsonKeyVisitor_t visitor, void *pContext) {
 	int32_t i, metadataEnd;
-	uint32_t dataLength;
-	jsmntok_t dataToken;
-
-	IOT_UNUSED(pJsonHandler);
-
-	for(i = 1; i < tokenCount; ) {
-		if(jsoneq(pJsonDocument, &(jsonTokenStruct[i]), pDataStruct->pKey) == 0) {
-			dataToken = jsonTokenStruct[i + 1];
-			dataLength = (uint32_t) (dataToken.end - dataToken.start);
-			UpdateValueIfNoObject(pJsonDocument, pDataStruct, dataToken);
-			*pDataPosition = dataToken.start;
-			*pDataLength = dataLength;
-			return true;
-		} else if(jsoneq(pJsonDocument, &(jsonTokenStruct[i]), "metadata") == 0) {
-			/* Sanity check: must not be at the last key in the json object. */
-			if(i >= tokenCount-2)
-			{
-				return false;
-			}
+	jsmntok_t *pToken;
 
+	/* Keys are the string tokens with one child, their value; the last token
+	 * cannot be a key. */
+	for(i = 1; i < tokenCount - 1; ) {
+		pToken = &jsonTokenStruct[i];
+		if(pToken->type != JSMN_STRING || pToken->size != 1) {
+			i++;
+		} else if(jsoneq(pJsonDocument, pToken, "metadata") == 0) {
 			/* Record where the metadata object ends. */
-			metadataEnd = jsonTokenStruct[i+1].end;
+			metadataEnd = jsonTokenStruct[i + 1].end;
 
 			/* Skip past the "metadata" key and jsmn object element. */
-			i+= 2;
+			i += 2;
 
-			/* Skip past every key inside "metadata". Keys inside "metadata" have
-			 * have an end character before the end of the metadata object.
+			/* Skip past every token inside "metadata". They all end before the
+			 * end of the metadata object.
 			 */
-			while(jsonTokenStruct[i].end < metadataEnd)
-			{
+			while(i < tokenCount && jsonTokenStruct[i].end < metadataEnd) {
 				i++;
 			}
-		}
-		else
-		{
-			/* Only increment the loop counter if the current object doesn't
-			 * match AND isn't "metadata".
-			 */
+		} else {
+			if(!visitor(pJsonDocument + pToken->start, (size_t) (pToken->end - pToken->start), i, pContext)) {
+				return;
+			}
 			i++;
 		}
 	}
-	return false;
+}
+
+void updateValueFromJsonKey(const char *pJsonDocument, int32_t keyToken, jsonStruct_t *pDataStruct,
+							uint32_t *pDataLength, int32_t *pDataPosition) {
+	jsmntok_t dataToken = jsonTokenStruct[keyToken + 1];
+
+	UpdateValueIfNoObject(pJsonDocument, pDataStruct, dataToken);
+	*pDataPosition = dataToken.start;
+	*pDataLength = (uint32_t) (dataToken.end - dataToken.start);
+}
+
+typedef struct {
+	const char *pKey;
+	size_t keyLength;
+	int32_t keyToken;
+} KeySearch_t;
+
+static bool matchSearchedKey(const char *pKey, size_t keyLength, int32_t keyToken, void *pContext) {
+	KeySearch_t *pSearch = (KeySearch_t *) pContext;
+
+	if(keyLength == pSearch->keyLength && strncmp(pKey, pSearch->pKey, keyLength) == 0) {
+		pSearch->keyToken = keyToken;
+		return false;
+	}
+	return true;
+}
+
+bool isJsonKeyMatchingAndUpdateValue(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount,
+									 jsonStruct_t *pDataStruct, uint32_t *pDataLength, int32_t *pDataPosition) {
+	KeySearch_t search;
+
+	IOT_UNUSED(pJsonHandler);
+
+	search.pKey = pDataStruct->pKey;
+	search.keyLength = strlen(pDataStruct->pKey);
+	search.keyToken = -1;
+	forEachJsonKey(pJsonDocument, tokenCount, matchSearchedKey, &search);
+	if(search.keyToken < 0) {
+		return false;
+	}
+
+	updateValueFromJsonKey(pJsonDocument, search.keyToken, pDataStruct, pDataLength, pDataPosition);
+	return true;
 }
 
 bool isReceivedJsonValid(const char *pJsonDocument, size_t jsonSize ) {
 	int32_t tokenCount;
 
-	jsmn_init(&shadowJsonParser);
-
-	tokenCount = jsmn_parse(&shadowJsonParser, pJsonDocument, jsonSize, jsonTokenStruct,
-							sizeof(jsonTokenStruct) / sizeof(jsonTokenStruct[0]));
+	tokenCount = parseJsonTokens(pJsonDocument, jsonSize);
 
 	if(tokenCount < 0) {
 		IOT_WARN("Failed to parse JSON: %d\n", tokenCount);
@@ -502,10 +564,8 @@ bool extractClientToken(const char *pJsonDocument, size_t jsonSize, char *pExtra
 	int32_t tokenCount, i;
 	size_t length;
 	jsmntok_t ClientJsonToken;
-	jsmn_init(&shadowJsonParser);
 
-	tokenCount = jsmn_parse(&shadowJsonParser, pJsonDocument, jsonSize, jsonTokenStruct,
-							sizeof(jsonTokenStruct) / sizeof(jsonTokenStruct[0]));
+	tokenCount = parseJsonTokens(pJsonDocument, jsonSize);
 
 	if(tokenCount < 0) {
 		IOT_WARN("Failed to parse JSON: %d\n", tokenCount);
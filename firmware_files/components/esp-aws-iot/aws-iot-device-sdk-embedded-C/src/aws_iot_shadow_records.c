@@ -78,6 +78,27 @@ char shadowRxBuf[SHADOW_MAX_SIZE_OF_RX_BUFFER];
 
 static JsonTokenTable_t tokenTable[MAX_JSON_TOKEN_EXPECTED];
 static uint32_t tokenTableIndex = 0;
+
+/* Registered delta keys are looked up through a hash table that is rebuilt on
+ * every registration. Its size and seed are searched so that every distinct
+ * key has a slot of its own (a perfect hash): a key in a delta document then
+ * costs one hash and at most one compare. Only if no such table turns up do
+ * colliding keys fall back to linear probing. Entries registered with the same
+ * key are chained behind the first one. */
+#define DELTA_KEY_MAX_SLOTS (4 * MAX_JSON_TOKEN_EXPECTED)
+#define DELTA_KEY_SEEDS_PER_SIZE 16
+#define DELTA_KEY_NONE (-1)
+static int16_t deltaKeySlots[DELTA_KEY_MAX_SLOTS];
+static uint32_t deltaKeySlotCount = 1;
+static uint32_t deltaKeySeed = 0;
+static bool deltaKeyPerfect = true;
+static uint16_t deltaKeyLength[MAX_JSON_TOKEN_EXPECTED];
+static int16_t deltaKeyNext[MAX_JSON_TOKEN_EXPECTED];
+static bool deltaKeyChained[MAX_JSON_TOKEN_EXPECTED];
+
+/* Key token matched by each entry in the delta being dispatched */
+static int32_t deltaKeyToken[MAX_JSON_TOKEN_EXPECTED];
+static uint32_t deltaKeysMatched;
 static bool deltaTopicSubscribedFlag = false;
 uint32_t shadowJsonVersionNum = 0;
 bool shadowDiscardOldDeltaFlag = true;
@@ -96,6 +117,117 @@ static int16_t getNextFreeIndexOfSubscriptionList(void);
 
 static void unsubscribeFromAcceptedAndRejected(uint8_t index);
 
+static uint32_t deltaKeyHash(const char *pKey, size_t keyLength, uint32_t seed) {
+	uint32_t hash = 2166136261u ^ seed;
+	size_t i;
+
+	/* FNV-1a, with the high bits folded in for the modulo */
+	for(i = 0; i < keyLength; i++) {
+		hash ^= (uint8_t) pKey[i];
+		hash *= 16777619u;
+	}
+	return hash ^ (hash >> 16);
+}
+
+static bool placeDeltaKeys(uint32_t slotCount, uint32_t seed, bool probe) {
+	uint32_t i, slot;
+
+	for(i = 0; i < slotCount; i++) {
+		deltaKeySlots[i] = DELTA_KEY_NONE;
+	}
+
+	for(i = 0; i < tokenTableIndex; i++) {
+		if(deltaKeyChained[i]) {
+			continue;
+		}
+		slot = deltaKeyHash(tokenTable[i].pKey, deltaKeyLength[i], seed) % slotCount;
+		while(deltaKeySlots[slot] != DELTA_KEY_NONE) {
+			if(!probe) {
+				return false;
+			}
+			slot = (slot + 1) % slotCount;
+		}
+		deltaKeySlots[slot] = (int16_t) i;
+	}
+	return true;
+}
+
+static void buildDeltaKeyTable(void) {
+	uint32_t i, j, distinct = 0, slotCount, seed;
+
+	/* Chain entries with the same key behind the first one */
+	for(i = 0; i < tokenTableIndex; i++) {
+		deltaKeyLength[i] = (uint16_t) strlen(tokenTable[i].pKey);
+		deltaKeyNext[i] = DELTA_KEY_NONE;
+		deltaKeyChained[i] = false;
+		for(j = 0; j < i; j++) {
+			if(!deltaKeyChained[j] && deltaKeyLength[j] == deltaKeyLength[i] &&
+			   strcmp(tokenTable[j].pKey, tokenTable[i].pKey) == 0) {
+				break;
+			}
+		}
+		if(j == i) {
+			distinct++;
+			continue;
+		}
+		while(deltaKeyNext[j] != DELTA_KEY_NONE) {
+			j = (uint32_t) deltaKeyNext[j];
+		}
+		deltaKeyNext[j] = (int16_t) i;
+		deltaKeyChained[i] = true;
+	}
+
+	for(slotCount = 2 * distinct; slotCount > 0 && slotCount <= DELTA_KEY_MAX_SLOTS; slotCount *= 2) {
+		for(seed = 0; seed < DELTA_KEY_SEEDS_PER_SIZE; seed++) {
+			if(placeDeltaKeys(slotCount, seed, false)) {
+				deltaKeySlotCount = slotCount;
+				deltaKeySeed = seed;
+				deltaKeyPerfect = true;
+				return;
+			}
+		}
+	}
+
+	IOT_DEBUG("No perfect hash for %u delta keys, probing", (unsigned int) distinct);
+	deltaKeySlotCount = DELTA_KEY_MAX_SLOTS;
+	deltaKeySeed = 0;
+	deltaKeyPerfect = false;
+	placeDeltaKeys(deltaKeySlotCount, deltaKeySeed, true);
+}
+
+static int32_t findDeltaKey(const char *pKey, size_t keyLength) {
+	uint32_t slot = deltaKeyHash(pKey, keyLength, deltaKeySeed) % deltaKeySlotCount;
+	int16_t entry;
+
+	while((entry = deltaKeySlots[slot]) != DELTA_KEY_NONE) {
+		if(deltaKeyLength[entry] == keyLength && strncmp(tokenTable[entry].pKey, pKey, keyLength) == 0) {
+			return entry;
+		}
+		if(deltaKeyPerfect) {
+			break;
+		}
+		slot = (slot + 1) % deltaKeySlotCount;
+	}
+	return DELTA_KEY_NONE;
+}
+
+static bool matchDeltaKey(const char *pKey, size_t keyLength, int32_t keyToken, void *pContext) {
+	int32_t entry;
+
+	IOT_UNUSED(pContext);
+
+	/* The first occurrence of a key in the document is the one dispatched */
+	for(entry = findDeltaKey(pKey, keyLength); entry != DELTA_KEY_NONE; entry = deltaKeyNext[entry]) {
+		if(deltaKeyToken[entry] == DELTA_KEY_NONE) {
+			deltaKeyToken[entry] = keyToken;
+			deltaKeysMatched++;
+		}
+	}
+
+	/* Stop once every registered key has been seen */
+	return deltaKeysMatched < tokenTableIndex;
+}
+
 void initDeltaTokens(void) {
 	uint32_t i;
 	for(i = 0; i < MAX_JSON_TOKEN_EXPECTED; i++) {
@@ -103,6 +235,7 @@ void initDeltaTokens(void) {
 	}
 	tokenTableIndex = 0;
 	deltaTopicSubscribedFlag = false;
+	buildDeltaKeyTable();
 }
 
 IoT_Error_t registerJsonTokenOnDelta(jsonStruct_t *pStruct) {
@@ -125,6 +258,7 @@ IoT_Error_t registerJsonTokenOnDelta(jsonStruct_t *pStruct) {
 	tokenTable[tokenTableIndex].pStruct = pStruct;
 	tokenTable[tokenTableIndex].isFree = false;
 	tokenTableIndex++;
+	buildDeltaKeyTable();
 
 	return rc;
 }
@@ -511,14 +645,23 @@ static void shadow_delta_callback(AWS_IoT_Client *pClient, char *topicName,
 		}
 	}
 
+	/* Match every key in the document against the registered keys in one
+	 * pass, then dispatch in registration order. */
 	for(i = 0; i < tokenTableIndex; i++) {
-		if(!tokenTable[i].isFree) {
-			if(isJsonKeyMatchingAndUpdateValue(shadowRxBuf, pJsonHandler, tokenCount,
-											   (jsonStruct_t *) tokenTable[i].pStruct, &dataLength, &DataPosition)) {
-				if(tokenTable[i].callback != NULL) {
-					tokenTable[i].callback(shadowRxBuf + DataPosition, dataLength,
-										   (jsonStruct_t *) tokenTable[i].pStruct);
-				}
+		deltaKeyToken[i] = DELTA_KEY_NONE;
+	}
+	deltaKeysMatched = 0;
+	if(tokenTableIndex > 0) {
+		forEachJsonKey(shadowRxBuf, tokenCount, matchDeltaKey, NULL);
+	}
+
+	for(i = 0; i < tokenTableIndex && deltaKeysMatched > 0; i++) {
+		if(!tokenTable[i].isFree && deltaKeyToken[i] != DELTA_KEY_NONE) {
+			updateValueFromJsonKey(shadowRxBuf, deltaKeyToken[i], (jsonStruct_t *) tokenTable[i].pStruct,
+								   &dataLength, &DataPosition);
+			if(tokenTable[i].callback != NULL) {
+				tokenTable[i].callback(shadowRxBuf + DataPosition, dataLength,
+									   (jsonStruct_t *) tokenTable[i].pStruct);
 			}
 		}
 	}
@@ -31,3 +31,9 @@ TEST_GROUP_C_WRAPPER(ShadowDeltaTest, registerDeltaInt)
 TEST_GROUP_C_WRAPPER(ShadowDeltaTest, registerDeltaIntNoCallback)
 TEST_GROUP_C_WRAPPER(ShadowDeltaTest, DeltaNestedObject)
 TEST_GROUP_C_WRAPPER(ShadowDeltaTest, DeltaVersionIgnoreOldVersion)
+TEST_GROUP_C_WRAPPER(ShadowDeltaTest, DeltaTokenArenaGrows)
+TEST_GROUP_C_WRAPPER(ShadowDeltaTest, DeltaDuplicateRegisteredKeys)
+TEST_GROUP_C_WRAPPER(ShadowDeltaTest, DeltaDuplicateDocumentKeys)
+TEST_GROUP_C_WRAPPER(ShadowDeltaTest, DeltaValueEqualToKey)
+TEST_GROUP_C_WRAPPER(ShadowDeltaTest, DeltaMetadataSkipped)
+TEST_GROUP_C_WRAPPER(ShadowDeltaTest, DeltaUnknownKey)
@@ -44,6 +44,15 @@ void genericCallback(const char *pJsonStringData, uint32_t JsonStringDataLen, js
 	ESP_LOGI(TAG, "\nkey[%s]==Data[%.*s]", pContext->pKey, JsonStringDataLen, pJsonStringData);
 }
 
+static uint32_t countedCallbacks = 0;
+
+void countingCallback(const char *pJsonStringData, uint32_t JsonStringDataLen, jsonStruct_t *pContext) {
+	IOT_UNUSED(pJsonStringData);
+	IOT_UNUSED(JsonStringDataLen);
+	IOT_UNUSED(pContext);
+	countedCallbacks++;
+}
+
 void nestedObjectCallback(const char *pJsonStringData, uint32_t JsonStringDataLen, jsonStruct_t *pContext) {
 	ESP_LOGI(TAG, "\nkey[%s]==Data[%.*s]", pContext->pKey, JsonStringDataLen, pJsonStringData);
 	snESP_LOGI(TAG, receivedNestedObject, 100, "%.*s", JsonStringDataLen, pJsonStringData);
@@ -77,6 +86,40 @@ TEST_GROUP_C_TEARDOWN(ShadowDeltaTest) {
 
 }
 
+static void initIntHandler(jsonStruct_t *pHandler, const char *pKey, int32_t *pData) {
+	pHandler->cb = countingCallback;
+	pHandler->pKey = pKey;
+	pHandler->type = SHADOW_JSON_INT32;
+	pHandler->pData = pData;
+	pHandler->dataLength = sizeof(int32_t);
+}
+
+static void subscribeDelta(jsonStruct_t *pHandler) {
+	IoT_Publish_Message_Params params;
+
+	params.payloadLen = 0;
+	params.payload = NULL;
+	params.qos = QOS0;
+
+	ResetTLSBuffer();
+	setTLSRxBufferForSuback(shadowDeltaTopic, strlen(shadowDeltaTopic), QOS0, params);
+
+	CHECK_EQUAL_C_INT(SUCCESS, aws_iot_shadow_register_delta(&client, pHandler));
+}
+
+static void receiveDelta(char *pDeltaJSONString) {
+	IoT_Publish_Message_Params params;
+
+	params.payloadLen = strlen(pDeltaJSONString);
+	params.payload = pDeltaJSONString;
+	params.qos = QOS0;
+
+	ResetTLSBuffer();
+	setTLSRxBufferWithMsgOnSubscribedTopic(shadowDeltaTopic, strlen(shadowDeltaTopic), QOS0, params, params.payload);
+
+	aws_iot_shadow_yield(&client, 100);
+}
+
 TEST_C(ShadowDeltaTest, registerDeltaSuccess) {
 	jsonStruct_t windowHandler;
 	char deltaJSONString[] = "{\"state\":{\"delta\":{\"window\":true}},\"version\":1}";
@@ -322,3 +365,134 @@ TEST_C(ShadowDeltaTest, DeltaVersionIgnoreOldVersion) {
 	aws_iot_shadow_yield(&client, 100);
 	CHECK_EQUAL_C_STRING(sentNestedObjectData, receivedNestedObject);
 }
+
+// More tokens than MAX_JSON_TOKEN_EXPECTED: the token arena grows and the key after the array is still found
+TEST_C(ShadowDeltaTest, DeltaTokenArenaGrows) {
+	jsonStruct_t lengthHandler;
+	int32_t lengthData = 0;
+	char deltaJSONString[SHADOW_MAX_SIZE_OF_RX_BUFFER / 2 + 2 * MAX_JSON_TOKEN_EXPECTED];
+	uint32_t i;
+
+	IOT_DEBUG("\n-->Running Shadow Delta Tests - Delta with more tokens than the initial arena \n");
+
+	initIntHandler(&lengthHandler, "length", &lengthData);
+	countedCallbacks = 0;
+	subscribeDelta(&lengthHandler);
+
+	strcpy(deltaJSONString, "{\"state\":{\"delta\":{\"samples\":[");
+	for(i = 0; i < MAX_JSON_TOKEN_EXPECTED + 10; i++) {
+		strcat(deltaJSONString, (i == 0) ? "0" : ",0");
+	}
+	strcat(deltaJSONString, "],\"length\":42}},\"version\":1}");
+	CHECK_C(strlen(deltaJSONString) < SHADOW_MAX_SIZE_OF_RX_BUFFER);
+
+	receiveDelta(deltaJSONString);
+	CHECK_EQUAL_C_INT(42, lengthData);
+	CHECK_EQUAL_C_INT(1, countedCallbacks);
+
+	// The grown arena is kept for the next document
+	strcpy(deltaJSONString, "{\"state\":{\"delta\":{\"length\":43}},\"version\":2}");
+	receiveDelta(deltaJSONString);
+	CHECK_EQUAL_C_INT(43, lengthData);
+	CHECK_EQUAL_C_INT(2, countedCallbacks);
+}
+
+// Entries registered with the same key all receive its value
+TEST_C(ShadowDeltaTest, DeltaDuplicateRegisteredKeys) {
+	jsonStruct_t firstHandler;
+	jsonStruct_t secondHandler;
+	int32_t firstData = 0;
+	int32_t secondData = 0;
+	char deltaJSONString[] = "{\"state\":{\"delta\":{\"speed\":7}},\"version\":1}";
+
+	IOT_DEBUG("\n-->Running Shadow Delta Tests - Two entries with the same key \n");
+
+	initIntHandler(&firstHandler, "speed", &firstData);
+	initIntHandler(&secondHandler, "speed", &secondData);
+	countedCallbacks = 0;
+	subscribeDelta(&firstHandler);
+	CHECK_EQUAL_C_INT(SUCCESS, aws_iot_shadow_register_delta(&client, &secondHandler));
+
+	receiveDelta(deltaJSONString);
+	CHECK_EQUAL_C_INT(7, firstData);
+	CHECK_EQUAL_C_INT(7, secondData);
+	CHECK_EQUAL_C_INT(2, countedCallbacks);
+}
+
+// A key that appears twice in the document is dispatched once, with its first value
+TEST_C(ShadowDeltaTest, DeltaDuplicateDocumentKeys) {
+	jsonStruct_t speedHandler;
+	int32_t speedData = 0;
+	char deltaJSONString[] = "{\"state\":{\"delta\":{\"speed\":7,\"speed\":9}},\"version\":1}";
+
+	IOT_DEBUG("\n-->Running Shadow Delta Tests - Key repeated in the delta \n");
+
+	initIntHandler(&speedHandler, "speed", &speedData);
+	countedCallbacks = 0;
+	subscribeDelta(&speedHandler);
+
+	receiveDelta(deltaJSONString);
+	CHECK_EQUAL_C_INT(7, speedData);
+	CHECK_EQUAL_C_INT(1, countedCallbacks);
+}
+
+// A string value equal to a registered key is not a match
+TEST_C(ShadowDeltaTest, DeltaValueEqualToKey) {
+	jsonStruct_t doorHandler;
+	int32_t doorData = 5;
+	char deltaJSONString[] = "{\"state\":{\"delta\":{\"label\":\"door\"}},\"version\":1}";
+
+	IOT_DEBUG("\n-->Running Shadow Delta Tests - Value equal to a registered key \n");
+
+	initIntHandler(&doorHandler, "door", &doorData);
+	countedCallbacks = 0;
+	subscribeDelta(&doorHandler);
+
+	receiveDelta(deltaJSONString);
+	CHECK_EQUAL_C_INT(5, doorData);
+	CHECK_EQUAL_C_INT(0, countedCallbacks);
+}
+
+// Keys inside "metadata" are skipped, even when it comes before the state
+TEST_C(ShadowDeltaTest, DeltaMetadataSkipped) {
+	jsonStruct_t fanHandler;
+	int32_t fanData = 0;
+	char deltaJSONString[] = "{\"metadata\":{\"fan\":{\"timestamp\":5}},\"state\":{\"delta\":{\"fan\":1}},\"version\":1}";
+	char metadataOnlyJSONString[] = "{\"state\":{\"delta\":{\"pump\":1}},\"metadata\":{\"fan\":{\"timestamp\":6}},\"version\":2}";
+
+	IOT_DEBUG("\n-->Running Shadow Delta Tests - Metadata keys skipped \n");
+
+	initIntHandler(&fanHandler, "fan", &fanData);
+	countedCallbacks = 0;
+	subscribeDelta(&fanHandler);
+
+	receiveDelta(deltaJSONString);
+	CHECK_EQUAL_C_INT(1, fanData);
+	CHECK_EQUAL_C_INT(1, countedCallbacks);
+
+	receiveDelta(metadataOnlyJSONString);
+	CHECK_EQUAL_C_INT(1, fanData);
+	CHECK_EQUAL_C_INT(1, countedCallbacks);
+}
+
+// Keys that are not registered are ignored and do not hide the registered ones
+TEST_C(ShadowDeltaTest, DeltaUnknownKey) {
+	jsonStruct_t levelHandler;
+	int32_t levelData = 0;
+	char deltaJSONString[] = "{\"state\":{\"delta\":{\"unknown\":3,\"level\":4}},\"version\":1}";
+	char unknownOnlyJSONString[] = "{\"state\":{\"delta\":{\"unknown\":5}},\"version\":2}";
+
+	IOT_DEBUG("\n-->Running Shadow Delta Tests - Unknown key in the delta \n");
+
+	initIntHandler(&levelHandler, "level", &levelData);
+	countedCallbacks = 0;
+	subscribeDelta(&levelHandler);
+
+	receiveDelta(deltaJSONString);
+	CHECK_EQUAL_C_INT(4, levelData);
+	CHECK_EQUAL_C_INT(1, countedCallbacks);
+
+	receiveDelta(unknownOnlyJSONString);
+	CHECK_EQUAL_C_INT(4, levelData);
+	CHECK_EQUAL_C_INT(1, countedCallbacks);
+}
@@ -27,6 +27,7 @@ IoT_Error_t iot_tls_init(Network *pNetwork, char *pRootCALocation, char *pDevice
 	pNetwork->connect = iot_tls_connect;
 	pNetwork->read = iot_tls_read;
 	pNetwork->write = iot_tls_write;
+	pNetwork->writev = NULL;
 	pNetwork->disconnect = iot_tls_disconnect;
 	pNetwork->isConnected = iot_tls_is_connected;
 	pNetwork->destroy = iot_tls_destroy;
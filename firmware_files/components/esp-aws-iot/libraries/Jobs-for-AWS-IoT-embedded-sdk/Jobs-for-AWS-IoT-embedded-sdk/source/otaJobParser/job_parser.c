@@ -16,44 +16,76 @@
 #include "core_json.h"
 #include "job_parser.h"
 
+/**
+ * @brief Entries of the query table searched by populateJobDocFields().
+ *
+ * The table is sorted by query, so JSON_SearchMany() scans each object on
+ * the way to the fields once for all of them.
+ */
+typedef enum
+{
+    queryAuthScheme = 0,
+    queryCertfile,
+    queryFileType,
+    queryFileId,
+    queryFilepath,
+    queryFileSize,
+    querySignature,
+    queryUpdateDataUrl,
+    queryProtocol,
+    queryStreamname,
+    queryCount
+} JobDocQuery_t;
+
+/** @brief Number of queries for fields of the selected file. */
+#define FILE_QUERY_COUNT         ( ( size_t ) queryProtocol )
+
+/** @brief Longest file query: "afr_ota.files[N].sig-sha256-ecdsa". */
+#define FILE_QUERY_MAX_LENGTH    ( 33U )
+
+/**
+ * @brief Keys of the file fields, in the order of the query table
+ */
+static const char * const fileQueryKeys[ FILE_QUERY_COUNT ] =
+{
+    "auth_scheme",
+    "certfile",
+    "fileType",
+    "fileid",
+    "filepath",
+    "filesize",
+    "sig-sha256-ecdsa",
+    "update_data_url"
+};
+
 /**
  * @brief Populates common job document fields in result
  *
- * @param jobDoc FreeRTOS OTA job document
- * @param jobDocLength OTA job document length
- * @param fileIndex The index of the file to use
+ * @param queries Query table searched in the job document
  * @param result Job document structure to populate
  * @return JSONStatus_t JSON parsing status
  */
-static JSONStatus_t populateCommonFields( const char * jobDoc,
-                                          const size_t jobDocLength,
-                                          int32_t fileIndex,
+static JSONStatus_t populateCommonFields( const JSONQuery_t * queries,
                                           AfrOtaJobDocumentFields_t * result );
 
 /**
  * @brief Populates MQTT job document fields in result
  *
- * @param jobDoc FreeRTOS OTA job document
- * @param jobDocLength OTA job document length
+ * @param queries Query table searched in the job document
  * @param result Job document structure to populate
  * @return JSONStatus_t JSON parsing status
  */
-static JSONStatus_t populateMqttStreamingFields( const char * jobDoc,
-                                                 const size_t jobDocLength,
+static JSONStatus_t populateMqttStreamingFields( const JSONQuery_t * queries,
                                                  AfrOtaJobDocumentFields_t * result );
 
 /**
  * @brief Populates HTTP job document fields in result
  *
- * @param jobDoc FreeRTOS OTA job document
- * @param jobDocLength OTA job document length
- * @param fileIndex The index of the file to use
+ * @param queries Query table searched in the job document
  * @param result Job document structure to populate
  * @return JSONStatus_t JSON parsing status
  */
-static JSONStatus_t populateHttpStreamingFields( const char * jobDoc,
-                                                 const size_t jobDocLength,
-                                                 int32_t fileIndex,
+static JSONStatus_t populateHttpStreamingFields( const JSONQuery_t * queries,
                                                  AfrOtaJobDocumentFields_t * result );
 
 /**
@@ -73,20 +105,14 @@ static void buildIndexedFileQueryString( int32_t fileIndex,
                                          size_t * resultLength );
 
 /**
- * @brief Searches the JSON document for the uint32_t value
+ * @brief Reads the uint32_t value found by a query
  *
- * @param jobDoc FreeRTOS OTA job document
- * @param jobDocLength OTA job document length
- * @param query The JSON path to query
- * @param queryLength The length of the JSON path
+ * @param query The query searched in the job document
  * @param value Pointer to set uint32_t value
  * @return JSONStatus_t JSON parsing status
  */
-static JSONStatus_t searchUintValue( const char * jobDoc,
-                                     const size_t jobDocLength,
-                                     const char * query,
-                                     const size_t queryLength,
-                                     uint32_t * value );
+static JSONStatus_t queryUintValue( const JSONQuery_t * query,
+                                    uint32_t * value );
 
 /**
  * @brief Convert a non-null terminated string to a unsigned 32-bit integer
@@ -139,38 +165,57 @@ bool populateJobDocFields( const char * jobDoc,
 {
     bool populatedJobDocFields = false;
     JSONStatus_t jsonResult = JSONNotFound;
-    const char * protocol = NULL;
-    size_t protocolLength = 0U;
+    JSONQuery_t queries[ queryCount ];
+    char fileQueries[ FILE_QUERY_COUNT ][ FILE_QUERY_MAX_LENGTH ];
+    size_t i;
 
     /* TODO - Add assertions for NULL job docs or 0 length documents*/
-    jsonResult = populateCommonFields( jobDoc, jobDocLength, fileIndex, result );
+    if( fileIndex <= 9 )
+    {
+        for( i = 0U; i < FILE_QUERY_COUNT; i++ )
+        {
+            buildIndexedFileQueryString( fileIndex,
+                                         fileQueryKeys[ i ],
+                                         strlen( fileQueryKeys[ i ] ),
+                                         fileQueries[ i ],
+                                         &( queries[ i ].queryLength ) );
+            queries[ i ].query = fileQueries[ i ];
+        }
+
+        queries[ queryProtocol ].query = "afr_ota.protocols[0]";
+        queries[ queryProtocol ].queryLength = 20U;
+        queries[ queryStreamname ].query = "afr_ota.streamname";
+        queries[ queryStreamname ].queryLength = 18U;
+
+        /* Fields of either protocol are looked up in the same pass, the
+         * protocol then decides which of them are used. */
+        ( void ) JSON_SearchMany( jobDoc, jobDocLength, queries, ( size_t ) queryCount );
+
+        jsonResult = populateCommonFields( queries, result );
+    }
+    else
+    {
+        jsonResult = JSONIllegalDocument;
+    }
 
     if( jsonResult == JSONSuccess )
     {
-        jsonResult = JSON_SearchConst( jobDoc,
-                                       jobDocLength,
-                                       "afr_ota.protocols[0]",
-                                       20U,
-                                       &protocol,
-                                       &protocolLength,
-                                       NULL );
+        jsonResult = queries[ queryProtocol ].status;
     }
 
     /* Determine if the supported protocol is MQTT or HTTP */
-    if( ( jsonResult == JSONSuccess ) && ( protocolLength == 4U ) )
+    if( ( jsonResult == JSONSuccess ) &&
+        ( queries[ queryProtocol ].valueLength == 4U ) )
     {
-        if( strncmp( "MQTT", protocol, protocolLength ) == 0 )
+        if( strncmp( "MQTT",
+                     queries[ queryProtocol ].value,
+                     queries[ queryProtocol ].valueLength ) == 0 )
         {
-            jsonResult = populateMqttStreamingFields( jobDoc,
-                                                      jobDocLength,
-                                                      result );
+            jsonResult = populateMqttStreamingFields( queries, result );
         }
         else
         {
-            jsonResult = populateHttpStreamingFields( jobDoc,
-                                                      jobDocLength,
-                                                      fileIndex,
-                                                      result );
+            jsonResult = populateHttpStreamingFields( queries, result );
         }
     }
 
@@ -181,126 +226,55 @@ bool populateJobDocFields( const char * jobDoc,
     return populatedJobDocFields;
 }
 
-static JSONStatus_t populateCommonFields( const char * jobDoc,
-                                          const size_t jobDocLength,
-                                          int32_t fileIndex,
+static JSONStatus_t populateCommonFields( const JSONQuery_t * queries,
                                           AfrOtaJobDocumentFields_t * result )
 {
     JSONStatus_t jsonResult = JSONNotFound;
-    const char * jsonValue = NULL;
-    size_t jsonValueLength = 0U;
-    char queryString[ 33 ];
-    size_t queryStringLength;
 
-    if( fileIndex <= 9 )
-    {
-        buildIndexedFileQueryString( fileIndex,
-                                     "filesize",
-                                     8U,
-                                     queryString,
-                                     &queryStringLength );
-        jsonResult = searchUintValue( jobDoc,
-                                      jobDocLength,
-                                      queryString,
-                                      queryStringLength,
-                                      &( result->fileSize ) );
-    }
-    else
-    {
-        jsonResult = JSONIllegalDocument;
-    }
+    jsonResult = queryUintValue( &queries[ queryFileSize ],
+                                 &( result->fileSize ) );
 
     if( jsonResult == JSONSuccess )
     {
-        buildIndexedFileQueryString( fileIndex,
-                                     "fileid",
-                                     6U,
-                                     queryString,
-                                     &queryStringLength );
-        jsonResult = searchUintValue( jobDoc,
-                                      jobDocLength,
-                                      queryString,
-                                      queryStringLength,
-                                      &( result->fileId ) );
+        jsonResult = queryUintValue( &queries[ queryFileId ],
+                                     &( result->fileId ) );
     }
 
     if( jsonResult == JSONSuccess )
     {
-        buildIndexedFileQueryString( fileIndex,
-                                     "filepath",
-                                     8U,
-                                     queryString,
-                                     &queryStringLength );
-        jsonResult = JSON_SearchConst( jobDoc,
-                                       jobDocLength,
-                                       queryString,
-                                       queryStringLength,
-                                       &jsonValue,
-                                       &jsonValueLength,
-                                       NULL );
-        result->filepath = jsonValue;
-        result->filepathLen = ( uint32_t ) jsonValueLength;
+        jsonResult = queries[ queryFilepath ].status;
+        result->filepath = queries[ queryFilepath ].value;
+        result->filepathLen = ( uint32_t ) queries[ queryFilepath ].valueLength;
     }
 
     if( jsonResult == JSONSuccess )
     {
-        buildIndexedFileQueryString( fileIndex,
-                                     "certfile",
-                                     8U,
-                                     queryString,
-                                     &queryStringLength );
-        jsonResult = JSON_SearchConst( jobDoc,
-                                       jobDocLength,
-                                       queryString,
-                                       queryStringLength,
-                                       &jsonValue,
-                                       &jsonValueLength,
-                                       NULL );
-        result->certfile = jsonValue;
-        result->certfileLen = ( uint32_t ) jsonValueLength;
+        jsonResult = queries[ queryCertfile ].status;
+        result->certfile = queries[ queryCertfile ].value;
+        result->certfileLen = ( uint32_t ) queries[ queryCertfile ].valueLength;
     }
 
     if( jsonResult == JSONSuccess )
     {
-        buildIndexedFileQueryString( fileIndex,
-                                     "sig-sha256-ecdsa",
-                                     16U,
-                                     queryString,
-                                     &queryStringLength );
-        jsonResult = JSON_SearchConst( jobDoc,
-                                       jobDocLength,
-                                       queryString,
-                                       queryStringLength,
-                                       &jsonValue,
-                                       &jsonValueLength,
-                                       NULL );
-        result->signature = jsonValue;
-        result->signatureLen = ( uint32_t ) jsonValueLength;
+        jsonResult = queries[ querySignature ].status;
+        result->signature = queries[ querySignature ].value;
+        result->signatureLen = ( uint32_t ) queries[ querySignature ].valueLength;
     }
 
     return jsonResult;
 }
 
-static JSONStatus_t populateMqttStreamingFields( const char * jobDoc,
-                                                 const size_t jobDocLength,
+static JSONStatus_t populateMqttStreamingFields( const JSONQuery_t * queries,
                                                  AfrOtaJobDocumentFields_t * result )
 {
     JSONStatus_t jsonResult = JSONNotFound;
-    const char * jsonValue = NULL;
-    size_t jsonValueLength = 0U;
-
-    jsonResult = JSON_SearchConst( jobDoc,
-                                   jobDocLength,
-                                   "afr_ota.streamname",
-                                   18U,
-                                   &jsonValue,
-                                   &jsonValueLength,
-                                   NULL );
-    result->imageRef = jsonValue;
-    result->imageRefLen = ( uint32_t ) jsonValueLength;
+
+    jsonResult = queries[ queryStreamname ].status;
+    result->imageRef = queries[ queryStreamname ].value;
+    result->imageRefLen = ( uint32_t ) queries[ queryStreamname ].valueLength;
 
     /* If the stream name is empty, consider this an error */
-    if( jsonValueLength == 0U )
+    if( queries[ queryStreamname ].valueLength == 0U )
     {
         jsonResult = JSONNotFound;
     }
@@ -308,65 +282,29 @@ static JSONStatus_t populateMqttStreamingFields( const char * jobDoc,
     return jsonResult;
 }
 
-static JSONStatus_t populateHttpStreamingFields( const char * jobDoc,
-                                                 const size_t jobDocLength,
-                                                 int32_t fileIndex,
+static JSONStatus_t populateHttpStreamingFields( const JSONQuery_t * queries,
                                                  AfrOtaJobDocumentFields_t * result )
 {
     JSONStatus_t jsonResult = JSONNotFound;
-    const char * jsonValue = NULL;
-    size_t jsonValueLength = 0U;
-    char queryString[ 33 ];
-    size_t queryStringLength;
-
-    buildIndexedFileQueryString( fileIndex,
-                                 "fileType",
-                                 8U,
-                                 queryString,
-                                 &queryStringLength );
-    jsonResult = searchUintValue( jobDoc,
-                                  jobDocLength,
-                                  queryString,
-                                  queryStringLength,
-                                  &( result->fileType ) );
+
+    jsonResult = queryUintValue( &queries[ queryFileType ],
+                                 &( result->fileType ) );
 
     if( jsonResult == JSONSuccess )
     {
-        buildIndexedFileQueryString( fileIndex,
-                                     "auth_scheme",
-                                     11U,
-                                     queryString,
-                                     &queryStringLength );
-        jsonResult = JSON_SearchConst( jobDoc,
-                                       jobDocLength,
-                                       queryString,
-                                       queryStringLength,
-                                       &jsonValue,
-                                       &jsonValueLength,
-                                       NULL );
-        result->authScheme = jsonValue;
-        result->authSchemeLen = ( uint32_t ) jsonValueLength;
+        jsonResult = queries[ queryAuthScheme ].status;
+        result->authScheme = queries[ queryAuthScheme ].value;
+        result->authSchemeLen = ( uint32_t ) queries[ queryAuthScheme ].valueLength;
     }
 
     if( jsonResult == JSONSuccess )
     {
-        buildIndexedFileQueryString( fileIndex,
-                                     "update_data_url",
-                                     15U,
-                                     queryString,
-                                     &queryStringLength );
-        jsonResult = JSON_SearchConst( jobDoc,
-                                       jobDocLength,
-                                       queryString,
-                                       queryStringLength,
-                                       &jsonValue,
-                                       &jsonValueLength,
-                                       NULL );
-        result->imageRef = jsonValue;
-        result->imageRefLen = ( uint32_t ) jsonValueLength;
+        jsonResult = queries[ queryUpdateDataUrl ].status;
+        result->imageRef = queries[ queryUpdateDataUrl ].value;
+        result->imageRefLen = ( uint32_t ) queries[ queryUpdateDataUrl ].valueLength;
 
         /* If the url is empty, consider this an error */
-        if( jsonValueLength == 0U )
+        if( queries[ queryUpdateDataUrl ].valueLength == 0U )
         {
             jsonResult = JSONNotFound;
         }
@@ -391,30 +329,17 @@ static void buildIndexedFileQueryString( int32_t fileIndex,
     *resultLength = 17U + queryStringLength;
 }
 
-static JSONStatus_t searchUintValue( const char * jobDoc,
-                                     const size_t jobDocLength,
-                                     const char * query,
-                                     const size_t queryLength,
-                                     uint32_t * value )
+static JSONStatus_t queryUintValue( const JSONQuery_t * query,
+                                    uint32_t * value )
 {
     bool numConversionSuccess = true;
-    JSONStatus_t jsonResult = JSONNotFound;
-    const char * jsonValue = NULL;
-    size_t jsonValueLength = 0U;
-
-    jsonResult = JSON_SearchConst( jobDoc,
-                                   jobDocLength,
-                                   query,
-                                   queryLength,
-                                   &jsonValue,
-                                   &jsonValueLength,
-                                   NULL );
+    JSONStatus_t jsonResult = query->status;
 
     if( jsonResult == JSONSuccess )
     {
-        numConversionSuccess = uintFromString( jsonValue,
+        numConversionSuccess = uintFromString( query->value,
                                                ( const uint32_t )
-                                               jsonValueLength,
+                                               query->valueLength,
                                                value );
     }
 
@@ -306,7 +306,7 @@ size_t mqttDownloader_createGetDataBlockRequest( DataType_t dataType,
             /* MISRA Ref 21.6.1 [Use of snprintf] */
             /* More details at: https://github.com/aws/aws-iot-core-mqtt-file-streams-embedded-c//blob/main/MISRA.md#rule-216 */
             /* coverity[misra_c_2012_rule_21_6_violation] */
-            ( void ) snESP_LOGI(TAG,  getStreamRequest,
+            ( void ) snprintf( getStreamRequest,
                                GET_STREAM_REQUEST_BUFFER_SIZE,
                                "{"
                                "\"s\": 1,"
@@ -61,6 +61,150 @@ typedef union
 #define isSquareOpen_( x )            ( ( x ) == '[' )
 #define isSquareClose_( x )           ( ( x ) == ']' )
 
+/* A character that may appear in a string as is, and is one byte long. */
+#define isPlainChar_( x )                                         \
+    ( isascii_( x ) && !iscntrl_( x ) && ( ( x ) != '"' ) && \
+      ( ( x ) != '\\' ) )
+
+/*
+ * Runs of whitespace and of plain string characters are skipped a machine
+ * word at a time. A word is skipped only when each of its bytes would have
+ * been skipped by the byte at a time loops, so the results are the same.
+ * Words are read with aligned loads through a type that may alias char,
+ * which needs GCC or Clang; define JSON_WORD_SCAN as 0 to turn this off.
+ */
+#ifndef JSON_WORD_SCAN
+    #if defined( __GNUC__ )
+        #define JSON_WORD_SCAN    1
+    #else
+        #define JSON_WORD_SCAN    0
+    #endif
+#endif
+
+#if ( JSON_WORD_SCAN != 0 )
+
+typedef size_t __attribute__( ( __may_alias__ ) ) jsonWord_t;
+
+#define WORD_SIZE_                    ( sizeof( jsonWord_t ) )
+#define WORD_ONES_                    ( SIZE_MAX / 0xFFU )
+#define WORD_HIGHS_                   ( WORD_ONES_ * 0x80U )
+#define wordOf_( c )                  ( WORD_ONES_ * ( size_t ) ( uint8_t ) ( c ) )
+
+/* MISRA Ref 11.4.1 [Pointer to integer conversion] */
+/* More details at: https://github.com/FreeRTOS/coreJSON/blob/main/MISRA.md#rule-114 */
+/* coverity[misra_c_2012_rule_11_4_violation] */
+#define isWordAligned_( p )           ( ( ( uintptr_t ) ( p ) & ( WORD_SIZE_ - 1U ) ) == 0U )
+
+/* Sets the high bit of each byte of x that is zero, and no other bit. */
+#define zeroBytes_( x ) \
+    ( ~( ( ( ( x ) & ~WORD_HIGHS_ ) + ~WORD_HIGHS_ ) | ( x ) ) & WORD_HIGHS_ )
+
+/* Sets the high bit of each byte of x that is below ' ', and no other bit. */
+#define controlBytes_( x ) \
+    ( ~( ( ( ( x ) & ~WORD_HIGHS_ ) + wordOf_( 0x80U - ( uint8_t ) ' ' ) ) | ( x ) ) & WORD_HIGHS_ )
+
+/* The offset of the first byte in memory whose high bit is set in x, for x != 0. */
+#if defined( __BYTE_ORDER__ ) && ( __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__ )
+    #define firstByte_( x ) \
+    ( ( ( size_t ) __builtin_clzll( x ) - ( ( sizeof( unsigned long long ) - WORD_SIZE_ ) * 8U ) ) / 8U )
+#else
+    #define firstByte_( x )    ( ( size_t ) __builtin_ctzll( x ) / 8U )
+#endif
+
+/**
+ * @brief Advance buffer index beyond whitespace, a word at a time.
+ *
+ * Stops at the first byte which is not whitespace, or short of the end of
+ * the buffer; the caller finishes the run a byte at a time.
+ *
+ * @param[in] buf  The buffer to parse.
+ * @param[in,out] start  The index at which to begin.
+ * @param[in] max  The size of the buffer.
+ */
+static void skipSpaceWords( const char * buf,
+                            size_t * start,
+                            size_t max )
+{
+    size_t i = *start, w, spaces;
+
+    while( ( ( i + 1U ) < max ) && !isWordAligned_( &buf[ i ] ) && isspace_( buf[ i ] ) )
+    {
+        i++;
+    }
+
+    if( isWordAligned_( &buf[ i ] ) )
+    {
+        while( ( i < max ) && ( ( max - i ) > WORD_SIZE_ ) )
+        {
+            /* MISRA Ref 11.3.2 [Pointer conversion] */
+            /* More details at: https://github.com/FreeRTOS/coreJSON/blob/main/MISRA.md#rule-113 */
+            /* coverity[misra_c_2012_rule_11_3_violation] */
+            w = *( ( const jsonWord_t * ) &buf[ i ] );
+            spaces = zeroBytes_( w ^ wordOf_( ' ' ) ) | zeroBytes_( w ^ wordOf_( '\n' ) ) |
+                     zeroBytes_( w ^ wordOf_( '\r' ) ) | zeroBytes_( w ^ wordOf_( '\t' ) );
+
+            if( spaces != WORD_HIGHS_ )
+            {
+                i += firstByte_( ~spaces & WORD_HIGHS_ );
+                break;
+            }
+
+            i += WORD_SIZE_;
+        }
+    }
+
+    *start = i;
+}
+
+/**
+ * @brief Advance buffer index beyond plain string characters, a word at a time.
+ *
+ * Plain characters are those skipString() accepts one byte at a time:
+ * ASCII other than control characters, quotes and backslashes.
+ * Stops at the first byte which is not plain, or short of the end of the
+ * buffer; the caller goes on a byte at a time.
+ *
+ * @param[in] buf  The buffer to parse.
+ * @param[in,out] start  The index at which to begin.
+ * @param[in] max  The size of the buffer.
+ */
+static void skipStringWords( const char * buf,
+                             size_t * start,
+                             size_t max )
+{
+    size_t i = *start, w, special;
+
+    while( ( ( i + 1U ) < max ) && !isWordAligned_( &buf[ i ] ) && isPlainChar_( buf[ i ] ) )
+    {
+        i++;
+    }
+
+    if( isWordAligned_( &buf[ i ] ) )
+    {
+        while( ( i < max ) && ( ( max - i ) > WORD_SIZE_ ) )
+        {
+            /* MISRA Ref 11.3.2 [Pointer conversion] */
+            /* More details at: https://github.com/FreeRTOS/coreJSON/blob/main/MISRA.md#rule-113 */
+            /* coverity[misra_c_2012_rule_11_3_violation] */
+            w = *( ( const jsonWord_t * ) &buf[ i ] );
+            special = ( w & WORD_HIGHS_ ) | controlBytes_( w ) |
+                      zeroBytes_( w ^ wordOf_( '"' ) ) | zeroBytes_( w ^ wordOf_( '\\' ) );
+
+            if( special != 0U )
+            {
+                i += firstByte_( special );
+                break;
+            }
+
+            i += WORD_SIZE_;
+        }
+    }
+
+    *start = i;
+}
+
+#endif /* if ( JSON_WORD_SCAN != 0 ) */
+
 /**
  * @brief Advance buffer index beyond whitespace.
  *
@@ -76,7 +220,18 @@ static void skipSpace( const char * buf,
 
     coreJSON_ASSERT( ( buf != NULL ) && ( start != NULL ) && ( max > 0U ) );
 
-    for( i = *start; i < max; i++ )
+    i = *start;
+
+    #if ( JSON_WORD_SCAN != 0 )
+        /* Most runs are empty or a single space; only longer ones are worth
+         * reading a word at a time. */
+        if( ( ( i + 1U ) < max ) && isspace_( buf[ i ] ) && isspace_( buf[ i + 1U ] ) )
+        {
+            skipSpaceWords( buf, &i, max );
+        }
+    #endif
+
+    for( ; i < max; i++ )
     {
         if( !isspace_( buf[ i ] ) )
         {
@@ -522,6 +677,10 @@ static bool skipString( const char * buf,
 
         while( i < max )
         {
+            #if ( JSON_WORD_SCAN != 0 )
+                skipStringWords( buf, &i, max );
+            #endif
+
             if( buf[ i ] == '"' )
             {
                 ret = true;
@@ -1516,6 +1675,84 @@ static bool skipQueryPart( const char * buf,
     return ret;
 }
 
+/**
+ * @brief Parse the query part which begins at a given index.
+ *
+ * The part is either a key, or an array index in square brackets.
+ * A separator following the part is skipped.
+ *
+ * @param[in] query  The object keys and array indexes to search for.
+ * @param[in] queryLength  Length of the query.
+ * @param[in,out] start  The index at which the part begins.
+ * @param[out] key  A pointer to receive the index of the key.
+ * @param[out] keyLength  A pointer to receive the length of the key,
+ * which is 0 for an array index.
+ * @param[out] queryIndex  A pointer to receive the array index.
+ *
+ * @return #JSONSuccess if the part is valid;
+ * #JSONBadParameter if the part is empty, is followed by a trailing
+ * separator, or has an index that is too large to convert.
+ */
+static JSONStatus_t nextQueryPart( const char * query,
+                                   size_t queryLength,
+                                   size_t * start,
+                                   size_t * key,
+                                   size_t * keyLength,
+                                   uint32_t * queryIndex )
+{
+    JSONStatus_t ret = JSONSuccess;
+    size_t i = 0U;
+
+    coreJSON_ASSERT( ( query != NULL ) && ( start != NULL ) );
+    coreJSON_ASSERT( ( key != NULL ) && ( keyLength != NULL ) && ( queryIndex != NULL ) );
+    coreJSON_ASSERT( *start < queryLength );
+
+    i = *start;
+
+    if( isSquareOpen_( query[ i ] ) )
+    {
+        int32_t index = -1;
+        i++;
+
+        ( void ) skipDigits( query, &i, queryLength, &index );
+
+        if( ( index < 0 ) ||
+            ( i >= queryLength ) || !isSquareClose_( query[ i ] ) )
+        {
+            ret = JSONBadParameter;
+        }
+        else
+        {
+            i++;
+            *keyLength = 0U;
+            *queryIndex = ( uint32_t ) index;
+        }
+    }
+    else
+    {
+        *key = i;
+
+        if( ( skipQueryPart( query, &i, queryLength, keyLength ) != true ) ||
+            /* catch an empty key part or a trailing separator */
+            ( i == ( queryLength - 1U ) ) )
+        {
+            ret = JSONBadParameter;
+        }
+    }
+
+    if( ret == JSONSuccess )
+    {
+        if( ( i < queryLength ) && isSeparator_( query[ i ] ) )
+        {
+            i++;
+        }
+
+        *start = i;
+    }
+
+    return ret;
+}
+
 /**
  * @brief Handle a nested search by iterating over the parts of the query.
  *
@@ -1541,7 +1778,7 @@ static JSONStatus_t multiSearch( const char * buf,
                                  size_t * outValueLength )
 {
     JSONStatus_t ret = JSONSuccess;
-    size_t i = 0U, start = 0U, queryStart = 0U, value = 0U, length = max;
+    size_t i = 0U, start = 0U, value = 0U, length = max;
 
     coreJSON_ASSERT( ( buf != NULL ) && ( query != NULL ) );
     coreJSON_ASSERT( ( outValue != NULL ) && ( outValueLength != NULL ) );
@@ -1550,40 +1787,23 @@ static JSONStatus_t multiSearch( const char * buf,
     while( i < queryLength )
     {
         bool found = false;
+        size_t key = 0U, keyLength = 0U;
+        uint32_t queryIndex = 0U;
 
-        if( isSquareOpen_( query[ i ] ) )
-        {
-            int32_t queryIndex = -1;
-            i++;
-
-            ( void ) skipDigits( query, &i, queryLength, &queryIndex );
+        ret = nextQueryPart( query, queryLength, &i, &key, &keyLength, &queryIndex );
 
-            if( ( queryIndex < 0 ) ||
-                ( i >= queryLength ) || !isSquareClose_( query[ i ] ) )
-            {
-                ret = JSONBadParameter;
-                break;
-            }
-
-            i++;
+        if( ret != JSONSuccess )
+        {
+            break;
+        }
 
-            found = arraySearch( &buf[ start ], length, ( uint32_t ) queryIndex, &value, &length );
+        if( keyLength == 0U )
+        {
+            found = arraySearch( &buf[ start ], length, queryIndex, &value, &length );
         }
         else
         {
-            size_t keyLength = 0;
-
-            queryStart = i;
-
-            if( ( skipQueryPart( query, &i, queryLength, &keyLength ) != true ) ||
-                /* catch an empty key part or a trailing separator */
-                ( i == ( queryLength - 1U ) ) )
-            {
-                ret = JSONBadParameter;
-                break;
-            }
-
-            found = objectSearch( &buf[ start ], length, &query[ queryStart ], keyLength, &value, &length );
+            found = objectSearch( &buf[ start ], length, &query[ key ], keyLength, &value, &length );
         }
 
         if( found == false )
@@ -1593,11 +1813,6 @@ static JSONStatus_t multiSearch( const char * buf,
         }
 
         start += value;
-
-        if( ( i < queryLength ) && isSeparator_( query[ i ] ) )
-        {
-            i++;
-        }
     }
 
     if( ret == JSONSuccess )
@@ -1726,6 +1941,301 @@ JSONStatus_t JSON_SearchT( char * buf,
 
 /** @cond DO_NOT_DOCUMENT */
 
+/**
+ * @brief Check whether a query of JSON_SearchMany() is waiting to be matched
+ * in a given value.
+ *
+ * Pending queries hold the value their path so far has led to, so those
+ * waiting on the same value share a path and are matched in the same scan.
+ */
+#define isWaitingIn_( q, buf, max ) \
+    ( ( ( q )->status == JSONPartial ) && ( ( q )->value == ( buf ) ) && ( ( q )->valueLength == ( max ) ) )
+
+/**
+ * @brief Match the next part of a query of JSON_SearchMany() against a key
+ * or array index, and move the query on to the value if it matches.
+ *
+ * @param[in,out] q  The query.
+ * @param[in] buf  The buffer holding the value the query is waiting in.
+ * @param[in] key  The index of the key, or 0 for an array element.
+ * @param[in] keyLength  The length of the key.
+ * @param[in] currentIndex  The index of the array element.
+ * @param[in] value  The index of the value of the key or array element.
+ * @param[in] valueLength  The length of the value.
+ *
+ * @return true if the query matched;
+ * false otherwise.
+ */
+static bool matchQueryPart( JSONQuery_t * q,
+                            const char * buf,
+                            size_t key,
+                            size_t keyLength,
+                            uint32_t currentIndex,
+                            size_t value,
+                            size_t valueLength )
+{
+    bool ret = false;
+    size_t i = 0U, queryKey = 0U, queryKeyLength = 0U;
+    uint32_t queryIndex = 0U;
+
+    coreJSON_ASSERT( ( q != NULL ) && ( buf != NULL ) );
+
+    i = q->next;
+
+    /* The part was checked before the scan began. */
+    ( void ) nextQueryPart( q->query, q->queryLength, &i, &queryKey, &queryKeyLength, &queryIndex );
+
+    if( key == 0U )
+    {
+        ret = ( queryKeyLength == 0U ) && ( queryIndex == currentIndex );
+    }
+    else
+    {
+        ret = ( queryKeyLength == keyLength ) &&
+              ( strnEq( &q->query[ queryKey ], &buf[ key ], keyLength ) == true );
+    }
+
+    if( ret == true )
+    {
+        q->value = &buf[ value ];
+        q->valueLength = valueLength;
+        q->next = i;
+
+        if( i == q->queryLength )
+        {
+            JSONTypes_t t = getType( buf[ value ] );
+
+            if( t == JSONString )
+            {
+                /* strip the surrounding quotes */
+                q->value++;
+                q->valueLength -= 2U;
+            }
+
+            q->jsonType = t;
+            q->status = JSONSuccess;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Scan a value once for the next part of every query of
+ * JSON_SearchMany() that is waiting in it.
+ *
+ * The queries waiting in the value are those in the given range of the
+ * table for which isWaitingIn_() holds. Each query that matches a key or
+ * array index of the value moves on to the value of that key or element;
+ * the rest are not found. As in objectSearch() and arraySearch(), only the
+ * first match of a key counts, and the scan stops upon finding a match for
+ * every query.
+ *
+ * @param[in] buf  The value to scan.
+ * @param[in] max  size of the value.
+ * @param[in,out] queries  The query table.
+ * @param[in] first  The index of the first query waiting in the value.
+ * @param[in] last  The index after the last query waiting in the value.
+ */
+static void searchWaitingQueries( const char * buf,
+                                  size_t max,
+                                  JSONQuery_t * queries,
+                                  size_t first,
+                                  size_t last )
+{
+    size_t i = 0U, j, key = 0U, keyLength = 0U, value = 0U, valueLength = 0U;
+    size_t waiting = 0U;
+    uint32_t currentIndex = 0U;
+
+    coreJSON_ASSERT( ( buf != NULL ) && ( max > 0U ) && ( queries != NULL ) );
+    coreJSON_ASSERT( first < last );
+
+    /* Check the next part of each query before the scan, so the scan
+     * only has to compare. */
+    for( j = first; j < last; j++ )
+    {
+        if( isWaitingIn_( &queries[ j ], buf, max ) )
+        {
+            size_t next = queries[ j ].next;
+            uint32_t queryIndex = 0U;
+
+            if( nextQueryPart( queries[ j ].query, queries[ j ].queryLength, &next,
+                               &key, &keyLength, &queryIndex ) != JSONSuccess )
+            {
+                queries[ j ].status = JSONBadParameter;
+            }
+            else
+            {
+                waiting++;
+            }
+        }
+    }
+
+    skipSpace( buf, &i, max );
+
+    if( ( waiting > 0U ) && ( i < max ) && isOpenBracket_( buf[ i ] ) )
+    {
+        bool isObject = ( buf[ i ] == '{' );
+
+        i++;
+        skipSpace( buf, &i, max );
+
+        while( i < max )
+        {
+            if( isObject == true )
+            {
+                if( nextKeyValuePair( buf, &i, max, &key, &keyLength,
+                                      &value, &valueLength ) != true )
+                {
+                    break;
+                }
+            }
+            else
+            {
+                if( nextValue( buf, &i, max, &value, &valueLength ) != true )
+                {
+                    break;
+                }
+
+                key = 0U;
+            }
+
+            for( j = first; j < last; j++ )
+            {
+                if( isWaitingIn_( &queries[ j ], buf, max ) &&
+                    ( matchQueryPart( &queries[ j ], buf, key, keyLength,
+                                      currentIndex, value, valueLength ) == true ) )
+                {
+                    waiting--;
+                }
+            }
+
+            if( ( waiting == 0U ) ||
+                ( skipSpaceAndComma( buf, &i, max ) != true ) ||
+                ( currentIndex == UINT32_MAX ) )
+            {
+                break;
+            }
+
+            currentIndex++;
+        }
+    }
+
+    for( j = first; j < last; j++ )
+    {
+        if( isWaitingIn_( &queries[ j ], buf, max ) )
+        {
+            queries[ j ].status = JSONNotFound;
+        }
+    }
+}
+
+/** @endcond */
+
+/**
+ * See core_json.h for docs.
+ */
+JSONStatus_t JSON_SearchMany( const char * buf,
+                              size_t max,
+                              JSONQuery_t * queries,
+                              size_t queryCount )
+{
+    JSONStatus_t ret = JSONSuccess;
+    size_t first, last;
+    bool pending = false;
+
+    if( ( buf == NULL ) || ( queries == NULL ) )
+    {
+        ret = JSONNullParameter;
+    }
+    else if( ( max == 0U ) || ( queryCount == 0U ) )
+    {
+        ret = JSONBadParameter;
+    }
+    else
+    {
+        for( first = 0U; first < queryCount; first++ )
+        {
+            if( queries[ first ].query == NULL )
+            {
+                ret = JSONNullParameter;
+                break;
+            }
+        }
+    }
+
+    if( ret == JSONSuccess )
+    {
+        /* Every query starts out waiting in the whole document. */
+        for( first = 0U; first < queryCount; first++ )
+        {
+            queries[ first ].value = buf;
+            queries[ first ].valueLength = max;
+            queries[ first ].jsonType = JSONInvalid;
+            queries[ first ].next = 0U;
+            queries[ first ].status = ( queries[ first ].queryLength == 0U ) ? JSONBadParameter : JSONPartial;
+            pending = pending || ( queries[ first ].status == JSONPartial );
+        }
+
+        /* Each round moves every pending query one part further along its
+         * path, scanning each value that pending queries wait in once. */
+        while( pending == true )
+        {
+            first = 0U;
+
+            while( first < queryCount )
+            {
+                const JSONQuery_t * q = &queries[ first ];
+
+                if( q->status != JSONPartial )
+                {
+                    first++;
+                }
+                else
+                {
+                    for( last = first + 1U; last < queryCount; last++ )
+                    {
+                        if( ( queries[ last ].status == JSONPartial ) &&
+                            !isWaitingIn_( &queries[ last ], q->value, q->valueLength ) )
+                        {
+                            break;
+                        }
+                    }
+
+                    searchWaitingQueries( q->value, q->valueLength, queries, first, last );
+                    first = last;
+                }
+            }
+
+            pending = false;
+
+            for( first = 0U; first < queryCount; first++ )
+            {
+                pending = pending || ( queries[ first ].status == JSONPartial );
+            }
+        }
+
+        for( first = 0U; first < queryCount; first++ )
+        {
+            if( queries[ first ].status != JSONSuccess )
+            {
+                queries[ first ].value = NULL;
+                queries[ first ].valueLength = 0U;
+                queries[ first ].jsonType = JSONInvalid;
+
+                if( ret != JSONBadParameter )
+                {
+                    ret = queries[ first ].status;
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+/** @cond DO_NOT_DOCUMENT */
+
 /**
  * @brief Output the next key-value pair or value from a collection.
  *
@@ -251,6 +251,83 @@ JSONStatus_t JSON_SearchConst( const char * buf,
                                JSONTypes_t * outType );
 /* @[declare_json_searchconst] */
 
+/**
+ * @ingroup json_struct_types
+ * @brief One entry of the query table given to JSON_SearchMany().
+ *
+ * The caller sets @p query and @p queryLength; JSON_SearchMany() sets the rest.
+ */
+typedef struct
+{
+    const char * query;   /**< @brief The object keys and array indexes to search for. */
+    size_t queryLength;   /**< @brief Length of the query. */
+    const char * value;   /**< @brief Pointer to the value found, or NULL. */
+    size_t valueLength;   /**< @brief Length of the value found. */
+    JSONTypes_t jsonType; /**< @brief JSON-specific type of the value. */
+    JSONStatus_t status;  /**< @brief Result of this query, as JSON_SearchConst() would return it. */
+    size_t next;          /**< @brief Used by JSON_SearchMany(): index in query of the next part to match. */
+} JSONQuery_t;
+
+/**
+ * @brief Run several searches over a JSON document at once.
+ *
+ * Each entry of @p queries is resolved exactly as JSON_SearchConst() would
+ * resolve it, including the type and the stripping of quotes from strings.
+ * Instead of one walk of the document per query, the document is walked once
+ * for all of them: every object or array on the way to a value is scanned a
+ * single time, matching each of its keys against all the queries that go
+ * through it. A scan stops as soon as every query going through it has been
+ * matched, and the search stops once every query is settled.
+ *
+ * Queries that share a path are only scanned together when they are next to
+ * each other in the table, which is always the case when the table is sorted
+ * by query (e.g. with strcmp()). The results do not depend on the order.
+ *
+ * @param[in] buf  The buffer to search.
+ * @param[in] max  size of the buffer.
+ * @param[in,out] queries  The queries to resolve.
+ * @param[in] queryCount  The number of entries in @p queries.
+ *
+ * @note As with JSON_SearchConst(), the document is only validated as far as
+ * needed to find the values. To validate the entire JSON document, use
+ * JSON_Validate().
+ *
+ * @return #JSONSuccess if every query is matched;
+ * #JSONNullParameter if buf, queries, or the query of any entry is NULL;
+ * #JSONBadParameter if max or queryCount is 0, or the status of any entry is
+ * #JSONBadParameter;
+ * #JSONNotFound if some query has no match.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *     // Variables used in this example.
+ *     JSONStatus_t result;
+ *     char buffer[] = "{\"foo\":\"abc\",\"bar\":{\"foo\":\"xyz\"}}";
+ *     size_t bufferLength = sizeof( buffer ) - 1;
+ *     JSONQuery_t queries[] =
+ *     {
+ *         { .query = "bar.foo", .queryLength = 7 },
+ *         { .query = "foo",     .queryLength = 3 },
+ *     };
+ *
+ *     result = JSON_SearchMany( buffer, bufferLength, queries, 2 );
+ *
+ *     if( result == JSONSuccess )
+ *     {
+ *         // "bar.foo -> xyz, foo -> abc" will be printed.
+ *         ESP_LOGI(TAG, "bar.foo -> %.*s, foo -> %.*s",
+ *                  ( int ) queries[ 0 ].valueLength, queries[ 0 ].value,
+ *                  ( int ) queries[ 1 ].valueLength, queries[ 1 ].value );
+ *     }
+ * @endcode
+ */
+/* @[declare_json_searchmany] */
+JSONStatus_t JSON_SearchMany( const char * buf,
+                              size_t max,
+                              JSONQuery_t * queries,
+                              size_t queryCount );
+/* @[declare_json_searchmany] */
+
 /**
  * @ingroup json_struct_types
  * @brief Structure to represent a key-value pair.
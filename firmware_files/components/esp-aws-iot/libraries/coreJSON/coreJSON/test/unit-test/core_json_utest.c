@@ -955,6 +955,210 @@ void test_JSON_Search_Legal_Array_Documents( void )
     doSearch( "[5]", ARRAY_ELEMENT_5_TYPE, ARRAY_ELEMENT_5 );
 }
 
+/**
+ * @brief Test that JSON_SearchMany finds every value JSON_Search finds.
+ */
+void test_JSON_SearchMany_Legal_Documents( void )
+{
+    JSONStatus_t jsonStatus;
+    JSONQuery_t queries[ 9 ];
+    size_t i;
+
+#define setQuery( index, query_ )                               \
+    queries[ index ].query = ( query_ );                        \
+    queries[ index ].queryLength = ( sizeof( query_ ) - 1 )
+
+#define checkQuery( index, type, answer )                                   \
+    TEST_ASSERT_EQUAL( JSONSuccess, queries[ index ].status );              \
+    TEST_ASSERT_EQUAL( type, queries[ index ].jsonType );                   \
+    TEST_ASSERT_EQUAL( ( sizeof( answer ) - 1 ), queries[ index ].valueLength ); \
+    TEST_ASSERT_EQUAL_STRING_LEN( ( answer ),                               \
+                                  queries[ index ].value,                   \
+                                  queries[ index ].valueLength )
+
+    /* Sorted by query, as callers are expected to pass them. */
+    setQuery( 0, "[0]" );
+    setQuery( 1, "[1]" );
+    setQuery( 2, "[2]" );
+    setQuery( 3, "[2]." FIRST_QUERY_KEY );
+    setQuery( 4, "[2]." SECOND_QUERY_KEY );
+    setQuery( 5, "[2]." SECOND_QUERY_KEY "[0]" );
+    setQuery( 6, "[2]." SECOND_QUERY_KEY "[1]" );
+    setQuery( 7, "[3]" );
+    setQuery( 8, "[5]" );
+
+    jsonStatus = JSON_SearchMany( JSON_DOC_LEGAL_ARRAY,
+                                  JSON_DOC_LEGAL_ARRAY_LENGTH,
+                                  queries,
+                                  9 );
+    TEST_ASSERT_EQUAL( JSONSuccess, jsonStatus );
+    checkQuery( 0, ARRAY_ELEMENT_0_TYPE, ARRAY_ELEMENT_0 );
+    checkQuery( 1, ARRAY_ELEMENT_1_TYPE, ARRAY_ELEMENT_1 );
+    checkQuery( 2, ARRAY_ELEMENT_2_TYPE, ARRAY_ELEMENT_2 );
+    checkQuery( 3, ARRAY_ELEMENT_2_SUB_0_TYPE, ARRAY_ELEMENT_2_SUB_0 );
+    checkQuery( 4, ARRAY_ELEMENT_2_SUB_1_TYPE, ARRAY_ELEMENT_2_SUB_1 );
+    checkQuery( 5, ARRAY_ELEMENT_2_SUB_1_SUB_0_TYPE, ARRAY_ELEMENT_2_SUB_1_SUB_0 );
+    checkQuery( 6, ARRAY_ELEMENT_2_SUB_1_SUB_1_TYPE, ARRAY_ELEMENT_2_SUB_1_SUB_1 );
+    checkQuery( 7, ARRAY_ELEMENT_3_TYPE, ARRAY_ELEMENT_3 );
+    checkQuery( 8, ARRAY_ELEMENT_5_TYPE, ARRAY_ELEMENT_5 );
+
+    /* The order of the table does not change the results. */
+    setQuery( 0, "[2]." SECOND_QUERY_KEY "[1]" );
+    setQuery( 1, "[5]" );
+    setQuery( 2, "[2]." FIRST_QUERY_KEY );
+    setQuery( 3, "[0]" );
+
+    jsonStatus = JSON_SearchMany( JSON_DOC_LEGAL_ARRAY,
+                                  JSON_DOC_LEGAL_ARRAY_LENGTH,
+                                  queries,
+                                  4 );
+    TEST_ASSERT_EQUAL( JSONSuccess, jsonStatus );
+    checkQuery( 0, ARRAY_ELEMENT_2_SUB_1_SUB_1_TYPE, ARRAY_ELEMENT_2_SUB_1_SUB_1 );
+    checkQuery( 1, ARRAY_ELEMENT_5_TYPE, ARRAY_ELEMENT_5 );
+    checkQuery( 2, ARRAY_ELEMENT_2_SUB_0_TYPE, ARRAY_ELEMENT_2_SUB_0 );
+    checkQuery( 3, ARRAY_ELEMENT_0_TYPE, ARRAY_ELEMENT_0 );
+
+    setQuery( 0, FIRST_QUERY_KEY );
+    setQuery( 1, COMPLETE_QUERY_KEY );
+
+    jsonStatus = JSON_SearchMany( JSON_DOC_VARIED_SCALARS,
+                                  JSON_DOC_VARIED_SCALARS_LENGTH,
+                                  queries,
+                                  2 );
+    TEST_ASSERT_EQUAL( JSONSuccess, jsonStatus );
+    checkQuery( 0, FIRST_QUERY_KEY_ANSWER_TYPE, FIRST_QUERY_KEY_ANSWER );
+    checkQuery( 1, COMPLETE_QUERY_KEY_ANSWER_TYPE, COMPLETE_QUERY_KEY_ANSWER );
+
+    /* Every query matches the first occurrence of a key, like JSON_Search. */
+    for( i = 0; i < 3; i++ )
+    {
+        setQuery( i, "foo" );
+    }
+
+    jsonStatus = JSON_SearchMany( "{\"foo\":1,\"foo\":2}", 17, queries, 3 );
+    TEST_ASSERT_EQUAL( JSONSuccess, jsonStatus );
+
+    for( i = 0; i < 3; i++ )
+    {
+        checkQuery( i, JSONNumber, "1" );
+    }
+}
+
+/**
+ * @brief Test that JSON_SearchMany reports each query that is not found
+ * or not valid, and still resolves the others.
+ */
+void test_JSON_SearchMany_Query_Not_Found( void )
+{
+    JSONStatus_t jsonStatus;
+    JSONQuery_t queries[ 6 ];
+
+    setQuery( 0, "[2]." FIRST_QUERY_KEY );
+    setQuery( 1, "[2]." FIRST_QUERY_KEY "." SECOND_QUERY_KEY );
+    setQuery( 2, "[2].nope" );
+    setQuery( 3, "[9]" );
+    setQuery( 4, "hello" );
+    setQuery( 5, "[1].." );
+
+    jsonStatus = JSON_SearchMany( JSON_DOC_LEGAL_ARRAY,
+                                  JSON_DOC_LEGAL_ARRAY_LENGTH,
+                                  queries,
+                                  5 );
+    TEST_ASSERT_EQUAL( JSONNotFound, jsonStatus );
+    checkQuery( 0, ARRAY_ELEMENT_2_SUB_0_TYPE, ARRAY_ELEMENT_2_SUB_0 );
+    TEST_ASSERT_EQUAL( JSONNotFound, queries[ 1 ].status );
+    TEST_ASSERT_NULL( queries[ 1 ].value );
+    TEST_ASSERT_EQUAL( 0, queries[ 1 ].valueLength );
+    TEST_ASSERT_EQUAL( JSONNotFound, queries[ 2 ].status );
+    TEST_ASSERT_EQUAL( JSONNotFound, queries[ 3 ].status );
+    TEST_ASSERT_EQUAL( JSONNotFound, queries[ 4 ].status );
+
+    jsonStatus = JSON_SearchMany( JSON_DOC_LEGAL_ARRAY,
+                                  JSON_DOC_LEGAL_ARRAY_LENGTH,
+                                  queries,
+                                  6 );
+    TEST_ASSERT_EQUAL( JSONBadParameter, jsonStatus );
+    checkQuery( 0, ARRAY_ELEMENT_2_SUB_0_TYPE, ARRAY_ELEMENT_2_SUB_0 );
+    TEST_ASSERT_EQUAL( JSONNotFound, queries[ 4 ].status );
+    TEST_ASSERT_EQUAL( JSONBadParameter, queries[ 5 ].status );
+    TEST_ASSERT_NULL( queries[ 5 ].value );
+
+    /* Values after an illegal one are not reached. */
+    setQuery( 0, "foo" );
+    setQuery( 1, "bar" );
+
+    jsonStatus = JSON_SearchMany( MISSING_VALUE_AFTER_KEY,
+                                  MISSING_VALUE_AFTER_KEY_LENGTH,
+                                  queries,
+                                  1 );
+    TEST_ASSERT_EQUAL( JSONNotFound, jsonStatus );
+
+    jsonStatus = JSON_SearchMany( MISSING_COMMA_AFTER_VALUE,
+                                  MISSING_COMMA_AFTER_VALUE_LENGTH,
+                                  queries,
+                                  2 );
+    TEST_ASSERT_EQUAL( JSONNotFound, jsonStatus );
+    checkQuery( 0, JSONObject, "{}" );
+    TEST_ASSERT_EQUAL( JSONNotFound, queries[ 1 ].status );
+
+    /* A document that is not a collection has nothing to find. */
+    jsonStatus = JSON_SearchMany( SINGLE_SCALAR,
+                                  SINGLE_SCALAR_LENGTH,
+                                  queries,
+                                  2 );
+    TEST_ASSERT_EQUAL( JSONNotFound, jsonStatus );
+}
+
+/**
+ * @brief Test that JSON_SearchMany checks its parameters.
+ */
+void test_JSON_SearchMany_Invalid_Params( void )
+{
+    JSONStatus_t jsonStatus;
+    JSONQuery_t queries[ 2 ];
+
+    setQuery( 0, COMPLETE_QUERY_KEY );
+    setQuery( 1, FIRST_QUERY_KEY );
+
+    jsonStatus = JSON_SearchMany( NULL, 0, queries, 2 );
+    TEST_ASSERT_EQUAL( JSONNullParameter, jsonStatus );
+
+    jsonStatus = JSON_SearchMany( JSON_DOC_VARIED_SCALARS,
+                                  JSON_DOC_VARIED_SCALARS_LENGTH,
+                                  NULL,
+                                  2 );
+    TEST_ASSERT_EQUAL( JSONNullParameter, jsonStatus );
+
+    jsonStatus = JSON_SearchMany( JSON_DOC_VARIED_SCALARS,
+                                  0,
+                                  queries,
+                                  2 );
+    TEST_ASSERT_EQUAL( JSONBadParameter, jsonStatus );
+
+    jsonStatus = JSON_SearchMany( JSON_DOC_VARIED_SCALARS,
+                                  JSON_DOC_VARIED_SCALARS_LENGTH,
+                                  queries,
+                                  0 );
+    TEST_ASSERT_EQUAL( JSONBadParameter, jsonStatus );
+
+    queries[ 1 ].query = NULL;
+    jsonStatus = JSON_SearchMany( JSON_DOC_VARIED_SCALARS,
+                                  JSON_DOC_VARIED_SCALARS_LENGTH,
+                                  queries,
+                                  2 );
+    TEST_ASSERT_EQUAL( JSONNullParameter, jsonStatus );
+
+    queries[ 1 ].query = FIRST_QUERY_KEY;
+    queries[ 1 ].queryLength = 0;
+    jsonStatus = JSON_SearchMany( JSON_DOC_VARIED_SCALARS,
+                                  JSON_DOC_VARIED_SCALARS_LENGTH,
+                                  queries,
+                                  2 );
+    TEST_ASSERT_EQUAL( JSONBadParameter, jsonStatus );
+    checkQuery( 0, COMPLETE_QUERY_KEY_ANSWER_TYPE, COMPLETE_QUERY_KEY_ANSWER );
+    TEST_ASSERT_EQUAL( JSONBadParameter, queries[ 1 ].status );
+}
+
 /**
  * @brief Test that JSON_Iterate returns the given values from a JSON array.
  */
@@ -1725,6 +1929,8 @@ void test_JSON_asserts( void )
     uint16_t u = 0;
     size_t key, keyLength, value, valueLength;
     int32_t queryIndex = 0;
+    uint32_t u32 = 0;
+    JSONQuery_t query = { 0 };
 
     catch_assert( skipSpace( NULL, &start, max ) );
     catch_assert( skipSpace( buf, NULL, max ) );
@@ -1842,6 +2048,23 @@ void test_JSON_asserts( void )
     catch_assert( multiSearch( buf, max, queryKey, keyLength, NULL, &valueLength ) );
     catch_assert( multiSearch( buf, max, queryKey, keyLength, &value, NULL ) );
 
+    catch_assert( nextQueryPart( NULL, max, &start, &key, &keyLength, &u32 ) );
+    catch_assert( nextQueryPart( queryKey, max, NULL, &key, &keyLength, &u32 ) );
+    catch_assert( nextQueryPart( queryKey, max, &start, NULL, &keyLength, &u32 ) );
+    catch_assert( nextQueryPart( queryKey, max, &start, &key, NULL, &u32 ) );
+    catch_assert( nextQueryPart( queryKey, max, &start, &key, &keyLength, NULL ) );
+    /* assert: start < queryLength */
+    catch_assert( nextQueryPart( queryKey, max, &start, &key, &keyLength, &u32 ) );
+
+    catch_assert( matchQueryPart( NULL, buf, key, keyLength, u32, value, valueLength ) );
+    catch_assert( matchQueryPart( &query, NULL, key, keyLength, u32, value, valueLength ) );
+
+    catch_assert( searchWaitingQueries( NULL, max, &query, 0, 1 ) );
+    catch_assert( searchWaitingQueries( buf, 0, &query, 0, 1 ) );
+    catch_assert( searchWaitingQueries( buf, max, NULL, 0, 1 ) );
+    /* assert: first < last */
+    catch_assert( searchWaitingQueries( buf, max, &query, 1, 1 ) );
+
     catch_assert( iterate( NULL, max, &start, &next, &key, &keyLength, &value, &valueLength ) );
     catch_assert( iterate( buf, 0, &start, &next, &key, &keyLength, &value, &valueLength ) );
     catch_assert( iterate( buf, max, NULL, &next, &key, &keyLength, &value, &valueLength ) );
@@ -1899,3 +2122,185 @@ void test_JSON_overflows( void )
     start = SIZE_MAX;
     TEST_ASSERT_EQUAL( false, skipOneHexEscape( buf, &start, SIZE_MAX, &u ) );
 }
+
+/* The word scan tests place a string at every offset of a word aligned
+ * buffer, so that its bytes move through every lane of a word and its end
+ * falls on every byte of the last, partial word. */
+#define WORD_SCAN_LANES           ( sizeof( size_t ) )
+#define WORD_SCAN_PLAIN_LENGTH    ( 3U * WORD_SCAN_LANES )
+
+static size_t wordScanBuffer[ 8 ];
+
+/**
+ * @brief Writes a string of length plain characters at offset in the word
+ * aligned buffer.
+ *
+ * @return The buffer.
+ */
+static char * wordScanString( size_t offset,
+                              size_t length )
+{
+    char * buf = ( char * ) wordScanBuffer;
+
+    memset( buf, 'x', sizeof( wordScanBuffer ) );
+    buf[ offset ] = '"';
+    memset( &buf[ offset + 1U ], 'a', length );
+    buf[ offset + 1U + length ] = '"';
+
+    return buf;
+}
+
+/**
+ * @brief Runs skipString on the string at offset, which ends before max.
+ *
+ * @return The index after the string, or 0 if skipString failed.
+ */
+static size_t wordScanSkipString( const char * buf,
+                                  size_t offset,
+                                  size_t max )
+{
+    size_t start = offset;
+
+    return ( skipString( buf, &start, max ) == true ) ? start : 0U;
+}
+
+/**
+ * @brief Test that strings are skipped from any alignment, including tails
+ * shorter than a word, and that a string cut off by the end of the buffer
+ * is rejected.
+ */
+void test_JSON_WordScan_String_Offsets_And_Tails( void )
+{
+    char * buf;
+    size_t offset, length, max;
+
+    for( offset = 0; offset < WORD_SCAN_LANES; offset++ )
+    {
+        for( length = 0; length <= WORD_SCAN_PLAIN_LENGTH; length++ )
+        {
+            buf = wordScanString( offset, length );
+            max = offset + length + 2U;
+
+            TEST_ASSERT_EQUAL( max, wordScanSkipString( buf, offset, max ) );
+            TEST_ASSERT_EQUAL( 0, wordScanSkipString( buf, offset, max - 1U ) );
+        }
+    }
+}
+
+/**
+ * @brief Test that control characters, quotes, backslashes and non-ASCII
+ * bytes stop the word scan in every lane of a word.
+ */
+void test_JSON_WordScan_Special_Bytes_Every_Lane( void )
+{
+    char * buf;
+    size_t offset, lane, i, max;
+
+    for( offset = 0; offset < WORD_SCAN_LANES; offset++ )
+    {
+        max = offset + WORD_SCAN_PLAIN_LENGTH + 2U;
+
+        for( lane = 0; lane < WORD_SCAN_PLAIN_LENGTH; lane++ )
+        {
+            i = offset + 1U + lane;
+
+            /* An unescaped control character is not allowed. */
+            buf = wordScanString( offset, WORD_SCAN_PLAIN_LENGTH );
+            buf[ i ] = '\x01';
+            TEST_ASSERT_EQUAL( 0, wordScanSkipString( buf, offset, max ) );
+            buf[ i ] = '\x1F';
+            TEST_ASSERT_EQUAL( 0, wordScanSkipString( buf, offset, max ) );
+            buf[ i ] = '\n';
+            TEST_ASSERT_EQUAL( 0, wordScanSkipString( buf, offset, max ) );
+
+            /* The string ends at the first quote. */
+            buf[ i ] = '"';
+            TEST_ASSERT_EQUAL( i + 1U, wordScanSkipString( buf, offset, max ) );
+
+            /* A lone continuation byte is not valid UTF-8. */
+            buf[ i ] = ( char ) 0x80;
+            TEST_ASSERT_EQUAL( 0, wordScanSkipString( buf, offset, max ) );
+
+            buf[ i ] = '\\';
+
+            if( ( lane + 1U ) < WORD_SCAN_PLAIN_LENGTH )
+            {
+                buf[ i + 1U ] = 'n';
+                TEST_ASSERT_EQUAL( max, wordScanSkipString( buf, offset, max ) );
+                buf[ i + 1U ] = 'a';
+                TEST_ASSERT_EQUAL( 0, wordScanSkipString( buf, offset, max ) );
+
+                /* A two byte UTF-8 sequence is passed on to skipUTF8. */
+                buf[ i ] = ( char ) 0xC3;
+                buf[ i + 1U ] = ( char ) 0xA9;
+                TEST_ASSERT_EQUAL( max, wordScanSkipString( buf, offset, max ) );
+            }
+            else
+            {
+                /* The backslash escapes the closing quote. */
+                TEST_ASSERT_EQUAL( 0, wordScanSkipString( buf, offset, max ) );
+            }
+        }
+    }
+}
+
+/**
+ * @brief Test escape sequences that start in one word and end in the next.
+ */
+void test_JSON_WordScan_Escape_Across_Words( void )
+{
+    char * buf;
+    size_t offset, lane, max;
+
+    for( offset = 0; offset < WORD_SCAN_LANES; offset++ )
+    {
+        max = offset + WORD_SCAN_PLAIN_LENGTH + 2U;
+
+        for( lane = 0; ( lane + 6U ) <= WORD_SCAN_PLAIN_LENGTH; lane++ )
+        {
+            buf = wordScanString( offset, WORD_SCAN_PLAIN_LENGTH );
+            memcpy( &buf[ offset + 1U + lane ], "\\u00e9", 6 );
+            TEST_ASSERT_EQUAL( max, wordScanSkipString( buf, offset, max ) );
+
+            /* The same sequence cut short by a quote in the next word. */
+            buf[ offset + lane + 6U ] = '"';
+            TEST_ASSERT_EQUAL( 0, wordScanSkipString( buf, offset, max ) );
+        }
+    }
+}
+
+/**
+ * @brief Test that runs of whitespace stop at a non-space byte in every lane
+ * of a word, and at the end of the buffer.
+ */
+void test_JSON_WordScan_Space_Every_Lane( void )
+{
+    static const char spaces[] = " \t\r\n";
+    char * buf = ( char * ) wordScanBuffer;
+    size_t offset, lane, i, start;
+
+    for( offset = 0; offset < WORD_SCAN_LANES; offset++ )
+    {
+        for( lane = 0; lane <= WORD_SCAN_PLAIN_LENGTH; lane++ )
+        {
+            memset( buf, 'x', sizeof( wordScanBuffer ) );
+
+            for( i = 0; i < lane; i++ )
+            {
+                buf[ offset + i ] = spaces[ i % ( sizeof( spaces ) - 1U ) ];
+            }
+
+            start = offset;
+            skipSpace( buf, &start, offset + WORD_SCAN_PLAIN_LENGTH + 1U );
+            TEST_ASSERT_EQUAL( offset + lane, start );
+
+            /* Only whitespace up to the end of the buffer. */
+            if( lane > 0U )
+            {
+                start = offset;
+                skipSpace( buf, &start, offset + lane );
+                TEST_ASSERT_EQUAL( offset + lane, start );
+            }
+        }
+    }
+}
@@ -66,6 +66,21 @@
     static MQTTPubAckInfo_t pIncomingPublishRecords[ MQTT_AGENT_MAX_OUTSTANDING_ACKS ];
 #endif
 
+/**
+ * @brief Slot at which the probe for a packet ID starts in the list of pending
+ * acknowledgments.
+ *
+ * The list is an open addressed hash table keyed by packet ID. Packet IDs are
+ * handed out sequentially, so consecutive outstanding operations land in
+ * consecutive slots and a lookup usually succeeds on the first probe.
+ */
+#define PENDING_ACK_HOME_SLOT( packetId )    ( ( size_t ) ( packetId ) % ( size_t ) MQTT_AGENT_MAX_OUTSTANDING_ACKS )
+
+/**
+ * @brief Slot probed after @p slot in the list of pending acknowledgments.
+ */
+#define PENDING_ACK_NEXT_SLOT( slot )        ( ( ( slot ) + 1U ) % ( size_t ) MQTT_AGENT_MAX_OUTSTANDING_ACKS )
+
 /**
  * @brief Track an operation by adding it to a list, indicating it is anticipating
  * an acknowledgment.
@@ -98,6 +113,19 @@ static MQTTStatus_t addAwaitingOperation( MQTTAgentContext_t * pAgentContext,
 static MQTTAgentAckInfo_t * getAwaitingOperation( MQTTAgentContext_t * pAgentContext,
                                                   uint16_t incomingPacketId );
 
+/**
+ * @brief Remove an operation from the list of pending acks.
+ *
+ * Entries that were displaced past the removed slot by collisions are moved
+ * back, so the probe sequence of every remaining packet ID stays unbroken.
+ * This may move another entry into @p pAckInfo.
+ *
+ * @param[in] pAgentContext Agent context for the MQTT connection.
+ * @param[in] pAckInfo Entry of the list to remove.
+ */
+static void removeAwaitingOperation( MQTTAgentContext_t * pAgentContext,
+                                     MQTTAgentAckInfo_t * pAckInfo );
+
 /**
  * @brief Populate the parameters of a #MQTTAgentCommand struct.
  *
@@ -176,7 +204,7 @@ static void mqttEventCallback( MQTTContext_t * pMqttContext,
  * @param[in] packetType The type of the incoming packet, either SUBACK, UNSUBACK,
  * PUBACK, or PUBCOMP.
  */
-static void handleAcks( const MQTTAgentContext_t * pAgentContext,
+static void handleAcks( MQTTAgentContext_t * pAgentContext,
                         const MQTTPacketInfo_t * pPacketInfo,
                         const MQTTDeserializedInfo_t * pDeserializedInfo,
                         MQTTAgentAckInfo_t * pAckInfo,
@@ -327,7 +355,7 @@ static MQTTStatus_t addAwaitingOperation( MQTTAgentContext_t * pAgentContext,
                                           uint16_t packetId,
                                           MQTTAgentCommand_t * pCommand )
 {
-    size_t i = 0, unusedPos = MQTT_AGENT_MAX_OUTSTANDING_ACKS;
+    size_t i = 0, slot;
     MQTTStatus_t status = MQTTNoMemory;
     MQTTAgentAckInfo_t * pendingAcks = NULL;
 
@@ -336,22 +364,23 @@ static MQTTStatus_t addAwaitingOperation( MQTTAgentContext_t * pAgentContext,
     assert( packetId != MQTT_PACKET_ID_INVALID );
     pendingAcks = pAgentContext->pPendingAcks;
 
-    /* Before adding the record for the pending acknowledgement of the packet ID,
-     * make sure that there doesn't already exist an entry for the same packet ID.
-     * Also, as part of iterating through the list of pending acknowledgements,
-     * find an unused space for the packet ID to be added, if it can be. */
+    /* Walk the probe sequence of the packet ID. An existing entry for the same
+     * packet ID can only be found before the first unused slot, so reaching an
+     * unused slot both rules out a duplicate and gives the position of the new
+     * entry. */
+    slot = PENDING_ACK_HOME_SLOT( packetId );
+
     for( i = 0; i < MQTT_AGENT_MAX_OUTSTANDING_ACKS; i++ )
     {
-        /* If the packetId is MQTT_PACKET_ID_INVALID then the array space is not in
-         * use. */
-        if( ( unusedPos == MQTT_AGENT_MAX_OUTSTANDING_ACKS ) &&
-            ( pendingAcks[ i ].packetId == MQTT_PACKET_ID_INVALID ) )
+        if( pendingAcks[ slot ].packetId == MQTT_PACKET_ID_INVALID )
         {
-            unusedPos = i;
+            pendingAcks[ slot ].packetId = packetId;
+            pendingAcks[ slot ].pOriginalCommand = pCommand;
             status = MQTTSuccess;
+            break;
         }
 
-        if( pendingAcks[ i ].packetId == packetId )
+        if( pendingAcks[ slot ].packetId == packetId )
         {
             /* Check whether there exists a duplicate entry for pending
              * acknowledgment for the same packet ID that we want to add to
@@ -367,24 +396,15 @@ static MQTTStatus_t addAwaitingOperation( MQTTAgentContext_t * pAgentContext,
                         "Existing entry found for same packet: PacketId=%u\n", packetId ) );
             break;
         }
-    }
 
-    /* Add the packet ID to the list if there is space available, and there is no
-     * duplicate entry for the same packet ID found. */
-    if( status == MQTTSuccess )
-    {
-        pendingAcks[ unusedPos ].packetId = packetId;
-        pendingAcks[ unusedPos ].pOriginalCommand = pCommand;
+        slot = PENDING_ACK_NEXT_SLOT( slot );
     }
-    else if( status == MQTTNoMemory )
+
+    if( status == MQTTNoMemory )
     {
         LogError( ( "Failed to add operation to list of pending acknowledgments: "
                     "No memory available: PacketId=%u\n", packetId ) );
     }
-    else
-    {
-        /* Empty else MISRA 15.7 */
-    }
 
     return status;
 }
@@ -394,20 +414,29 @@ static MQTTStatus_t addAwaitingOperation( MQTTAgentContext_t * pAgentContext,
 static MQTTAgentAckInfo_t * getAwaitingOperation( MQTTAgentContext_t * pAgentContext,
                                                   uint16_t incomingPacketId )
 {
-    size_t i = 0;
+    size_t i = 0, slot;
     MQTTAgentAckInfo_t * pFoundAck = NULL;
 
     assert( pAgentContext != NULL );
 
-    /* Look through the array of packet IDs that are still waiting to be acked to
-     * find one with incomingPacketId. */
+    /* Follow the probe sequence of incomingPacketId through the packet IDs
+     * that are still waiting to be acked. An unused slot ends the sequence. */
+    slot = PENDING_ACK_HOME_SLOT( incomingPacketId );
+
     for( i = 0; i < MQTT_AGENT_MAX_OUTSTANDING_ACKS; i++ )
     {
-        if( pAgentContext->pPendingAcks[ i ].packetId == incomingPacketId )
+        if( pAgentContext->pPendingAcks[ slot ].packetId == incomingPacketId )
         {
-            pFoundAck = &( pAgentContext->pPendingAcks[ i ] );
+            pFoundAck = &( pAgentContext->pPendingAcks[ slot ] );
             break;
         }
+
+        if( pAgentContext->pPendingAcks[ slot ].packetId == MQTT_PACKET_ID_INVALID )
+        {
+            break;
+        }
+
+        slot = PENDING_ACK_NEXT_SLOT( slot );
     }
 
     if( pFoundAck == NULL )
@@ -419,7 +448,7 @@ static MQTTAgentAckInfo_t * getAwaitingOperation( MQTTAgentContext_t * pAgentCon
         LogError( ( "Found ack had empty fields. PacketId=%hu, Original Command=%p",
                     ( unsigned short ) pFoundAck->packetId,
                     ( void * ) pFoundAck->pOriginalCommand ) );
-        ( void ) memset( pFoundAck, 0x00, sizeof( MQTTAgentAckInfo_t ) );
+        removeAwaitingOperation( pAgentContext, pFoundAck );
         pFoundAck = NULL;
     }
     else
@@ -432,6 +461,50 @@ static MQTTAgentAckInfo_t * getAwaitingOperation( MQTTAgentContext_t * pAgentCon
 
 /*-----------------------------------------------------------*/
 
+static void removeAwaitingOperation( MQTTAgentContext_t * pAgentContext,
+                                     MQTTAgentAckInfo_t * pAckInfo )
+{
+    MQTTAgentAckInfo_t * pendingAcks;
+    size_t i, hole, slot, home;
+
+    assert( pAgentContext != NULL );
+    assert( pAckInfo != NULL );
+
+    pendingAcks = pAgentContext->pPendingAcks;
+    hole = ( size_t ) ( pAckInfo - pendingAcks );
+    assert( hole < MQTT_AGENT_MAX_OUTSTANDING_ACKS );
+
+    ( void ) memset( pAckInfo, 0x00, sizeof( MQTTAgentAckInfo_t ) );
+
+    /* Walk the rest of the cluster after the hole. An entry whose probe
+     * sequence passes through the hole, i.e. whose home slot is not between
+     * the hole and its current slot, is moved into the hole, which then moves
+     * to where the entry was. */
+    slot = PENDING_ACK_NEXT_SLOT( hole );
+
+    for( i = 1; i < MQTT_AGENT_MAX_OUTSTANDING_ACKS; i++ )
+    {
+        if( pendingAcks[ slot ].packetId == MQTT_PACKET_ID_INVALID )
+        {
+            break;
+        }
+
+        home = PENDING_ACK_HOME_SLOT( pendingAcks[ slot ].packetId );
+
+        if( ( ( slot + MQTT_AGENT_MAX_OUTSTANDING_ACKS - home ) % MQTT_AGENT_MAX_OUTSTANDING_ACKS ) >=
+            ( ( slot + MQTT_AGENT_MAX_OUTSTANDING_ACKS - hole ) % MQTT_AGENT_MAX_OUTSTANDING_ACKS ) )
+        {
+            pendingAcks[ hole ] = pendingAcks[ slot ];
+            ( void ) memset( &( pendingAcks[ slot ] ), 0x00, sizeof( MQTTAgentAckInfo_t ) );
+            hole = slot;
+        }
+
+        slot = PENDING_ACK_NEXT_SLOT( slot );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 static MQTTStatus_t createCommand( MQTTAgentCommandType_t commandType,
                                    const MQTTAgentContext_t * pMqttAgentContext,
                                    void * pMqttInfoParam,
@@ -627,7 +700,7 @@ static MQTTStatus_t processCommand( MQTTAgentContext_t * pMqttAgentContext,
 
 /*-----------------------------------------------------------*/
 
-static void handleAcks( const MQTTAgentContext_t * pAgentContext,
+static void handleAcks( MQTTAgentContext_t * pAgentContext,
                         const MQTTPacketInfo_t * pPacketInfo,
                         const MQTTDeserializedInfo_t * pDeserializedInfo,
                         MQTTAgentAckInfo_t * pAckInfo,
@@ -647,7 +720,7 @@ static void handleAcks( const MQTTAgentContext_t * pAgentContext,
                      pSubackCodes );
 
     /* Clear the entry from the list. */
-    ( void ) memset( pAckInfo, 0x00, sizeof( MQTTAgentAckInfo_t ) );
+    removeAwaitingOperation( pAgentContext, pAckInfo );
 }
 
 /*-----------------------------------------------------------*/
@@ -855,7 +928,7 @@ static MQTTStatus_t resendPublishes( MQTTAgentContext_t * pMqttAgentContext )
             if( statusResult != MQTTSuccess )
             {
                 concludeCommand( pMqttAgentContext, pFoundAck->pOriginalCommand, statusResult, NULL );
-                ( void ) memset( pFoundAck, 0x00, sizeof( MQTTAgentAckInfo_t ) );
+                removeAwaitingOperation( pMqttAgentContext, pFoundAck );
                 LogError( ( "Failed to resend publishes. Error code=%s\n", MQTT_Status_strerror( statusResult ) ) );
                 break;
             }
@@ -874,35 +947,38 @@ static void clearPendingAcknowledgments( MQTTAgentContext_t * pMqttAgentContext,
 {
     size_t i = 0;
     MQTTAgentAckInfo_t * pendingAcks;
+    bool clearEntry;
 
     assert( pMqttAgentContext != NULL );
 
     pendingAcks = pMqttAgentContext->pPendingAcks;
 
     /* Clear all operations pending acknowledgments. */
-    for( i = 0; i < MQTT_AGENT_MAX_OUTSTANDING_ACKS; i++ )
+    while( i < MQTT_AGENT_MAX_OUTSTANDING_ACKS )
     {
+        clearEntry = false;
+
         if( pendingAcks[ i ].packetId != MQTT_PACKET_ID_INVALID )
         {
-            bool clearEntry = true;
-
             assert( pendingAcks[ i ].pOriginalCommand != NULL );
 
-            if( clearOnlySubUnsubEntries &&
-                ( pendingAcks[ i ].pOriginalCommand->commandType != SUBSCRIBE ) &&
-                ( pendingAcks[ i ].pOriginalCommand->commandType != UNSUBSCRIBE ) )
-            {
-                clearEntry = false;
-            }
+            clearEntry = ( !clearOnlySubUnsubEntries ) ||
+                         ( pendingAcks[ i ].pOriginalCommand->commandType == SUBSCRIBE ) ||
+                         ( pendingAcks[ i ].pOriginalCommand->commandType == UNSUBSCRIBE );
+        }
 
-            if( clearEntry )
-            {
-                /* Receive failed to indicate network error. */
-                concludeCommand( pMqttAgentContext, pendingAcks[ i ].pOriginalCommand, MQTTRecvFailed, NULL );
+        if( clearEntry )
+        {
+            /* Receive failed to indicate network error. */
+            concludeCommand( pMqttAgentContext, pendingAcks[ i ].pOriginalCommand, MQTTRecvFailed, NULL );
 
-                /* Now remove it from the list. */
-                ( void ) memset( &( pendingAcks[ i ] ), 0x00, sizeof( MQTTAgentAckInfo_t ) );
-            }
+            /* Now remove it from the list. Removal can move a later entry into
+             * this slot, so look at the same slot again. */
+            removeAwaitingOperation( pMqttAgentContext, &( pendingAcks[ i ] ) );
+        }
+        else
+        {
+            i++;
         }
     }
 }
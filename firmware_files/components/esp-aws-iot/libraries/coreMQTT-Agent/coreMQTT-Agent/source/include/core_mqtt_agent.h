@@ -153,7 +153,7 @@ typedef struct MQTTAgentContext
 {
     MQTTContext_t mqttContext;                                          /**< MQTT connection information used by coreMQTT. */
     MQTTAgentMessageInterface_t agentInterface;                         /**< Struct of function pointers for agent messaging. */
-    MQTTAgentAckInfo_t pPendingAcks[ MQTT_AGENT_MAX_OUTSTANDING_ACKS ]; /**< List of pending acknowledgment packets. */
+    MQTTAgentAckInfo_t pPendingAcks[ MQTT_AGENT_MAX_OUTSTANDING_ACKS ]; /**< Pending acknowledgment packets, hashed by packet ID. */
     MQTTAgentIncomingPublishCallback_t pIncomingCallback;               /**< Callback to invoke for incoming publishes. */
     void * pIncomingCallbackContext;                                    /**< Context for incoming publish callback. */
     bool packetReceivedInLoop;                                          /**< Whether a MQTT_ProcessLoop() call received a packet. */
@@ -35,6 +35,11 @@
 #include "mock_core_mqtt_state.h"
 #include "mock_core_mqtt_agent_command_functions.h"
 
+/**
+ * @brief Slot of the pending acknowledgments list that holds a packet ID when
+ * no other pending packet ID collides with it.
+ */
+#define PENDING_ACK_SLOT( packetId )    ( ( size_t ) ( packetId ) % MQTT_AGENT_MAX_OUTSTANDING_ACKS )
 
 /**
  * @brief The agent messaging context.
@@ -628,8 +633,8 @@ void test_MQTTAgent_ResumeSession_session_present_no_publish_found( void )
     setupAgentContext( &mqttAgentContext );
 
     MQTT_PublishToResend_ExpectAnyArgsAndReturn( 2 );
-    mqttAgentContext.pPendingAcks[ 0 ].packetId = 1U;
-    mqttAgentContext.pPendingAcks[ 0 ].pOriginalCommand = &command;
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( 1U ) ].packetId = 1U;
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( 1U ) ].pOriginalCommand = &command;
 
     MQTT_PublishToResend_ExpectAnyArgsAndReturn( MQTT_PACKET_ID_INVALID );
     mqttStatus = MQTTAgent_ResumeSession( &mqttAgentContext, sessionPresent );
@@ -650,6 +655,7 @@ void test_MQTTAgent_ResumeSession_session_present_clear_pending_subscribe_unsubs
     MQTTAgentCommand_t subscribeCommand = { 0 };
     MQTTAgentCommand_t unsubscribeCommand = { 0 };
     const uint16_t pubPacketId = 1U;
+    const uint16_t unsubPacketId = MQTT_AGENT_MAX_OUTSTANDING_ACKS - 1U;
 
     subscribeCommand.commandType = SUBSCRIBE;
     unsubscribeCommand.commandType = UNSUBSCRIBE;
@@ -659,12 +665,12 @@ void test_MQTTAgent_ResumeSession_session_present_clear_pending_subscribe_unsubs
 
     /* Setup the pending ack list to contain operations for SUBSCRIBE
      * UNSUBSCRIBE and PUBLISH operations. */
-    mqttAgentContext.pPendingAcks[ 0 ].packetId = pubPacketId;
-    mqttAgentContext.pPendingAcks[ 0 ].pOriginalCommand = &publishCommand;
-    mqttAgentContext.pPendingAcks[ 1 ].packetId = pubPacketId + 1;
-    mqttAgentContext.pPendingAcks[ 1 ].pOriginalCommand = &subscribeCommand;
-    mqttAgentContext.pPendingAcks[ MQTT_AGENT_MAX_OUTSTANDING_ACKS - 1 ].packetId = pubPacketId + 2;
-    mqttAgentContext.pPendingAcks[ MQTT_AGENT_MAX_OUTSTANDING_ACKS - 1 ].pOriginalCommand =
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( pubPacketId ) ].packetId = pubPacketId;
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( pubPacketId ) ].pOriginalCommand = &publishCommand;
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( pubPacketId + 1 ) ].packetId = pubPacketId + 1;
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( pubPacketId + 1 ) ].pOriginalCommand = &subscribeCommand;
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( unsubPacketId ) ].packetId = unsubPacketId;
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( unsubPacketId ) ].pOriginalCommand =
         &unsubscribeCommand;
 
     /* Even though the list has a pending PUBLISH operation, return no packet ID
@@ -678,16 +684,69 @@ void test_MQTTAgent_ResumeSession_session_present_clear_pending_subscribe_unsubs
 
     /* Ensure that the list entries for SUBSCRIBE and UNSUBSCRIBE operations have
      * been cleared. */
-    TEST_ASSERT_EQUAL( MQTT_PACKET_ID_INVALID, mqttAgentContext.pPendingAcks[ 1 ].packetId );
-    TEST_ASSERT_EQUAL_PTR( NULL, mqttAgentContext.pPendingAcks[ 1 ].pOriginalCommand );
+    TEST_ASSERT_EQUAL( MQTT_PACKET_ID_INVALID, mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( pubPacketId + 1 ) ].packetId );
+    TEST_ASSERT_EQUAL_PTR( NULL, mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( pubPacketId + 1 ) ].pOriginalCommand );
     TEST_ASSERT_EQUAL( MQTT_PACKET_ID_INVALID, mqttAgentContext.
-                          pPendingAcks[ MQTT_AGENT_MAX_OUTSTANDING_ACKS - 1 ].packetId );
+                          pPendingAcks[ PENDING_ACK_SLOT( unsubPacketId ) ].packetId );
     TEST_ASSERT_EQUAL_PTR( NULL, mqttAgentContext.
-                              pPendingAcks[ MQTT_AGENT_MAX_OUTSTANDING_ACKS - 1 ].pOriginalCommand );
+                              pPendingAcks[ PENDING_ACK_SLOT( unsubPacketId ) ].pOriginalCommand );
 
     /* Ensure that the list entry for PUBLISH operation was not removed. */
-    TEST_ASSERT_EQUAL( pubPacketId, mqttAgentContext.pPendingAcks[ 0 ].packetId );
-    TEST_ASSERT_EQUAL_PTR( &publishCommand, mqttAgentContext.pPendingAcks[ 0 ].pOriginalCommand );
+    TEST_ASSERT_EQUAL( pubPacketId, mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( pubPacketId ) ].packetId );
+    TEST_ASSERT_EQUAL_PTR( &publishCommand, mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( pubPacketId ) ].pOriginalCommand );
+}
+
+/**
+ * @brief Tests that removing entries from the list of pending acknowledgments
+ * moves entries that collided with them back towards their home slot, so they
+ * can still be found by packet ID.
+ */
+void test_MQTTAgent_ResumeSession_session_present_clear_colliding_entries( void )
+{
+    bool sessionPresent = true;
+    MQTTStatus_t mqttStatus;
+    MQTTAgentContext_t mqttAgentContext;
+    MQTTAgentCommand_t publishCommand = { 0 };
+    MQTTAgentCommand_t collidingPublishCommand = { 0 };
+    MQTTAgentCommand_t subscribeCommand = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    const uint16_t subPacketId = 1U;
+    const uint16_t collidingPacketId = subPacketId + MQTT_AGENT_MAX_OUTSTANDING_ACKS;
+    const uint16_t pubPacketId = 2U;
+
+    subscribeCommand.commandType = SUBSCRIBE;
+    publishCommand.commandType = PUBLISH;
+    collidingPublishCommand.commandType = PUBLISH;
+    collidingPublishCommand.pArgs = &publishInfo;
+
+    setupAgentContext( &mqttAgentContext );
+
+    /* The second packet ID has the same home slot as the SUBSCRIBE, so it was
+     * placed in the next slot, which displaced the third one as well. */
+    mqttAgentContext.pPendingAcks[ 1 ].packetId = subPacketId;
+    mqttAgentContext.pPendingAcks[ 1 ].pOriginalCommand = &subscribeCommand;
+    mqttAgentContext.pPendingAcks[ 2 ].packetId = collidingPacketId;
+    mqttAgentContext.pPendingAcks[ 2 ].pOriginalCommand = &collidingPublishCommand;
+    mqttAgentContext.pPendingAcks[ 3 ].packetId = pubPacketId;
+    mqttAgentContext.pPendingAcks[ 3 ].pOriginalCommand = &publishCommand;
+
+    /* The displaced publish is resent after the SUBSCRIBE entry is cleared,
+     * so it must still be found. */
+    MQTT_PublishToResend_ExpectAnyArgsAndReturn( collidingPacketId );
+    MQTT_Publish_ExpectAnyArgsAndReturn( MQTTSuccess );
+    MQTT_PublishToResend_ExpectAnyArgsAndReturn( MQTT_PACKET_ID_INVALID );
+
+    mqttStatus = MQTTAgent_ResumeSession( &mqttAgentContext, sessionPresent );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    TEST_ASSERT_TRUE( publishInfo.dup );
+
+    /* Both publishes moved back by one slot. */
+    TEST_ASSERT_EQUAL( collidingPacketId, mqttAgentContext.pPendingAcks[ 1 ].packetId );
+    TEST_ASSERT_EQUAL_PTR( &collidingPublishCommand, mqttAgentContext.pPendingAcks[ 1 ].pOriginalCommand );
+    TEST_ASSERT_EQUAL( pubPacketId, mqttAgentContext.pPendingAcks[ 2 ].packetId );
+    TEST_ASSERT_EQUAL_PTR( &publishCommand, mqttAgentContext.pPendingAcks[ 2 ].pOriginalCommand );
+    TEST_ASSERT_EQUAL( MQTT_PACKET_ID_INVALID, mqttAgentContext.pPendingAcks[ 3 ].packetId );
+    TEST_ASSERT_EQUAL_PTR( NULL, mqttAgentContext.pPendingAcks[ 3 ].pOriginalCommand );
 }
 
 void test_MQTTAgent_ResumeSession_failed_publish( void )
@@ -701,8 +760,8 @@ void test_MQTTAgent_ResumeSession_failed_publish( void )
     setupAgentContext( &mqttAgentContext );
 
     command.pArgs = &args;
-    mqttAgentContext.pPendingAcks[ 0 ].packetId = 1U;
-    mqttAgentContext.pPendingAcks[ 0 ].pOriginalCommand = &command;
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( 1U ) ].packetId = 1U;
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( 1U ) ].pOriginalCommand = &command;
     /* Check that failed resending publish return MQTTSendFailed. */
     MQTT_PublishToResend_IgnoreAndReturn( 1 );
     MQTT_Publish_IgnoreAndReturn( MQTTSendFailed );
@@ -725,7 +784,7 @@ void test_MQTTAgent_ResumeSession_publish_resend_success( void )
 
     ackInfo.packetId = 1U;
     ackInfo.pOriginalCommand = &command;
-    mqttAgentContext.pPendingAcks[ 0 ] = ackInfo;
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( ackInfo.packetId ) ] = ackInfo;
 
     /* Check that publish ack is resent successfully when session resumes. */
     MQTT_PublishToResend_ExpectAnyArgsAndReturn( 1 );
@@ -1383,8 +1442,8 @@ void test_MQTTAgent_CommandLoop_add_acknowledgment_success( void )
     TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
 
     /* Ensure that acknowledgment is added. */
-    TEST_ASSERT_EQUAL( 1, mqttAgentContext.pPendingAcks[ 0 ].packetId );
-    TEST_ASSERT_EQUAL_PTR( &commandToSend, mqttAgentContext.pPendingAcks[ 0 ].pOriginalCommand );
+    TEST_ASSERT_EQUAL( 1, mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( 1U ) ].packetId );
+    TEST_ASSERT_EQUAL_PTR( &commandToSend, mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( 1U ) ].pOriginalCommand );
     /* Ensure that callback is not invoked. */
     TEST_ASSERT_EQUAL( 0, commandCompleteCallbackCount );
 }
@@ -1560,9 +1619,9 @@ void test_MQTTAgent_CommandLoop_with_eventCallback( void )
     packetType = MQTT_PACKET_TYPE_PUBACK;
     commandCompleteCallbackCount = 0;
 
-    mqttAgentContext.pPendingAcks[ 0 ].packetId = 1U;
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( 1U ) ].packetId = 1U;
     command.pCommandCompleteCallback = stubCompletionCallback;
-    mqttAgentContext.pPendingAcks[ 0 ].pOriginalCommand = &command;
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( 1U ) ].pOriginalCommand = &command;
 
     MQTTAgentCommand_Publish_ExpectAnyArgsAndReturn( MQTTSuccess );
     MQTTAgentCommand_Publish_ReturnThruPtr_pReturnFlags( &returnFlags );
@@ -1574,13 +1633,13 @@ void test_MQTTAgent_CommandLoop_with_eventCallback( void )
     /* Ensure that callback is invoked. */
     TEST_ASSERT_EQUAL( 2, commandCompleteCallbackCount );
     /* Ensure that acknowledgment is cleared. */
-    TEST_ASSERT_EQUAL( 0, mqttAgentContext.pPendingAcks[ 0 ].packetId );
-    TEST_ASSERT_EQUAL( NULL, mqttAgentContext.pPendingAcks[ 0 ].pOriginalCommand );
+    TEST_ASSERT_EQUAL( 0, mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( 1U ) ].packetId );
+    TEST_ASSERT_EQUAL( NULL, mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( 1U ) ].pOriginalCommand );
 
     /* mqttEventcallback behavior when the command for the pending ack is NULL for the received PUBACK. */
     commandCompleteCallbackCount = 0;
-    mqttAgentContext.pPendingAcks[ 0 ].packetId = 1U;
-    mqttAgentContext.pPendingAcks[ 0 ].pOriginalCommand = NULL;
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( 1U ) ].packetId = 1U;
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( 1U ) ].pOriginalCommand = NULL;
     MQTTAgentCommand_Publish_ExpectAnyArgsAndReturn( MQTTSuccess );
     MQTTAgentCommand_Publish_ReturnThruPtr_pReturnFlags( &returnFlags );
     MQTT_ProcessLoop_Stub( MQTT_ProcessLoop_CustomStub );
@@ -1626,9 +1685,9 @@ void test_MQTTAgent_CommandLoop_with_eventCallback( void )
     packetType = MQTT_PACKET_TYPE_SUBACK;
     commandCompleteCallbackCount = 0;
 
-    mqttAgentContext.pPendingAcks[ 0 ].packetId = 1U;
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( 1U ) ].packetId = 1U;
     command.pCommandCompleteCallback = NULL;
-    mqttAgentContext.pPendingAcks[ 0 ].pOriginalCommand = &command;
+    mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( 1U ) ].pOriginalCommand = &command;
 
 
     MQTTAgentCommand_Publish_ExpectAnyArgsAndReturn( MQTTSuccess );
@@ -1641,8 +1700,8 @@ void test_MQTTAgent_CommandLoop_with_eventCallback( void )
     /* Ensure that callback is invoked. */
     TEST_ASSERT_EQUAL( 1, commandCompleteCallbackCount );
     /* Ensure that acknowledgment is cleared. */
-    TEST_ASSERT_EQUAL( 0, mqttAgentContext.pPendingAcks[ 0 ].packetId );
-    TEST_ASSERT_EQUAL( NULL, mqttAgentContext.pPendingAcks[ 0 ].pOriginalCommand );
+    TEST_ASSERT_EQUAL( 0, mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( 1U ) ].packetId );
+    TEST_ASSERT_EQUAL( NULL, mqttAgentContext.pPendingAcks[ PENDING_ACK_SLOT( 1U ) ].pOriginalCommand );
 
     /* Invoking mqttEventCallback with MQTT_PACKET_TYPE_PUBLISH packet type. */
     packetType = MQTT_PACKET_TYPE_PUBLISH;
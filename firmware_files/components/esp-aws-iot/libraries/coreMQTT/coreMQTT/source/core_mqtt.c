@@ -2471,12 +2471,16 @@ static MQTTStatus_t handleSessionResumption( MQTTContext_t * pContext,
                              pContext->outgoingPublishRecordMaxCount * sizeof( *pContext->outgoingPublishRecords ) );
         }
 
+        pContext->outgoingPublishRecordEnd = 0U;
+
         if( pContext->incomingPublishRecordMaxCount > 0U )
         {
             ( void ) memset( pContext->incomingPublishRecords,
                              0x00,
                              pContext->incomingPublishRecordMaxCount * sizeof( *pContext->incomingPublishRecords ) );
         }
+
+        pContext->incomingPublishRecordEnd = 0U;
     }
 
     return status;
@@ -2631,12 +2635,29 @@ MQTTStatus_t MQTT_InitStatefulQoS( MQTTContext_t * pContext,
                     " been called successfully.\n" ) );
         status = MQTTBadParameter;
     }
+
+    /* The packet ID index refers to records by 16-bit position. */
+    else if( ( outgoingPublishCount > UINT16_MAX ) ||
+             ( incomingPublishCount > UINT16_MAX ) )
+    {
+        LogError( ( "Too many publish records: outgoingPublishCount=%lu, "
+                    "incomingPublishCount=%lu",
+                    ( unsigned long ) outgoingPublishCount,
+                    ( unsigned long ) incomingPublishCount ) );
+        status = MQTTBadParameter;
+    }
     else
     {
         pContext->incomingPublishRecordMaxCount = incomingPublishCount;
         pContext->incomingPublishRecords = pIncomingPublishRecords;
         pContext->outgoingPublishRecordMaxCount = outgoingPublishCount;
         pContext->outgoingPublishRecords = pOutgoingPublishRecords;
+
+        /* The arrays may already hold records, e.g. when the context is
+         * initialized again with the same memory. The state engine trims the
+         * end down to the last record before it appends. */
+        pContext->incomingPublishRecordEnd = incomingPublishCount;
+        pContext->outgoingPublishRecordEnd = outgoingPublishCount;
     }
 
     return status;
@@ -69,6 +69,26 @@ static const size_t ZERO_SIZE_T = 0U;
  */
 #define UINT16_CHECK_BIT( x, position )         ( ( ( x ) & ( UINT16_BITMAP_BIT_SET_AT( position ) ) ) == ( UINT16_BITMAP_BIT_SET_AT( position ) ) )
 
+/**
+ * @brief Slot of the packet ID index at which the search for a packet ID starts.
+ *
+ * Packet IDs are mostly handed out in sequence, so consecutive in-flight IDs
+ * land in consecutive slots and probe sequences stay short even when the
+ * records array is full.
+ *
+ * @param[in] packetId The packet ID.
+ * @param[in] recordCount Length of the record array.
+ */
+#define INDEX_HOME_SLOT( packetId, recordCount )    ( ( size_t ) ( packetId ) % ( recordCount ) )
+
+/**
+ * @brief Slot of the packet ID index following @p slot.
+ *
+ * @param[in] slot Current slot.
+ * @param[in] recordCount Length of the record array.
+ */
+#define INDEX_NEXT_SLOT( slot, recordCount )        ( ( ( slot ) + 1U ) % ( recordCount ) )
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -113,6 +133,52 @@ static bool validateTransitionAck( MQTTPublishState_t currentState,
 static bool isPublishOutgoing( MQTTPubAckType_t packetType,
                                MQTTStateOperation_t opType );
 
+/**
+ * @brief Find the packet ID index slot that refers to the record of a packet ID.
+ *
+ * The records keep their insertion order, which MQTT requires when publishes
+ * and PUBRELs are resent. To avoid scanning them for every ack, the
+ * #MQTTPubAckInfo_t.indexEntry fields of the same array form an open
+ * addressing table keyed by packet ID. A non-zero entry holds the position of
+ * a record plus one.
+ *
+ * @param[in] records State record array.
+ * @param[in] recordCount Length of record array.
+ * @param[in] packetId packet ID to search for.
+ *
+ * @return The index slot, or #MQTT_INVALID_STATE_COUNT if the packet ID has no record.
+ */
+static size_t findIndexSlot( const MQTTPubAckInfo_t * records,
+                             size_t recordCount,
+                             uint16_t packetId );
+
+/**
+ * @brief Add the record at a position to the packet ID index.
+ *
+ * @param[in] records State record array.
+ * @param[in] recordCount Length of record array.
+ * @param[in] packetId Packet ID of the record.
+ * @param[in] recordIndex Position of the record.
+ */
+static void insertIndexEntry( MQTTPubAckInfo_t * records,
+                              size_t recordCount,
+                              uint16_t packetId,
+                              size_t recordIndex );
+
+/**
+ * @brief Remove an entry from the packet ID index.
+ *
+ * Entries further along the probe sequence are shifted back into the freed
+ * slot, so lookups never need tombstones.
+ *
+ * @param[in] records State record array.
+ * @param[in] recordCount Length of record array.
+ * @param[in] slot Index slot to clear.
+ */
+static void removeIndexEntry( MQTTPubAckInfo_t * records,
+                              size_t recordCount,
+                              size_t slot );
+
 /**
  * @brief Find a packet ID in the state record.
  *
@@ -139,15 +205,18 @@ static size_t findInRecord( const MQTTPubAckInfo_t * records,
  *
  * @param[in] records State record array.
  * @param[in] recordCount Length of record array.
+ *
+ * @return Index after the last record once compacted.
  */
-static void compactRecords( MQTTPubAckInfo_t * records,
-                            size_t recordCount );
+static size_t compactRecords( MQTTPubAckInfo_t * records,
+                              size_t recordCount );
 
 /**
  * @brief Store a new entry in the state record.
  *
  * @param[in] records State record array.
  * @param[in] recordCount Length of record array.
+ * @param[in,out] pRecordEnd Index after the last record in the array.
  * @param[in] packetId Packet ID of new entry.
  * @param[in] qos QoS of new entry.
  * @param[in] publishState State of new entry.
@@ -156,6 +225,7 @@ static void compactRecords( MQTTPubAckInfo_t * records,
  */
 static MQTTStatus_t addRecord( MQTTPubAckInfo_t * records,
                                size_t recordCount,
+                               size_t * pRecordEnd,
                                uint16_t packetId,
                                MQTTQoS_t qos,
                                MQTTPublishState_t publishState );
@@ -164,11 +234,13 @@ static MQTTStatus_t addRecord( MQTTPubAckInfo_t * records,
  * @brief Update and possibly delete an entry in the state record.
  *
  * @param[in] records State record array.
+ * @param[in] recordCount Length of record array.
  * @param[in] recordIndex index of record to update.
  * @param[in] newState New state to update.
  * @param[in] shouldDelete Whether an existing entry should be deleted.
  */
 static void updateRecord( MQTTPubAckInfo_t * records,
+                          size_t recordCount,
                           size_t recordIndex,
                           MQTTPublishState_t newState,
                           bool shouldDelete );
@@ -193,6 +265,7 @@ static uint16_t stateSelect( const MQTTContext_t * pMqttContext,
  *
  * @param[in] records State records pointer.
  * @param[in] maxRecordCount The maximum number of records.
+ * @param[in,out] pRecordEnd Index after the last record in the array.
  * @param[in] recordIndex Index at which the record is stored.
  * @param[in] packetId Packet id of the packet.
  * @param[in] currentState Current state of the publish record.
@@ -202,6 +275,7 @@ static uint16_t stateSelect( const MQTTContext_t * pMqttContext,
  */
 static MQTTStatus_t updateStateAck( MQTTPubAckInfo_t * records,
                                     size_t maxRecordCount,
+                                    size_t * pRecordEnd,
                                     size_t recordIndex,
                                     uint16_t packetId,
                                     MQTTPublishState_t currentState,
@@ -221,7 +295,7 @@ static MQTTStatus_t updateStateAck( MQTTPubAckInfo_t * records,
  *
  * @return #MQTTIllegalState, #MQTTStateCollision or #MQTTSuccess.
  */
-static MQTTStatus_t updateStatePublish( const MQTTContext_t * pMqttContext,
+static MQTTStatus_t updateStatePublish( MQTTContext_t * pMqttContext,
                                         size_t recordIndex,
                                         uint16_t packetId,
                                         MQTTStateOperation_t opType,
@@ -443,31 +517,122 @@ static bool isPublishOutgoing( MQTTPubAckType_t packetType,
 
 /*-----------------------------------------------------------*/
 
+static size_t findIndexSlot( const MQTTPubAckInfo_t * records,
+                             size_t recordCount,
+                             uint16_t packetId )
+{
+    size_t slot = INDEX_HOME_SLOT( packetId, recordCount );
+    size_t probeCount = 0U;
+    size_t recordIndex = 0U;
+    size_t foundSlot = MQTT_INVALID_STATE_COUNT;
+
+    /* The probe sequence of a packet ID ends at the first empty slot. */
+    while( ( probeCount < recordCount ) && ( records[ slot ].indexEntry != 0U ) )
+    {
+        recordIndex = ( size_t ) records[ slot ].indexEntry - 1U;
+        assert( recordIndex < recordCount );
+
+        if( records[ recordIndex ].packetId == packetId )
+        {
+            foundSlot = slot;
+            break;
+        }
+
+        slot = INDEX_NEXT_SLOT( slot, recordCount );
+        probeCount++;
+    }
+
+    return foundSlot;
+}
+
+/*-----------------------------------------------------------*/
+
+static void insertIndexEntry( MQTTPubAckInfo_t * records,
+                              size_t recordCount,
+                              uint16_t packetId,
+                              size_t recordIndex )
+{
+    size_t slot = INDEX_HOME_SLOT( packetId, recordCount );
+    size_t probeCount = 0U;
+
+    /* There is one slot per record, so a free slot exists as long as the
+     * record itself found a free position. */
+    while( records[ slot ].indexEntry != 0U )
+    {
+        slot = INDEX_NEXT_SLOT( slot, recordCount );
+        probeCount++;
+        assert( probeCount < recordCount );
+    }
+
+    records[ slot ].indexEntry = ( uint16_t ) ( recordIndex + 1U );
+}
+
+/*-----------------------------------------------------------*/
+
+static void removeIndexEntry( MQTTPubAckInfo_t * records,
+                              size_t recordCount,
+                              size_t slot )
+{
+    size_t emptySlot = slot;
+    size_t nextSlot = INDEX_NEXT_SLOT( slot, recordCount );
+    size_t homeSlot = 0U;
+    bool canMove = false;
+
+    records[ emptySlot ].indexEntry = 0U;
+
+    /* Walk the rest of the cluster. An entry may fill the empty slot unless
+     * its home slot lies cyclically in ( emptySlot, nextSlot ], in which case
+     * moving it would put it before its own home. */
+    while( records[ nextSlot ].indexEntry != 0U )
+    {
+        homeSlot = INDEX_HOME_SLOT( records[ ( size_t ) records[ nextSlot ].indexEntry - 1U ].packetId,
+                                    recordCount );
+
+        if( emptySlot <= nextSlot )
+        {
+            canMove = ( homeSlot <= emptySlot ) || ( homeSlot > nextSlot );
+        }
+        else
+        {
+            canMove = ( homeSlot <= emptySlot ) && ( homeSlot > nextSlot );
+        }
+
+        if( canMove == true )
+        {
+            records[ emptySlot ].indexEntry = records[ nextSlot ].indexEntry;
+            records[ nextSlot ].indexEntry = 0U;
+            emptySlot = nextSlot;
+        }
+
+        nextSlot = INDEX_NEXT_SLOT( nextSlot, recordCount );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 static size_t findInRecord( const MQTTPubAckInfo_t * records,
                             size_t recordCount,
                             uint16_t packetId,
                             MQTTQoS_t * pQos,
                             MQTTPublishState_t * pCurrentState )
 {
-    size_t index = 0;
+    size_t index = MQTT_INVALID_STATE_COUNT;
+    size_t slot = MQTT_INVALID_STATE_COUNT;
 
     assert( packetId != MQTT_PACKET_ID_INVALID );
 
     *pCurrentState = MQTTStateNull;
 
-    for( index = 0; index < recordCount; index++ )
+    if( recordCount > 0U )
     {
-        if( records[ index ].packetId == packetId )
-        {
-            *pQos = records[ index ].qos;
-            *pCurrentState = records[ index ].publishState;
-            break;
-        }
+        slot = findIndexSlot( records, recordCount, packetId );
     }
 
-    if( index == recordCount )
+    if( slot != MQTT_INVALID_STATE_COUNT )
     {
-        index = MQTT_INVALID_STATE_COUNT;
+        index = ( size_t ) records[ slot ].indexEntry - 1U;
+        *pQos = records[ index ].qos;
+        *pCurrentState = records[ index ].publishState;
     }
 
     return index;
@@ -475,11 +640,12 @@ static size_t findInRecord( const MQTTPubAckInfo_t * records,
 
 /*-----------------------------------------------------------*/
 
-static void compactRecords( MQTTPubAckInfo_t * records,
-                            size_t recordCount )
+static size_t compactRecords( MQTTPubAckInfo_t * records,
+                              size_t recordCount )
 {
     size_t index = 0;
     size_t emptyIndex = MQTT_INVALID_STATE_COUNT;
+    size_t slot = MQTT_INVALID_STATE_COUNT;
 
     assert( records != NULL );
 
@@ -498,6 +664,11 @@ static void compactRecords( MQTTPubAckInfo_t * records,
         {
             if( emptyIndex != MQTT_INVALID_STATE_COUNT )
             {
+                /* Point the index entry of the record at its new position. */
+                slot = findIndexSlot( records, recordCount, records[ index ].packetId );
+                assert( slot != MQTT_INVALID_STATE_COUNT );
+                records[ slot ].indexEntry = ( uint16_t ) ( emptyIndex + 1U );
+
                 /* Copy over the contents at non empty index to empty index. */
                 records[ emptyIndex ].packetId = records[ index ].packetId;
                 records[ emptyIndex ].qos = records[ index ].qos;
@@ -513,70 +684,63 @@ static void compactRecords( MQTTPubAckInfo_t * records,
             }
         }
     }
+
+    return ( emptyIndex == MQTT_INVALID_STATE_COUNT ) ? recordCount : emptyIndex;
 }
 
 /*-----------------------------------------------------------*/
 
 static MQTTStatus_t addRecord( MQTTPubAckInfo_t * records,
                                size_t recordCount,
+                               size_t * pRecordEnd,
                                uint16_t packetId,
                                MQTTQoS_t qos,
                                MQTTPublishState_t publishState )
 {
     MQTTStatus_t status = MQTTNoMemory;
-    int32_t index = 0;
-    size_t availableIndex = recordCount;
-    bool validEntryFound = false;
+    size_t availableIndex = *pRecordEnd;
 
     assert( packetId != MQTT_PACKET_ID_INVALID );
     assert( qos != MQTTQoS0 );
+    assert( availableIndex <= recordCount );
 
-    /* Check if we have to compact the records. This is known by checking if
-     * the last spot in the array is filled. */
-    if( records[ recordCount - 1U ].packetId != MQTT_PACKET_ID_INVALID )
+    if( findIndexSlot( records, recordCount, packetId ) != MQTT_INVALID_STATE_COUNT )
     {
-        compactRecords( records, recordCount );
-    }
+        /* Collision. */
+        LogError( ( "Collision when adding PacketID=%u.",
+                    ( unsigned int ) packetId ) );
 
-    /* Start from end so first available index will be populated.
-     * Available index is always found after the last element in the records.
-     * This is to make sure the relative order of the records in order to meet
-     * the message ordering requirement of MQTT spec 3.1.1. */
-    for( index = ( ( int32_t ) recordCount - 1 ); index >= 0; index-- )
+        status = MQTTStateCollision;
+    }
+    else
     {
-        /* Available index is only found after packet at the highest index. */
-        if( records[ index ].packetId == MQTT_PACKET_ID_INVALID )
+        /* New records are only added after the last record, to keep the
+         * relative order of the records in order to meet the message ordering
+         * requirement of MQTT spec 3.1.1. Records deleted from the end leave
+         * the end where it was, so step back over them first. */
+        while( ( availableIndex > 0U ) &&
+               ( records[ availableIndex - 1U ].packetId == MQTT_PACKET_ID_INVALID ) )
         {
-            if( validEntryFound == false )
-            {
-                availableIndex = ( size_t ) index;
-            }
+            availableIndex--;
         }
-        else
+
+        /* Compact the records if the last spot in the array is filled. */
+        if( availableIndex == recordCount )
         {
-            /* A non-empty spot found in the records. */
-            validEntryFound = true;
+            availableIndex = compactRecords( records, recordCount );
+        }
 
-            if( records[ index ].packetId == packetId )
-            {
-                /* Collision. */
-                LogError( ( "Collision when adding PacketID=%u at index=%d.",
-                            ( unsigned int ) packetId,
-                            ( int ) index ) );
-
-                status = MQTTStateCollision;
-                availableIndex = recordCount;
-                break;
-            }
+        if( availableIndex < recordCount )
+        {
+            records[ availableIndex ].packetId = packetId;
+            records[ availableIndex ].qos = qos;
+            records[ availableIndex ].publishState = publishState;
+            insertIndexEntry( records, recordCount, packetId, availableIndex );
+            availableIndex++;
+            status = MQTTSuccess;
         }
-    }
 
-    if( availableIndex < recordCount )
-    {
-        records[ availableIndex ].packetId = packetId;
-        records[ availableIndex ].qos = qos;
-        records[ availableIndex ].publishState = publishState;
-        status = MQTTSuccess;
+        *pRecordEnd = availableIndex;
     }
 
     return status;
@@ -585,14 +749,21 @@ static MQTTStatus_t addRecord( MQTTPubAckInfo_t * records,
 /*-----------------------------------------------------------*/
 
 static void updateRecord( MQTTPubAckInfo_t * records,
+                          size_t recordCount,
                           size_t recordIndex,
                           MQTTPublishState_t newState,
                           bool shouldDelete )
 {
+    size_t slot = MQTT_INVALID_STATE_COUNT;
+
     assert( records != NULL );
 
     if( shouldDelete == true )
     {
+        slot = findIndexSlot( records, recordCount, records[ recordIndex ].packetId );
+        assert( slot != MQTT_INVALID_STATE_COUNT );
+        removeIndexEntry( records, recordCount, slot );
+
         /* Mark the record as invalid. */
         records[ recordIndex ].packetId = MQTT_PACKET_ID_INVALID;
         records[ recordIndex ].qos = MQTTQoS0;
@@ -705,6 +876,7 @@ MQTTPublishState_t MQTT_CalculateStateAck( MQTTPubAckType_t packetType,
 
 static MQTTStatus_t updateStateAck( MQTTPubAckInfo_t * records,
                                     size_t maxRecordCount,
+                                    size_t * pRecordEnd,
                                     size_t recordIndex,
                                     uint16_t packetId,
                                     MQTTPublishState_t currentState,
@@ -733,6 +905,7 @@ static MQTTStatus_t updateStateAck( MQTTPubAckInfo_t * records,
         if( currentState != newState )
         {
             updateRecord( records,
+                          maxRecordCount,
                           recordIndex,
                           newState,
                           shouldDeleteRecord );
@@ -745,6 +918,7 @@ static MQTTStatus_t updateStateAck( MQTTPubAckInfo_t * records,
             {
                 status = addRecord( records,
                                     maxRecordCount,
+                                    pRecordEnd,
                                     packetId,
                                     MQTTQoS2,
                                     MQTTPubRelSend );
@@ -764,7 +938,7 @@ static MQTTStatus_t updateStateAck( MQTTPubAckInfo_t * records,
 
 /*-----------------------------------------------------------*/
 
-static MQTTStatus_t updateStatePublish( const MQTTContext_t * pMqttContext,
+static MQTTStatus_t updateStatePublish( MQTTContext_t * pMqttContext,
                                         size_t recordIndex,
                                         uint16_t packetId,
                                         MQTTStateOperation_t opType,
@@ -791,6 +965,7 @@ static MQTTStatus_t updateStatePublish( const MQTTContext_t * pMqttContext,
         {
             status = addRecord( pMqttContext->incomingPublishRecords,
                                 pMqttContext->incomingPublishRecordMaxCount,
+                                &pMqttContext->incomingPublishRecordEnd,
                                 packetId,
                                 qos,
                                 newState );
@@ -803,6 +978,7 @@ static MQTTStatus_t updateStatePublish( const MQTTContext_t * pMqttContext,
             if( currentState != newState )
             {
                 updateRecord( pMqttContext->outgoingPublishRecords,
+                              pMqttContext->outgoingPublishRecordMaxCount,
                               recordIndex,
                               newState,
                               false );
@@ -822,7 +998,7 @@ static MQTTStatus_t updateStatePublish( const MQTTContext_t * pMqttContext,
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MQTT_ReserveState( const MQTTContext_t * pMqttContext,
+MQTTStatus_t MQTT_ReserveState( MQTTContext_t * pMqttContext,
                                 uint16_t packetId,
                                 MQTTQoS_t qos )
 {
@@ -841,6 +1017,7 @@ MQTTStatus_t MQTT_ReserveState( const MQTTContext_t * pMqttContext,
         /* Collisions are detected when adding the record. */
         status = addRecord( pMqttContext->outgoingPublishRecords,
                             pMqttContext->outgoingPublishRecordMaxCount,
+                            &pMqttContext->outgoingPublishRecordEnd,
                             packetId,
                             qos,
                             MQTTPublishSend );
@@ -880,7 +1057,7 @@ MQTTPublishState_t MQTT_CalculateStatePublish( MQTTStateOperation_t opType,
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MQTT_UpdateStatePublish( const MQTTContext_t * pMqttContext,
+MQTTStatus_t MQTT_UpdateStatePublish( MQTTContext_t * pMqttContext,
                                       uint16_t packetId,
                                       MQTTStateOperation_t opType,
                                       MQTTQoS_t qos,
@@ -991,6 +1168,7 @@ MQTTStatus_t MQTT_RemoveStateRecord( const MQTTContext_t * pMqttContext,
         {
             /* Delete the record. */
             updateRecord( records,
+                          pMqttContext->outgoingPublishRecordMaxCount,
                           recordIndex,
                           MQTTStateNull,
                           true );
@@ -1002,7 +1180,7 @@ MQTTStatus_t MQTT_RemoveStateRecord( const MQTTContext_t * pMqttContext,
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MQTT_UpdateStateAck( const MQTTContext_t * pMqttContext,
+MQTTStatus_t MQTT_UpdateStateAck( MQTTContext_t * pMqttContext,
                                   uint16_t packetId,
                                   MQTTPubAckType_t packetType,
                                   MQTTStateOperation_t opType,
@@ -1014,6 +1192,7 @@ MQTTStatus_t MQTT_UpdateStateAck( const MQTTContext_t * pMqttContext,
     MQTTQoS_t qos = MQTTQoS0;
     size_t maxRecordCount = MQTT_INVALID_STATE_COUNT;
     size_t recordIndex = MQTT_INVALID_STATE_COUNT;
+    size_t * pRecordEnd = NULL;
 
     MQTTPubAckInfo_t * records = NULL;
     MQTTStatus_t status = MQTTBadResponse;
@@ -1041,11 +1220,13 @@ MQTTStatus_t MQTT_UpdateStateAck( const MQTTContext_t * pMqttContext,
         {
             records = pMqttContext->outgoingPublishRecords;
             maxRecordCount = pMqttContext->outgoingPublishRecordMaxCount;
+            pRecordEnd = &pMqttContext->outgoingPublishRecordEnd;
         }
         else
         {
             records = pMqttContext->incomingPublishRecords;
             maxRecordCount = pMqttContext->incomingPublishRecordMaxCount;
+            pRecordEnd = &pMqttContext->incomingPublishRecordEnd;
         }
 
         recordIndex = findInRecord( records,
@@ -1062,6 +1243,7 @@ MQTTStatus_t MQTT_UpdateStateAck( const MQTTContext_t * pMqttContext,
         /* Validate state transition and update state record. */
         status = updateStateAck( records,
                                  maxRecordCount,
+                                 pRecordEnd,
                                  recordIndex,
                                  packetId,
                                  currentState,
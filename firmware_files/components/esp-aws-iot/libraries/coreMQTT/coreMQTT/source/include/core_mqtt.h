@@ -157,10 +157,14 @@ typedef enum MQTTSubAckStatus
 /**
  * @ingroup mqtt_struct_types
  * @brief An element of the state engine records for QoS 1 or Qos 2 publishes.
+ *
+ * Besides the record itself, every element holds one slot of a packet ID
+ * index over the array, so that acks find their record without a scan.
  */
 typedef struct MQTTPubAckInfo
 {
     uint16_t packetId;               /**< @brief The packet ID of the original PUBLISH. */
+    uint16_t indexEntry;             /**< @brief Packet ID index slot, owned by the state engine. */
     MQTTQoS_t qos;                   /**< @brief The QoS of the original PUBLISH. */
     MQTTPublishState_t publishState; /**< @brief The current state of the publish process. */
 } MQTTPubAckInfo_t;
@@ -191,6 +195,16 @@ typedef struct MQTTContext
      */
     size_t incomingPublishRecordMaxCount;
 
+    /**
+     * @brief Outgoing publish records at or after this index are unused.
+     */
+    size_t outgoingPublishRecordEnd;
+
+    /**
+     * @brief Incoming publish records at or after this index are unused.
+     */
+    size_t incomingPublishRecordEnd;
+
     /**
      * @brief The transport interface used by the MQTT connection.
      */
@@ -356,6 +370,9 @@ MQTTStatus_t MQTT_Init( MQTTContext_t * pContext,
  * @param[in] incomingPublishCount Maximum number of records which can be kept in the memory
  * pointed to by @p pIncomingPublishRecords.
  *
+ * @note The record arrays must be zero-initialized before first use. At most
+ * UINT16_MAX records can be kept in each array.
+ *
  * @return #MQTTBadParameter if invalid parameters are passed;
  * #MQTTSuccess otherwise.
  *
@@ -380,7 +397,7 @@ MQTTStatus_t MQTT_Init( MQTTContext_t * pContext,
  * MQTTFixedBuffer_t fixedBuffer;
  * uint8_t buffer[ 1024 ];
  * const size_t outgoingPublishCount = 30;
- * MQTTPubAckInfo_t outgoingPublishes[ outgoingPublishCount ];
+ * MQTTPubAckInfo_t outgoingPublishes[ outgoingPublishCount ] = { 0 };
  *
  * // Clear context.
  * memset( ( void * ) &mqttContext, 0x00, sizeof( MQTTContext_t ) );
@@ -113,6 +113,61 @@ static void resetPublishRecords( MQTTContext_t * pMqttContext )
         pMqttContext->incomingPublishRecords[ i ].packetId = MQTT_PACKET_ID_INVALID;
         pMqttContext->incomingPublishRecords[ i ].qos = MQTTQoS0;
         pMqttContext->incomingPublishRecords[ i ].publishState = MQTTStateNull;
+        pMqttContext->outgoingPublishRecords[ i ].indexEntry = 0;
+        pMqttContext->incomingPublishRecords[ i ].indexEntry = 0;
+    }
+
+    pMqttContext->outgoingPublishRecordEnd = 0;
+    pMqttContext->incomingPublishRecordEnd = 0;
+}
+
+static void rebuildIndex( MQTTPubAckInfo_t * records,
+                          size_t recordCount,
+                          size_t * pRecordEnd )
+{
+    size_t i;
+    size_t slot;
+
+    for( i = 0; i < recordCount; i++ )
+    {
+        records[ i ].indexEntry = 0;
+    }
+
+    *pRecordEnd = 0;
+
+    for( i = 0; i < recordCount; i++ )
+    {
+        if( records[ i ].packetId != MQTT_PACKET_ID_INVALID )
+        {
+            slot = records[ i ].packetId % recordCount;
+
+            while( records[ slot ].indexEntry != 0 )
+            {
+                slot = ( slot + 1 ) % recordCount;
+            }
+
+            records[ slot ].indexEntry = ( uint16_t ) ( i + 1 );
+            *pRecordEnd = i + 1;
+        }
+    }
+}
+
+/* Tests write records directly; this brings the packet ID index and the
+ * record ends in line with them before calling into the state engine. */
+static void syncRecords( MQTTContext_t * pMqttContext )
+{
+    if( pMqttContext->outgoingPublishRecords != NULL )
+    {
+        rebuildIndex( pMqttContext->outgoingPublishRecords,
+                      pMqttContext->outgoingPublishRecordMaxCount,
+                      &pMqttContext->outgoingPublishRecordEnd );
+    }
+
+    if( pMqttContext->incomingPublishRecords != NULL )
+    {
+        rebuildIndex( pMqttContext->incomingPublishRecords,
+                      pMqttContext->incomingPublishRecordMaxCount,
+                      &pMqttContext->incomingPublishRecordEnd );
     }
 }
 
@@ -195,12 +250,14 @@ void test_MQTT_ReserveState( void )
     mqttContext.outgoingPublishRecords[ 0 ].qos = MQTTQoS1;
     mqttContext.outgoingPublishRecords[ 0 ].publishState = MQTTPublishSend;
 
+    syncRecords( &mqttContext );
     status = MQTT_ReserveState( &mqttContext, PACKET_ID, MQTTQoS1 );
     TEST_ASSERT_EQUAL( MQTTStateCollision, status );
 
 
     /* Test for no memory. */
     fillRecord( mqttContext.outgoingPublishRecords, 2, MQTTQoS1, MQTTPublishSend );
+    syncRecords( &mqttContext );
     status = MQTT_ReserveState( &mqttContext, PACKET_ID, MQTTQoS1 );
     TEST_ASSERT_EQUAL( MQTTNoMemory, status );
 
@@ -218,6 +275,7 @@ void test_MQTT_ReserveState( void )
      * Already an entry exists at index 0. Adding 1 more entry at index 5.
      * The new index used should be 6. */
     addToRecord( mqttContext.outgoingPublishRecords, index, PACKET_ID2, MQTTQoS2, MQTTPubRelSend );
+    syncRecords( &mqttContext );
     status = MQTT_ReserveState( &mqttContext, PACKET_ID3, MQTTQoS1 );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     TEST_ASSERT_EQUAL( PACKET_ID3, mqttContext.outgoingPublishRecords[ index + 1 ].packetId );
@@ -266,6 +324,7 @@ void test_MQTT_RemoveStateRecord_NoRecordFound( void )
     memset( context.outgoingPublishRecords, 0, sizeof( outgoingRecords ) );
 
     /* Any non-zero packet ID. */
+    syncRecords( &context );
     status = MQTT_RemoveStateRecord( &context, 12U );
 
     TEST_ASSERT_EQUAL( MQTTBadParameter, status );
@@ -294,6 +353,7 @@ void test_MQTT_RemoveStateRecord_RecordFoundIncorrectQoS( void )
     context.outgoingPublishRecords[ 0 ].qos = MQTTQoS0;
 
     /* Any non-zero packet ID. */
+    syncRecords( &context );
     status = MQTT_RemoveStateRecord( &context, packetID );
 
     TEST_ASSERT_EQUAL( MQTTBadParameter, status );
@@ -322,6 +382,7 @@ void test_MQTT_RemoveStateRecord_RemoveQoS1Record( void )
     context.outgoingPublishRecords[ 1 ].qos = MQTTQoS1;
 
     /* Any non-zero packet ID. */
+    syncRecords( &context );
     status = MQTT_RemoveStateRecord( &context, packetID );
 
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
@@ -353,6 +414,7 @@ void test_MQTT_RemoveStateRecord_RemoveQoS2Record( void )
     context.outgoingPublishRecords[ 1 ].qos = MQTTQoS2;
 
     /* Any non-zero packet ID. */
+    syncRecords( &context );
     status = MQTT_RemoveStateRecord( &context, packetID );
 
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
@@ -398,6 +460,7 @@ void test_MQTT_ReserveState_compactRecords( void )
                  PACKET_ID,
                  MQTTQoS1,
                  MQTTPubRelSend );
+    syncRecords( &mqttContext );
     status = MQTT_ReserveState( &mqttContext, PACKET_ID2, MQTTQoS1 );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     /* The existing record should be at index 0. */
@@ -420,6 +483,7 @@ void test_MQTT_ReserveState_compactRecords( void )
     fillRecord( mqttContext.outgoingPublishRecords, PACKET_ID2 + 1, MQTTQoS2, MQTTPubRelSend );
     /* Invalid record at index 3. */
     mqttContext.outgoingPublishRecords[ 3 ].packetId = MQTT_PACKET_ID_INVALID;
+    syncRecords( &mqttContext );
     status = MQTT_ReserveState( &mqttContext, PACKET_ID, MQTTQoS1 );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     /* The new record should be added to the end. */
@@ -443,6 +507,7 @@ void test_MQTT_ReserveState_compactRecords( void )
     mqttContext.outgoingPublishRecords[ 5 ].packetId = MQTT_PACKET_ID_INVALID;
     mqttContext.outgoingPublishRecords[ 7 ].packetId = MQTT_PACKET_ID_INVALID;
     mqttContext.outgoingPublishRecords[ 9 ].packetId = MQTT_PACKET_ID_INVALID;
+    syncRecords( &mqttContext );
     status = MQTT_ReserveState( &mqttContext, PACKET_ID, MQTTQoS1 );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     /* The new record should be added to the end. */
@@ -473,6 +538,7 @@ void test_MQTT_ReserveState_compactRecords( void )
 
     /* Adding one element should result in array in state
      * 1 1 1 1 1 1 0 0 0 0. */
+    syncRecords( &mqttContext );
     status = MQTT_ReserveState( &mqttContext, PACKET_ID2, MQTTQoS1 );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     validateRecordAt( mqttContext.outgoingPublishRecords, 5, PACKET_ID2, MQTTQoS1, MQTTPublishSend );
@@ -492,6 +558,7 @@ void test_MQTT_ReserveState_compactRecords( void )
     mqttContext.outgoingPublishRecords[ 2 ].packetId = MQTT_PACKET_ID_INVALID;
     mqttContext.outgoingPublishRecords[ 7 ].packetId = MQTT_PACKET_ID_INVALID;
     mqttContext.outgoingPublishRecords[ 8 ].packetId = MQTT_PACKET_ID_INVALID;
+    syncRecords( &mqttContext );
     status = MQTT_ReserveState( &mqttContext, PACKET_ID2, MQTTQoS1 );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     validateRecordAt( mqttContext.outgoingPublishRecords, 6, PACKET_ID2, MQTTQoS1, MQTTPublishSend );
@@ -507,6 +574,7 @@ void test_MQTT_ReserveState_compactRecords( void )
     resetPublishRecords( &mqttContext );
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPubRecPending );
     addToRecord( mqttContext.outgoingPublishRecords, 9, PACKET_ID2 + 1, MQTTQoS2, MQTTPubCompPending );
+    syncRecords( &mqttContext );
     status = MQTT_ReserveState( &mqttContext, PACKET_ID2, MQTTQoS1 );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     validateRecordAt( mqttContext.outgoingPublishRecords, 2, PACKET_ID2, MQTTQoS1, MQTTPublishSend );
@@ -585,17 +653,20 @@ void test_MQTT_UpdateStatePublish( void )
     TEST_ASSERT_EQUAL( MQTTBadParameter, status );
     /* QoS mismatch. */
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPublishSend );
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStatePublish( &mqttContext, PACKET_ID, operation, qos, &state );
     TEST_ASSERT_EQUAL( MQTTBadParameter, status );
 
     /* Invalid state transition. */
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS1, MQTTPubRelPending );
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStatePublish( &mqttContext, PACKET_ID, operation, qos, &state );
     TEST_ASSERT_EQUAL( MQTTIllegalState, status );
 
     /* Invalid QoS. */
     operation = MQTT_SEND;
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, 3, MQTTPublishSend );
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStatePublish( &mqttContext, PACKET_ID, operation, 3, &state );
     TEST_ASSERT_EQUAL( MQTTIllegalState, status );
     operation = MQTT_RECEIVE;
@@ -605,18 +676,21 @@ void test_MQTT_UpdateStatePublish( void )
     /* Invalid current state. */
     operation = MQTT_SEND;
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, qos, MQTTStateNull );
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStatePublish( &mqttContext, PACKET_ID, operation, qos, &state );
     TEST_ASSERT_EQUAL( MQTTIllegalState, status );
 
     /* Collision. */
     operation = MQTT_RECEIVE;
     addToRecord( mqttContext.incomingPublishRecords, 0, PACKET_ID, MQTTQoS1, MQTTPubAckSend );
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStatePublish( &mqttContext, PACKET_ID, operation, qos, &state );
     TEST_ASSERT_EQUAL( MQTTStateCollision, status );
 
     /* No memory. */
     operation = MQTT_RECEIVE;
     fillRecord( mqttContext.incomingPublishRecords, 2, MQTTQoS1, MQTTPublishSend );
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStatePublish( &mqttContext, PACKET_ID, operation, qos, &state );
     TEST_ASSERT_EQUAL( MQTTNoMemory, status );
 
@@ -627,6 +701,7 @@ void test_MQTT_UpdateStatePublish( void )
     /* Send. */
     operation = MQTT_SEND;
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS1, MQTTPublishSend );
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStatePublish( &mqttContext, PACKET_ID, operation, qos, &state );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     TEST_ASSERT_EQUAL( MQTTPubAckPending, state );
@@ -655,6 +730,7 @@ void test_MQTT_UpdateStatePublish( void )
     /* Send. */
     operation = MQTT_SEND;
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPublishSend );
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStatePublish( &mqttContext, PACKET_ID, operation, qos, &state );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     TEST_ASSERT_EQUAL( MQTTPubRecPending, state );
@@ -677,6 +753,7 @@ void test_MQTT_UpdateStatePublish( void )
     TEST_ASSERT_EQUAL( MQTTPubRecSend, mqttContext.incomingPublishRecords[ 0 ].publishState );
     /* Receive incoming publish when the packet record is in state #MQTTPubRelPending. */
     addToRecord( mqttContext.incomingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPubRelPending );
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStatePublish( &mqttContext, PACKET_ID, operation, qos, &state );
     TEST_ASSERT_EQUAL( MQTTStateCollision, status );
     /* The returned state will always be #MQTTPubRecSend as a PUBREC need to be sent. */
@@ -791,21 +868,25 @@ void test_MQTT_UpdateStateAck( void )
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPubRelPending );
     ack = MQTTPubrel;
     operation = MQTT_SEND;
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, PACKET_ID, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTIllegalState, status );
     /* Invalid transition from #MQTTPubCompSend. */
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPubCompSend );
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, PACKET_ID, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTIllegalState, status );
     /* Invalid transition from #MQTTPubCompPending. */
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPubCompPending );
     ack = MQTTPubrec;
     operation = MQTT_RECEIVE;
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, PACKET_ID, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTIllegalState, status );
     /* Invalid transition from #MQTTPubRecPending. */
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPubRecPending );
     ack = MQTTPubcomp;
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, 1, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTIllegalState, status );
 
@@ -815,12 +896,15 @@ void test_MQTT_UpdateStateAck( void )
 
     /* Invalid current state. */
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPublishDone );
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, PACKET_ID, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTIllegalState, status );
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPublishSend );
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, PACKET_ID, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTIllegalState, status );
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTStateNull );
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, PACKET_ID, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTIllegalState, status );
 
@@ -830,6 +914,7 @@ void test_MQTT_UpdateStateAck( void )
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS1, MQTTPubAckPending );
     operation = MQTT_RECEIVE;
     ack = MQTTPuback;
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, PACKET_ID, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     TEST_ASSERT_EQUAL( MQTTPublishDone, state );
@@ -839,6 +924,7 @@ void test_MQTT_UpdateStateAck( void )
     /* Send PUBACK for incoming publish. */
     operation = MQTT_SEND;
     addToRecord( mqttContext.incomingPublishRecords, 0, PACKET_ID, MQTTQoS1, MQTTPubAckSend );
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, PACKET_ID, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     TEST_ASSERT_EQUAL( MQTTPublishDone, state );
@@ -850,6 +936,7 @@ void test_MQTT_UpdateStateAck( void )
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPubRelSend );
     operation = MQTT_SEND;
     ack = MQTTPubrel;
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, PACKET_ID, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     TEST_ASSERT_EQUAL( MQTTPubCompPending, state );
@@ -862,6 +949,7 @@ void test_MQTT_UpdateStateAck( void )
     /* Incoming. */
     addToRecord( mqttContext.incomingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPubRelPending );
     operation = MQTT_RECEIVE;
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, PACKET_ID, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     TEST_ASSERT_EQUAL( MQTTPubCompSend, state );
@@ -877,6 +965,7 @@ void test_MQTT_UpdateStateAck( void )
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPubRecPending );
     operation = MQTT_RECEIVE;
     ack = MQTTPubrec;
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, PACKET_ID, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     TEST_ASSERT_EQUAL( MQTTPubRelSend, state );
@@ -893,6 +982,7 @@ void test_MQTT_UpdateStateAck( void )
     resetPublishRecords( &mqttContext );
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPubRecPending );
     addToRecord( mqttContext.outgoingPublishRecords, 1, PACKET_ID + 1, MQTTQoS2, MQTTPubRelSend );
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, PACKET_ID, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     TEST_ASSERT_EQUAL( MQTTPubRelSend, state );
@@ -908,11 +998,13 @@ void test_MQTT_UpdateStateAck( void )
     /* Incoming. */
     addToRecord( mqttContext.incomingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPubRecSend );
     operation = MQTT_SEND;
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, PACKET_ID, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     TEST_ASSERT_EQUAL( MQTTPubRelPending, state );
     /* Incoming. Duplicate publish received and record is in state #MQTTPubRelPending. */
     addToRecord( mqttContext.incomingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPubRelPending );
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, PACKET_ID, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     TEST_ASSERT_EQUAL( MQTTPubRelPending, state );
@@ -922,12 +1014,14 @@ void test_MQTT_UpdateStateAck( void )
     addToRecord( mqttContext.outgoingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPubCompPending );
     operation = MQTT_RECEIVE;
     ack = MQTTPubcomp;
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, PACKET_ID, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     TEST_ASSERT_EQUAL( MQTTPublishDone, state );
     /* Incoming. */
     addToRecord( mqttContext.incomingPublishRecords, 0, PACKET_ID, MQTTQoS2, MQTTPubCompSend );
     operation = MQTT_SEND;
+    syncRecords( &mqttContext );
     status = MQTT_UpdateStateAck( &mqttContext, PACKET_ID, ack, operation, &state );
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     TEST_ASSERT_EQUAL( MQTTPublishDone, state );
@@ -935,6 +1029,102 @@ void test_MQTT_UpdateStateAck( void )
 
 /* ========================================================================== */
 
+void test_MQTT_UpdateStateAck_packetIdIndex( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTPublishState_t state = MQTTStateNull;
+    MQTTStatus_t status;
+    TransportInterface_t transport;
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    /* 9, 19 and 29 share index slot 9 and wrap around to slots 0 and 1,
+     * pushing 10 out of its own slot 0. */
+    const uint16_t packetIds[] = { 9, 19, 29, 10 };
+    const size_t packetIdCount = sizeof( packetIds ) / sizeof( packetIds[ 0 ] );
+    size_t i;
+
+    transport.recv = transportRecvSuccess;
+    transport.send = transportSendSuccess;
+
+    MQTTPubAckInfo_t incomingRecords[ MQTT_STATE_ARRAY_MAX_COUNT ] = { 0 };
+    MQTTPubAckInfo_t outgoingRecords[ MQTT_STATE_ARRAY_MAX_COUNT ] = { 0 };
+
+    status = MQTT_Init( &mqttContext, &transport,
+                        getTime, eventCallback, &networkBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+
+    status = MQTT_InitStatefulQoS( &mqttContext,
+                                   outgoingRecords, MQTT_STATE_ARRAY_MAX_COUNT,
+                                   incomingRecords, MQTT_STATE_ARRAY_MAX_COUNT );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+
+    for( i = 0; i < packetIdCount; i++ )
+    {
+        status = MQTT_ReserveState( &mqttContext, packetIds[ i ], MQTTQoS1 );
+        TEST_ASSERT_EQUAL( MQTTSuccess, status );
+        status = MQTT_UpdateStatePublish( &mqttContext, packetIds[ i ], MQTT_SEND, MQTTQoS1, &state );
+        TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    }
+
+    /* Records stay in the order they were reserved. */
+    for( i = 0; i < packetIdCount; i++ )
+    {
+        validateRecordAt( mqttContext.outgoingPublishRecords, i, packetIds[ i ], MQTTQoS1, MQTTPubAckPending );
+    }
+
+    /* Removing the head of the probe sequence must not hide the others. */
+    status = MQTT_UpdateStateAck( &mqttContext, 9, MQTTPuback, MQTT_RECEIVE, &state );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( MQTTPublishDone, state );
+    status = MQTT_UpdateStateAck( &mqttContext, 29, MQTTPuback, MQTT_RECEIVE, &state );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    status = MQTT_UpdateStateAck( &mqttContext, 10, MQTTPuback, MQTT_RECEIVE, &state );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    status = MQTT_UpdateStateAck( &mqttContext, 19, MQTTPuback, MQTT_RECEIVE, &state );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+
+    /* A second ack finds no record. */
+    status = MQTT_UpdateStateAck( &mqttContext, 19, MQTTPuback, MQTT_RECEIVE, &state );
+    TEST_ASSERT_EQUAL( MQTTBadResponse, status );
+
+    for( i = 0; i < MQTT_STATE_ARRAY_MAX_COUNT; i++ )
+    {
+        TEST_ASSERT_EQUAL( MQTT_PACKET_ID_INVALID, mqttContext.outgoingPublishRecords[ i ].packetId );
+        TEST_ASSERT_EQUAL( 0, mqttContext.outgoingPublishRecords[ i ].indexEntry );
+    }
+
+    /* Fill all records with packet IDs that share one index slot, then
+     * acknowledge them in reverse order. */
+    for( i = 0; i < MQTT_STATE_ARRAY_MAX_COUNT; i++ )
+    {
+        status = MQTT_ReserveState( &mqttContext, ( uint16_t ) ( ( i + 1 ) * MQTT_STATE_ARRAY_MAX_COUNT ), MQTTQoS2 );
+        TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    }
+
+    status = MQTT_ReserveState( &mqttContext, 1, MQTTQoS2 );
+    TEST_ASSERT_EQUAL( MQTTNoMemory, status );
+    status = MQTT_ReserveState( &mqttContext, MQTT_STATE_ARRAY_MAX_COUNT, MQTTQoS2 );
+    TEST_ASSERT_EQUAL( MQTTStateCollision, status );
+
+    for( i = MQTT_STATE_ARRAY_MAX_COUNT; i > 0; i-- )
+    {
+        status = MQTT_RemoveStateRecord( &mqttContext, ( uint16_t ) ( i * MQTT_STATE_ARRAY_MAX_COUNT ) );
+        TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    }
+
+    for( i = 0; i < MQTT_STATE_ARRAY_MAX_COUNT; i++ )
+    {
+        TEST_ASSERT_EQUAL( MQTT_PACKET_ID_INVALID, mqttContext.outgoingPublishRecords[ i ].packetId );
+        TEST_ASSERT_EQUAL( 0, mqttContext.outgoingPublishRecords[ i ].indexEntry );
+    }
+
+    /* The freed records are reused from the start. */
+    status = MQTT_ReserveState( &mqttContext, 1, MQTTQoS1 );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    validateRecordAt( mqttContext.outgoingPublishRecords, 0, 1, MQTTQoS1, MQTTPublishSend );
+}
+
+/* ========================================================================== */
+
 void test_MQTT_AckToResend( void )
 {
     MQTTContext_t mqttContext = { 0 };
@@ -987,6 +1177,7 @@ void test_MQTT_AckToResend( void )
     cursor = MQTT_STATE_CURSOR_INITIALIZER;
     addToRecord( mqttContext.outgoingPublishRecords, index, PACKET_ID3, MQTTQoS2, MQTTPubRelPending );
     addToRecord( mqttContext.outgoingPublishRecords, index2, PACKET_ID4, MQTTQoS2, MQTTPubCompSend );
+    syncRecords( &mqttContext );
     packetId = MQTT_PubrelToResend( &mqttContext, &cursor, &state );
     TEST_ASSERT_EQUAL( MQTT_PACKET_ID_INVALID, packetId );
     TEST_ASSERT_EQUAL( MQTTStateNull, state );
@@ -995,6 +1186,7 @@ void test_MQTT_AckToResend( void )
     /* Add a record in #MQTTPubCompPending state. */
     cursor = MQTT_STATE_CURSOR_INITIALIZER;
     addToRecord( mqttContext.outgoingPublishRecords, index3, PACKET_ID, MQTTQoS2, MQTTPubCompPending );
+    syncRecords( &mqttContext );
     packetId = MQTT_PubrelToResend( &mqttContext, &cursor, &state );
     TEST_ASSERT_EQUAL( PACKET_ID, packetId );
     TEST_ASSERT_EQUAL( index3 + 1, cursor );
@@ -1002,6 +1194,7 @@ void test_MQTT_AckToResend( void )
 
     /* Add another record in #MQTTPubCompPending state. */
     addToRecord( mqttContext.outgoingPublishRecords, index4, PACKET_ID2, MQTTQoS2, MQTTPubCompPending );
+    syncRecords( &mqttContext );
     packetId = MQTT_PubrelToResend( &mqttContext, &cursor, &state );
     TEST_ASSERT_EQUAL( PACKET_ID2, packetId );
     TEST_ASSERT_EQUAL( index4 + 1, cursor );
@@ -1009,6 +1202,7 @@ void test_MQTT_AckToResend( void )
 
     /* Add another record in #MQTTPubRelSend state. */
     addToRecord( mqttContext.outgoingPublishRecords, index4 + 1, PACKET_ID2 + 1, MQTTQoS2, MQTTPubRelSend );
+    syncRecords( &mqttContext );
     packetId = MQTT_PubrelToResend( &mqttContext, &cursor, &state );
     TEST_ASSERT_EQUAL( PACKET_ID2 + 1, packetId );
     TEST_ASSERT_EQUAL( index4 + 2, cursor );
@@ -1018,6 +1212,7 @@ void test_MQTT_AckToResend( void )
     resetPublishRecords( &mqttContext );
     cursor = MQTT_STATE_CURSOR_INITIALIZER;
     addToRecord( mqttContext.outgoingPublishRecords, index3, PACKET_ID, MQTTQoS2, MQTTPubRelSend );
+    syncRecords( &mqttContext );
     packetId = MQTT_PubrelToResend( &mqttContext, &cursor, &state );
     TEST_ASSERT_EQUAL( PACKET_ID, packetId );
     TEST_ASSERT_EQUAL( index3 + 1, cursor );
@@ -1082,6 +1277,7 @@ void test_MQTT_PublishToResend( void )
     cursor = MQTT_STATE_CURSOR_INITIALIZER;
     addToRecord( mqttContext.outgoingPublishRecords, index, PACKET_ID3, MQTTQoS2, MQTTPubCompPending );
     addToRecord( mqttContext.outgoingPublishRecords, index2, PACKET_ID4, MQTTQoS2, MQTTPubRelSend );
+    syncRecords( &mqttContext );
     packetId = MQTT_PublishToResend( &mqttContext, &cursor );
     TEST_ASSERT_EQUAL( MQTT_PACKET_ID_INVALID, packetId );
     TEST_ASSERT_EQUAL( MQTT_STATE_ARRAY_MAX_COUNT, cursor );
@@ -1089,18 +1285,21 @@ void test_MQTT_PublishToResend( void )
     /* Add a record in #MQTTPublishSend state. */
     cursor = MQTT_STATE_CURSOR_INITIALIZER;
     addToRecord( mqttContext.outgoingPublishRecords, index3, PACKET_ID, MQTTQoS2, MQTTPublishSend );
+    syncRecords( &mqttContext );
     packetId = MQTT_PublishToResend( &mqttContext, &cursor );
     TEST_ASSERT_EQUAL( PACKET_ID, packetId );
     TEST_ASSERT_EQUAL( index3 + 1, cursor );
 
     /* Add another record in #MQTTPubAckPending state. */
     addToRecord( mqttContext.outgoingPublishRecords, index4, PACKET_ID2, MQTTQoS1, MQTTPubAckPending );
+    syncRecords( &mqttContext );
     packetId = MQTT_PublishToResend( &mqttContext, &cursor );
     TEST_ASSERT_EQUAL( PACKET_ID2, packetId );
     TEST_ASSERT_EQUAL( index4 + 1, cursor );
 
     /* Add another record in #MQTTPubRecPending state. */
     addToRecord( mqttContext.outgoingPublishRecords, index4 + 1, PACKET_ID2 + 1, MQTTQoS2, MQTTPubRecPending );
+    syncRecords( &mqttContext );
     packetId = MQTT_PublishToResend( &mqttContext, &cursor );
     TEST_ASSERT_EQUAL( PACKET_ID2 + 1, packetId );
     TEST_ASSERT_EQUAL( index4 + 2, cursor );
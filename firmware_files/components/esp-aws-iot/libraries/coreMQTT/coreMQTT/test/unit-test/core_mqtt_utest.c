@@ -6007,3 +6007,39 @@ void test_MQTT_InitStatefulQoS_callback_is_null( void )
     TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
 }
 /* ========================================================================== */
+
+void test_MQTT_InitStatefulQoS_too_many_records( void )
+{
+    MQTTStatus_t mqttStatus;
+    MQTTPubAckInfo_t pOutgoingPublishRecords[ 10 ] = { 0 };
+    MQTTPubAckInfo_t pIncomingPublishRecords[ 10 ] = { 0 };
+
+    MQTTContext_t mqttContext = { 0 };
+
+    mqttContext.appCallback = eventCallback;
+
+    /* Records are indexed by 16-bit position. */
+    mqttStatus = MQTT_InitStatefulQoS( &mqttContext,
+                                       pOutgoingPublishRecords,
+                                       ( size_t ) UINT16_MAX + 1U,
+                                       pIncomingPublishRecords,
+                                       10 );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    mqttStatus = MQTT_InitStatefulQoS( &mqttContext,
+                                       pOutgoingPublishRecords,
+                                       10,
+                                       pIncomingPublishRecords,
+                                       ( size_t ) UINT16_MAX + 1U );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, mqttStatus );
+
+    mqttStatus = MQTT_InitStatefulQoS( &mqttContext,
+                                       pOutgoingPublishRecords,
+                                       10,
+                                       pIncomingPublishRecords,
+                                       10 );
+    TEST_ASSERT_EQUAL( MQTTSuccess, mqttStatus );
+    TEST_ASSERT_EQUAL( 10, mqttContext.outgoingPublishRecordEnd );
+    TEST_ASSERT_EQUAL( 10, mqttContext.incomingPublishRecordEnd );
+}
+/* ========================================================================== */
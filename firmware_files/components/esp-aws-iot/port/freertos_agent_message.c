@@ -0,0 +1,174 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ * Additions Copyright 2016 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file freertos_agent_message.c
+ * @brief coreMQTT-Agent message interface backed by a lock-free ring.
+ *
+ * Bounded multi-producer ring with a sequence number per slot. A slot whose
+ * sequence equals a producer's position is free for that position; once the
+ * command is stored the sequence is advanced by one, which publishes it to
+ * the agent task. The agent hands the slot back by advancing the sequence to
+ * the position of the next lap.
+ *
+ * A producer that is preempted between claiming and filling a slot holds up
+ * the commands behind it until it runs again; the agent simply waits for it
+ * like it would for an empty ring.
+ */
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "freertos_agent_message.h"
+
+#define RING_MASK ((uint32_t) AGENT_MESSAGE_RING_SIZE - 1U)
+
+_Static_assert((AGENT_MESSAGE_RING_SIZE & (AGENT_MESSAGE_RING_SIZE - 1)) == 0,
+               "AGENT_MESSAGE_RING_SIZE must be a power of two");
+_Static_assert(AGENT_MESSAGE_RING_SIZE >= MQTT_AGENT_COMMAND_QUEUE_LENGTH,
+               "the message ring must hold MQTT_AGENT_COMMAND_QUEUE_LENGTH commands");
+
+static bool ring_push(MQTTAgentMessageContext_t *pMsgCtx, MQTTAgentCommand_t *pCommand) {
+    uint32_t pos = atomic_load_explicit(&pMsgCtx->head, memory_order_relaxed);
+    AgentMessageSlot_t *pSlot;
+    int32_t diff;
+
+    for(;;) {
+        pSlot = &pMsgCtx->slots[pos & RING_MASK];
+        diff = (int32_t) (atomic_load_explicit(&pSlot->sequence, memory_order_acquire) - pos);
+
+        if(0 == diff) {
+            /* Free for this position, try to claim it. On failure pos is
+             * reloaded with the position another producer left behind. */
+            if(atomic_compare_exchange_weak_explicit(&pMsgCtx->head, &pos, pos + 1U,
+                                                     memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if(diff < 0) {
+            /* The agent has not consumed this slot from the previous lap yet. */
+            return false;
+        } else {
+            /* Another producer claimed it first. */
+            pos = atomic_load_explicit(&pMsgCtx->head, memory_order_relaxed);
+        }
+    }
+
+    pSlot->pCommand = pCommand;
+    atomic_store_explicit(&pSlot->sequence, pos + 1U, memory_order_release);
+
+    /* Pairs with the fence in Agent_MessageReceive: either the agent sees
+     * this command before it sleeps, or this task sees it asleep. */
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(&pMsgCtx->consumerWaiting, memory_order_relaxed)) {
+        xSemaphoreGive(pMsgCtx->wakeup);
+    }
+
+    return true;
+}
+
+static bool ring_pop(MQTTAgentMessageContext_t *pMsgCtx, MQTTAgentCommand_t **pCommand) {
+    uint32_t pos = pMsgCtx->tail;
+    AgentMessageSlot_t *pSlot = &pMsgCtx->slots[pos & RING_MASK];
+
+    if(atomic_load_explicit(&pSlot->sequence, memory_order_acquire) != pos + 1U) {
+        return false;
+    }
+
+    *pCommand = pSlot->pCommand;
+    atomic_store_explicit(&pSlot->sequence, pos + AGENT_MESSAGE_RING_SIZE, memory_order_release);
+    pMsgCtx->tail = pos + 1U;
+
+    return true;
+}
+
+void Agent_MessageInit(MQTTAgentMessageContext_t *pMsgCtx) {
+    uint32_t i;
+
+    memset(pMsgCtx, 0, sizeof(*pMsgCtx));
+
+    for(i = 0; i < AGENT_MESSAGE_RING_SIZE; i++) {
+        atomic_init(&pMsgCtx->slots[i].sequence, i);
+    }
+    atomic_init(&pMsgCtx->head, 0U);
+    atomic_init(&pMsgCtx->consumerWaiting, false);
+
+    pMsgCtx->wakeup = xSemaphoreCreateBinaryStatic(&pMsgCtx->wakeupStorage);
+}
+
+bool Agent_MessageSend(MQTTAgentMessageContext_t *pMsgCtx, MQTTAgentCommand_t * const *pCommandToSend,
+                       uint32_t blockTimeMs) {
+    TimeOut_t timeOut;
+    TickType_t ticksToWait = pdMS_TO_TICKS(blockTimeMs);
+
+    if((NULL == pMsgCtx) || (NULL == pCommandToSend)) {
+        return false;
+    }
+
+    if(ring_push(pMsgCtx, *pCommandToSend)) {
+        return true;
+    }
+
+    /* Only reachable if commands are posted that did not come from the pool,
+     * which is never larger than the ring. Poll until the agent catches up. */
+    vTaskSetTimeOutState(&timeOut);
+    while(xTaskCheckForTimeOut(&timeOut, &ticksToWait) == pdFALSE) {
+        vTaskDelay(1);
+        if(ring_push(pMsgCtx, *pCommandToSend)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Agent_MessageReceive(MQTTAgentMessageContext_t *pMsgCtx, MQTTAgentCommand_t **pReceivedCommand,
+                          uint32_t blockTimeMs) {
+    TimeOut_t timeOut;
+    TickType_t ticksToWait = pdMS_TO_TICKS(blockTimeMs);
+    bool received;
+
+    if((NULL == pMsgCtx) || (NULL == pReceivedCommand)) {
+        return false;
+    }
+
+    if(ring_pop(pMsgCtx, pReceivedCommand)) {
+        return true;
+    }
+
+    vTaskSetTimeOutState(&timeOut);
+    while(xTaskCheckForTimeOut(&timeOut, &ticksToWait) == pdFALSE) {
+        atomic_store_explicit(&pMsgCtx->consumerWaiting, true, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        /* Check again now that producers will wake us up. */
+        received = ring_pop(pMsgCtx, pReceivedCommand);
+        if(!received) {
+            xSemaphoreTake(pMsgCtx->wakeup, ticksToWait);
+            received = ring_pop(pMsgCtx, pReceivedCommand);
+        }
+
+        atomic_store_explicit(&pMsgCtx->consumerWaiting, false, memory_order_relaxed);
+
+        if(received) {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ * Additions Copyright 2016 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file freertos_command_pool.c
+ * @brief Static pool of coreMQTT-Agent commands.
+ *
+ * Free commands are tracked in a bitmap that is claimed and released with
+ * atomic operations, so tasks on both cores take commands without a lock.
+ * A task that finds the pool empty sleeps on a counting semaphore, which is
+ * only given while someone is waiting.
+ */
+
+#include <stdatomic.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "core_mqtt_agent_config.h"
+#include "freertos_command_pool.h"
+
+#define POOL_WORD_BITS  32U
+#define POOL_WORD_COUNT ((MQTT_COMMAND_CONTEXTS_POOL_SIZE + POOL_WORD_BITS - 1U) / POOL_WORD_BITS)
+
+static const char *TAG = "command_pool";
+
+static MQTTAgentCommand_t commandStructurePool[MQTT_COMMAND_CONTEXTS_POOL_SIZE];
+
+/* Set bits mark free commands. */
+static atomic_uint_least32_t freeCommandBits[POOL_WORD_COUNT];
+
+/* Tasks blocked in Agent_GetCommand. */
+static atomic_uint_least32_t waitingTasks;
+static StaticSemaphore_t commandReleasedStorage;
+static SemaphoreHandle_t commandReleased = NULL;
+
+static MQTTAgentCommand_t *pool_take(void) {
+    uint32_t bits;
+    size_t word;
+    unsigned int bit;
+
+    for(word = 0; word < POOL_WORD_COUNT; word++) {
+        bits = atomic_load_explicit(&freeCommandBits[word], memory_order_relaxed);
+        while(0U != bits) {
+            bit = (unsigned int) __builtin_ctz(bits);
+            /* On failure bits is reloaded with the current value of the word. */
+            if(atomic_compare_exchange_weak_explicit(&freeCommandBits[word], &bits, bits & ~((uint32_t) 1U << bit),
+                                                     memory_order_acquire, memory_order_relaxed)) {
+                return &commandStructurePool[word * POOL_WORD_BITS + bit];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void Agent_InitializePool(void) {
+    size_t i;
+
+    if(NULL != commandReleased) {
+        return;
+    }
+
+    memset(commandStructurePool, 0, sizeof(commandStructurePool));
+
+    for(i = 0; i < POOL_WORD_COUNT; i++) {
+        atomic_init(&freeCommandBits[i], 0U);
+    }
+    for(i = 0; i < MQTT_COMMAND_CONTEXTS_POOL_SIZE; i++) {
+        freeCommandBits[i / POOL_WORD_BITS] |= (uint32_t) 1U << (i % POOL_WORD_BITS);
+    }
+    atomic_init(&waitingTasks, 0U);
+
+    commandReleased = xSemaphoreCreateCountingStatic(MQTT_COMMAND_CONTEXTS_POOL_SIZE, 0, &commandReleasedStorage);
+}
+
+MQTTAgentCommand_t *Agent_GetCommand(uint32_t blockTimeMs) {
+    MQTTAgentCommand_t *pCommand;
+    TimeOut_t timeOut;
+    TickType_t ticksToWait = pdMS_TO_TICKS(blockTimeMs);
+
+    if(NULL == commandReleased) {
+        ESP_LOGE(TAG, "Agent_GetCommand: pool used before Agent_InitializePool");
+        return NULL;
+    }
+
+    pCommand = pool_take();
+    if(NULL != pCommand) {
+        return pCommand;
+    }
+
+    vTaskSetTimeOutState(&timeOut);
+    while(xTaskCheckForTimeOut(&timeOut, &ticksToWait) == pdFALSE) {
+        atomic_fetch_add_explicit(&waitingTasks, 1U, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        /* Check again now that releases will wake us up. */
+        pCommand = pool_take();
+        if(NULL == pCommand) {
+            xSemaphoreTake(commandReleased, ticksToWait);
+            pCommand = pool_take();
+        }
+
+        atomic_fetch_sub_explicit(&waitingTasks, 1U, memory_order_relaxed);
+
+        if(NULL != pCommand) {
+            return pCommand;
+        }
+    }
+
+    ESP_LOGW(TAG, "Agent_GetCommand: no command structure free after %u ms", (unsigned int) blockTimeMs);
+    return NULL;
+}
+
+bool Agent_ReleaseCommand(MQTTAgentCommand_t *pCommandToRelease) {
+    size_t index;
+    uint32_t mask;
+
+    if((pCommandToRelease < &commandStructurePool[0]) ||
+       (pCommandToRelease > &commandStructurePool[MQTT_COMMAND_CONTEXTS_POOL_SIZE - 1])) {
+        return false;
+    }
+
+    index = (size_t) (pCommandToRelease - commandStructurePool);
+    mask = (uint32_t) 1U << (index % POOL_WORD_BITS);
+
+    if(atomic_load_explicit(&freeCommandBits[index / POOL_WORD_BITS], memory_order_relaxed) & mask) {
+        ESP_LOGE(TAG, "Agent_ReleaseCommand: command %p is already free", (void *) pCommandToRelease);
+        return false;
+    }
+
+    memset(pCommandToRelease, 0, sizeof(*pCommandToRelease));
+    atomic_fetch_or_explicit(&freeCommandBits[index / POOL_WORD_BITS], mask, memory_order_release);
+
+    /* Pairs with the fence in Agent_GetCommand: either the waiting task sees
+     * this command, or this task sees it waiting. */
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(&waitingTasks, memory_order_relaxed) > 0U) {
+        xSemaphoreGive(commandReleased);
+    }
+
+    return true;
+}
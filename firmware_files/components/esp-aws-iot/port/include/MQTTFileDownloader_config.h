@@ -0,0 +1,21 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+/* MQTT file streams configuration for the ESP-IDF port. */
+
+/* One block per 4 KB flash sector, so a block can be erased and written on
+   its own whatever order blocks arrive in. The MQTT network buffer has to
+   hold a whole block message. */
+#define mqttFileDownloader_CONFIG_BLOCK_SIZE 4096U
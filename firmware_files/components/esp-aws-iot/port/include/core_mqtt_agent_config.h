@@ -0,0 +1,32 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include "sdkconfig.h"
+#include "core_mqtt_config.h"
+
+/* coreMQTT-Agent configuration for the ESP-IDF port. */
+
+/* Number of commands that can be queued to the agent at once. */
+#define MQTT_AGENT_COMMAND_QUEUE_LENGTH CONFIG_AWS_IOT_MQTT_AGENT_COMMAND_QUEUE_LEN
+
+/* Every queued command needs a structure from the pool, so size them together. */
+#define MQTT_COMMAND_CONTEXTS_POOL_SIZE CONFIG_AWS_IOT_MQTT_AGENT_COMMAND_QUEUE_LEN
+
+/* QoS 1 publishes and (un)subscribes waiting for their acknowledgement. */
+#define MQTT_AGENT_MAX_OUTSTANDING_ACKS CONFIG_AWS_IOT_MQTT_AGENT_MAX_OUTSTANDING_ACKS
+
+/* Longest time the agent waits for a command before it services the socket,
+   which bounds the latency of incoming publishes while the device is idle. */
+#define MQTT_AGENT_MAX_EVENT_QUEUE_WAIT_TIME 50U
@@ -0,0 +1,42 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include "esp_log.h"
+
+/* coreMQTT configuration for the ESP-IDF port.
+
+   The library passes log messages as a parenthesised printf argument list,
+   e.g. LogError( ( "Bad packet %d", x ) ), so the macros below simply prepend
+   the IDF log call to that list.
+*/
+#define CORE_MQTT_LOG_ERROR(format, ...) ESP_LOGE("coreMQTT", format, ##__VA_ARGS__)
+#define CORE_MQTT_LOG_WARN(format, ...) ESP_LOGW("coreMQTT", format, ##__VA_ARGS__)
+#define CORE_MQTT_LOG_INFO(format, ...) ESP_LOGI("coreMQTT", format, ##__VA_ARGS__)
+#define CORE_MQTT_LOG_DEBUG(format, ...) ESP_LOGD("coreMQTT", format, ##__VA_ARGS__)
+
+#define LogError(message) CORE_MQTT_LOG_ERROR message
+#define LogWarn(message) CORE_MQTT_LOG_WARN message
+#define LogInfo(message) CORE_MQTT_LOG_INFO message
+#define LogDebug(message) CORE_MQTT_LOG_DEBUG message
+
+/* How long MQTT_ProcessLoop keeps polling the transport for the rest of a
+   packet once its first byte has arrived. */
+#define MQTT_RECV_POLLING_TIMEOUT_MS 1000U
+
+/* How long a send may make no progress before the connection is dropped. */
+#define MQTT_SEND_TIMEOUT_MS 5000U
+
+/* AWS IoT answers PINGREQ well within this on a healthy link. */
+#define MQTT_PINGRESP_TIMEOUT_MS 5000U
@@ -0,0 +1,36 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include "esp_log.h"
+
+/* Device Defender configuration for the ESP-IDF port. */
+
+/* Reports use the short keys ("met", "tc", ...), which is what keeps a CBOR
+   report to a few hundred bytes. */
+#define DEFENDER_USE_LONG_KEYS 0
+
+/* Files that also include core_mqtt_config.h get its log macros, which take
+   the same parenthesised argument list. */
+#ifndef LogError
+#define LogError(message) DEFENDER_LOG_ERROR message
+#define LogWarn(message) DEFENDER_LOG_WARN message
+#define LogInfo(message) DEFENDER_LOG_INFO message
+#define LogDebug(message) DEFENDER_LOG_DEBUG message
+#endif
+
+#define DEFENDER_LOG_ERROR(format, ...) ESP_LOGE("defender", format, ##__VA_ARGS__)
+#define DEFENDER_LOG_WARN(format, ...) ESP_LOGW("defender", format, ##__VA_ARGS__)
+#define DEFENDER_LOG_INFO(format, ...) ESP_LOGI("defender", format, ##__VA_ARGS__)
+#define DEFENDER_LOG_DEBUG(format, ...) ESP_LOGD("defender", format, ##__VA_ARGS__)
@@ -0,0 +1,96 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "core_mqtt_agent_config.h"
+#include "core_mqtt_agent_message_interface.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Slots in the message ring: MQTT_AGENT_COMMAND_QUEUE_LENGTH rounded up to a
+ * power of two, so positions can wrap around freely. */
+#define AGENT_MESSAGE_RING_SIZE                                      \
+    ((MQTT_AGENT_COMMAND_QUEUE_LENGTH) <= 2 ? 2 :                    \
+     (MQTT_AGENT_COMMAND_QUEUE_LENGTH) <= 4 ? 4 :                    \
+     (MQTT_AGENT_COMMAND_QUEUE_LENGTH) <= 8 ? 8 :                    \
+     (MQTT_AGENT_COMMAND_QUEUE_LENGTH) <= 16 ? 16 :                  \
+     (MQTT_AGENT_COMMAND_QUEUE_LENGTH) <= 32 ? 32 :                  \
+     (MQTT_AGENT_COMMAND_QUEUE_LENGTH) <= 64 ? 64 : 128)
+
+/**
+ * One slot of the message ring. The sequence number tells producers and the
+ * consumer whose turn it is to use the slot.
+ */
+typedef struct {
+    atomic_uint_least32_t sequence;
+    MQTTAgentCommand_t *pCommand;
+} AgentMessageSlot_t;
+
+/**
+ * Message context of the coreMQTT-Agent: a bounded lock-free ring of command
+ * pointers. Any number of tasks, on either core, may post to it at once; only
+ * the agent task receives from it.
+ *
+ * Posting a command is a compare-and-swap on the head position, so producers
+ * never block each other. The semaphore is only given while the agent task is
+ * asleep waiting for work.
+ */
+struct MQTTAgentMessageContext {
+    AgentMessageSlot_t slots[AGENT_MESSAGE_RING_SIZE];
+    atomic_uint_least32_t head;     /* next position producers claim */
+    uint32_t tail;                  /* next position the agent reads, agent task only */
+    atomic_bool consumerWaiting;    /* agent task is blocked on wakeup */
+    SemaphoreHandle_t wakeup;
+    StaticSemaphore_t wakeupStorage;
+};
+
+/**
+ * Prepares an empty message context. Must be called before the context is
+ * given to MQTTAgent_Init and while no task is using it.
+ * @param pMsgCtx message context to initialize
+ */
+void Agent_MessageInit(MQTTAgentMessageContext_t *pMsgCtx);
+
+/**
+ * Posts a command to the agent. Safe to call from several tasks at once.
+ * @param pMsgCtx message context holding the ring
+ * @param pCommandToSend command to post
+ * @param blockTimeMs how long to wait for a free slot in the ring
+ * @return true if the command was queued
+ */
+bool Agent_MessageSend(MQTTAgentMessageContext_t *pMsgCtx, MQTTAgentCommand_t * const *pCommandToSend,
+                       uint32_t blockTimeMs);
+
+/**
+ * Receives the next command. Must only be called by the agent task.
+ * @param pMsgCtx message context holding the ring
+ * @param pReceivedCommand receives the command pointer
+ * @param blockTimeMs how long to wait for a command
+ * @return true if a command was received
+ */
+bool Agent_MessageReceive(MQTTAgentMessageContext_t *pMsgCtx, MQTTAgentCommand_t **pReceivedCommand,
+                          uint32_t blockTimeMs);
+
+#ifdef __cplusplus
+}
+#endif
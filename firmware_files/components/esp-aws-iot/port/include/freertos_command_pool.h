@@ -0,0 +1,47 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "core_mqtt_agent.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates the static pool of MQTT_COMMAND_CONTEXTS_POOL_SIZE agent commands.
+ * Must be called once before the agent is initialized; later calls are no-ops.
+ */
+void Agent_InitializePool(void);
+
+/**
+ * MQTTAgentCommandGet_t implementation.
+ * @param blockTimeMs how long to wait for a free command
+ * @return a command, or NULL if none became free in time
+ */
+MQTTAgentCommand_t *Agent_GetCommand(uint32_t blockTimeMs);
+
+/**
+ * MQTTAgentCommandRelease_t implementation.
+ * @param pCommandToRelease command previously returned by Agent_GetCommand
+ * @return true if the command belongs to the pool and was returned to it
+ */
+bool Agent_ReleaseCommand(MQTTAgentCommand_t *pCommandToRelease);
+
+#ifdef __cplusplus
+}
+#endif
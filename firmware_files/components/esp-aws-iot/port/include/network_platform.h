@@ -16,6 +16,7 @@
 
 #ifndef IOTSDKC_NETWORK_MBEDTLS_PLATFORM_H_H
 
+#include "sdkconfig.h"
 #include <mbedtls/version.h>
 /* Keep forward-compatibility with Mbed TLS 3.x */
 #if (MBEDTLS_VERSION_NUMBER < 0x03000000)
@@ -62,6 +63,7 @@ typedef struct _TLSDataParams {
     mbedtls_x509_crt clicert;
     mbedtls_pk_context pkey;
     mbedtls_net_context server_fd;
+    unsigned char gatherBuf[CONFIG_AWS_IOT_TLS_WRITEV_GATHER_LEN];
 }TLSDataParams;
 
 #define IOTSDKC_NETWORK_MBEDTLS_PLATFORM_H_H
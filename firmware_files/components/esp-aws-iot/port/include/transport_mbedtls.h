@@ -0,0 +1,70 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "network_interface.h"
+#include "transport_interface.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * coreMQTT transport over the mbedTLS network port.
+ *
+ * The connection is set up by iot_tls_connect, so coreMQTT gets the same
+ * credential handling (PEM, DER or file paths), TLS profile and scatter-gather
+ * writes as the legacy client.
+ */
+struct NetworkContext {
+    Network network;
+};
+
+/**
+ * Opens a TLS connection to the broker.
+ * @param pNetworkContext context to connect; its contents are overwritten
+ * @param pParams root CA, device credentials, endpoint, port, handshake timeout
+ *        and hostname verification flag, in the same format as iot_tls_init
+ * @return SUCCESS or the TLS error returned by the network port
+ */
+IoT_Error_t transport_mbedtls_connect(NetworkContext_t *pNetworkContext, const TLSConnectParams *pParams);
+
+/**
+ * Closes the TLS connection and frees everything owned by the context.
+ * @param pNetworkContext connected context
+ */
+void transport_mbedtls_disconnect(NetworkContext_t *pNetworkContext);
+
+/**
+ * TransportRecv_t implementation. Returns 0 when no data arrives within
+ * CONFIG_AWS_IOT_MQTT_TRANSPORT_RECV_TIMEOUT_MS.
+ */
+int32_t transport_mbedtls_recv(NetworkContext_t *pNetworkContext, void *pBuffer, size_t bytesToRecv);
+
+/**
+ * TransportSend_t implementation.
+ */
+int32_t transport_mbedtls_send(NetworkContext_t *pNetworkContext, const void *pBuffer, size_t bytesToSend);
+
+/**
+ * TransportWritev_t implementation, backed by iot_tls_writev.
+ */
+int32_t transport_mbedtls_writev(NetworkContext_t *pNetworkContext, TransportOutVector_t *pIoVec, size_t ioVecCount);
+
+#ifdef __cplusplus
+}
+#endif
@@ -57,6 +57,41 @@ static const char *TAG = "aws_iot";
 	#define IOT_SSL_READ_RETRY_TIMEOUT_MS 10
 #endif
 
+#ifdef CONFIG_AWS_IOT_TLS_ECDSA_PROFILE
+/* Cipher suites offered by the ECDHE-ECDSA TLS profile, AES and SHA-256 run on the hardware accelerators */
+static const int _iot_tls_ecdsa_ciphersuites[] = {
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    0
+};
+
+/* P-256 is the only curve offered for the key exchange and accepted for certificates */
+#ifdef MBEDTLS_2_X_COMPAT
+static const mbedtls_ecp_group_id _iot_tls_ecdsa_curves[] = {
+    MBEDTLS_ECP_DP_SECP256R1,
+    MBEDTLS_ECP_DP_NONE
+};
+#else
+static const uint16_t _iot_tls_ecdsa_groups[] = {
+    MBEDTLS_SSL_IANA_TLS_GROUP_SECP256R1,
+    MBEDTLS_SSL_IANA_TLS_GROUP_NONE
+};
+#endif
+#endif
+
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH) && defined(CONFIG_AWS_IOT_TLS_MAX_FRAGMENT_LEN) && (CONFIG_AWS_IOT_TLS_MAX_FRAGMENT_LEN > 0)
+#if CONFIG_AWS_IOT_TLS_MAX_FRAGMENT_LEN == 512
+#define IOT_SSL_MAX_FRAG_LEN_CODE MBEDTLS_SSL_MAX_FRAG_LEN_512
+#elif CONFIG_AWS_IOT_TLS_MAX_FRAGMENT_LEN == 1024
+#define IOT_SSL_MAX_FRAG_LEN_CODE MBEDTLS_SSL_MAX_FRAG_LEN_1024
+#elif CONFIG_AWS_IOT_TLS_MAX_FRAGMENT_LEN == 2048
+#define IOT_SSL_MAX_FRAG_LEN_CODE MBEDTLS_SSL_MAX_FRAG_LEN_2048
+#elif CONFIG_AWS_IOT_TLS_MAX_FRAGMENT_LEN == 4096
+#define IOT_SSL_MAX_FRAG_LEN_CODE MBEDTLS_SSL_MAX_FRAG_LEN_4096
+#else
+#error "CONFIG_AWS_IOT_TLS_MAX_FRAGMENT_LEN must be 0, 512, 1024, 2048 or 4096"
+#endif
+#endif
+
 /*
  * This is a function to do further verification if needed on the cert received.
  *
@@ -81,6 +116,57 @@ static int _iot_tls_verify_cert(void *data, mbedtls_x509_crt *crt, int depth, ui
     return 0;
 }
 
+/*
+ * Returns the encoded length (tag + length + value) of the DER element at pDer,
+ * or 0 if pDer does not start with a definite-length ASN.1 SEQUENCE.
+ *
+ * Certificates and keys that were converted to DER at build time are embedded
+ * without a length, so the outer SEQUENCE header is used to find where each
+ * element ends. The build step appends a NUL, which terminates a chain.
+ */
+static size_t _iot_tls_der_len(const unsigned char *pDer) {
+    size_t len = 0;
+    size_t numLenBytes;
+
+    if (pDer[0] != 0x30) {
+        return 0;
+    }
+
+    if ((pDer[1] & 0x80) == 0) {
+        return 2 + pDer[1];
+    }
+
+    numLenBytes = pDer[1] & 0x7F;
+    if (numLenBytes == 0 || numLenBytes > 3) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < numLenBytes; i++) {
+        len = (len << 8) | pDer[2 + i];
+    }
+
+    return 2 + numLenBytes + len;
+}
+
+/*
+ * Parses one or more back-to-back DER certificates into pChain without copying
+ * them, so the parsed chain keeps pointing at the flash-mapped image.
+ */
+static int _iot_tls_parse_der_chain(mbedtls_x509_crt *pChain, const unsigned char *pDer) {
+    int ret = MBEDTLS_ERR_X509_INVALID_FORMAT;
+    size_t derLen;
+
+    while ((derLen = _iot_tls_der_len(pDer)) != 0) {
+        ret = mbedtls_x509_crt_parse_der_nocopy(pChain, pDer, derLen);
+        if (ret != 0) {
+            return ret;
+        }
+        pDer += derLen;
+    }
+
+    return ret;
+}
+
 static void _iot_tls_set_connect_params(Network *pNetwork, const char *pRootCALocation, const char *pDeviceCertLocation,
                                  const char *pDevicePrivateKeyLocation, const char *pDestinationURL,
                                  uint16_t destinationPort, uint32_t timeout_ms, bool ServerVerificationFlag) {
@@ -102,6 +188,7 @@ IoT_Error_t iot_tls_init(Network *pNetwork, const char *pRootCALocation, const c
     pNetwork->connect = iot_tls_connect;
     pNetwork->read = iot_tls_read;
     pNetwork->write = iot_tls_write;
+    pNetwork->writev = iot_tls_writev;
     pNetwork->disconnect = iot_tls_disconnect;
     pNetwork->isConnected = iot_tls_is_connected;
     pNetwork->destroy = iot_tls_destroy;
@@ -160,10 +247,15 @@ IoT_Error_t iot_tls_connect(Network *pNetwork, TLSConnectParams *params) {
        Certs/keys can be paths or they can be raw data. These use a
        very basic heuristic: if the cert starts with '/' then it's a
        path, if it's longer than this then it's raw cert data (PEM or DER,
-       neither of which can start with a slash. */
+       neither of which can start with a slash. DER data starts with an
+       ASN.1 SEQUENCE tag and is parsed in place without a heap copy. */
     if (pNetwork->tlsConnectParams.pRootCALocation[0] == '/') {
         ESP_LOGD(TAG, "Loading CA root certificate from file ...");
         ret = mbedtls_x509_crt_parse_file(&(tlsDataParams->cacert), pNetwork->tlsConnectParams.pRootCALocation);
+    } else if (_iot_tls_der_len((const unsigned char *)pNetwork->tlsConnectParams.pRootCALocation) != 0) {
+        ESP_LOGD(TAG, "Loading embedded DER CA root certificate ...");
+        ret = _iot_tls_parse_der_chain(&(tlsDataParams->cacert),
+                                       (const unsigned char *)pNetwork->tlsConnectParams.pRootCALocation);
     } else {
         ESP_LOGD(TAG, "Loading embedded CA root certificate ...");
         ret = mbedtls_x509_crt_parse(&(tlsDataParams->cacert), (const unsigned char *)pNetwork->tlsConnectParams.pRootCALocation,
@@ -193,6 +285,10 @@ IoT_Error_t iot_tls_connect(Network *pNetwork, TLSConnectParams *params) {
         ESP_LOGD(TAG, "Loading client cert from file...");
         ret = mbedtls_x509_crt_parse_file(&(tlsDataParams->clicert),
                                           pNetwork->tlsConnectParams.pDeviceCertLocation);
+    } else if (_iot_tls_der_len((const unsigned char *)pNetwork->tlsConnectParams.pDeviceCertLocation) != 0) {
+        ESP_LOGD(TAG, "Loading embedded DER client certificate...");
+        ret = _iot_tls_parse_der_chain(&(tlsDataParams->clicert),
+                                       (const unsigned char *)pNetwork->tlsConnectParams.pDeviceCertLocation);
     } else {
         ESP_LOGD(TAG, "Loading embedded client certificate...");
         ret = mbedtls_x509_crt_parse(&(tlsDataParams->clicert),
@@ -230,6 +326,20 @@ IoT_Error_t iot_tls_connect(Network *pNetwork, TLSConnectParams *params) {
         ret = mbedtls_pk_parse_keyfile(&(tlsDataParams->pkey),
                                        pNetwork->tlsConnectParams.pDevicePrivateKeyLocation,
                                        "", mbedtls_ctr_drbg_random, NULL);
+#endif
+    } else if (_iot_tls_der_len((const unsigned char *)pNetwork->tlsConnectParams.pDevicePrivateKeyLocation) != 0) {
+        /* DER keys skip the PEM decode; mbedTLS has no no-copy key parser */
+        ESP_LOGD(TAG, "Loading embedded DER client private key...");
+#ifdef MBEDTLS_2_X_COMPAT
+        ret = mbedtls_pk_parse_key(&(tlsDataParams->pkey),
+                                   (const unsigned char *)pNetwork->tlsConnectParams.pDevicePrivateKeyLocation,
+                                   _iot_tls_der_len((const unsigned char *)pNetwork->tlsConnectParams.pDevicePrivateKeyLocation),
+                                   NULL, 0);
+#else
+        ret = mbedtls_pk_parse_key(&(tlsDataParams->pkey),
+                                   (const unsigned char *)pNetwork->tlsConnectParams.pDevicePrivateKeyLocation,
+                                   _iot_tls_der_len((const unsigned char *)pNetwork->tlsConnectParams.pDevicePrivateKeyLocation),
+                                   NULL, 0, mbedtls_ctr_drbg_random, &(tlsDataParams->ctr_drbg));
 #endif
     } else {
         ESP_LOGD(TAG, "Loading embedded client private key...");
@@ -283,6 +393,23 @@ IoT_Error_t iot_tls_connect(Network *pNetwork, TLSConnectParams *params) {
 
     mbedtls_ssl_conf_verify(&(tlsDataParams->conf), _iot_tls_verify_cert, NULL);
 
+#ifdef CONFIG_AWS_IOT_TLS_ECDSA_PROFILE
+    ESP_LOGD(TAG, "Using the ECDHE-ECDSA P-256 TLS profile");
+    mbedtls_ssl_conf_ciphersuites(&(tlsDataParams->conf), _iot_tls_ecdsa_ciphersuites);
+#ifdef MBEDTLS_2_X_COMPAT
+    mbedtls_ssl_conf_curves(&(tlsDataParams->conf), _iot_tls_ecdsa_curves);
+#else
+    mbedtls_ssl_conf_groups(&(tlsDataParams->conf), _iot_tls_ecdsa_groups);
+#endif
+#endif
+
+#ifdef IOT_SSL_MAX_FRAG_LEN_CODE
+    if((ret = mbedtls_ssl_conf_max_frag_len(&(tlsDataParams->conf), IOT_SSL_MAX_FRAG_LEN_CODE)) != 0) {
+        ESP_LOGE(TAG, "failed! mbedtls_ssl_conf_max_frag_len returned -0x%x", -ret);
+        return SSL_CONNECTION_ERROR;
+    }
+#endif
+
     if(pNetwork->tlsConnectParams.ServerVerificationFlag == true) {
         mbedtls_ssl_conf_authmode(&(tlsDataParams->conf), MBEDTLS_SSL_VERIFY_REQUIRED);
     } else {
@@ -425,6 +552,68 @@ IoT_Error_t iot_tls_write(Network *pNetwork, unsigned char *pMsg, size_t len, Ti
 	return SUCCESS;
 }
 
+IoT_Error_t iot_tls_writev(Network *pNetwork, const NetworkOutVector *pVectors, size_t count, Timer *timer,
+						   size_t *written_len) {
+	unsigned char *pGather = pNetwork->tlsDataParams.gatherBuf;
+	const size_t gatherLen = sizeof(pNetwork->tlsDataParams.gatherBuf);
+	size_t gathered = 0U;
+	size_t txLen = 0U;
+	size_t sentLen;
+	size_t i;
+	IoT_Error_t rc = SUCCESS;
+
+	for(i = 0U; i < count; i++) {
+		const unsigned char *pBase = pVectors[i].pBase;
+		size_t len = pVectors[i].len;
+
+		/* Top up the gather buffer so that the headers share a record with
+		 * the data that follows them. */
+		if(gathered > 0U || len < gatherLen) {
+			size_t chunk = MIN(len, gatherLen - gathered);
+
+			memcpy(&pGather[gathered], pBase, chunk);
+			gathered += chunk;
+			pBase += chunk;
+			len -= chunk;
+
+			if(gathered < gatherLen) {
+				continue;
+			}
+
+			sentLen = 0U;
+			rc = iot_tls_write(pNetwork, pGather, gathered, timer, &sentLen);
+			txLen += sentLen;
+			gathered = 0U;
+			if(SUCCESS != rc) {
+				break;
+			}
+		}
+
+		/* What is left over is either a large buffer, which is encrypted in
+		 * place, or a short tail that starts the next gather. */
+		if(len >= gatherLen) {
+			sentLen = 0U;
+			rc = iot_tls_write(pNetwork, (unsigned char *) pBase, len, timer, &sentLen);
+			txLen += sentLen;
+			if(SUCCESS != rc) {
+				break;
+			}
+		} else if(len > 0U) {
+			memcpy(pGather, pBase, len);
+			gathered = len;
+		}
+	}
+
+	if(SUCCESS == rc && gathered > 0U) {
+		sentLen = 0U;
+		rc = iot_tls_write(pNetwork, pGather, gathered, timer, &sentLen);
+		txLen += sentLen;
+	}
+
+	*written_len = txLen;
+	return rc;
+}
+
 IoT_Error_t iot_tls_read(Network *pNetwork, unsigned char *pMsg, size_t len, Timer *timer, size_t *read_len) {
     TLSDataParams *tlsDataParams = &(pNetwork->tlsDataParams);
 	mbedtls_ssl_context *pSsl = &(pNetwork->tlsDataParams.ssl);
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ * Additions Copyright 2016 Espressif Systems (Shanghai) PTE LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file transport_mbedtls.c
+ * @brief coreMQTT transport interface on top of the mbedTLS network port.
+ */
+
+#include <string.h>
+#include <sys/param.h>
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+
+#include "network_interface.h"
+#include "network_platform.h"
+#include "timer_platform.h"
+#include "transport_mbedtls.h"
+
+static const char *TAG = "transport";
+
+/* Vectors handed to iot_tls_writev per call. coreMQTT publishes use at most
+ * five (header, topic, packet id, payload) so this is rarely split. */
+#define TRANSPORT_WRITEV_BATCH 8
+
+IoT_Error_t transport_mbedtls_connect(NetworkContext_t *pNetworkContext, const TLSConnectParams *pParams) {
+    Network *pNetwork = &(pNetworkContext->network);
+    IoT_Error_t rc;
+
+    memset(pNetworkContext, 0, sizeof(*pNetworkContext));
+
+    rc = iot_tls_init(pNetwork, pParams->pRootCALocation, pParams->pDeviceCertLocation,
+                      pParams->pDevicePrivateKeyLocation, pParams->pDestinationURL,
+                      pParams->DestinationPort, pParams->timeout_ms, pParams->ServerVerificationFlag);
+    if(SUCCESS != rc) {
+        return rc;
+    }
+
+    rc = iot_tls_connect(pNetwork, NULL);
+    if(SUCCESS != rc) {
+        ESP_LOGE(TAG, "transport_mbedtls_connect: TLS connection to %s:%d failed (%d)",
+                 pParams->pDestinationURL, pParams->DestinationPort, rc);
+        iot_tls_destroy(pNetwork);
+        return rc;
+    }
+
+    /* coreMQTT polls the transport, so reads must give up quickly when the
+     * broker has nothing to say. */
+    mbedtls_ssl_conf_read_timeout(&(pNetwork->tlsDataParams.conf), CONFIG_AWS_IOT_MQTT_TRANSPORT_RECV_TIMEOUT_MS);
+
+    return SUCCESS;
+}
+
+void transport_mbedtls_disconnect(NetworkContext_t *pNetworkContext) {
+    iot_tls_disconnect(&(pNetworkContext->network));
+    iot_tls_destroy(&(pNetworkContext->network));
+}
+
+int32_t transport_mbedtls_recv(NetworkContext_t *pNetworkContext, void *pBuffer, size_t bytesToRecv) {
+    int ret = mbedtls_ssl_read(&(pNetworkContext->network.tlsDataParams.ssl), pBuffer, bytesToRecv);
+
+    if(ret > 0) {
+        return (int32_t) ret;
+    }
+
+    if(ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_TIMEOUT) {
+        return 0;
+    }
+
+    ESP_LOGE(TAG, "transport_mbedtls_recv: mbedtls_ssl_read returned -0x%x", (unsigned int) -ret);
+    return -1;
+}
+
+int32_t transport_mbedtls_send(NetworkContext_t *pNetworkContext, const void *pBuffer, size_t bytesToSend) {
+    int ret = mbedtls_ssl_write(&(pNetworkContext->network.tlsDataParams.ssl), pBuffer, bytesToSend);
+
+    if(ret >= 0) {
+        return (int32_t) ret;
+    }
+
+    if(ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        return 0;
+    }
+
+    ESP_LOGE(TAG, "transport_mbedtls_send: mbedtls_ssl_write returned -0x%x", (unsigned int) -ret);
+    return -1;
+}
+
+int32_t transport_mbedtls_writev(NetworkContext_t *pNetworkContext, TransportOutVector_t *pIoVec, size_t ioVecCount) {
+    NetworkOutVector vectors[TRANSPORT_WRITEV_BATCH];
+    Timer timer;
+    size_t total = 0U;
+    size_t written;
+    size_t count;
+    size_t i;
+    IoT_Error_t rc;
+
+    /* The timer is not used by the port, it only has to be valid. */
+    init_timer(&timer);
+
+    while(ioVecCount > 0U) {
+        count = MIN(ioVecCount, (size_t) TRANSPORT_WRITEV_BATCH);
+        for(i = 0U; i < count; i++) {
+            vectors[i].pBase = pIoVec[i].iov_base;
+            vectors[i].len = pIoVec[i].iov_len;
+        }
+
+        written = 0U;
+        rc = iot_tls_writev(&(pNetworkContext->network), vectors, count, &timer, &written);
+        total += written;
+
+        if(NETWORK_SSL_WRITE_TIMEOUT_ERROR == rc) {
+            /* Report the partial write, coreMQTT resumes from there. */
+            break;
+        } else if(SUCCESS != rc) {
+            ESP_LOGE(TAG, "transport_mbedtls_writev: iot_tls_writev failed (%d)", rc);
+            return -1;
+        }
+
+        pIoVec += count;
+        ioVecCount -= count;
+    }
+
+    return (int32_t) total;
+}
@@ -0,0 +1,216 @@
+/*
+ * acquisition.c
+ *
+ * The sampler task reads every sensor once per period and appends the result
+ * to the ring; readers are woken through an event group bit that is set and
+ * cleared again for each sample.
+ */
+
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sys/param.h"
+
+#include "acquisition.h"
+#include "sntp_time_sync.h"
+#include "task_manager_i2c.h"
+#include "tasks_common.h"
+
+static const char TAG[] = "acquisition";
+
+// Set for every new sample
+#define ACQUISITION_SAMPLE_BIT	BIT0
+
+// Sampling period
+#define ACQUISITION_PERIOD_TICKS	pdMS_TO_TICKS(CONFIG_ACQUISITION_PERIOD_MS)
+
+// Recent samples, sample n is at n % ACQUISITION_RING_LEN
+static acquisition_sample_t acquisition_ring[ACQUISITION_RING_LEN];
+
+// Number of the next sample
+static uint32_t acquisition_next;
+
+// Unix time minus uptime in ms, 0 until the clock is set; dates samples taken before that
+static int64_t acquisition_time_offset_ms;
+
+// Guards the ring, acquisition_next and acquisition_time_offset_ms
+static portMUX_TYPE acquisition_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Wakes readers waiting for a sample
+static EventGroupHandle_t acquisition_event_group;
+
+// Sampler task handle
+static TaskHandle_t task_acquisition = NULL;
+
+/**
+ * Reads all sensors. A reading that fails is left at 0.
+ * @param ina219 feeder sensor
+ * @param ina3221 transformer sensor
+ * @param sample receives the readings
+ */
+static void acquisition_sample(ina219_t *ina219, ina3221_t *ina3221, acquisition_sample_t *sample)
+{
+	float bus_voltage, shunt_voltage, shunt_current, current;
+	struct timeval now;
+
+	*sample = (acquisition_sample_t) {0};
+
+	sample->uptime_ms = esp_timer_get_time() / 1000;
+	if (sntp_time_synced())
+	{
+		gettimeofday(&now, NULL);
+		sample->timestamp_ms = (int64_t) now.tv_sec * 1000 + now.tv_usec / 1000;
+	}
+
+	if (ina219_get_bus_voltage(ina219, &bus_voltage) == ESP_OK)
+	{
+		sample->feeder_line_voltage = bus_voltage;
+	}
+	if (ina219_get_shunt_voltage(ina219, &shunt_voltage) == ESP_OK)
+	{
+		sample->feeder_shunt_voltage = shunt_voltage * 1000;
+	}
+	if (ina219_get_current(ina219, &current) == ESP_OK)
+	{
+		sample->feeder_current = current * 1000;
+	}
+
+	for (uint8_t i = 0; i < INA3221_BUS_NUMBER; i++)
+	{
+		if (ina3221_get_shunt_value(ina3221, i, &shunt_voltage, &shunt_current) == ESP_OK)
+		{
+			sample->transformer_shunt_voltage[i] = shunt_voltage;
+			sample->transformer_current[i] = shunt_current;
+		}
+	}
+}
+
+/**
+ * Sampler task.
+ */
+static void acquisition_task(void *param)
+{
+	ina219_t *ina219;
+	ina3221_t *ina3221;
+	acquisition_sample_t sample;
+	TickType_t last_wake;
+	esp_err_t err;
+
+	ina219 = malloc(sizeof(ina219_t));
+	ina3221 = malloc(sizeof(ina3221_t));
+	if (ina219 == NULL || ina3221 == NULL)
+	{
+		ESP_LOGE(TAG, "acquisition_task: failed to allocate the sensors");
+		abort();
+	}
+
+	err = initialize_sensors(ina219, ina3221);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "acquisition_task: failed to initialize sensors: %s", esp_err_to_name(err));
+		abort();
+	}
+
+	ESP_LOGI(TAG, "acquisition_task: sampling every %d ms", CONFIG_ACQUISITION_PERIOD_MS);
+
+	last_wake = xTaskGetTickCount();
+	for (;;)
+	{
+		acquisition_sample(ina219, ina3221, &sample);
+
+		taskENTER_CRITICAL(&acquisition_lock);
+		sample.seq = acquisition_next;
+		acquisition_ring[acquisition_next % ACQUISITION_RING_LEN] = sample;
+		acquisition_next++;
+		if (acquisition_time_offset_ms == 0 && sample.timestamp_ms != 0)
+		{
+			acquisition_time_offset_ms = sample.timestamp_ms - sample.uptime_ms;
+		}
+		taskEXIT_CRITICAL(&acquisition_lock);
+
+		if (sample.seq == 0)
+		{
+			ESP_LOGI(TAG, "acquisition_task: first sample %lld ms after boot", (long long) sample.uptime_ms);
+		}
+
+		// Setting the bit releases every waiting reader at once
+		xEventGroupSetBits(acquisition_event_group, ACQUISITION_SAMPLE_BIT);
+		xEventGroupClearBits(acquisition_event_group, ACQUISITION_SAMPLE_BIT);
+
+		xTaskDelayUntil(&last_wake, ACQUISITION_PERIOD_TICKS);
+	}
+}
+
+void acquisition_start(void)
+{
+	if (task_acquisition == NULL)
+	{
+		acquisition_event_group = xEventGroupCreate();
+		xTaskCreatePinnedToCore(&acquisition_task, "acquisition_task", ACQUISITION_TASK_STACK_SIZE, NULL,
+								ACQUISITION_TASK_PRIORITY, &task_acquisition, ACQUISITION_TASK_CORE_ID);
+	}
+}
+
+uint32_t acquisition_next_seq(void)
+{
+	uint32_t next;
+
+	taskENTER_CRITICAL(&acquisition_lock);
+	next = acquisition_next;
+	taskEXIT_CRITICAL(&acquisition_lock);
+
+	return next;
+}
+
+esp_err_t acquisition_read(uint32_t seq, acquisition_sample_t *sample, TickType_t ticks)
+{
+	TickType_t start = xTaskGetTickCount();
+	TickType_t elapsed;
+	uint32_t behind;
+
+	if (acquisition_event_group == NULL)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	for (;;)
+	{
+		taskENTER_CRITICAL(&acquisition_lock);
+		behind = acquisition_next - seq;
+		if (behind > 0 && behind <= INT32_MAX)
+		{
+			if (behind > ACQUISITION_RING_LEN)
+			{
+				seq = acquisition_next - ACQUISITION_RING_LEN;
+			}
+			*sample = acquisition_ring[seq % ACQUISITION_RING_LEN];
+			if (sample->timestamp_ms == 0 && acquisition_time_offset_ms != 0)
+			{
+				sample->timestamp_ms = sample->uptime_ms + acquisition_time_offset_ms;
+			}
+			taskEXIT_CRITICAL(&acquisition_lock);
+			return ESP_OK;
+		}
+		if (behind != 0)
+		{
+			// Ahead of the sampler, e.g. a position from before a reboot
+			seq = acquisition_next;
+		}
+		taskEXIT_CRITICAL(&acquisition_lock);
+
+		elapsed = xTaskGetTickCount() - start;
+		if (elapsed >= ticks)
+		{
+			return ESP_ERR_TIMEOUT;
+		}
+
+		// A sample taken between the check and the wait is picked up one period later
+		xEventGroupWaitBits(acquisition_event_group, ACQUISITION_SAMPLE_BIT, pdFALSE, pdFALSE,
+							MIN(ticks - elapsed, ACQUISITION_PERIOD_TICKS));
+	}
+}
@@ -0,0 +1,62 @@
+/*
+ * acquisition.h
+ *
+ * Samples the feeder (INA219) and transformer (INA3221) sensors at a fixed
+ * rate into a ring of recent samples. Readers each keep their own position
+ * in the ring by sequence number, so a reader that falls behind only loses
+ * its own oldest samples and never holds up the sampler or other readers.
+ */
+
+#ifndef MAIN_ACQUISITION_H_
+#define MAIN_ACQUISITION_H_
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#include "ina3221.h"
+
+// Samples kept in the ring, a power of two
+#define ACQUISITION_RING_LEN	64
+
+/**
+ * One reading of all sensors
+ */
+typedef struct acquisition_sample
+{
+	uint32_t seq;										///> Number of the sample since boot, from 0
+	int64_t timestamp_ms;								///> Unix time in ms, 0 while the clock is not set
+	int64_t uptime_ms;									///> Time since boot in ms
+	float feeder_line_voltage;							///> V
+	float feeder_shunt_voltage;							///> mV
+	float feeder_current;								///> mA
+	float transformer_shunt_voltage[INA3221_BUS_NUMBER];	///> mV
+	float transformer_current[INA3221_BUS_NUMBER];		///> mA
+} acquisition_sample_t;
+
+/**
+ * Initializes the sensors and starts sampling every CONFIG_ACQUISITION_PERIOD_MS.
+ * Sampling starts right away at boot; samples taken before SNTP sets the clock
+ * are stamped from their uptime when they are read after it is set.
+ */
+void acquisition_start(void);
+
+/**
+ * Number the next sample will get; reading it waits for a fresh sample.
+ * @return sequence number
+ */
+uint32_t acquisition_next_seq(void);
+
+/**
+ * Copies a sample out of the ring. If the sample has already been overwritten
+ * the oldest one still in the ring is returned instead, so the caller can tell
+ * how many it missed from sample->seq and should continue from sample->seq + 1.
+ * @param seq number of the sample wanted
+ * @param sample receives the sample
+ * @param ticks how long to wait if seq has not been sampled yet
+ * @return ESP_OK, ESP_ERR_TIMEOUT, or ESP_ERR_INVALID_STATE before acquisition_start
+ */
+esp_err_t acquisition_read(uint32_t seq, acquisition_sample_t *sample, TickType_t ticks);
+
+#endif /* MAIN_ACQUISITION_H_ */
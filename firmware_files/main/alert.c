@@ -0,0 +1,160 @@
+/*
+ * alert.c
+ *
+ * A one-shot esp_timer steps through the blink patterns. Each run of its
+ * callback takes the raised alerts off the event queue, shows the next on or
+ * off phase of the most severe active pattern and re-arms the timer for that
+ * phase's length. With no active pattern the LEDs go back to the state
+ * colour and the timer stays idle until the next alert_raise.
+ */
+
+#include <stdatomic.h>
+
+#include "driver/gpio.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "alert.h"
+#include "metrics.h"
+#include "rgb_led.h"
+#include "task_manager_i2c.h"
+
+static const char TAG[] = "alert";
+
+// Blink pattern for one severity
+typedef struct alert_pattern
+{
+	uint8_t red;
+	uint8_t green;
+	uint8_t blue;
+	uint16_t on_ms;
+	uint16_t off_ms;
+	uint8_t blinks;
+} alert_pattern_t;
+
+static const alert_pattern_t alert_patterns[ALERT_SEVERITY_COUNT] = {
+	[ALERT_SEVERITY_LOW]	= { 255, 160, 0, 400, 400, 3 },		// Amber, slow
+	[ALERT_SEVERITY_MEDIUM]	= { 255, 64, 0, 200, 200, 5 },		// Orange
+	[ALERT_SEVERITY_HIGH]	= { 255, 0, 0, 100, 100, 10 },		// Red, fast, ~2 seconds
+};
+
+// Raised severities waiting for the timer callback
+static QueueHandle_t alert_queue;
+
+// One bit per severity that is on the queue, so repeated raises are coalesced
+// and the queue never fills
+static atomic_uint alert_queued;
+
+// Steps the patterns
+static esp_timer_handle_t alert_timer;
+
+// On and off phases left for each severity, only used by the timer callback
+static uint8_t alert_phases_left[ALERT_SEVERITY_COUNT];
+
+// Set while the LEDs show a pattern, only used by the timer callback
+static bool alert_showing = false;
+
+/**
+ * Shows the next phase of the most severe active pattern.
+ * Runs in the esp_timer task.
+ */
+static void alert_timer_callback(void *arg)
+{
+	const alert_pattern_t *pattern;
+	alert_severity_t severity;
+	uint16_t phase_ms;
+	int i;
+
+	// Raising a severity that is already playing starts it over
+	while (xQueueReceive(alert_queue, &severity, 0) == pdTRUE)
+	{
+		atomic_fetch_and(&alert_queued, ~(1U << severity));
+		alert_phases_left[severity] = alert_patterns[severity].blinks * 2;
+	}
+
+	for (i = ALERT_SEVERITY_COUNT - 1; i >= 0; i--)
+	{
+		if (alert_phases_left[i] > 0)
+		{
+			break;
+		}
+	}
+
+	if (i < 0)
+	{
+		if (alert_showing)
+		{
+			gpio_set_level(LED_GPIO, 0);
+			rgb_led_alert_end();
+			alert_showing = false;
+		}
+		return;
+	}
+
+	// Phases count down from an even number, so even means on
+	pattern = &alert_patterns[i];
+	if ((alert_phases_left[i] % 2) == 0)
+	{
+		gpio_set_level(LED_GPIO, 1);
+		rgb_led_alert_colour(pattern->red, pattern->green, pattern->blue);
+		phase_ms = pattern->on_ms;
+	}
+	else
+	{
+		gpio_set_level(LED_GPIO, 0);
+		rgb_led_alert_colour(0, 0, 0);
+		phase_ms = pattern->off_ms;
+	}
+	alert_phases_left[i]--;
+	alert_showing = true;
+
+	esp_timer_start_once(alert_timer, (uint64_t) phase_ms * 1000ULL);
+}
+
+void alert_start(void)
+{
+	const esp_timer_create_args_t alert_timer_args = {
+		.callback = &alert_timer_callback,
+		.name = "alert",
+	};
+
+	if (alert_queue != NULL)
+	{
+		return;
+	}
+
+	alert_queue = xQueueCreate(ALERT_SEVERITY_COUNT, sizeof(alert_severity_t));
+	metrics_register_queue("alert", alert_queue);
+	ESP_ERROR_CHECK(esp_timer_create(&alert_timer_args, &alert_timer));
+
+	led_gpio_init();
+	rgb_led_initialize();
+}
+
+bool alert_raise(alert_severity_t severity)
+{
+	if ((unsigned int) severity >= ALERT_SEVERITY_COUNT)
+	{
+		return false;
+	}
+
+	// Already queued: the pending event starts the pattern from the beginning anyway
+	if ((atomic_fetch_or(&alert_queued, 1U << severity) & (1U << severity)) != 0U)
+	{
+		return true;
+	}
+
+	if (xQueueSend(alert_queue, &severity, 0) != pdPASS)
+	{
+		ESP_LOGE(TAG, "Alert queue full, severity %d dropped", severity);
+		atomic_fetch_and(&alert_queued, ~(1U << severity));
+		return false;
+	}
+
+	// Fails harmlessly while a phase is timing; the callback then sees the event when it ends
+	esp_timer_start_once(alert_timer, 0);
+
+	return true;
+}
@@ -0,0 +1,40 @@
+/*
+ * alert.h
+ *
+ * Theft alert actuator. Alerts are blink patterns on the RGB LED and the
+ * theft LED, played by an esp_timer; raising one only posts an event, so it
+ * can be done from the MQTT agent callback.
+ */
+
+#ifndef MAIN_ALERT_H_
+#define MAIN_ALERT_H_
+
+#include <stdbool.h>
+
+// Alert severities, from least to most severe
+typedef enum alert_severity
+{
+	ALERT_SEVERITY_LOW = 0,
+	ALERT_SEVERITY_MEDIUM,
+	ALERT_SEVERITY_HIGH,
+	ALERT_SEVERITY_COUNT
+} alert_severity_t;
+
+/**
+ * Creates the event queue and pattern timer and sets up the LEDs.
+ * Must be called from app_main before any alert is raised.
+ */
+void alert_start(void);
+
+/**
+ * Starts the pattern for a severity, or restarts it if it is already playing.
+ * The most severe active alert is shown, taking over from a less severe one
+ * at its next on/off phase; less severe ones continue once it ends. Never
+ * blocks, and raising the same severity many times before the pattern timer
+ * runs costs one event.
+ * @param severity alert to raise
+ * @return false if severity is out of range
+ */
+bool alert_raise(alert_severity_t severity);
+
+#endif /* MAIN_ALERT_H_ */
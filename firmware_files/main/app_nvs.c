@@ -1,3 +1,5 @@
+#include "esp_mac.h"
+
 #include "app_nvs.h"
 #include "wifi_app.h"
 
@@ -7,6 +9,36 @@ static const char TAG[] = "nvs";
 // NVS name-space used for station mode credentials
 const char app_nvs_sta_creds_namespace[] = "staCreds";
 
+// Key of the connection cache, kept next to the credentials it belongs to
+static const char app_nvs_sta_cache_key[] = "cache";
+
+/**
+ * Checks whether the credentials differ from the ones saved in NVS.
+ * @param handle open handle of the credentials name-space
+ * @param wifi_sta_config credentials about to be saved
+ * @return true if they differ or none are saved
+ */
+static bool app_nvs_sta_creds_changed(nvs_handle handle, const wifi_config_t *wifi_sta_config)
+{
+    uint8_t saved[MAX_PASSWORD_LENGTH];
+    size_t len = MAX_SSID_LENGTH;
+
+    if (nvs_get_blob(handle, "ssid", saved, &len) != ESP_OK || len != MAX_SSID_LENGTH ||
+        memcmp(saved, wifi_sta_config->sta.ssid, MAX_SSID_LENGTH) != 0)
+    {
+        return true;
+    }
+
+    len = MAX_PASSWORD_LENGTH;
+    if (nvs_get_blob(handle, "password", saved, &len) != ESP_OK || len != MAX_PASSWORD_LENGTH ||
+        memcmp(saved, wifi_sta_config->sta.password, MAX_PASSWORD_LENGTH) != 0)
+    {
+        return true;
+    }
+
+    return false;
+}
+
 esp_err_t app_nvs_save_sta_creds(void)
 {
     nvs_handle handle;
@@ -24,6 +56,14 @@ esp_err_t app_nvs_save_sta_creds(void)
             return esp_err;
         }
 
+        // Reconnects save the same credentials again; keep them and the cache that goes with them
+        if (!app_nvs_sta_creds_changed(handle, wifi_sta_config))
+        {
+            nvs_close(handle);
+            ESP_LOGI(TAG, "app_nvs_save_sta_creds: credentials unchanged");
+            return ESP_OK;
+        }
+
         // Set SSID
         esp_err = nvs_set_blob(handle, "ssid", wifi_sta_config->sta.ssid, MAX_SSID_LENGTH);
         if(esp_err != ESP_OK)
@@ -40,6 +80,14 @@ esp_err_t app_nvs_save_sta_creds(void)
             return esp_err;
         }
 
+        // The cache was for the previous credentials
+        esp_err = nvs_erase_key(handle, app_nvs_sta_cache_key);
+        if(esp_err != ESP_OK && esp_err != ESP_ERR_NVS_NOT_FOUND)
+        {
+            ESP_LOGE(TAG, "app_nvs_save_sta_creds: Error (%s) erasing the connection cache!", esp_err_to_name(esp_err));
+            return esp_err;
+        }
+
         // Commit credentials to NVS
         esp_err = nvs_commit(handle);
         if(esp_err != ESP_OK)
@@ -113,6 +161,54 @@ bool app_nvs_load_sta_creds(void)
     }
 }
 
+esp_err_t app_nvs_save_sta_cache(const app_nvs_sta_cache_t *cache)
+{
+    nvs_handle handle;
+    esp_err_t esp_err;
+
+    esp_err = nvs_open(app_nvs_sta_creds_namespace, NVS_READWRITE, &handle);
+    if(esp_err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "app_nvs_save_sta_cache: Error (%s) opening NVS handle!", esp_err_to_name(esp_err));
+        return esp_err;
+    }
+
+    esp_err = nvs_set_blob(handle, app_nvs_sta_cache_key, cache, sizeof(*cache));
+    if(esp_err == ESP_OK)
+    {
+        esp_err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    if(esp_err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "app_nvs_save_sta_cache: Error (%s) saving the connection cache!", esp_err_to_name(esp_err));
+        return esp_err;
+    }
+
+    ESP_LOGI(TAG, "app_nvs_save_sta_cache: BSSID " MACSTR " channel %u%s", MAC2STR(cache->bssid), cache->channel,
+             cache->has_pmk ? " with PMK" : "");
+    return ESP_OK;
+}
+
+bool app_nvs_load_sta_cache(app_nvs_sta_cache_t *cache)
+{
+    nvs_handle handle;
+    size_t len = sizeof(*cache);
+    esp_err_t esp_err;
+
+    if(nvs_open(app_nvs_sta_creds_namespace, NVS_READONLY, &handle) != ESP_OK)
+    {
+        return false;
+    }
+
+    esp_err = nvs_get_blob(handle, app_nvs_sta_cache_key, cache, &len);
+    nvs_close(handle);
+
+    // A cache from an older layout is ignored and replaced after the next connection
+    return esp_err == ESP_OK && len == sizeof(*cache);
+}
+
 esp_err_t app_nvs_clear_sta_creds(void)
 {
     nvs_handle handle;
@@ -2,6 +2,7 @@
 #define MAIN_APP_NVS_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -9,7 +10,8 @@
 #include "nvs_flash.h"
 
 /**
- * Saves station mode Wifi credentials to NVS
+ * Saves station mode Wifi credentials to NVS. The connection cache is
+ * erased if they differ from the saved ones, and kept if they are the same.
  * @return ESP_OK if successful
  */
 esp_err_t app_nvs_save_sta_creds(void);
@@ -20,6 +22,32 @@ esp_err_t app_nvs_save_sta_creds(void);
  */
 bool app_nvs_load_sta_creds(void);
 
+/**
+ * What is remembered about the last AP the station connected to, so the next
+ * connection can skip the scan and the key derivation
+ */
+typedef struct app_nvs_sta_cache
+{
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t has_pmk;        ///> pmk is valid, only for WPA/WPA2-Personal APs
+    uint8_t pmk[32];        ///> PBKDF2 of the password and SSID
+} app_nvs_sta_cache_t;
+
+/**
+ * Saves the connection cache for the saved credentials
+ * @param cache cache to save
+ * @return ESP_OK if successful
+ */
+esp_err_t app_nvs_save_sta_cache(const app_nvs_sta_cache_t *cache);
+
+/**
+ * Loads the connection cache saved with app_nvs_save_sta_cache
+ * @param cache receives the cache
+ * @return true if a cache was found
+ */
+bool app_nvs_load_sta_cache(app_nvs_sta_cache_t *cache);
+
 /**
  * Clears station mode credentials from NVS
  * @return ESP_OK if successful
@@ -0,0 +1,683 @@
+/*
+ * device_defender.c
+ *
+ * The report task runs at the lowest priority on core 0, away from the
+ * sampling and MQTT tasks on core 1. Sockets are listed by walking the lwIP
+ * PCB lists in the TCP/IP task (esp_netif_tcpip_exec), which only copies
+ * them; formatting and encoding happen in the report task.
+ *
+ * lwIP is built without the MIB-II interface counters, so traffic is counted
+ * by wrapping the input and linkoutput functions of the station and SoftAP
+ * netifs. That is two relaxed atomic adds per frame, and it is all the
+ * reports add to the data path.
+ *
+ * Each report logs its size and the time taken to collect and encode it;
+ * that time also goes into the defender_report_us histogram of the health
+ * report, and the task's CPU share is listed there with the other tasks.
+ */
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_netif_net_stack.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "lwip/ip_addr.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/udp.h"
+
+#include "cbor.h"
+#include "defender.h"
+
+#include "device_defender.h"
+#include "metrics.h"
+#include "mqtt_agent_manager.h"
+#include "sntp_time_sync.h"
+#include "tasks_common.h"
+#include "wifi_app.h"
+
+static const char TAG[] = "device_defender";
+
+// The thing name is the MQTT client ID
+#define DEVICE_DEFENDER_THING_NAME		CONFIG_AWS_CLIENT_ID
+
+#define DEVICE_DEFENDER_TOPIC_MAX_LEN	DEFENDER_API_MAX_LENGTH(sizeof(DEVICE_DEFENDER_THING_NAME) - 1)
+
+// Interfaces whose traffic is counted, the station and the SoftAP
+#define DEVICE_DEFENDER_NETIFS			2
+
+// How long the report task waits for wifi_app_task to create the interfaces
+#define DEVICE_DEFENDER_NETIF_WAIT_MS	10000
+
+// Custom metrics besides the counters
+#define DEVICE_DEFENDER_HEAP_METRICS	2
+
+// Report format version
+static const char DEVICE_DEFENDER_REPORT_VERSION[] = "1.0";
+
+/**
+ * A counted interface and the functions its wrappers hand frames on to
+ */
+typedef struct device_defender_netif
+{
+	struct netif *netif;
+	netif_input_fn input;
+	netif_linkoutput_fn linkoutput;
+} device_defender_netif_t;
+
+/**
+ * An established TCP connection
+ */
+typedef struct device_defender_connection
+{
+	ip_addr_t remote_ip;
+	uint16_t remote_port;
+	uint16_t local_port;
+} device_defender_connection_t;
+
+/**
+ * Sockets as listed in the TCP/IP task; the totals also count those that
+ * did not fit
+ */
+typedef struct device_defender_sockets
+{
+	device_defender_connection_t connections[DEVICE_DEFENDER_MAX_CONNECTIONS];
+	uint32_t connection_total;
+	uint16_t tcp_ports[DEVICE_DEFENDER_MAX_PORTS];
+	uint32_t tcp_port_total;
+	uint16_t udp_ports[DEVICE_DEFENDER_MAX_PORTS];
+	uint32_t udp_port_total;
+} device_defender_sockets_t;
+
+/**
+ * Traffic and health counters since boot. They wrap; reports carry the
+ * difference to the last report sent.
+ */
+typedef struct device_defender_totals
+{
+	uint32_t bytes_in;
+	uint32_t bytes_out;
+	uint32_t packets_in;
+	uint32_t packets_out;
+	uint32_t counters[METRICS_COUNTERS];
+} device_defender_totals_t;
+
+static device_defender_netif_t device_defender_netifs[DEVICE_DEFENDER_NETIFS];
+
+static atomic_uint device_defender_bytes_in;
+static atomic_uint device_defender_bytes_out;
+static atomic_uint device_defender_packets_in;
+static atomic_uint device_defender_packets_out;
+
+// Report topic and the filter for its accepted and rejected responses;
+// zeroed, so they stay NUL terminated
+static char device_defender_topic[DEVICE_DEFENDER_TOPIC_MAX_LEN + 1];
+static char device_defender_response_filter[DEVICE_DEFENDER_TOPIC_MAX_LEN + 1];
+
+// Report task handle
+static TaskHandle_t task_device_defender = NULL;
+
+/**
+ * Finds the counted interface of a netif.
+ * @param netif lwIP netif, one of the two the wrappers are installed on
+ * @return the counted interface
+ */
+static device_defender_netif_t *device_defender_find_netif(struct netif *netif)
+{
+	return (device_defender_netifs[0].netif == netif) ? &device_defender_netifs[0] : &device_defender_netifs[1];
+}
+
+/**
+ * Counts a received frame and hands it to the stack.
+ */
+static err_t device_defender_input(struct pbuf *p, struct netif *netif)
+{
+	atomic_fetch_add_explicit(&device_defender_bytes_in, p->tot_len, memory_order_relaxed);
+	atomic_fetch_add_explicit(&device_defender_packets_in, 1, memory_order_relaxed);
+
+	return device_defender_find_netif(netif)->input(p, netif);
+}
+
+/**
+ * Counts a frame and hands it to the driver.
+ */
+static err_t device_defender_linkoutput(struct netif *netif, struct pbuf *p)
+{
+	atomic_fetch_add_explicit(&device_defender_bytes_out, p->tot_len, memory_order_relaxed);
+	atomic_fetch_add_explicit(&device_defender_packets_out, 1, memory_order_relaxed);
+
+	return device_defender_find_netif(netif)->linkoutput(netif, p);
+}
+
+/**
+ * Installs the counting wrappers on the station and SoftAP netifs, or puts
+ * them back. ESP-IDF can restore the input and linkoutput functions when an
+ * interface is started again, e.g. on a switch between APSTA and station
+ * mode, so this also runs before every report and takes whatever it finds
+ * there as the new originals. Runs in the TCP/IP task.
+ * @param ctx if not NULL, set to true when wrappers that were already
+ *            installed had to be put back
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND if neither interface exists
+ */
+static esp_err_t device_defender_wrap_netifs(void *ctx)
+{
+	esp_netif_t *esp_netifs[DEVICE_DEFENDER_NETIFS] = {esp_netif_sta, esp_netif_ap};
+	bool *rewrapped = ctx;
+	struct netif *netif;
+
+	for (int i = 0; i < DEVICE_DEFENDER_NETIFS; i++)
+	{
+		netif = (esp_netifs[i] != NULL) ? esp_netif_get_netif_impl(esp_netifs[i]) : NULL;
+		if (netif == NULL)
+		{
+			continue;
+		}
+
+		if (rewrapped != NULL && device_defender_netifs[i].netif != NULL &&
+			(netif->input != device_defender_input || netif->linkoutput != device_defender_linkoutput))
+		{
+			*rewrapped = true;
+		}
+
+		// Never save a wrapper as the original, or the frame would loop
+		device_defender_netifs[i].netif = netif;
+		if (netif->input != device_defender_input)
+		{
+			device_defender_netifs[i].input = netif->input;
+			netif->input = device_defender_input;
+		}
+		if (netif->linkoutput != device_defender_linkoutput)
+		{
+			device_defender_netifs[i].linkoutput = netif->linkoutput;
+			netif->linkoutput = device_defender_linkoutput;
+		}
+	}
+
+	if (device_defender_netifs[0].netif == NULL && device_defender_netifs[1].netif == NULL)
+	{
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	return ESP_OK;
+}
+
+/**
+ * Copies the established connections and the listening ports. Runs in the
+ * TCP/IP task, which owns the PCB lists.
+ * @param ctx device_defender_sockets_t to fill, zeroed
+ * @return ESP_OK
+ */
+static esp_err_t device_defender_list_sockets(void *ctx)
+{
+	device_defender_sockets_t *sockets = ctx;
+	device_defender_connection_t *connection;
+
+	for (struct tcp_pcb *pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next)
+	{
+		if (pcb->state != ESTABLISHED)
+		{
+			continue;
+		}
+
+		if (sockets->connection_total < DEVICE_DEFENDER_MAX_CONNECTIONS)
+		{
+			connection = &sockets->connections[sockets->connection_total];
+			ip_addr_copy(connection->remote_ip, pcb->remote_ip);
+			connection->remote_port = pcb->remote_port;
+			connection->local_port = pcb->local_port;
+		}
+		sockets->connection_total++;
+	}
+
+	for (struct tcp_pcb_listen *pcb = tcp_listen_pcbs.listen_pcbs; pcb != NULL; pcb = pcb->next)
+	{
+		if (sockets->tcp_port_total < DEVICE_DEFENDER_MAX_PORTS)
+		{
+			sockets->tcp_ports[sockets->tcp_port_total] = pcb->local_port;
+		}
+		sockets->tcp_port_total++;
+	}
+
+	// Connected UDP PCBs only talk to their peer, e.g. DNS lookups
+	for (struct udp_pcb *pcb = udp_pcbs; pcb != NULL; pcb = pcb->next)
+	{
+		if (pcb->local_port == 0 || (pcb->flags & UDP_FLAGS_CONNECTED) != 0)
+		{
+			continue;
+		}
+
+		if (sockets->udp_port_total < DEVICE_DEFENDER_MAX_PORTS)
+		{
+			sockets->udp_ports[sockets->udp_port_total] = pcb->local_port;
+		}
+		sockets->udp_port_total++;
+	}
+
+	return ESP_OK;
+}
+
+/**
+ * Reads the traffic and health counters.
+ * @param totals receives them
+ */
+static void device_defender_read_totals(device_defender_totals_t *totals)
+{
+	totals->bytes_in = atomic_load_explicit(&device_defender_bytes_in, memory_order_relaxed);
+	totals->bytes_out = atomic_load_explicit(&device_defender_bytes_out, memory_order_relaxed);
+	totals->packets_in = atomic_load_explicit(&device_defender_packets_in, memory_order_relaxed);
+	totals->packets_out = atomic_load_explicit(&device_defender_packets_out, memory_order_relaxed);
+
+	for (int i = 0; i < METRICS_COUNTERS; i++)
+	{
+		totals->counters[i] = metrics_counter_value(i);
+	}
+}
+
+/**
+ * Encodes the established TCP connections.
+ * @param map metrics map
+ * @param sockets listed sockets
+ * @return CborNoError or the encoder errors
+ */
+static CborError device_defender_encode_connections(CborEncoder *map, const device_defender_sockets_t *sockets)
+{
+	const device_defender_connection_t *connection;
+	char ip[IPADDR_STRLEN_MAX];
+	char remote_addr[IPADDR_STRLEN_MAX + 6];
+	size_t count = MIN(sockets->connection_total, DEVICE_DEFENDER_MAX_CONNECTIONS);
+	CborEncoder tcp;
+	CborEncoder established;
+	CborEncoder array;
+	CborEncoder entry;
+	CborError err = CborNoError;
+
+	err |= cbor_encode_text_stringz(map, DEFENDER_REPORT_TCP_CONNECTIONS_KEY);
+	err |= cbor_encoder_create_map(map, &tcp, 1);
+	err |= cbor_encode_text_stringz(&tcp, DEFENDER_REPORT_ESTABLISHED_CONNECTIONS_KEY);
+	err |= cbor_encoder_create_map(&tcp, &established, 2);
+
+	err |= cbor_encode_text_stringz(&established, DEFENDER_REPORT_CONNECTIONS_KEY);
+	err |= cbor_encoder_create_array(&established, &array, count);
+	for (size_t i = 0; i < count; i++)
+	{
+		connection = &sockets->connections[i];
+		ipaddr_ntoa_r(&connection->remote_ip, ip, sizeof(ip));
+		snprintf(remote_addr, sizeof(remote_addr), "%s:%u", ip, connection->remote_port);
+
+		err |= cbor_encoder_create_map(&array, &entry, 2);
+		err |= cbor_encode_text_stringz(&entry, DEFENDER_REPORT_REMOTE_ADDR_KEY);
+		err |= cbor_encode_text_stringz(&entry, remote_addr);
+		err |= cbor_encode_text_stringz(&entry, DEFENDER_REPORT_LOCAL_PORT_KEY);
+		err |= cbor_encode_uint(&entry, connection->local_port);
+		err |= cbor_encoder_close_container(&array, &entry);
+	}
+	err |= cbor_encoder_close_container(&established, &array);
+
+	err |= cbor_encode_text_stringz(&established, DEFENDER_REPORT_TOTAL_KEY);
+	err |= cbor_encode_uint(&established, sockets->connection_total);
+	err |= cbor_encoder_close_container(&tcp, &established);
+	err |= cbor_encoder_close_container(map, &tcp);
+
+	return err;
+}
+
+/**
+ * Encodes a list of listening ports.
+ * @param map metrics map
+ * @param key DEFENDER_REPORT_TCP_LISTENING_PORTS_KEY or DEFENDER_REPORT_UDP_LISTENING_PORTS_KEY
+ * @param ports listed ports
+ * @param total number of ports, including those that did not fit
+ * @return CborNoError or the encoder errors
+ */
+static CborError device_defender_encode_ports(CborEncoder *map, const char *key, const uint16_t *ports, uint32_t total)
+{
+	size_t count = MIN(total, DEVICE_DEFENDER_MAX_PORTS);
+	CborEncoder listening;
+	CborEncoder array;
+	CborEncoder entry;
+	CborError err = CborNoError;
+
+	err |= cbor_encode_text_stringz(map, key);
+	err |= cbor_encoder_create_map(map, &listening, 2);
+
+	err |= cbor_encode_text_stringz(&listening, DEFENDER_REPORT_PORTS_KEY);
+	err |= cbor_encoder_create_array(&listening, &array, count);
+	for (size_t i = 0; i < count; i++)
+	{
+		err |= cbor_encoder_create_map(&array, &entry, 1);
+		err |= cbor_encode_text_stringz(&entry, DEFENDER_REPORT_PORT_KEY);
+		err |= cbor_encode_uint(&entry, ports[i]);
+		err |= cbor_encoder_close_container(&array, &entry);
+	}
+	err |= cbor_encoder_close_container(&listening, &array);
+
+	err |= cbor_encode_text_stringz(&listening, DEFENDER_REPORT_TOTAL_KEY);
+	err |= cbor_encode_uint(&listening, total);
+	err |= cbor_encoder_close_container(map, &listening);
+
+	return err;
+}
+
+/**
+ * Encodes the interface traffic since the last report.
+ * @param map metrics map
+ * @param now totals now
+ * @param last totals at the last report
+ * @return CborNoError or the encoder errors
+ */
+static CborError device_defender_encode_network_stats(CborEncoder *map, const device_defender_totals_t *now,
+													  const device_defender_totals_t *last)
+{
+	CborEncoder stats;
+	CborError err = CborNoError;
+
+	err |= cbor_encode_text_stringz(map, DEFENDER_REPORT_NETWORK_STATS_KEY);
+	err |= cbor_encoder_create_map(map, &stats, 4);
+	err |= cbor_encode_text_stringz(&stats, DEFENDER_REPORT_BYTES_IN_KEY);
+	err |= cbor_encode_uint(&stats, now->bytes_in - last->bytes_in);
+	err |= cbor_encode_text_stringz(&stats, DEFENDER_REPORT_BYTES_OUT_KEY);
+	err |= cbor_encode_uint(&stats, now->bytes_out - last->bytes_out);
+	err |= cbor_encode_text_stringz(&stats, DEFENDER_REPORT_PKTS_IN_KEY);
+	err |= cbor_encode_uint(&stats, now->packets_in - last->packets_in);
+	err |= cbor_encode_text_stringz(&stats, DEFENDER_REPORT_PKTS_OUT_KEY);
+	err |= cbor_encode_uint(&stats, now->packets_out - last->packets_out);
+	err |= cbor_encoder_close_container(map, &stats);
+
+	return err;
+}
+
+/**
+ * Encodes a custom metric of type number.
+ * @param map custom metrics map
+ * @param name metric name
+ * @param value metric value
+ * @return CborNoError or the encoder errors
+ */
+static CborError device_defender_encode_custom_metric(CborEncoder *map, const char *name, uint32_t value)
+{
+	CborEncoder array;
+	CborEncoder number;
+	CborError err = CborNoError;
+
+	err |= cbor_encode_text_stringz(map, name);
+	err |= cbor_encoder_create_array(map, &array, 1);
+	err |= cbor_encoder_create_map(&array, &number, 1);
+	err |= cbor_encode_text_stringz(&number, DEFENDER_REPORT_NUMBER_KEY);
+	err |= cbor_encode_uint(&number, value);
+	err |= cbor_encoder_close_container(&array, &number);
+	err |= cbor_encoder_close_container(map, &array);
+
+	return err;
+}
+
+/**
+ * Encodes a report.
+ * @param buff receives the report
+ * @param size size of buff
+ * @param len receives the length of the report
+ * @param report_id report ID, increasing from one report to the next
+ * @param sockets listed sockets
+ * @param now totals now
+ * @param last totals at the last report
+ * @return CborNoError or the encoder errors
+ */
+static CborError device_defender_encode_report(uint8_t *buff, size_t size, size_t *len, int64_t report_id,
+											   const device_defender_sockets_t *sockets,
+											   const device_defender_totals_t *now,
+											   const device_defender_totals_t *last)
+{
+	CborEncoder encoder;
+	CborEncoder report;
+	CborEncoder inner;
+	CborError err = CborNoError;
+
+	cbor_encoder_init(&encoder, buff, size, 0);
+	err |= cbor_encoder_create_map(&encoder, &report, 3);
+
+	err |= cbor_encode_text_stringz(&report, DEFENDER_REPORT_HEADER_KEY);
+	err |= cbor_encoder_create_map(&report, &inner, 2);
+	err |= cbor_encode_text_stringz(&inner, DEFENDER_REPORT_ID_KEY);
+	err |= cbor_encode_int(&inner, report_id);
+	err |= cbor_encode_text_stringz(&inner, DEFENDER_REPORT_VERSION_KEY);
+	err |= cbor_encode_text_stringz(&inner, DEVICE_DEFENDER_REPORT_VERSION);
+	err |= cbor_encoder_close_container(&report, &inner);
+
+	err |= cbor_encode_text_stringz(&report, DEFENDER_REPORT_METRICS_KEY);
+	err |= cbor_encoder_create_map(&report, &inner, 4);
+	err |= device_defender_encode_connections(&inner, sockets);
+	err |= device_defender_encode_ports(&inner, DEFENDER_REPORT_TCP_LISTENING_PORTS_KEY, sockets->tcp_ports,
+										sockets->tcp_port_total);
+	err |= device_defender_encode_ports(&inner, DEFENDER_REPORT_UDP_LISTENING_PORTS_KEY, sockets->udp_ports,
+										sockets->udp_port_total);
+	err |= device_defender_encode_network_stats(&inner, now, last);
+	err |= cbor_encoder_close_container(&report, &inner);
+
+	err |= cbor_encode_text_stringz(&report, DEFENDER_REPORT_CUSTOM_METRICS_KEY);
+	err |= cbor_encoder_create_map(&report, &inner, METRICS_COUNTERS + DEVICE_DEFENDER_HEAP_METRICS);
+	for (int i = 0; i < METRICS_COUNTERS; i++)
+	{
+		err |= device_defender_encode_custom_metric(&inner, metrics_counter_name(i),
+													now->counters[i] - last->counters[i]);
+	}
+	err |= device_defender_encode_custom_metric(&inner, "heap_min_free", esp_get_minimum_free_heap_size());
+	err |= device_defender_encode_custom_metric(&inner, "heap_largest_block",
+												heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+	err |= cbor_encoder_close_container(&report, &inner);
+
+	err |= cbor_encoder_close_container(&encoder, &report);
+
+	if (err == CborNoError)
+	{
+		*len = cbor_encoder_get_buffer_size(&encoder, buff);
+	}
+
+	return err;
+}
+
+/**
+ * Collects, encodes and publishes a report.
+ * @param sockets scratch space for the socket list
+ * @param last totals at the last report, updated once the report is sent
+ * @return ESP_OK, or the error that stopped the report
+ */
+static esp_err_t device_defender_send_report(device_defender_sockets_t *sockets, device_defender_totals_t *last)
+{
+	device_defender_totals_t now;
+	int64_t report_id = time(NULL);
+	int64_t start;
+	int64_t collected;
+	int64_t encoded;
+	uint8_t *buff;
+	size_t len = 0;
+	bool rewrapped = false;
+	CborError cbor_err;
+	esp_err_t err;
+
+	buff = malloc(DEVICE_DEFENDER_REPORT_MAX_LEN);
+	if (buff == NULL)
+	{
+		ESP_LOGE(TAG, "device_defender_send_report: No memory for the report");
+		return ESP_ERR_NO_MEM;
+	}
+
+	start = esp_timer_get_time();
+
+	// Frames sent or received while the wrappers were off are not counted
+	if (esp_netif_tcpip_exec(device_defender_wrap_netifs, &rewrapped) == ESP_OK && rewrapped)
+	{
+		ESP_LOGW(TAG, "device_defender_send_report: WiFi interface restarted, traffic counting resumed");
+	}
+
+	memset(sockets, 0, sizeof(*sockets));
+	err = esp_netif_tcpip_exec(device_defender_list_sockets, sockets);
+	device_defender_read_totals(&now);
+	collected = esp_timer_get_time();
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "device_defender_send_report: Error listing sockets: %s", esp_err_to_name(err));
+		free(buff);
+		return err;
+	}
+
+	cbor_err = device_defender_encode_report(buff, DEVICE_DEFENDER_REPORT_MAX_LEN, &len, report_id, sockets, &now, last);
+	encoded = esp_timer_get_time();
+
+	if (cbor_err != CborNoError)
+	{
+		ESP_LOGE(TAG, "device_defender_send_report: Error encoding the report: %s", cbor_error_string(cbor_err));
+		free(buff);
+		return (cbor_err == CborErrorOutOfMemory) ? ESP_ERR_NO_MEM : ESP_FAIL;
+	}
+
+	metrics_observe(METRICS_DEFENDER_REPORT_US, (uint32_t) (encoded - start));
+
+	err = mqtt_agent_manager_publish(device_defender_topic, buff, len, MQTTQoS1, DEVICE_DEFENDER_ENQUEUE_TIMEOUT_MS);
+	free(buff);
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGW(TAG, "device_defender_send_report: Error publishing report %" PRId64 ": %s", report_id, esp_err_to_name(err));
+		return err;
+	}
+
+	ESP_LOGI(TAG, "device_defender_send_report: report %" PRId64 ", %u bytes, collected in %" PRId64 " us, encoded in %" PRId64 " us",
+			 report_id, (unsigned int) len, collected - start, encoded - collected);
+	*last = now;
+
+	return ESP_OK;
+}
+
+/**
+ * Logs Device Defender's response to a report.
+ * @param pPublishInfo response on the accepted or rejected topic
+ * @param arg unused
+ */
+static void device_defender_response_callback(MQTTPublishInfo_t *pPublishInfo, void *arg)
+{
+	DefenderTopic_t api;
+
+	if (Defender_MatchTopic(pPublishInfo->pTopicName, pPublishInfo->topicNameLength, &api, NULL, NULL) != DefenderSuccess)
+	{
+		return;
+	}
+
+	if (api == DefenderCborReportRejected)
+	{
+		ESP_LOGW(TAG, "device_defender_response_callback: Report rejected");
+	}
+	else if (api == DefenderCborReportAccepted)
+	{
+		ESP_LOGD(TAG, "device_defender_response_callback: Report accepted");
+	}
+}
+
+/**
+ * Waits for wifi_app_task to create the station and SoftAP netifs, then
+ * starts counting their traffic.
+ */
+static void device_defender_count_traffic(void)
+{
+	TickType_t start = xTaskGetTickCount();
+	esp_err_t err;
+
+	while ((esp_netif_sta == NULL || esp_netif_ap == NULL) &&
+		   xTaskGetTickCount() - start < pdMS_TO_TICKS(DEVICE_DEFENDER_NETIF_WAIT_MS))
+	{
+		vTaskDelay(pdMS_TO_TICKS(100));
+	}
+
+	// esp_netif_init has run once either interface exists
+	err = (esp_netif_sta != NULL || esp_netif_ap != NULL) ? esp_netif_tcpip_exec(device_defender_wrap_netifs, NULL)
+														  : ESP_ERR_NOT_FOUND;
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "device_defender_count_traffic: Error (%s) wrapping the WiFi interfaces, traffic is reported as 0",
+				 esp_err_to_name(err));
+	}
+	else if (esp_netif_sta == NULL || esp_netif_ap == NULL)
+	{
+		ESP_LOGW(TAG, "device_defender_count_traffic: Only counting the %s interface",
+				 (esp_netif_sta != NULL) ? "station" : "SoftAP");
+	}
+}
+
+/**
+ * Report task: waits for the clock, since report IDs are Unix times, then
+ * sends a report every CONFIG_DEVICE_DEFENDER_REPORT_INTERVAL_S while
+ * connected. A report that is not sent is folded into the next one.
+ * @param param unused
+ */
+static void device_defender_task(void *param)
+{
+	// Static, to keep it off the task stack
+	static device_defender_sockets_t sockets;
+	device_defender_totals_t last;
+	TickType_t last_wake;
+
+	device_defender_count_traffic();
+
+	if (mqtt_agent_manager_subscribe(device_defender_response_filter, MQTTQoS0, device_defender_response_callback,
+									 NULL) == ESP_ERR_NO_MEM)
+	{
+		ESP_LOGW(TAG, "device_defender_task: No room to subscribe, responses are not logged");
+	}
+
+	device_defender_read_totals(&last);
+
+	while (!sntp_time_synced())
+	{
+		vTaskDelay(pdMS_TO_TICKS(1000));
+	}
+
+	last_wake = xTaskGetTickCount();
+
+	for (;;)
+	{
+		xTaskDelayUntil(&last_wake, pdMS_TO_TICKS(CONFIG_DEVICE_DEFENDER_REPORT_INTERVAL_S * 1000));
+
+		if (!mqtt_agent_manager_wait_connected(0))
+		{
+			ESP_LOGW(TAG, "device_defender_task: Not connected, report skipped");
+			continue;
+		}
+
+		device_defender_send_report(&sockets, &last);
+	}
+}
+
+void device_defender_start(void)
+{
+	uint16_t len;
+
+	if (task_device_defender != NULL)
+	{
+		return;
+	}
+
+	if (Defender_GetTopic(device_defender_topic, sizeof(device_defender_topic) - 1, DEVICE_DEFENDER_THING_NAME,
+						  (uint16_t) strlen(DEVICE_DEFENDER_THING_NAME), DefenderCborReportPublish, &len) != DefenderSuccess)
+	{
+		ESP_LOGE(TAG, "device_defender_start: Thing name %s does not make a valid topic", DEVICE_DEFENDER_THING_NAME);
+		return;
+	}
+
+	// One filter for both responses, "<report topic>/+"
+	snprintf(device_defender_response_filter, sizeof(device_defender_response_filter), "%.*s/+", len,
+			 device_defender_topic);
+
+	xTaskCreatePinnedToCore(&device_defender_task, "defender_task", DEVICE_DEFENDER_TASK_STACK_SIZE, NULL,
+							DEVICE_DEFENDER_TASK_PRIORITY, &task_device_defender, DEVICE_DEFENDER_TASK_CORE_ID);
+}
@@ -0,0 +1,39 @@
+/*
+ * device_defender.h
+ *
+ * AWS IoT Device Defender metrics reports (CONFIG_DEVICE_DEFENDER), so the
+ * fleet's security profiles can flag a meter that starts talking to new
+ * hosts, opens ports or moves unusual amounts of data. Every
+ * CONFIG_DEVICE_DEFENDER_REPORT_INTERVAL_S seconds a report is published to
+ * $aws/things/<client id>/defender/metrics/cbor with:
+ * - the established TCP connections and the listening TCP and UDP ports;
+ * - bytes and packets in and out on the WiFi interfaces since the last report;
+ * - the health counters (metrics.h) since the last report, and the lowest
+ *   free heap and largest free block, as custom metrics.
+ *
+ * Reports are CBOR with the short keys, a few hundred bytes each. Security
+ * profiles can only use the custom metrics once they are created in AWS IoT
+ * as number metrics with the names in the report, e.g. "i2c_errors".
+ */
+
+#ifndef MAIN_DEVICE_DEFENDER_H_
+#define MAIN_DEVICE_DEFENDER_H_
+
+// Connections and ports listed in a report; the totals count all of them
+#define DEVICE_DEFENDER_MAX_CONNECTIONS		16
+#define DEVICE_DEFENDER_MAX_PORTS			16
+
+// Buffer that holds a report
+#define DEVICE_DEFENDER_REPORT_MAX_LEN		1536
+
+// How long a publish may wait for room in the agent command queue
+#define DEVICE_DEFENDER_ENQUEUE_TIMEOUT_MS	1000
+
+/**
+ * Starts the report task. It starts counting interface traffic once
+ * wifi_app_task has created the station and SoftAP interfaces, and sends the
+ * first report one interval after the clock is set.
+ */
+void device_defender_start(void);
+
+#endif /* MAIN_DEVICE_DEFENDER_H_ */
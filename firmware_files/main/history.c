@@ -0,0 +1,705 @@
+/*
+ * history.c
+ *
+ * Each log is a ring of flash sectors. A sector starts with a header giving
+ * its log and a sequence number, followed by fixed size records in time
+ * order; records not written yet are still erased. At boot the headers are
+ * read into a sparse index holding, for each sector, its sequence number,
+ * the time of its first record and its record count, found with a binary
+ * search for the first erased record. A query uses the index to skip to the
+ * sector that covers its start, finds the first record in it with another
+ * binary search and then reads forward in small batches until the end of the
+ * range, so it only reads the records it returns.
+ *
+ * The recorder task keeps its own position in the acquisition ring, folds
+ * each sample into the current minute and each finished minute into the
+ * current hour. A record's time is its first field, so a write cut short by
+ * a reset leaves a record with odd values rather than a hole in the log.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sys/param.h"
+
+#include "acquisition.h"
+#include "history.h"
+#include "tasks_common.h"
+
+static const char TAG[] = "history";
+
+// First bytes of a sector in use
+#define HISTORY_MAGIC				"GSH1"
+
+#define HISTORY_SECTOR_SIZE			4096
+
+// Sectors given to the hour log, the rest of the partition holds minutes
+#define HISTORY_HOUR_SECTORS		4
+
+// Most sectors indexed: the 64 KB history partition of partitions_two_ota.csv.
+// A larger partition is only used up to this many sectors.
+#define HISTORY_MAX_SECTORS			16
+
+// Records read from flash at a time by a query
+#define HISTORY_READ_BATCH			16
+
+// Samples older than 2024 were taken before SNTP set the clock
+#define HISTORY_MIN_TIME			1704067200
+
+// Time field of a record not written yet
+#define HISTORY_ERASED_TIME			UINT32_MAX
+
+// The logs, by rollup interval
+typedef enum history_level
+{
+	HISTORY_LEVEL_MINUTE = 0,
+	HISTORY_LEVEL_HOUR,
+	HISTORY_LEVELS
+} history_level_e;
+
+static const uint32_t history_interval[HISTORY_LEVELS] = {
+	[HISTORY_LEVEL_MINUTE] = 60,
+	[HISTORY_LEVEL_HOUR] = 3600,
+};
+
+typedef struct __attribute__((packed)) history_header
+{
+	char magic[4];
+	uint8_t level;
+	uint8_t reserved[3];
+	uint32_t seq;
+	uint32_t reserved2;
+} history_header_t;
+
+// Values are stored in fixed point, see history_channel_info
+typedef struct __attribute__((packed)) history_record
+{
+	uint32_t time;
+	uint16_t count;
+	int16_t min[HISTORY_CHANNELS];
+	int16_t mean[HISTORY_CHANNELS];
+	int16_t max[HISTORY_CHANNELS];
+} history_record_t;
+
+#define HISTORY_RECORDS_PER_SECTOR	((HISTORY_SECTOR_SIZE - sizeof(history_header_t)) / sizeof(history_record_t))
+
+// Index entry for one sector
+typedef struct history_sector
+{
+	bool valid;					// Has a header for this log
+	uint32_t seq;
+	uint32_t first_time;		// HISTORY_ERASED_TIME while empty
+	uint16_t count;
+} history_sector_t;
+
+typedef struct history_log
+{
+	size_t base;				// First sector of the log in the partition
+	size_t len;					// Sectors in the log
+	size_t active;				// Sector records are appended to, from 0
+	uint32_t last_time;			// Time of the newest record, 0 if there is none
+	history_sector_t *sectors;
+} history_log_t;
+
+// Channels pulled out of a sample, or folded together over an interval
+typedef struct history_acc
+{
+	uint32_t time;
+	uint32_t count;
+	float min[HISTORY_CHANNELS];
+	float max[HISTORY_CHANNELS];
+	float sum[HISTORY_CHANNELS];
+} history_acc_t;
+
+static const struct history_channel_info
+{
+	const char *name;
+	const char *unit;
+	float scale;				// Stored value per unit
+} history_channel_info[HISTORY_CHANNELS] = {
+	[HISTORY_FEEDER_VOLTAGE] = {"feeder_voltage", "V", 100},
+	[HISTORY_FEEDER_CURRENT] = {"feeder_current", "mA", 10},
+	[HISTORY_TRANSFORMER1_CURRENT] = {"transformer1_current", "mA", 10},
+	[HISTORY_TRANSFORMER2_CURRENT] = {"transformer2_current", "mA", 10},
+	[HISTORY_TRANSFORMER3_CURRENT] = {"transformer3_current", "mA", 10},
+};
+
+static const esp_partition_t *history_partition;
+
+static history_sector_t history_sectors[HISTORY_MAX_SECTORS];
+
+static history_log_t history_logs[HISTORY_LEVELS];
+
+// Guards the index and the partition between the recorder and queries
+static SemaphoreHandle_t history_lock;
+
+// Rollups being built by the recorder
+static history_acc_t history_minute;
+static history_acc_t history_hour;
+
+// Recorder task handle
+static TaskHandle_t task_history = NULL;
+
+static size_t history_record_offset(const history_log_t *log, size_t sector, size_t n)
+{
+	return (log->base + sector) * HISTORY_SECTOR_SIZE + sizeof(history_header_t) + n * sizeof(history_record_t);
+}
+
+/**
+ * Reads the time of a record.
+ * @return the time, or HISTORY_ERASED_TIME if it cannot be read
+ */
+static uint32_t history_read_time(const history_log_t *log, size_t sector, size_t n)
+{
+	uint32_t time;
+
+	if (esp_partition_read(history_partition, history_record_offset(log, sector, n), &time, sizeof(time)) != ESP_OK)
+	{
+		return HISTORY_ERASED_TIME;
+	}
+	return time;
+}
+
+/**
+ * Finds the first record in a sector with a time of at least time.
+ * @return its index, or the record count if there is none
+ */
+static size_t history_search(const history_log_t *log, size_t sector, uint32_t time)
+{
+	size_t lo = 0;
+	size_t hi = log->sectors[sector].count;
+	size_t mid;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if (history_read_time(log, sector, mid) < time)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/**
+ * Erases a sector and makes it the one records are appended to.
+ * @return ESP_OK or the error from flash
+ */
+static esp_err_t history_open_sector(history_log_t *log, history_level_e level, size_t sector, uint32_t seq)
+{
+	history_header_t header = {
+		.magic = HISTORY_MAGIC,
+		.level = level,
+		.seq = seq,
+	};
+	history_sector_t *entry = &log->sectors[sector];
+	esp_err_t err;
+
+	entry->valid = false;
+
+	err = esp_partition_erase_range(history_partition, (log->base + sector) * HISTORY_SECTOR_SIZE, HISTORY_SECTOR_SIZE);
+	if (err == ESP_OK)
+	{
+		err = esp_partition_write(history_partition, (log->base + sector) * HISTORY_SECTOR_SIZE, &header, sizeof(header));
+	}
+	if (err != ESP_OK)
+	{
+		return err;
+	}
+
+	entry->valid = true;
+	entry->seq = seq;
+	entry->first_time = HISTORY_ERASED_TIME;
+	entry->count = 0;
+	log->active = sector;
+
+	return ESP_OK;
+}
+
+/**
+ * Builds the index of a log from the sector headers, or starts the log if it
+ * has none.
+ * @return ESP_OK or the error from flash
+ */
+static esp_err_t history_load_log(history_log_t *log, history_level_e level)
+{
+	history_header_t header;
+	history_sector_t *entry;
+	size_t lo;
+	size_t hi;
+	size_t mid;
+	bool found = false;
+
+	for (size_t i = 0; i < log->len; i++)
+	{
+		entry = &log->sectors[i];
+		entry->valid = esp_partition_read(history_partition, (log->base + i) * HISTORY_SECTOR_SIZE, &header,
+										  sizeof(header)) == ESP_OK &&
+					   memcmp(header.magic, HISTORY_MAGIC, sizeof(header.magic)) == 0 && header.level == level;
+		if (!entry->valid)
+		{
+			continue;
+		}
+
+		entry->seq = header.seq;
+
+		// Records are written in order, so the erased ones are all at the end
+		lo = 0;
+		hi = HISTORY_RECORDS_PER_SECTOR;
+		while (lo < hi)
+		{
+			mid = lo + (hi - lo) / 2;
+			if (history_read_time(log, i, mid) != HISTORY_ERASED_TIME)
+			{
+				lo = mid + 1;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+		entry->count = lo;
+		entry->first_time = (lo > 0) ? history_read_time(log, i, 0) : HISTORY_ERASED_TIME;
+
+		if (!found || entry->seq > log->sectors[log->active].seq)
+		{
+			log->active = i;
+			found = true;
+		}
+	}
+
+	if (!found)
+	{
+		return history_open_sector(log, level, 0, 0);
+	}
+
+	// The newest record is at the end of the active sector, or of the one before if it is empty
+	entry = &log->sectors[log->active];
+	if (entry->count > 0)
+	{
+		log->last_time = history_read_time(log, log->active, entry->count - 1);
+	}
+	else
+	{
+		mid = (log->active + log->len - 1) % log->len;
+		if (log->sectors[mid].valid && log->sectors[mid].count > 0)
+		{
+			log->last_time = history_read_time(log, mid, log->sectors[mid].count - 1);
+		}
+	}
+
+	return ESP_OK;
+}
+
+/**
+ * Appends a record to a log, moving on to the next sector when the active
+ * one is full. Called with history_lock held.
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if the record is not newer than the
+ * last one, or the error from flash
+ */
+static esp_err_t history_append(history_level_e level, const history_record_t *record)
+{
+	history_log_t *log = &history_logs[level];
+	history_sector_t *entry = &log->sectors[log->active];
+	esp_err_t err;
+
+	// A clock set back would break the time order the search relies on
+	if (record->time <= log->last_time)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (!entry->valid || entry->count == HISTORY_RECORDS_PER_SECTOR)
+	{
+		err = history_open_sector(log, level, (log->active + 1) % log->len, entry->seq + 1);
+		if (err != ESP_OK)
+		{
+			return err;
+		}
+		entry = &log->sectors[log->active];
+	}
+
+	err = esp_partition_write(history_partition, history_record_offset(log, log->active, entry->count), record,
+							  sizeof(*record));
+	if (err != ESP_OK)
+	{
+		return err;
+	}
+
+	if (entry->count == 0)
+	{
+		entry->first_time = record->time;
+	}
+	entry->count++;
+	log->last_time = record->time;
+
+	return ESP_OK;
+}
+
+/**
+ * Time of the oldest record in a log. Called with history_lock held.
+ * @return the time, or HISTORY_ERASED_TIME if the log is empty
+ */
+static uint32_t history_oldest_time(const history_log_t *log)
+{
+	const history_sector_t *entry;
+
+	for (size_t k = 1; k <= log->len; k++)
+	{
+		entry = &log->sectors[(log->active + k) % log->len];
+		if (entry->valid && entry->count > 0)
+		{
+			return entry->first_time;
+		}
+	}
+	return HISTORY_ERASED_TIME;
+}
+
+static int16_t history_to_fixed(history_channel_e channel, float value)
+{
+	float fixed = roundf(value * history_channel_info[channel].scale);
+
+	return (int16_t) MAX(MIN(fixed, INT16_MAX), INT16_MIN);
+}
+
+/**
+ * Folds src into dst.
+ */
+static void history_acc_merge(history_acc_t *dst, const history_acc_t *src)
+{
+	for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+	{
+		dst->min[ch] = (dst->count == 0) ? src->min[ch] : MIN(dst->min[ch], src->min[ch]);
+		dst->max[ch] = (dst->count == 0) ? src->max[ch] : MAX(dst->max[ch], src->max[ch]);
+		dst->sum[ch] += src->sum[ch];
+	}
+	dst->count += src->count;
+}
+
+/**
+ * Writes a rollup to its log and clears it.
+ */
+static void history_write(history_level_e level, history_acc_t *acc)
+{
+	history_record_t record = {
+		.time = acc->time,
+		.count = MIN(acc->count, UINT16_MAX),
+	};
+	esp_err_t err;
+
+	for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+	{
+		record.min[ch] = history_to_fixed(ch, acc->min[ch]);
+		record.mean[ch] = history_to_fixed(ch, acc->sum[ch] / acc->count);
+		record.max[ch] = history_to_fixed(ch, acc->max[ch]);
+	}
+
+	xSemaphoreTake(history_lock, portMAX_DELAY);
+	err = history_append(level, &record);
+	xSemaphoreGive(history_lock);
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGW(TAG, "history_write: %" PRIu32 "s rollup at %" PRIu32 " not stored: %s", history_interval[level],
+				 record.time, esp_err_to_name(err));
+	}
+
+	memset(acc, 0, sizeof(*acc));
+}
+
+/**
+ * Adds a sample to the current minute, writing out the minute and the hour
+ * when it is the first of a new one.
+ */
+static void history_record_sample(const acquisition_sample_t *sample)
+{
+	uint32_t time = (uint32_t) (sample->timestamp_ms / 1000);
+	uint32_t minute = time - time % history_interval[HISTORY_LEVEL_MINUTE];
+	uint32_t hour;
+	history_acc_t one = {
+		.count = 1,
+		.sum = {
+			[HISTORY_FEEDER_VOLTAGE] = sample->feeder_line_voltage,
+			[HISTORY_FEEDER_CURRENT] = sample->feeder_current,
+			[HISTORY_TRANSFORMER1_CURRENT] = sample->transformer_current[0],
+			[HISTORY_TRANSFORMER2_CURRENT] = sample->transformer_current[1],
+			[HISTORY_TRANSFORMER3_CURRENT] = sample->transformer_current[2],
+		},
+	};
+
+	if (history_minute.count > 0 && history_minute.time != minute)
+	{
+		hour = history_minute.time - history_minute.time % history_interval[HISTORY_LEVEL_HOUR];
+		if (history_hour.count > 0 && history_hour.time != hour)
+		{
+			history_write(HISTORY_LEVEL_HOUR, &history_hour);
+		}
+		history_hour.time = hour;
+		history_acc_merge(&history_hour, &history_minute);
+		history_write(HISTORY_LEVEL_MINUTE, &history_minute);
+	}
+
+	memcpy(one.min, one.sum, sizeof(one.min));
+	memcpy(one.max, one.sum, sizeof(one.max));
+	history_minute.time = minute;
+	history_acc_merge(&history_minute, &one);
+}
+
+/**
+ * Recorder task.
+ */
+static void history_task(void *param)
+{
+	acquisition_sample_t sample;
+	uint32_t seq = 0;
+
+	for (;;)
+	{
+		if (acquisition_read(seq, &sample, portMAX_DELAY) != ESP_OK)
+		{
+			vTaskDelay(pdMS_TO_TICKS(1000));
+			continue;
+		}
+
+		// Samples from before the clock was set are dated once it is, as long as they are still in the ring
+		if (sample.timestamp_ms == 0)
+		{
+			seq = sample.seq;
+			vTaskDelay(pdMS_TO_TICKS(1000));
+			continue;
+		}
+		seq = sample.seq + 1;
+
+		if (sample.timestamp_ms >= (int64_t) HISTORY_MIN_TIME * 1000)
+		{
+			history_record_sample(&sample);
+		}
+	}
+}
+
+void history_start(void)
+{
+	size_t sectors;
+	esp_err_t err;
+
+	if (task_history != NULL)
+	{
+		return;
+	}
+
+	history_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+												 HISTORY_PARTITION_LABEL);
+	sectors = (history_partition != NULL) ? MIN(history_partition->size / HISTORY_SECTOR_SIZE, HISTORY_MAX_SECTORS) : 0;
+	if (sectors < HISTORY_HOUR_SECTORS + 2)
+	{
+		ESP_LOGW(TAG, "history_start: no \"%s\" partition, readings are not stored", HISTORY_PARTITION_LABEL);
+		history_partition = NULL;
+		return;
+	}
+
+	history_logs[HISTORY_LEVEL_MINUTE].base = 0;
+	history_logs[HISTORY_LEVEL_MINUTE].len = sectors - HISTORY_HOUR_SECTORS;
+	history_logs[HISTORY_LEVEL_MINUTE].sectors = &history_sectors[0];
+	history_logs[HISTORY_LEVEL_HOUR].base = sectors - HISTORY_HOUR_SECTORS;
+	history_logs[HISTORY_LEVEL_HOUR].len = HISTORY_HOUR_SECTORS;
+	history_logs[HISTORY_LEVEL_HOUR].sectors = &history_sectors[sectors - HISTORY_HOUR_SECTORS];
+
+	for (int level = 0; level < HISTORY_LEVELS; level++)
+	{
+		err = history_load_log(&history_logs[level], level);
+		if (err != ESP_OK)
+		{
+			ESP_LOGE(TAG, "history_start: cannot load the %" PRIu32 "s log: %s", history_interval[level],
+					 esp_err_to_name(err));
+			history_partition = NULL;
+			return;
+		}
+	}
+
+	ESP_LOGI(TAG, "history_start: %u minute and %u hour sectors of %u records",
+			 (unsigned int) history_logs[HISTORY_LEVEL_MINUTE].len, (unsigned int) history_logs[HISTORY_LEVEL_HOUR].len,
+			 (unsigned int) HISTORY_RECORDS_PER_SECTOR);
+
+	history_lock = xSemaphoreCreateMutex();
+	xTaskCreatePinnedToCore(&history_task, "history_task", HISTORY_TASK_STACK_SIZE, NULL, HISTORY_TASK_PRIORITY,
+							&task_history, HISTORY_TASK_CORE_ID);
+}
+
+esp_err_t history_channel_from_name(const char *name, history_channel_e *channel)
+{
+	for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+	{
+		if (strcmp(name, history_channel_info[ch].name) == 0)
+		{
+			*channel = ch;
+			return ESP_OK;
+		}
+	}
+	return ESP_ERR_NOT_FOUND;
+}
+
+const char *history_channel_name(history_channel_e channel)
+{
+	return history_channel_info[channel].name;
+}
+
+const char *history_channel_unit(history_channel_e channel)
+{
+	return history_channel_info[channel].unit;
+}
+
+/**
+ * Hands a finished step to the query callback.
+ */
+static esp_err_t history_emit(const history_acc_t *acc, history_channel_e channel, history_point_cb_t cb, void *arg)
+{
+	float scale = history_channel_info[channel].scale;
+	history_point_t point = {
+		.time = acc->time,
+		.min = acc->min[0] / scale,
+		.mean = acc->sum[0] / acc->count / scale,
+		.max = acc->max[0] / scale,
+	};
+
+	return cb(&point, arg);
+}
+
+esp_err_t history_query(uint32_t from, uint32_t to, uint32_t *step, history_channel_e channel,
+						history_point_cb_t cb, void *arg)
+{
+	history_record_t batch[HISTORY_READ_BATCH];
+	history_level_e level = HISTORY_LEVEL_HOUR;
+	history_log_t *log;
+	history_sector_t *entry;
+	history_acc_t point = {0};
+	history_acc_t rec;
+	size_t sector = 0;
+	size_t n = 0;
+	size_t len;
+	uint32_t seq = 0;
+	bool found = false;
+	bool done = false;
+	esp_err_t err = ESP_OK;
+
+	if (history_partition == NULL)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+	if (from >= to || *step == 0 || *step > to - from || channel >= HISTORY_CHANNELS)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	xSemaphoreTake(history_lock, portMAX_DELAY);
+
+	if (*step < history_interval[HISTORY_LEVEL_HOUR] &&
+		history_oldest_time(&history_logs[HISTORY_LEVEL_MINUTE]) <= from)
+	{
+		level = HISTORY_LEVEL_MINUTE;
+	}
+	log = &history_logs[level];
+
+	// In 64 bits, a step near UINT32_MAX would round up past it to 0
+	*step = (uint32_t) MIN(((uint64_t) *step + history_interval[level] - 1) / history_interval[level] *
+							   history_interval[level],
+						   UINT32_MAX / history_interval[level] * history_interval[level]);
+	if ((to - from - 1) / *step >= HISTORY_MAX_POINTS)
+	{
+		xSemaphoreGive(history_lock);
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// The index gives the last sector starting at or before from, oldest first
+	for (size_t k = 1; k <= log->len; k++)
+	{
+		size_t i = (log->active + k) % log->len;
+
+		entry = &log->sectors[i];
+		if (entry->valid && entry->count > 0 && (!found || entry->first_time <= from))
+		{
+			sector = i;
+			seq = entry->seq;
+			found = true;
+		}
+	}
+	if (found)
+	{
+		n = history_search(log, sector, from);
+	}
+
+	xSemaphoreGive(history_lock);
+
+	while (found && !done && err == ESP_OK)
+	{
+		xSemaphoreTake(history_lock, portMAX_DELAY);
+
+		entry = &log->sectors[sector];
+		if (!entry->valid || entry->seq != seq)
+		{
+			// Overwritten while the last batch was being sent
+			xSemaphoreGive(history_lock);
+			break;
+		}
+
+		if (n >= entry->count)
+		{
+			// Go on to the next sector unless this is the one being appended to
+			found = sector != log->active;
+			sector = (sector + 1) % log->len;
+			seq++;
+			n = 0;
+			xSemaphoreGive(history_lock);
+			continue;
+		}
+
+		len = MIN(entry->count - n, HISTORY_READ_BATCH);
+		err = esp_partition_read(history_partition, history_record_offset(log, sector, n), batch,
+								 len * sizeof(history_record_t));
+		n += len;
+
+		xSemaphoreGive(history_lock);
+
+		for (size_t i = 0; i < len && err == ESP_OK; i++)
+		{
+			if (batch[i].time >= to)
+			{
+				done = true;
+				break;
+			}
+
+			rec = (history_acc_t) {
+				.time = batch[i].time - batch[i].time % *step,
+				.count = batch[i].count,
+				.min = {batch[i].min[channel]},
+				.max = {batch[i].max[channel]},
+				.sum = {(float) batch[i].mean[channel] * batch[i].count},
+			};
+
+			if (point.count > 0 && point.time != rec.time)
+			{
+				err = history_emit(&point, channel, cb, arg);
+				memset(&point, 0, sizeof(point));
+			}
+			point.time = rec.time;
+			history_acc_merge(&point, &rec);
+		}
+	}
+
+	if (err == ESP_OK && point.count > 0)
+	{
+		err = history_emit(&point, channel, cb, arg);
+	}
+
+	return err;
+}
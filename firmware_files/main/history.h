@@ -0,0 +1,105 @@
+/*
+ * history.h
+ *
+ * Time-series store for past readings on the "history" flash partition, so a
+ * meter can show what it measured while it was offline. Samples from the
+ * acquisition ring are rolled up per minute and per hour into min, mean and
+ * max for each channel, and each rollup is appended to its own log of 4 KB
+ * segments that is overwritten oldest first.
+ *
+ * With the 64 KB partition the minute log holds about a day and the hour log
+ * about two weeks. Samples are only stored once the clock has been set.
+ */
+
+#ifndef MAIN_HISTORY_H_
+#define MAIN_HISTORY_H_
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Label of the partition that holds the logs
+#define HISTORY_PARTITION_LABEL		"history"
+
+// Most points a query may return
+#define HISTORY_MAX_POINTS			1440
+
+/**
+ * Channels kept in the store
+ */
+typedef enum history_channel
+{
+	HISTORY_FEEDER_VOLTAGE = 0,
+	HISTORY_FEEDER_CURRENT,
+	HISTORY_TRANSFORMER1_CURRENT,
+	HISTORY_TRANSFORMER2_CURRENT,
+	HISTORY_TRANSFORMER3_CURRENT,
+	HISTORY_CHANNELS
+} history_channel_e;
+
+/**
+ * A channel summarized over one step of a query
+ */
+typedef struct history_point
+{
+	uint32_t time;	///> Unix time the step starts at
+	float min;
+	float mean;
+	float max;
+} history_point_t;
+
+/**
+ * Receives the points of a query in time order. Called without the store
+ * locked, so it may block on the network.
+ * @param point the point, only valid during the call
+ * @param arg arg passed to history_query
+ * @return ESP_OK to continue, or an error that ends the query
+ */
+typedef esp_err_t (*history_point_cb_t)(const history_point_t *point, void *arg);
+
+/**
+ * Loads the segment index from the partition and starts recording samples.
+ * Does nothing but log a warning if the partition table has no history partition.
+ */
+void history_start(void);
+
+/**
+ * Looks up a channel by the name used in queries, e.g. "feeder_current".
+ * @param name channel name
+ * @param channel receives the channel
+ * @return ESP_OK or ESP_ERR_NOT_FOUND
+ */
+esp_err_t history_channel_from_name(const char *name, history_channel_e *channel);
+
+/**
+ * @param channel a channel
+ * @return its name
+ */
+const char *history_channel_name(history_channel_e channel);
+
+/**
+ * @param channel a channel
+ * @return the unit of its values, "V" or "mA"
+ */
+const char *history_channel_unit(history_channel_e channel);
+
+/**
+ * Reads a channel between two times, downsampled to one point per step. The
+ * minute log is used for steps under an hour as long as it reaches back to
+ * from; otherwise the hour log. Steps without data are left out.
+ * @param from start of the range, Unix time
+ * @param to end of the range, not included
+ * @param step seconds per point; rounded up to a whole number of minutes or
+ * hours and updated to the step used
+ * @param channel channel to read
+ * @param cb called for each point
+ * @param arg passed to cb
+ * @return ESP_OK, ESP_ERR_INVALID_STATE without a history partition,
+ * ESP_ERR_INVALID_ARG if the range is empty, the step is longer than the
+ * range or the range needs more than HISTORY_MAX_POINTS points, the error
+ * from flash or the error from cb
+ */
+esp_err_t history_query(uint32_t from, uint32_t to, uint32_t *step, history_channel_e channel,
+						history_point_cb_t cb, void *arg);
+
+#endif /* MAIN_HISTORY_H_ */
@@ -1,11 +1,23 @@
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "freertos/semphr.h"
 #include "esp_https_server.h"
 #include "esp_timer.h"
 #include "esp_log.h"
 #include "esp_ota_ops.h"
+#include "esp_rom_crc.h"
 #include "esp_wifi.h"
 #include "sys/param.h"
 
+#include "acquisition.h"
+#include "history.h"
+#include "metrics.h"
+#include "snapshot.h"
 #include "http_server.h"
+#include "ota_writer.h"
 #include "sntp_time_sync.h"
 #include "tasks_common.h"
 #include "wifi_app.h"
@@ -13,6 +25,53 @@
 // Tag used for ESP serial console messages
 static const char TAG[] = "http_server";
 
+// Firmware upload chunk read per httpd_req_recv
+#define OTA_RECV_CHUNK_SIZE         4096
+
+// Socket timeouts in a row tolerated while receiving the firmware, about 30 s in all
+#define OTA_RECV_TIMEOUT_RETRIES    6
+
+// Longest multipart delimiter: CRLF, "--" and a boundary of up to 70 characters
+#define OTA_MULTIPART_DELIM_MAX     (4 + 70)
+
+// Live telemetry stream: bytes sent to a client at most at once, and the longest event
+#define STREAM_CHUNK_SIZE           2048
+#define STREAM_EVENT_MAX_LEN        512
+
+// Idle time after which a stream sends a comment, so dead clients are noticed
+#define STREAM_KEEPALIVE_MS         15000
+
+// Time a browser waits before reconnecting a dropped stream
+#define STREAM_RETRY_MS             2000
+
+// History queries: range used when from is left out, and points returned when step is
+#define HISTORY_DEFAULT_RANGE_S     86400
+#define HISTORY_DEFAULT_POINTS      240
+
+// Buffer a history response is built in and sent from, and the longest point
+#define HISTORY_CHUNK_SIZE          1024
+#define HISTORY_POINT_MAX_LEN       64
+
+// Sockets the server keeps open: a browser opens up to six, plus the stream
+// clients and an upload. lwIP needs three more for the server itself.
+#define HTTP_SERVER_MAX_OPEN_SOCKETS    (6 + CONFIG_HTTP_STREAM_MAX_CLIENTS + 1)
+
+// Seconds a send or receive may block, in the server task for an ordinary
+// request and in the worker task for an upload or a stream
+#define HTTP_SERVER_SOCKET_TIMEOUT_S    5
+
+// TCP keep-alive probes for idle connections: first after 10 s, then every
+// 5 s, and the socket is closed after 3 unanswered ones
+#define HTTP_SERVER_KEEP_ALIVE_IDLE_S       10
+#define HTTP_SERVER_KEEP_ALIVE_INTERVAL_S   5
+#define HTTP_SERVER_KEEP_ALIVE_COUNT        3
+
+// Cache-Control for assets whose URL changes with their content, for index.html,
+// which has to be checked on every visit, and for the icon the browser asks for by name
+#define ASSET_CACHE_IMMUTABLE       "public, max-age=31536000, immutable"
+#define ASSET_CACHE_REVALIDATE      "no-cache"
+#define ASSET_CACHE_DAY             "public, max-age=86400"
+
 // Wifi connect status
 static int g_wifi_connect_status = NONE;
 
@@ -25,6 +84,12 @@ static bool g_is_local_time_set = false;
 // HTTP server task handle
 static httpd_handle_t http_server_handle = NULL;
 
+// Free /stream client slots, one per CONFIG_HTTP_STREAM_MAX_CLIENTS
+static SemaphoreHandle_t http_server_stream_slots = NULL;
+
+// Taken while a firmware upload is being received
+static SemaphoreHandle_t http_server_ota_slot = NULL;
+
 // HTTP server monitor task handle
 static TaskHandle_t task_http_server_monitor = NULL;
 
@@ -42,21 +107,69 @@ const esp_timer_create_args_t fw_update_reset_args = {
 };
 esp_timer_handle_t fw_update_reset;
 
-// Embedded files: Jquery, index.html, app.css, app.js and favicon.ico files
-extern const uint8_t jquery_3_3_1_min_js_start[] asm("_binary_jquery_3_3_1_min_js_start");
-extern const uint8_t jquery_3_3_1_min_js_end[]   asm("_binary_jquery_3_3_1_min_js_end");
+// Embedded files, gzipped at build time: Jquery, index.html, app.css, app.js and favicon.ico files
+extern const uint8_t jquery_3_3_1_min_js_gz_start[] asm("_binary_jquery_3_3_1_min_js_gz_start");
+extern const uint8_t jquery_3_3_1_min_js_gz_end[]   asm("_binary_jquery_3_3_1_min_js_gz_end");
+
+extern const uint8_t index_html_gz_start[]          asm("_binary_index_html_gz_start");
+extern const uint8_t index_html_gz_end[]            asm("_binary_index_html_gz_end");
+
+extern const uint8_t app_css_gz_start[]             asm("_binary_app_css_gz_start");
+extern const uint8_t app_css_gz_end[]               asm("_binary_app_css_gz_end");
+
+extern const uint8_t app_js_gz_start[]              asm("_binary_app_js_gz_start");
+extern const uint8_t app_js_gz_end[]                asm("_binary_app_js_gz_end");
+
+extern const uint8_t favicon_ico_gz_start[]         asm("_binary_favicon_ico_gz_start");
+extern const uint8_t favicon_ico_gz_end[]           asm("_binary_favicon_ico_gz_end");
+
+/**
+ * An embedded web page asset and how the browser may cache it
+ */
+typedef struct http_server_asset
+{
+    const char *type;           ///> Content-Type
+    const char *cache_control;  ///> Cache-Control
+    const uint8_t *start;       ///> Gzipped data
+    const uint8_t *end;
+    char etag[11];              ///> Quoted CRC-32 of the data, filled in on the first request
+} http_server_asset_t;
+
+// index.html is checked on every visit; the files it links have their CRC-32 in the URL
+static http_server_asset_t index_html_asset = {
+    .type = "text/html",
+    .cache_control = ASSET_CACHE_REVALIDATE,
+    .start = index_html_gz_start,
+    .end = index_html_gz_end
+};
 
-extern const uint8_t index_html_start[]          asm("_binary_index_html_start");
-extern const uint8_t index_html_end[]            asm("_binary_index_html_end");
+static http_server_asset_t jquery_js_asset = {
+    .type = "application/javascript",
+    .cache_control = ASSET_CACHE_IMMUTABLE,
+    .start = jquery_3_3_1_min_js_gz_start,
+    .end = jquery_3_3_1_min_js_gz_end
+};
 
-extern const uint8_t app_css_start[]             asm("_binary_app_css_start");
-extern const uint8_t app_css_end[]               asm("_binary_app_css_end");
+static http_server_asset_t app_css_asset = {
+    .type = "text/css",
+    .cache_control = ASSET_CACHE_IMMUTABLE,
+    .start = app_css_gz_start,
+    .end = app_css_gz_end
+};
 
-extern const uint8_t app_js_start[]              asm("_binary_app_js_start");
-extern const uint8_t app_js_end[]                asm("_binary_app_js_end");
+static http_server_asset_t app_js_asset = {
+    .type = "application/javascript",
+    .cache_control = ASSET_CACHE_IMMUTABLE,
+    .start = app_js_gz_start,
+    .end = app_js_gz_end
+};
 
-extern const uint8_t favicon_ico_start[]         asm("_binary_favicon_ico_start");
-extern const uint8_t favicon_ico_end[]           asm("_binary_favicon_ico_end");
+static http_server_asset_t favicon_ico_asset = {
+    .type = "image/x-icon",
+    .cache_control = ASSET_CACHE_DAY,
+    .start = favicon_ico_gz_start,
+    .end = favicon_ico_gz_end
+};
 
 /**
  * Checks the g_fw_update_status and creates the fw_update_reset timer if g_fw_update_status is true
@@ -133,178 +246,447 @@ static void http_server_monitor(void *parameter)
     }
 }
 
+/**
+ * Sends an embedded asset gzipped, or 304 Not Modified if the browser already
+ * has this version of it
+ * @param req HTTP request for which the uri needs to be handled
+ * @param asset asset to send
+ * @return ESP_OK, or the error from sending the response
+ */
+static esp_err_t http_server_send_asset(httpd_req_t *req, http_server_asset_t *asset)
+{
+    char if_none_match[64];
+    char accept_encoding[64];
+
+    if(asset->etag[0] == '\0')
+    {
+        snprintf(asset->etag, sizeof(asset->etag), "\"%08" PRIx32 "\"",
+                 esp_rom_crc32_le(0, asset->start, asset->end - asset->start));
+    }
+
+    httpd_resp_set_hdr(req, "ETag", asset->etag);
+    httpd_resp_set_hdr(req, "Cache-Control", asset->cache_control);
+
+    if(httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+       strstr(if_none_match, asset->etag) != NULL)
+    {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    // Without an Accept-Encoding header any encoding will do
+    if(httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept_encoding, sizeof(accept_encoding)) == ESP_OK &&
+       strstr(accept_encoding, "gzip") == NULL)
+    {
+        httpd_resp_set_status(req, "406 Not Acceptable");
+        return httpd_resp_sendstr(req, "Only gzip encoding is available");
+    }
+
+    httpd_resp_set_type(req, asset->type);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    return httpd_resp_send(req, (const char *)asset->start, asset->end - asset->start);
+}
+
 /**
  * Jquery get handler requested when accessing the web page. 
  * @param req HTTP request for which the uri needs to be handled
- * @return ESP_OK
+ * @return ESP_OK, or the error from sending the response
  */
 static esp_err_t http_server_jquery_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "Jquery requested");
 
-    httpd_resp_set_type(req, "application/javascript");
-    httpd_resp_send(req, (const char *)jquery_3_3_1_min_js_start, jquery_3_3_1_min_js_end - jquery_3_3_1_min_js_start);
-
-    return ESP_OK;
+    return http_server_send_asset(req, &jquery_js_asset);
 }
 
 /**
  * Sends the index.html page.
  * @param req HTTP request for which the uri needs to be handled
- * @return ESP_OK
+ * @return ESP_OK, or the error from sending the response
  */
 static esp_err_t http_server_index_html_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "index.html requested");
 
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, (const char *)index_html_start, index_html_end - index_html_start);
-
-    return ESP_OK;
+    return http_server_send_asset(req, &index_html_asset);
 }
 
 /**
  * App.css get handler requested when accessing the web page. 
  * @param req HTTP request for which the uri needs to be handled
- * @return ESP_OK
+ * @return ESP_OK, or the error from sending the response
  */
 static esp_err_t http_server_app_css_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "app.css requested");
 
-    httpd_resp_set_type(req, "text/css");
-    httpd_resp_send(req, (const char *)app_css_start, app_css_end - app_css_start);
-
-    return ESP_OK;
+    return http_server_send_asset(req, &app_css_asset);
 }
 
 /**
  * App.js get handler requested when accessing the web page. 
  * @param req HTTP request for which the uri needs to be handled
- * @return ESP_OK
+ * @return ESP_OK, or the error from sending the response
  */
 static esp_err_t http_server_app_js_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "app.js requested");
 
-    httpd_resp_set_type(req, "application/javascript");
-    httpd_resp_send(req, (const char *)app_js_start, app_js_end - app_js_start);
-
-    return ESP_OK;
+    return http_server_send_asset(req, &app_js_asset);
 }
 
 /**
  * Sends the .ico (icon) file when accessing the webpage
  * @param req HTTP request for which the uri needs to be handled
- * @return ESP_OK
+ * @return ESP_OK, or the error from sending the response
  */
 static esp_err_t http_server_favicon_ico_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "favicon.ico requested");
 
-    httpd_resp_set_type(req, "image/x-icon");
-    httpd_resp_send(req, (const char *)favicon_ico_start, favicon_ico_end - favicon_ico_start);
-
-    return ESP_OK;
+    return http_server_send_asset(req, &favicon_ico_asset);
 }
 
 /**
- * Receives the .bin file via the web page and handles the firmware update
- * @param req HTTP request for which the uri needs to be handled
- * @return ESP_OK, otherwise ESP_FAIL if timeout occurs and the update cannot be started
+ * Streaming parser for the multipart/form-data body the web page posts; it
+ * passes the bytes of the file part to the OTA writer as they arrive
  */
-esp_err_t http_server_OTA_update_handler(httpd_req_t *req)
+typedef enum http_server_ota_multipart_state
 {
-    esp_ota_handle_t ota_handle;
+    OTA_MULTIPART_HEADERS = 0,  ///> Skipping the boundary line and part headers
+    OTA_MULTIPART_BODY,         ///> Passing file data to the OTA writer
+    OTA_MULTIPART_DONE          ///> Closing delimiter seen
+} http_server_ota_multipart_state_e;
 
-    char ota_buff[1024];
-    int content_length = req->content_len;
-    int content_received = 0;
-    int recv_len;
-    bool is_req_body_started = false;
-    bool flash_successful = false;
+typedef struct http_server_ota_multipart
+{
+    http_server_ota_multipart_state_e state;
+    char delim[OTA_MULTIPART_DELIM_MAX];    ///> "\r\n--" followed by the boundary, empty for a raw image
+    size_t delim_len;
+    size_t matched;                         ///> Bytes of "\r\n\r\n" or delim matched and held back
+} http_server_ota_multipart_t;
+
+/**
+ * Sets up the multipart parser from the request Content-Type. A body that is
+ * not multipart is taken to be the raw image.
+ * @param req HTTP request carrying the image
+ * @param mp parser to set up
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG if the boundary is missing or too long
+ */
+static esp_err_t http_server_ota_multipart_init(httpd_req_t *req, http_server_ota_multipart_t *mp)
+{
+    char content_type[128];
+    const char *boundary;
+    size_t boundary_len;
 
-    const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
+    memset(mp, 0, sizeof(*mp));
+    mp->state = OTA_MULTIPART_BODY;
 
-    do
+    if(httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type)) != ESP_OK ||
+       strncmp(content_type, "multipart/", strlen("multipart/")) != 0)
     {
-        // Read the data for the request
-        if((recv_len = httpd_req_recv(req, ota_buff, MIN(content_length, sizeof(ota_buff)))) < 0)
-        {
-            // Check if timeout occured
-            if(recv_len == HTTPD_SOCK_ERR_TIMEOUT)
-            {
-                ESP_LOGI(TAG, "http_server_OTA_update_handler: Socket Timeout");
-                continue; ///> Retry receiving if timeout occurs
-            }
-            ESP_LOGI(TAG, "http_server_OTA_update_handler: OTA other Error %d", recv_len);
-            return ESP_FAIL;
-        }
-        printf("http_server_OTA_update_handler: OTA RX: %d of %d\r", content_received, content_length);
+        return ESP_OK;
+    }
 
-        // Is this the first data we are receiving
-        // If so, it will have the information in the header that we need
-        if(!is_req_body_started)
-        {
-            is_req_body_started = true;
+    boundary = strstr(content_type, "boundary=");
+    if(boundary == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    boundary += strlen("boundary=");
+    if(*boundary == '"')
+    {
+        boundary++;
+    }
+    boundary_len = strcspn(boundary, "\";");
+    if(boundary_len == 0 || boundary_len > OTA_MULTIPART_DELIM_MAX - 4)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-            // Get the location of the .bin file content (remove the web form data)
-            char *body_start_p = strstr(ota_buff, "\r\n\r\n") + 4;
-            int body_part_len = recv_len - (body_start_p - ota_buff);
+    memcpy(mp->delim, "\r\n--", 4);
+    memcpy(mp->delim + 4, boundary, boundary_len);
+    mp->delim_len = boundary_len + 4;
+    mp->state = OTA_MULTIPART_HEADERS;
 
-            printf("http_server_OTA_update_handler: OTA file size: %d\r\n", content_length);
+    return ESP_OK;
+}
 
-            esp_err_t err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &ota_handle);
-            if(err != ESP_OK)
+/**
+ * Parses the next chunk of the body and writes the file data in it.
+ * The delimiter starts with the only CR it contains, so on a mismatch the
+ * held back bytes are all data and matching restarts at the next CR.
+ * @param mp parser
+ * @param data chunk of the request body
+ * @param len length of data
+ * @return ESP_OK, or the error from the OTA writer
+ */
+static esp_err_t http_server_ota_multipart_feed(http_server_ota_multipart_t *mp, const char *data, size_t len)
+{
+    static const char headers_end[] = "\r\n\r\n";
+    const char *cr;
+    size_t i = 0, run;
+    esp_err_t err;
+
+    while(i < len && mp->state != OTA_MULTIPART_DONE)
+    {
+        if(mp->state == OTA_MULTIPART_HEADERS)
+        {
+            if(data[i] == headers_end[mp->matched])
             {
-                printf("http_server_OTA_update_handler: Error with OTA begin, cancelling OTA\r\n");
-                return ESP_FAIL;
+                if(++mp->matched == strlen(headers_end))
+                {
+                    mp->state = OTA_MULTIPART_BODY;
+                    mp->matched = 0;
+                }
             }
             else
             {
-                printf("http_server_OTA_update_handler: writing to partition subtype %d at offset 0x%lx\r\n", update_partition->subtype, update_partition->address);
+                mp->matched = (data[i] == '\r') ? 1 : 0;
             }
-
-            // Write this first part of the data
-            esp_ota_write(ota_handle, body_start_p, body_part_len);
-            content_received += body_part_len;
+            i++;
+        }
+        else if(mp->delim_len == 0)
+        {
+            return ota_writer_write(data + i, len - i);
+        }
+        else if(mp->matched == 0)
+        {
+            // Everything up to the next CR is file data
+            cr = memchr(data + i, '\r', len - i);
+            run = (cr != NULL) ? (size_t)(cr - (data + i)) : len - i;
+            if(run > 0 && (err = ota_writer_write(data + i, run)) != ESP_OK)
+            {
+                return err;
+            }
+            i += run;
+            if(cr != NULL)
+            {
+                mp->matched = 1;
+                i++;
+            }
+        }
+        else if(data[i] == mp->delim[mp->matched])
+        {
+            if(++mp->matched == mp->delim_len)
+            {
+                mp->state = OTA_MULTIPART_DONE;
+            }
+            i++;
         }
-        else{
-            // Write OTA data
-            esp_ota_write(ota_handle, ota_buff, recv_len);
-            content_received += recv_len;
+        else
+        {
+            // Not the delimiter after all, data[i] is looked at again
+            err = ota_writer_write(mp->delim, mp->matched);
+            mp->matched = 0;
+            if(err != ESP_OK)
+            {
+                return err;
+            }
         }
-    } while ( recv_len > 0 && content_received < content_length);
+    }
 
-    if(esp_ota_end(ota_handle) == ESP_OK)
+    return ESP_OK;
+}
+
+/**
+ * Reads the optional X-OTA-SHA256 header, the image digest as 64 hex digits.
+ * @param req HTTP request carrying the image
+ * @param sha256 digest
+ * @return true if the header is present and well formed
+ */
+static bool http_server_ota_get_sha256(httpd_req_t *req, uint8_t sha256[OTA_WRITER_SHA256_LEN])
+{
+    char hex[2 * OTA_WRITER_SHA256_LEN + 1];
+    unsigned int byte;
+    int i;
+
+    if(httpd_req_get_hdr_value_str(req, "X-OTA-SHA256", hex, sizeof(hex)) != ESP_OK ||
+       strlen(hex) != 2 * OTA_WRITER_SHA256_LEN)
+    {
+        return false;
+    }
+    for(i = 0; i < OTA_WRITER_SHA256_LEN; i++)
     {
-        // Lets update the partition
-        if(esp_ota_set_boot_partition(update_partition) == ESP_OK)
+        if(!isxdigit((unsigned char)hex[2 * i]) || !isxdigit((unsigned char)hex[2 * i + 1]) ||
+           sscanf(&hex[2 * i], "%2x", &byte) != 1)
         {
-            const esp_partition_t *boot_partition = esp_ota_get_boot_partition();
-            ESP_LOGI(TAG, "http_server_OTA_update_handler: Next boot partition subtype %d at offset 0x%" PRIx32, boot_partition->subtype, boot_partition->address);
-            flash_successful = true;
-        }
-        else{
-            ESP_LOGI(TAG, "http_server_OTA_update_handler: FLASHED ERROR!!!");
+            return false;
         }
+        sha256[i] = (uint8_t)byte;
     }
-    else{
-        ESP_LOGI(TAG, "http_server_OTA_update_handler: esp_ota_end ERROR!!!");
+
+    return true;
+}
+
+/**
+ * Receives the .bin file via the web page and handles the firmware update.
+ * The body is received in chunks of OTA_RECV_CHUNK_SIZE and streamed to the
+ * OTA writer, which writes flash in its own task while the next chunk arrives.
+ * The file may also be a delta patch from tools/ota_delta.py or a compressed
+ * image from tools/ota_pack.py, which the writer unpacks on the way. If the
+ * request has an X-OTA-SHA256 header the new image must match it.
+ * @param req async copy of the HTTP request carrying the image
+ * @return ESP_OK if the image was written and set as the boot partition, otherwise ESP_FAIL
+ */
+static esp_err_t http_server_ota_receive(httpd_req_t *req)
+{
+    http_server_ota_multipart_t multipart;
+    uint8_t expected_sha256[OTA_WRITER_SHA256_LEN];
+    bool has_sha256 = http_server_ota_get_sha256(req, expected_sha256);
+    size_t remaining = req->content_len;
+    int timeouts = 0;
+    int recv_len;
+    char *recv_buff;
+    esp_err_t err;
+
+    if(http_server_ota_multipart_init(req, &multipart) != ESP_OK)
+    {
+        ESP_LOGI(TAG, "http_server_ota_receive: bad multipart boundary");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad multipart boundary");
+        http_server_monitor_send_message(HTTP_MSG_OTA_UPDATE_FAILED);
+        return ESP_FAIL;
     }
 
-    // We won't update the global variables throughout the file, so send the message about the status
-    if(flash_successful) 
+    recv_buff = malloc(OTA_RECV_CHUNK_SIZE);
+    if(recv_buff == NULL)
     {
-        http_server_monitor_send_message(HTTP_MSG_OTA_UPDATE_SUCCESFUL);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        http_server_monitor_send_message(HTTP_MSG_OTA_UPDATE_FAILED);
+        return ESP_FAIL;
     }
-    else{
+
+    err = ota_writer_begin();
+    if(err != ESP_OK)
+    {
+        ESP_LOGI(TAG, "http_server_ota_receive: cannot start OTA (%s)", esp_err_to_name(err));
+        free(recv_buff);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot start update");
         http_server_monitor_send_message(HTTP_MSG_OTA_UPDATE_FAILED);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "http_server_ota_receive: receiving %u bytes", (unsigned int)req->content_len);
+
+    while(remaining > 0 && multipart.state != OTA_MULTIPART_DONE)
+    {
+        recv_len = httpd_req_recv(req, recv_buff, MIN(remaining, OTA_RECV_CHUNK_SIZE));
+        if(recv_len == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts <= OTA_RECV_TIMEOUT_RETRIES)
+        {
+            ESP_LOGI(TAG, "http_server_ota_receive: Socket Timeout");
+            continue; ///> Retry receiving if timeout occurs
+        }
+        if(recv_len <= 0)
+        {
+            ESP_LOGI(TAG, "http_server_ota_receive: OTA receive error %d", recv_len);
+            err = ESP_FAIL;
+            break;
+        }
+        timeouts = 0;
+        remaining -= recv_len;
 
+        err = http_server_ota_multipart_feed(&multipart, recv_buff, recv_len);
+        if(err != ESP_OK)
+        {
+            break;
+        }
     }
+    free(recv_buff);
+
+    if(err == ESP_OK && multipart.delim_len > 0 && multipart.state != OTA_MULTIPART_DONE)
+    {
+        ESP_LOGI(TAG, "http_server_ota_receive: body ended before the closing boundary");
+        err = ESP_ERR_INVALID_SIZE;
+    }
+
+    if(err == ESP_OK)
+    {
+        ESP_LOGI(TAG, "http_server_ota_receive: %u byte image received", (unsigned int)ota_writer_bytes_received());
+        err = ota_writer_finish(has_sha256 ? expected_sha256 : NULL);
+    }
+    else
+    {
+        ota_writer_abort();
+    }
+
+    // We won't update the global variables throughout the file, so send the message about the status
+    if(err != ESP_OK)
+    {
+        ESP_LOGI(TAG, "http_server_ota_receive: update failed (%s)", esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, (err == ESP_ERR_INVALID_VERSION) ?
+                            "Patch is for another firmware version" : "Firmware update failed");
+        http_server_monitor_send_message(HTTP_MSG_OTA_UPDATE_FAILED);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_sendstr(req, "Firmware update complete");
+    http_server_monitor_send_message(HTTP_MSG_OTA_UPDATE_SUCCESFUL);
 
     return ESP_OK;
+}
+
+/**
+ * Runs one firmware upload outside the server task, so the web page can go on
+ * polling OTAstatus and the other handlers while the image is received.
+ * @param parameter async copy of the upload request
+ */
+static void http_server_ota_task(void *parameter)
+{
+    httpd_req_t *req = parameter;
+    httpd_handle_t handle = req->handle;
+    int sockfd = httpd_req_to_sockfd(req);
 
+    // A failed upload leaves unread body data behind, so its connection cannot be reused
+    if(http_server_ota_receive(req) != ESP_OK)
+    {
+        httpd_req_async_handler_complete(req);
+        httpd_sess_trigger_close(handle, sockfd);
+    }
+    else
+    {
+        httpd_req_async_handler_complete(req);
+    }
+
+    xSemaphoreGive(http_server_ota_slot);
+    vTaskDelete(NULL);
+}
+
+/**
+ * OTAupdate handler hands the upload to the OTA receive task. Only one upload
+ * runs at a time; another one gets 409.
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK, or ESP_FAIL to close the socket
+ */
+esp_err_t http_server_OTA_update_handler(httpd_req_t *req)
+{
+    httpd_req_t *async_req;
+
+    if(xSemaphoreTake(http_server_ota_slot, 0) != pdTRUE)
+    {
+        ESP_LOGI(TAG, "http_server_OTA_update_handler: an update is already in progress");
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_set_hdr(req, "Connection", "close");
+        httpd_resp_sendstr(req, "Update already in progress");
+        return ESP_FAIL;
+    }
+
+    if(httpd_req_async_handler_begin(req, &async_req) != ESP_OK)
+    {
+        xSemaphoreGive(http_server_ota_slot);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+
+    if(xTaskCreatePinnedToCore(&http_server_ota_task, "http_ota", HTTP_OTA_TASK_STACK_SIZE, async_req,
+                               HTTP_OTA_TASK_PRIORITY, NULL, HTTP_OTA_TASK_CORE_ID) != pdPASS)
+    {
+        httpd_req_async_handler_complete(async_req);
+        xSemaphoreGive(http_server_ota_slot);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
 }
 
 /**
@@ -484,7 +866,441 @@ static esp_err_t http_server_get_local_time_json_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+/**
+ * A /history.json response being built, sent to the client a chunk at a time
+ */
+typedef struct http_server_history
+{
+    httpd_req_t *req;
+    history_channel_e channel;
+    const uint32_t *step;           ///> Step the store settled on, set before the first point
+    bool started;                   ///> Header written
+    size_t len;
+    char buff[HISTORY_CHUNK_SIZE];
+} http_server_history_t;
 
+/**
+ * Writes the /history.json header into the response buffer.
+ * @param history the response
+ */
+static void http_server_history_begin(http_server_history_t *history)
+{
+    history->len = snprintf(history->buff, sizeof(history->buff),
+                            "{\"channel\":\"%s\",\"unit\":\"%s\",\"step\":%" PRIu32 ",\"points\":[",
+                            history_channel_name(history->channel), history_channel_unit(history->channel),
+                            *history->step);
+    history->started = true;
+}
+
+/**
+ * Adds a point to a /history.json response as [time,min,mean,max].
+ * @param point point from the store
+ * @param arg the response's http_server_history_t
+ * @return ESP_OK, or the error from sending a full buffer
+ */
+static esp_err_t http_server_history_point(const history_point_t *point, void *arg)
+{
+    http_server_history_t *history = arg;
+    const char *separator = ",";
+    esp_err_t err;
+
+    if(!history->started)
+    {
+        http_server_history_begin(history);
+        separator = "";
+    }
+
+    if(history->len + HISTORY_POINT_MAX_LEN > sizeof(history->buff))
+    {
+        err = httpd_resp_send_chunk(history->req, history->buff, history->len);
+        if(err != ESP_OK)
+        {
+            return err;
+        }
+        history->len = 0;
+    }
+
+    history->len += snprintf(history->buff + history->len, sizeof(history->buff) - history->len,
+                             "%s[%" PRIu32 ",%.2f,%.2f,%.2f]", separator,
+                             point->time, point->min, point->mean, point->max);
+
+    return ESP_OK;
+}
+
+/**
+ * Reads an unsigned number from a query string.
+ * @param query the query string
+ * @param key parameter name
+ * @param value receives the number, unchanged if the parameter is missing
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG if the parameter is not a number
+ */
+static esp_err_t http_server_query_uint32(const char *query, const char *key, uint32_t *value)
+{
+    char param[12];
+    char *end;
+    unsigned long number;
+
+    if(httpd_query_key_value(query, key, param, sizeof(param)) != ESP_OK)
+    {
+        return ESP_OK;
+    }
+
+    number = strtoul(param, &end, 10);
+    if(end == param || *end != '\0' || number > UINT32_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *value = number;
+
+    return ESP_OK;
+}
+
+/**
+ * history.json handler responds with one channel of the stored readings,
+ * downsampled by the store. All parameters are optional: from and to are Unix
+ * times and default to the last day, step is seconds per point and channel
+ * defaults to feeder_current.
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK, or ESP_FAIL to close the socket
+ */
+static esp_err_t http_server_history_json_handler(httpd_req_t *req)
+{
+    http_server_history_t *history;
+    history_channel_e channel = HISTORY_FEEDER_CURRENT;
+    char query[128] = "";
+    char name[24];
+    uint32_t to = time(NULL);
+    uint32_t from = 0;
+    uint32_t step = 0;
+    esp_err_t err;
+
+    ESP_LOGI(TAG, "/history.json requested");
+
+    if(httpd_req_get_url_query_len(req) < sizeof(query))
+    {
+        httpd_req_get_url_query_str(req, query, sizeof(query));
+    }
+
+    if(http_server_query_uint32(query, "to", &to) != ESP_OK ||
+       http_server_query_uint32(query, "from", &from) != ESP_OK ||
+       http_server_query_uint32(query, "step", &step) != ESP_OK ||
+       (httpd_query_key_value(query, "channel", name, sizeof(name)) == ESP_OK &&
+        history_channel_from_name(name, &channel) != ESP_OK))
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad from, to, step or channel");
+        return ESP_OK;
+    }
+
+    if(from == 0)
+    {
+        from = (to > HISTORY_DEFAULT_RANGE_S) ? to - HISTORY_DEFAULT_RANGE_S : 0;
+    }
+    if(step == 0 && to > from)
+    {
+        step = (to - from + HISTORY_DEFAULT_POINTS - 1) / HISTORY_DEFAULT_POINTS;
+    }
+
+    history = malloc(sizeof(http_server_history_t));
+    if(history == NULL)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    history->req = req;
+    history->channel = channel;
+    history->step = &step;
+    history->started = false;
+    history->len = 0;
+
+    httpd_resp_set_type(req, "application/json");
+
+    // Nothing is sent before the first buffer fills, so a rejected query can still get an error status
+    err = history_query(from, to, &step, channel, http_server_history_point, history);
+    if(err == ESP_ERR_INVALID_STATE)
+    {
+        free(history);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_sendstr(req, "No history partition");
+        return ESP_OK;
+    }
+    if(err == ESP_ERR_INVALID_ARG)
+    {
+        free(history);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Empty range, step longer than the range or too many points");
+        return ESP_OK;
+    }
+    if(err != ESP_OK)
+    {
+        // Part of the response may be out already; closing the socket tells the client it is cut short
+        ESP_LOGW(TAG, "http_server_history_json_handler: query failed: %s", esp_err_to_name(err));
+        free(history);
+        return ESP_FAIL;
+    }
+
+    if(!history->started)
+    {
+        http_server_history_begin(history);
+    }
+    history->len += snprintf(history->buff + history->len, sizeof(history->buff) - history->len, "]}");
+
+    err = httpd_resp_send_chunk(req, history->buff, history->len);
+    if(err == ESP_OK)
+    {
+        err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    free(history);
+
+    return (err == ESP_OK) ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * snapshot.cbor handler responds with the binary snapshot of the meter state
+ * (snapshot.h). The recent history is included unless the query has history=0.
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK, or ESP_FAIL to close the socket
+ */
+static esp_err_t http_server_snapshot_cbor_handler(httpd_req_t *req)
+{
+    char query[32] = "";
+    char history[4];
+    bool with_history = true;
+    uint8_t *buff;
+    size_t len;
+    esp_err_t err;
+
+    ESP_LOGI(TAG, "/snapshot.cbor requested");
+
+    if(httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+       httpd_query_key_value(query, "history", history, sizeof(history)) == ESP_OK)
+    {
+        with_history = strcmp(history, "0") != 0;
+    }
+
+    buff = malloc(SNAPSHOT_MAX_LEN);
+    if(buff == NULL)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+
+    err = snapshot_encode(buff, SNAPSHOT_MAX_LEN, with_history, &len);
+    if(err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "http_server_snapshot_cbor_handler: cannot encode the snapshot: %s", esp_err_to_name(err));
+        free(buff);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot encode snapshot");
+        return ESP_OK;
+    }
+
+    httpd_resp_set_type(req, "application/cbor");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    err = httpd_resp_send(req, (const char *)buff, len);
+    free(buff);
+
+    return err;
+}
+
+/**
+ * health.json handler responds with the runtime health report (metrics.h).
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK, or ESP_FAIL to close the socket
+ */
+static esp_err_t http_server_health_json_handler(httpd_req_t *req)
+{
+    char *buff;
+    size_t len;
+    esp_err_t err;
+
+    ESP_LOGI(TAG, "/health.json requested");
+
+    buff = malloc(METRICS_REPORT_MAX_LEN);
+    if(buff == NULL)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+
+    err = metrics_report_json(buff, METRICS_REPORT_MAX_LEN, &len);
+    if(err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "http_server_health_json_handler: cannot write the report: %s", esp_err_to_name(err));
+        free(buff);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot write report");
+        return ESP_OK;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    err = httpd_resp_send(req, buff, len);
+    free(buff);
+
+    return err;
+}
+
+/**
+ * One /stream client, served by its own task from an async copy of the request
+ */
+typedef struct http_server_stream
+{
+    httpd_req_t *req;               ///> Async request, owned by the task
+    uint32_t seq;                   ///> Next sample to send
+    uint32_t dropped;               ///> Samples overwritten before they were sent
+    char buff[STREAM_CHUNK_SIZE];
+} http_server_stream_t;
+
+/**
+ * Formats a sample as a server-sent event; the id lets a reconnecting browser
+ * continue where it stopped.
+ * @param buff receives the event
+ * @param size space in buff, at least STREAM_EVENT_MAX_LEN
+ * @param sample sample to send
+ * @return length of the event
+ */
+static size_t http_server_stream_format(char *buff, size_t size, const acquisition_sample_t *sample)
+{
+    int len = snprintf(buff, size,
+        "id: %" PRIu32 "\n"
+        "data: {\"seq\":%" PRIu32 ",\"time\":%lld,"
+        "\"feeder\":{\"line_voltage\":%.2f,\"shunt_voltage\":%.3f,\"current\":%.3f},"
+        "\"transformer_shunt_voltage\":[%.2f,%.2f,%.2f],"
+        "\"transformer_current\":[%.3f,%.3f,%.3f]}\n\n",
+        sample->seq, sample->seq, (long long)sample->timestamp_ms,
+        sample->feeder_line_voltage, sample->feeder_shunt_voltage, sample->feeder_current,
+        sample->transformer_shunt_voltage[0], sample->transformer_shunt_voltage[1], sample->transformer_shunt_voltage[2],
+        sample->transformer_current[0], sample->transformer_current[1], sample->transformer_current[2]);
+
+    // Only an absurd reading can overflow; drop the sample rather than send half an event
+    return (len > 0 && (size_t)len < size) ? (size_t)len : 0;
+}
+
+/**
+ * Sends samples to one /stream client as they are taken. Every sample already
+ * in the ring goes out in one chunk, so a client that is slow to take data gets
+ * fewer, larger chunks instead of holding up the sampler; one that falls more
+ * than ACQUISITION_RING_LEN samples behind skips the oldest. The stream ends
+ * when a send fails or times out.
+ * @param parameter the client's http_server_stream_t
+ */
+static void http_server_stream_task(void *parameter)
+{
+    http_server_stream_t *stream = parameter;
+    acquisition_sample_t sample;
+    httpd_handle_t handle;
+    size_t len;
+    int sockfd;
+    esp_err_t err;
+
+    for(;;)
+    {
+        len = 0;
+        err = acquisition_read(stream->seq, &sample, pdMS_TO_TICKS(STREAM_KEEPALIVE_MS));
+        while(err == ESP_OK)
+        {
+            if((int32_t)(sample.seq - stream->seq) > 0)
+            {
+                stream->dropped += sample.seq - stream->seq;
+            }
+            stream->seq = sample.seq + 1;
+            len += http_server_stream_format(stream->buff + len, sizeof(stream->buff) - len, &sample);
+
+            if(len + STREAM_EVENT_MAX_LEN > sizeof(stream->buff))
+            {
+                break;
+            }
+            err = acquisition_read(stream->seq, &sample, 0);
+        }
+
+        if(len == 0)
+        {
+            if(err != ESP_ERR_TIMEOUT)
+            {
+                break;
+            }
+            len = sprintf(stream->buff, ":\n\n");
+        }
+
+        if(httpd_resp_send_chunk(stream->req, stream->buff, len) != ESP_OK)
+        {
+            break;
+        }
+    }
+
+    ESP_LOGI(TAG, "http_server_stream_task: stream ended, %" PRIu32 " samples dropped", stream->dropped);
+
+    handle = stream->req->handle;
+    sockfd = httpd_req_to_sockfd(stream->req);
+    httpd_req_async_handler_complete(stream->req);
+    httpd_sess_trigger_close(handle, sockfd);
+    free(stream);
+    xSemaphoreGive(http_server_stream_slots);
+    vTaskDelete(NULL);
+}
+
+/**
+ * stream handler starts a server-sent event stream of live sensor samples and
+ * hands the socket to a stream task, so the server goes on serving other requests
+ * @param req HTTP request for which the uri needs to be handled
+ * @return ESP_OK, or ESP_FAIL to close the socket
+ */
+static esp_err_t http_server_stream_handler(httpd_req_t *req)
+{
+    http_server_stream_t *stream;
+    char last_event_id[12];
+    char retry[24];
+
+    if(xSemaphoreTake(http_server_stream_slots, 0) != pdTRUE)
+    {
+        ESP_LOGI(TAG, "http_server_stream_handler: %d clients already streaming", CONFIG_HTTP_STREAM_MAX_CLIENTS);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "10");
+        httpd_resp_sendstr(req, "Too many stream clients");
+        return ESP_OK;
+    }
+
+    stream = malloc(sizeof(http_server_stream_t));
+    if(stream == NULL)
+    {
+        xSemaphoreGive(http_server_stream_slots);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    stream->dropped = 0;
+
+    // A reconnecting browser sends the id of the last event it got
+    if(httpd_req_get_hdr_value_str(req, "Last-Event-ID", last_event_id, sizeof(last_event_id)) == ESP_OK)
+    {
+        stream->seq = (uint32_t)strtoul(last_event_id, NULL, 10) + 1;
+    }
+    else
+    {
+        stream->seq = acquisition_next_seq();
+    }
+
+    httpd_resp_set_type(req, "text/event-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    snprintf(retry, sizeof(retry), "retry: %d\n\n", STREAM_RETRY_MS);
+
+    if(httpd_resp_send_chunk(req, retry, strlen(retry)) != ESP_OK ||
+       httpd_req_async_handler_begin(req, &stream->req) != ESP_OK)
+    {
+        free(stream);
+        xSemaphoreGive(http_server_stream_slots);
+        return ESP_FAIL;
+    }
+
+    if(xTaskCreatePinnedToCore(&http_server_stream_task, "http_stream", HTTP_STREAM_TASK_STACK_SIZE, stream,
+                               HTTP_STREAM_TASK_PRIORITY, NULL, HTTP_STREAM_TASK_CORE_ID) != pdPASS)
+    {
+        httpd_req_async_handler_complete(stream->req);
+        free(stream);
+        xSemaphoreGive(http_server_stream_slots);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "http_server_stream_handler: streaming from sample %" PRIu32, stream->seq);
+
+    return ESP_OK;
+}
 
 /**
  * Sets up the default httpd server configuration
@@ -506,6 +1322,19 @@ static httpd_handle_t http_server_configure(void)
 
     // Create the message queue
     http_server_monitor_queue_handle = xQueueCreate(3, sizeof(http_server_queue_message_t));
+
+    // Slots for live telemetry stream clients
+    if(http_server_stream_slots == NULL)
+    {
+        http_server_stream_slots = xSemaphoreCreateCounting(CONFIG_HTTP_STREAM_MAX_CLIENTS, CONFIG_HTTP_STREAM_MAX_CLIENTS);
+    }
+
+    // Slot for the firmware upload
+    if(http_server_ota_slot == NULL)
+    {
+        http_server_ota_slot = xSemaphoreCreateBinary();
+        xSemaphoreGive(http_server_ota_slot);
+    }
     
     // The core that the HTTP server will run on
     config.core_id = HTTP_SERVER_TASK_CORE_ID;
@@ -519,9 +1348,22 @@ static httpd_handle_t http_server_configure(void)
     // Increase uri handlers
     config.max_uri_handlers = 20;
 
-    // Increase the timeout limits
-    config.recv_wait_timeout = 10;
-    config.send_wait_timeout = 10;
+    // Uploads and streams run in their own tasks, so a slow client only holds
+    // up the server task for one send or receive of an ordinary request
+    config.recv_wait_timeout = HTTP_SERVER_SOCKET_TIMEOUT_S;
+    config.send_wait_timeout = HTTP_SERVER_SOCKET_TIMEOUT_S;
+
+    // When every socket is taken, close the one idle the longest to make room
+    // for a new client; sockets held by an upload or a stream are never chosen
+    config.max_open_sockets = HTTP_SERVER_MAX_OPEN_SOCKETS;
+    config.lru_purge_enable = true;
+
+    // Connections are kept open between requests; probe idle ones so a client
+    // that went away without closing does not hold a socket
+    config.keep_alive_enable = true;
+    config.keep_alive_idle = HTTP_SERVER_KEEP_ALIVE_IDLE_S;
+    config.keep_alive_interval = HTTP_SERVER_KEEP_ALIVE_INTERVAL_S;
+    config.keep_alive_count = HTTP_SERVER_KEEP_ALIVE_COUNT;
 
     ESP_LOGI(TAG,
             "http_server_configure: Starting server on port: '%d' with task priority: '%d'",
@@ -640,6 +1482,42 @@ static httpd_handle_t http_server_configure(void)
             .user_ctx = NULL
             };
         httpd_register_uri_handler(http_server_handle, &local_time_json);
+
+        // register stream handler
+        httpd_uri_t stream = {
+            .uri = "/stream",
+            .method = HTTP_GET,
+            .handler = http_server_stream_handler,
+            .user_ctx = NULL
+            };
+        httpd_register_uri_handler(http_server_handle, &stream);
+
+        // register history.json handler
+        httpd_uri_t history_json = {
+            .uri = "/history.json",
+            .method = HTTP_GET,
+            .handler = http_server_history_json_handler,
+            .user_ctx = NULL
+            };
+        httpd_register_uri_handler(http_server_handle, &history_json);
+
+        // register snapshot.cbor handler
+        httpd_uri_t snapshot_cbor = {
+            .uri = "/snapshot.cbor",
+            .method = HTTP_GET,
+            .handler = http_server_snapshot_cbor_handler,
+            .user_ctx = NULL
+            };
+        httpd_register_uri_handler(http_server_handle, &snapshot_cbor);
+
+        // register health.json handler
+        httpd_uri_t health_json = {
+            .uri = "/health.json",
+            .method = HTTP_GET,
+            .handler = http_server_health_json_handler,
+            .user_ctx = NULL
+            };
+        httpd_register_uri_handler(http_server_handle, &health_json);
  
 
         return http_server_handle;
@@ -40,7 +40,9 @@
 #include <math.h>
 #include <esp_idf_lib_helpers.h>
 #include <string.h>
+#include <esp_timer.h>
 #include "ina219.h"
+#include "metrics.h"
 #include "task_manager_i2c.h"
 
 #define SENSOR_INA219
@@ -112,8 +114,11 @@ static esp_err_t ina219_read_register(ina219_t *dev, uint8_t reg, uint16_t *data
     }
 
     uint8_t buf[2] = {0};
+    int64_t start = esp_timer_get_time();
     esp_err_t err = i2c_master_transmit_receive(dev->i2c_dev_handle, &reg, 1, buf, 2, I2C_TIMEOUT_MS);
+    metrics_observe(METRICS_I2C_TRANSACTION_US, esp_timer_get_time() - start);
     if (err != ESP_OK) {
+        metrics_count(METRICS_I2C_ERRORS);
         ESP_LOGE(INA219_TAG, "Failed to read register 0x%02X: %s", reg, esp_err_to_name(err));
         return err;
     }
@@ -131,8 +136,11 @@ static esp_err_t ina219_write_register(ina219_t *dev, uint8_t reg, uint16_t data
     // Swap bytes for big-endian format
     uint8_t buf[3] = {reg, data >> 8, data & 0xFF};
     
+    int64_t start = esp_timer_get_time();
     esp_err_t err = i2c_master_transmit(dev->i2c_dev_handle, buf, sizeof(buf), I2C_TIMEOUT_MS);
+    metrics_observe(METRICS_I2C_TRANSACTION_US, esp_timer_get_time() - start);
     if (err != ESP_OK) {
+        metrics_count(METRICS_I2C_ERRORS);
         ESP_LOGE(INA219_TAG, "Failed to write register 0x%02X: %s", reg, esp_err_to_name(err));
     }
 
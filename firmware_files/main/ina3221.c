@@ -38,7 +38,9 @@
 #include <esp_idf_lib_helpers.h>
 #include <string.h>
 
+#include <esp_timer.h>
 #include "ina3221.h"
+#include "metrics.h"
 #include "task_manager_i2c.h"
 
 #define SENSOR_INA3221
@@ -75,7 +77,14 @@ static esp_err_t read_reg_16(ina3221_t *dev, uint8_t reg, uint16_t *val)
     CHECK_ARG(val);
 
     uint8_t buf[2];
-    CHECK(i2c_master_transmit_receive(dev->i2c_dev, &reg, 1, buf, 2, -1));
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = i2c_master_transmit_receive(dev->i2c_dev, &reg, 1, buf, 2, -1);
+    metrics_observe(METRICS_I2C_TRANSACTION_US, esp_timer_get_time() - start);
+    if (err != ESP_OK)
+    {
+        metrics_count(METRICS_I2C_ERRORS);
+        return err;
+    }
     *val = (buf[0] << 8) | buf[1];
 
     return ESP_OK;
@@ -84,7 +93,14 @@ static esp_err_t read_reg_16(ina3221_t *dev, uint8_t reg, uint16_t *val)
 static esp_err_t write_reg_16(ina3221_t *dev, uint8_t reg, uint16_t val)
 {
     uint8_t buf[3] = { reg, (uint8_t)(val >> 8), (uint8_t)(val & 0xFF) };
-    CHECK(i2c_master_transmit(dev->i2c_dev, buf, 3, -1));
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = i2c_master_transmit(dev->i2c_dev, buf, 3, -1);
+    metrics_observe(METRICS_I2C_TRANSACTION_US, esp_timer_get_time() - start);
+    if (err != ESP_OK)
+    {
+        metrics_count(METRICS_I2C_ERRORS);
+        return err;
+    }
 
     return ESP_OK;
 }
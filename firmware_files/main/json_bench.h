@@ -0,0 +1,27 @@
+/*
+ * json_bench.h
+ *
+ * On-device benchmark of coreJSON on the shadow, job and prediction
+ * documents the device receives.
+ */
+
+#ifndef MAIN_JSON_BENCH_H_
+#define MAIN_JSON_BENCH_H_
+
+// Length of each measurement
+#define JSON_BENCH_RUN_MS	500
+
+// Prediction messages decoded by each decoder
+#define JSON_BENCH_PREDICTION_MSGS	2000
+
+/**
+ * Validates each sample document in a loop for JSON_BENCH_RUN_MS and logs
+ * the throughput in kB/s, along with whether coreJSON was built with the
+ * word-at-a-time scanner (CONFIG_AWS_IOT_JSON_WORD_SCAN). Then logs heap
+ * allocations and time per prediction message for prediction_decode and for
+ * cJSON; allocations are only counted with CONFIG_HEAP_USE_HOOKS. Runs in the
+ * calling task.
+ */
+void json_bench_run(void);
+
+#endif /* MAIN_JSON_BENCH_H_ */
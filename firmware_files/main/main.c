@@ -3,9 +3,17 @@
  */
 
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 
+#include "acquisition.h"
+#include "alert.h"
 #include "aws_iot.h"
+#include "history.h"
+#include "json_bench.h"
+#include "metrics.h"
+#include "mqtt_agent_bench.h"
+#include "power.h"
 #include "task_manager_i2c.h"
 #include "sntp_time_sync.h"
 #include "wifi_app.h"
@@ -17,9 +25,9 @@ static const char TAG[] = "main";
 
 void wifi_application_connected_events(void)
 {
-    // Trigger time synchronization and initialize AWS IoT once WiFi is connected
-    ESP_LOGI(TAG, "Wifi Application Connected!");
-    sntp_time_sync_task_start();  // Sync time using SNTP protocol
+    // Trigger time synchronization once WiFi is connected; the MQTT agent connects by itself
+    ESP_LOGI(TAG, "Wifi Application Connected! (%lld ms after boot)", (long long)(esp_timer_get_time() / 1000));
+    sntp_time_sync_start();  // Sync time using SNTP protocol
     
 }
 
@@ -28,7 +36,7 @@ void app_main(void)
     // Monitor system health by tracking stack memory and other metrics
     ESP_LOGI(HEALTH_MONITOR_TAG, "Starting system monitoring");
     check_reset_reason();  // Check system reset reason to handle unexpected resets
-    xTaskCreate(monitor_system_health, "monitor_system_health", 4096, NULL, 1, NULL);  // Start system health monitoring task
+    metrics_start();  // Sample tasks, heap and queues for /health.json and the health topic
 
     // Initialize NVS (Non-Volatile Storage) to store system state across reboots
     esp_err_t ret = nvs_flash_init();  // Initialize NVS flash memory
@@ -44,9 +52,34 @@ void app_main(void)
     //ESP_LOGI(TAG, "Initializing and calibrating sensors...");
     //sensor_task_manager();  // Call to initialize sensors if necessary
 
-    // Start WiFi connection process
+#if CONFIG_MQTT_AGENT_BENCHMARK
+    // Measure the MQTT agent command path while nothing else is using it
+    mqtt_agent_bench_run();
+#endif
+
+#if CONFIG_JSON_BENCHMARK
+    json_bench_run();
+#endif
+
+    // Let the CPU sleep between samples in low power mode
+    power_start();
+
+    // Start sampling the sensors first, the I2C bus and sensors are set up in the sampler task;
+    // the web server streams them even without a cloud connection
+    acquisition_start();
+
+    // Start WiFi connection process; association is the slowest part of boot, so it runs
+    // while the rest is set up
+    wifi_app_set_callback(&wifi_application_connected_events);  // Set the WiFi connected event callback function
     wifi_app_start();  // Initialize WiFi and start connection
 
-    // Set the WiFi connected event callback function
-    wifi_app_set_callback(&wifi_application_connected_events);
+    // Set up the theft alert LEDs before anything can raise an alert
+    alert_start();
+
+    // Keep minute and hour rollups of the samples on flash for /history.json
+    history_start();
+
+    // Set up the MQTT agent while WiFi associates; it connects as soon as there is an IP
+    // and does not wait for SNTP
+    aws_iot_start();
 }
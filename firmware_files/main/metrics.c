@@ -0,0 +1,502 @@
+/*
+ * metrics.c
+ *
+ * Counters are atomics and histograms are updated under a spinlock, so
+ * recording costs well under a microsecond and never blocks. Everything that
+ * needs a scan, the task list and the heap, is done by the metrics task once
+ * per window and kept for the report; CPU shares are over that window.
+ */
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "metrics.h"
+#include "tasks_common.h"
+
+static const char TAG[] = "metrics";
+
+// Window over which CPU shares and gauge peaks are taken
+#define METRICS_WINDOW_S			30
+
+// How often the gauges are sampled
+#define METRICS_GAUGE_PERIOD_MS		1000
+
+// Tasks with less free stack than this are logged
+#define METRICS_LOW_STACK_BYTES		512
+
+/**
+ * A latency histogram with power of two buckets
+ */
+typedef struct metrics_histogram_state
+{
+	uint32_t count;
+	uint64_t sum;
+	uint32_t max;
+	uint32_t buckets[METRICS_HISTOGRAM_BUCKETS];
+} metrics_histogram_state_t;
+
+/**
+ * A registered gauge
+ */
+typedef struct metrics_gauge
+{
+	const char *name;
+	metrics_gauge_cb_t cb;
+	void *arg;
+	uint32_t value;			///> Last sample
+	uint32_t peak;			///> Highest sample in the current window
+	uint32_t last_peak;		///> Highest sample in the last full window
+} metrics_gauge_t;
+
+/**
+ * One task as of the end of the last window
+ */
+typedef struct metrics_task
+{
+	char name[configMAX_TASK_NAME_LEN];
+	uint32_t stack_free;	///> Lowest free stack since the task started, bytes
+	float cpu_pct;			///> Share of one core over the last window, -1 without run time stats
+} metrics_task_t;
+
+/**
+ * Run time counter of a task at the start of the window
+ */
+typedef struct metrics_run_time
+{
+	TaskHandle_t handle;
+	uint32_t run_time;
+} metrics_run_time_t;
+
+static const char *metrics_counter_names[METRICS_COUNTERS] = {
+	[METRICS_I2C_ERRORS] = "i2c_errors",
+	[METRICS_MQTT_PUBLISH_ERRORS] = "mqtt_publish_errors",
+	[METRICS_MQTT_CONNECT_FAILURES] = "mqtt_connect_failures",
+	[METRICS_MQTT_RECONNECTS] = "mqtt_reconnects",
+	[METRICS_WIFI_RECONNECTS] = "wifi_reconnects",
+};
+
+static const char *metrics_histogram_names[METRICS_HISTOGRAMS] = {
+	[METRICS_I2C_TRANSACTION_US] = "i2c_transaction_us",
+	[METRICS_MQTT_PUBLISH_MS] = "mqtt_publish_ms",
+	[METRICS_DEFENDER_REPORT_US] = "defender_report_us",
+};
+
+static atomic_uint metrics_counters[METRICS_COUNTERS];
+
+static metrics_histogram_state_t metrics_histograms[METRICS_HISTOGRAMS];
+
+static metrics_gauge_t metrics_gauges[METRICS_MAX_GAUGES];
+static size_t metrics_gauge_count;
+
+static metrics_task_t metrics_tasks[METRICS_MAX_TASKS];
+static size_t metrics_task_count;
+
+// Heap as of the end of the last window
+static size_t metrics_largest_block;
+static size_t metrics_free_8bit;
+
+// Guards the histograms, the gauges, the task list and the heap figures
+static portMUX_TYPE metrics_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Metrics task handle
+static TaskHandle_t task_metrics = NULL;
+
+void metrics_count(metrics_counter_e counter)
+{
+	atomic_fetch_add_explicit(&metrics_counters[counter], 1, memory_order_relaxed);
+}
+
+uint32_t metrics_counter_value(metrics_counter_e counter)
+{
+	return atomic_load_explicit(&metrics_counters[counter], memory_order_relaxed);
+}
+
+const char *metrics_counter_name(metrics_counter_e counter)
+{
+	return metrics_counter_names[counter];
+}
+
+void metrics_observe(metrics_histogram_e histogram, uint32_t value)
+{
+	metrics_histogram_state_t *state = &metrics_histograms[histogram];
+	int bucket = (value > 1) ? 31 - __builtin_clz(value) : 0;
+
+	if (bucket >= METRICS_HISTOGRAM_BUCKETS)
+	{
+		bucket = METRICS_HISTOGRAM_BUCKETS - 1;
+	}
+
+	taskENTER_CRITICAL(&metrics_lock);
+	state->count++;
+	state->sum += value;
+	if (value > state->max)
+	{
+		state->max = value;
+	}
+	state->buckets[bucket]++;
+	taskEXIT_CRITICAL(&metrics_lock);
+}
+
+esp_err_t metrics_register_gauge(const char *name, metrics_gauge_cb_t cb, void *arg)
+{
+	esp_err_t err = ESP_OK;
+
+	taskENTER_CRITICAL(&metrics_lock);
+	if (metrics_gauge_count < METRICS_MAX_GAUGES)
+	{
+		metrics_gauges[metrics_gauge_count] = (metrics_gauge_t) {
+			.name = name,
+			.cb = cb,
+			.arg = arg,
+		};
+		metrics_gauge_count++;
+	}
+	else
+	{
+		err = ESP_ERR_NO_MEM;
+	}
+	taskEXIT_CRITICAL(&metrics_lock);
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGW(TAG, "metrics_register_gauge: no room for %s", name);
+	}
+
+	return err;
+}
+
+/**
+ * Gauge callback for metrics_register_queue.
+ * @param arg the queue
+ * @return messages waiting in it
+ */
+static uint32_t metrics_queue_depth(void *arg)
+{
+	return uxQueueMessagesWaiting((QueueHandle_t) arg);
+}
+
+esp_err_t metrics_register_queue(const char *name, QueueHandle_t queue)
+{
+	return metrics_register_gauge(name, metrics_queue_depth, queue);
+}
+
+/**
+ * Samples every gauge and keeps the peak of the window.
+ */
+static void metrics_sample_gauges(void)
+{
+	size_t count;
+	uint32_t value;
+
+	taskENTER_CRITICAL(&metrics_lock);
+	count = metrics_gauge_count;
+	taskEXIT_CRITICAL(&metrics_lock);
+
+	// Gauges are only ever added, so the first count entries stay valid
+	for (size_t i = 0; i < count; i++)
+	{
+		value = metrics_gauges[i].cb(metrics_gauges[i].arg);
+
+		taskENTER_CRITICAL(&metrics_lock);
+		metrics_gauges[i].value = value;
+		if (value > metrics_gauges[i].peak)
+		{
+			metrics_gauges[i].peak = value;
+		}
+		taskEXIT_CRITICAL(&metrics_lock);
+	}
+}
+
+/**
+ * Starts a new window for the gauge peaks.
+ */
+static void metrics_roll_gauges(void)
+{
+	taskENTER_CRITICAL(&metrics_lock);
+	for (size_t i = 0; i < metrics_gauge_count; i++)
+	{
+		metrics_gauges[i].last_peak = metrics_gauges[i].peak;
+		metrics_gauges[i].peak = metrics_gauges[i].value;
+	}
+	taskEXIT_CRITICAL(&metrics_lock);
+}
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+/**
+ * Takes the stack high water mark of every task and, with run time stats,
+ * its CPU share since the last call.
+ * @param prev run time counters from the last call, updated
+ * @param prev_count entries in prev, updated
+ * @param prev_total total run time at the last call, updated
+ */
+static void metrics_sample_tasks(metrics_run_time_t *prev, size_t *prev_count, uint32_t *prev_total)
+{
+	metrics_task_t tasks[METRICS_MAX_TASKS];
+	metrics_run_time_t run_times[METRICS_MAX_TASKS];
+	configRUN_TIME_COUNTER_TYPE total = 0;
+	TaskStatus_t *status;
+	UBaseType_t count;
+	uint32_t elapsed;
+	uint32_t run_time;
+
+	// Room for a few tasks created in the meantime
+	count = uxTaskGetNumberOfTasks() + 4;
+	status = malloc(count * sizeof(TaskStatus_t));
+	if (status == NULL)
+	{
+		ESP_LOGW(TAG, "metrics_sample_tasks: no memory for %u tasks", (unsigned int) count);
+		return;
+	}
+
+	count = uxTaskGetSystemState(status, count, &total);
+	count = MIN(count, METRICS_MAX_TASKS);
+	elapsed = (uint32_t) total - *prev_total;
+
+	for (UBaseType_t i = 0; i < count; i++)
+	{
+		strlcpy(tasks[i].name, status[i].pcTaskName, sizeof(tasks[i].name));
+		tasks[i].stack_free = status[i].usStackHighWaterMark;
+		tasks[i].cpu_pct = -1;
+		run_times[i].handle = status[i].xHandle;
+		run_times[i].run_time = status[i].ulRunTimeCounter;
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+		// A task that is new in this window has run for all of its counter
+		run_time = run_times[i].run_time;
+		for (size_t j = 0; j < *prev_count; j++)
+		{
+			if (prev[j].handle == run_times[i].handle)
+			{
+				run_time -= prev[j].run_time;
+				break;
+			}
+		}
+		if (elapsed > 0)
+		{
+			tasks[i].cpu_pct = 100.0f * run_time / elapsed;
+		}
+#else
+		(void) run_time;
+		(void) elapsed;
+#endif
+
+		if (tasks[i].stack_free < METRICS_LOW_STACK_BYTES)
+		{
+			ESP_LOGW(TAG, "metrics_sample_tasks: %s has %" PRIu32 " bytes of stack left", tasks[i].name,
+					 tasks[i].stack_free);
+		}
+	}
+	free(status);
+
+	memcpy(prev, run_times, count * sizeof(run_times[0]));
+	*prev_count = count;
+	*prev_total = total;
+
+	taskENTER_CRITICAL(&metrics_lock);
+	memcpy(metrics_tasks, tasks, count * sizeof(tasks[0]));
+	metrics_task_count = count;
+	taskEXIT_CRITICAL(&metrics_lock);
+}
+#endif
+
+/**
+ * Takes the free heap and its largest block.
+ */
+static void metrics_sample_heap(void)
+{
+	size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+	size_t free_8bit = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+	taskENTER_CRITICAL(&metrics_lock);
+	metrics_largest_block = largest;
+	metrics_free_8bit = free_8bit;
+	taskEXIT_CRITICAL(&metrics_lock);
+
+	ESP_LOGI(TAG, "Free heap: %" PRIu32 " bytes, largest block %u bytes, lowest %" PRIu32 " bytes",
+			 esp_get_free_heap_size(), (unsigned int) largest, esp_get_minimum_free_heap_size());
+}
+
+/**
+ * Metrics task.
+ */
+static void metrics_task(void *param)
+{
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+	static metrics_run_time_t prev[METRICS_MAX_TASKS];
+	size_t prev_count = 0;
+	uint32_t prev_total = 0;
+#endif
+	TickType_t last_wake = xTaskGetTickCount();
+	uint32_t ticks = 0;
+
+	for (;;)
+	{
+		metrics_sample_gauges();
+
+		if (ticks++ % (METRICS_WINDOW_S * 1000 / METRICS_GAUGE_PERIOD_MS) == 0)
+		{
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+			metrics_sample_tasks(prev, &prev_count, &prev_total);
+#endif
+			metrics_sample_heap();
+			metrics_roll_gauges();
+		}
+
+		xTaskDelayUntil(&last_wake, pdMS_TO_TICKS(METRICS_GAUGE_PERIOD_MS));
+	}
+}
+
+void metrics_start(void)
+{
+	if (task_metrics == NULL)
+	{
+		xTaskCreatePinnedToCore(&metrics_task, "metrics_task", METRICS_TASK_STACK_SIZE, NULL,
+								METRICS_TASK_PRIORITY, &task_metrics, METRICS_TASK_CORE_ID);
+	}
+}
+
+/**
+ * Appends to the report, like snprintf.
+ * @param buff report buffer
+ * @param size size of buff
+ * @param len length so far, advanced; set past size once the report does not fit
+ * @param fmt format
+ */
+static void metrics_append(char *buff, size_t size, size_t *len, const char *fmt, ...)
+{
+	va_list args;
+	int n;
+
+	if (*len >= size)
+	{
+		return;
+	}
+
+	va_start(args, fmt);
+	n = vsnprintf(&buff[*len], size - *len, fmt, args);
+	va_end(args);
+
+	*len = (n < 0) ? size : *len + n;
+}
+
+/**
+ * Upper bound of a percentile from the buckets of a histogram.
+ * @param state the histogram
+ * @param pct percentile, 1 to 100
+ * @return the end of the bucket the percentile falls in, at most the maximum
+ */
+static uint32_t metrics_percentile(const metrics_histogram_state_t *state, uint32_t pct)
+{
+	uint64_t rank = ((uint64_t) state->count * pct + 99) / 100;
+	uint64_t seen = 0;
+
+	for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS - 1; i++)
+	{
+		seen += state->buckets[i];
+		if (seen >= rank)
+		{
+			return MIN((uint32_t) 2 << i, state->max);
+		}
+	}
+
+	return state->max;
+}
+
+esp_err_t metrics_report_json(char *buff, size_t size, size_t *len)
+{
+	metrics_histogram_state_t histogram;
+	metrics_gauge_t gauge;
+	metrics_task_t task;
+	size_t largest;
+	size_t free_8bit;
+	size_t count;
+	size_t n = 0;
+
+	taskENTER_CRITICAL(&metrics_lock);
+	largest = metrics_largest_block;
+	free_8bit = metrics_free_8bit;
+	taskEXIT_CRITICAL(&metrics_lock);
+
+	metrics_append(buff, size, &n, "{\"uptime_s\":%lld,\"reset_reason\":%d,",
+				   (long long) (esp_timer_get_time() / 1000000), (int) esp_reset_reason());
+	metrics_append(buff, size, &n,
+				   "\"heap\":{\"free\":%" PRIu32 ",\"min_free\":%" PRIu32 ",\"largest_block\":%u,\"fragmentation_pct\":%u},",
+				   esp_get_free_heap_size(), esp_get_minimum_free_heap_size(), (unsigned int) largest,
+				   (unsigned int) ((free_8bit > 0) ? 100 - (uint64_t) largest * 100 / free_8bit : 0));
+
+	metrics_append(buff, size, &n, "\"counters\":{");
+	for (int i = 0; i < METRICS_COUNTERS; i++)
+	{
+		metrics_append(buff, size, &n, "%s\"%s\":%u", (i > 0) ? "," : "", metrics_counter_names[i],
+					   atomic_load_explicit(&metrics_counters[i], memory_order_relaxed));
+	}
+
+	metrics_append(buff, size, &n, "},\"histograms\":{");
+	for (int i = 0; i < METRICS_HISTOGRAMS; i++)
+	{
+		taskENTER_CRITICAL(&metrics_lock);
+		histogram = metrics_histograms[i];
+		taskEXIT_CRITICAL(&metrics_lock);
+
+		metrics_append(buff, size, &n,
+					   "%s\"%s\":{\"count\":%" PRIu32 ",\"mean\":%" PRIu32 ",\"max\":%" PRIu32 ",\"p50\":%" PRIu32 ",\"p99\":%" PRIu32 "}",
+					   (i > 0) ? "," : "", metrics_histogram_names[i], histogram.count,
+					   (histogram.count > 0) ? (uint32_t) (histogram.sum / histogram.count) : 0, histogram.max,
+					   metrics_percentile(&histogram, 50), metrics_percentile(&histogram, 99));
+	}
+
+	metrics_append(buff, size, &n, "},\"queues\":{");
+	taskENTER_CRITICAL(&metrics_lock);
+	count = metrics_gauge_count;
+	taskEXIT_CRITICAL(&metrics_lock);
+	for (size_t i = 0; i < count; i++)
+	{
+		taskENTER_CRITICAL(&metrics_lock);
+		gauge = metrics_gauges[i];
+		taskEXIT_CRITICAL(&metrics_lock);
+
+		metrics_append(buff, size, &n, "%s\"%s\":{\"depth\":%" PRIu32 ",\"peak\":%" PRIu32 "}", (i > 0) ? "," : "",
+					   gauge.name, gauge.value, MAX(gauge.peak, gauge.last_peak));
+	}
+
+	metrics_append(buff, size, &n, "},\"tasks\":[");
+	taskENTER_CRITICAL(&metrics_lock);
+	count = metrics_task_count;
+	taskEXIT_CRITICAL(&metrics_lock);
+	for (size_t i = 0; i < count; i++)
+	{
+		taskENTER_CRITICAL(&metrics_lock);
+		task = metrics_tasks[i];
+		taskEXIT_CRITICAL(&metrics_lock);
+
+		metrics_append(buff, size, &n, "%s{\"name\":\"%s\",\"stack_free\":%" PRIu32, (i > 0) ? "," : "",
+					   task.name, task.stack_free);
+		if (task.cpu_pct >= 0)
+		{
+			metrics_append(buff, size, &n, ",\"cpu_pct\":%.1f", task.cpu_pct);
+		}
+		metrics_append(buff, size, &n, "}");
+	}
+	metrics_append(buff, size, &n, "]}");
+
+	if (n >= size)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+
+	*len = n;
+	return ESP_OK;
+}
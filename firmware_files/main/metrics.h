@@ -0,0 +1,126 @@
+/*
+ * metrics.h
+ *
+ * Runtime health metrics, to spot meters that are degrading before they fail:
+ * event counters, latency histograms and queue depths recorded by the other
+ * modules, plus per-task stack and CPU figures and heap fragmentation
+ * collected by the metrics task. The report is served at /health.json and
+ * published to "smartmeter/health".
+ *
+ * Counters and histograms count from boot; consumers should take the
+ * difference between two reports.
+ */
+
+#ifndef MAIN_METRICS_H_
+#define MAIN_METRICS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+
+// Buffer that holds a report
+#define METRICS_REPORT_MAX_LEN		3072
+
+// Tasks and queues the report has room for
+#define METRICS_MAX_TASKS			24
+#define METRICS_MAX_GAUGES			6
+
+// Histogram buckets; bucket i counts values below 2^(i+1) units
+#define METRICS_HISTOGRAM_BUCKETS	16
+
+/**
+ * Event counters
+ */
+typedef enum metrics_counter
+{
+	METRICS_I2C_ERRORS = 0,				///> Failed I2C transactions
+	METRICS_MQTT_PUBLISH_ERRORS,		///> Publishes not sent or not acknowledged
+	METRICS_MQTT_CONNECT_FAILURES,		///> Failed connection attempts to AWS IoT
+	METRICS_MQTT_RECONNECTS,			///> Connections to AWS IoT that dropped
+	METRICS_WIFI_RECONNECTS,			///> Connections to the AP that dropped
+	METRICS_COUNTERS
+} metrics_counter_e;
+
+/**
+ * Latency histograms
+ */
+typedef enum metrics_histogram
+{
+	METRICS_I2C_TRANSACTION_US = 0,		///> One register read or write, us
+	METRICS_MQTT_PUBLISH_MS,			///> Publish call, until sent (QoS 0) or acknowledged (QoS 1), ms
+	METRICS_DEFENDER_REPORT_US,			///> Collecting and encoding a Device Defender report, us
+	METRICS_HISTOGRAMS
+} metrics_histogram_e;
+
+/**
+ * Reads the current value of a gauge.
+ * @param arg arg passed to metrics_register_gauge
+ * @return the value
+ */
+typedef uint32_t (*metrics_gauge_cb_t)(void *arg);
+
+/**
+ * Starts the metrics task, which samples the gauges every second and the
+ * tasks and heap every METRICS_WINDOW_S. Counters, histograms and gauges can
+ * be used before it is started.
+ */
+void metrics_start(void);
+
+/**
+ * Adds one to a counter. Safe from any task or core.
+ * @param counter the counter
+ */
+void metrics_count(metrics_counter_e counter);
+
+/**
+ * Reads a counter.
+ * @param counter the counter
+ * @return its value, counted from boot
+ */
+uint32_t metrics_counter_value(metrics_counter_e counter);
+
+/**
+ * Returns the name of a counter, as in the report.
+ * @param counter the counter
+ * @return the name
+ */
+const char *metrics_counter_name(metrics_counter_e counter);
+
+/**
+ * Records a value in a histogram. Safe from any task or core.
+ * @param histogram the histogram
+ * @param value value in the histogram's unit
+ */
+void metrics_observe(metrics_histogram_e histogram, uint32_t value);
+
+/**
+ * Adds a gauge to the report, e.g. the depth of a queue. The report shows
+ * its value as of the last second and its peak over at least the last 30 s.
+ * @param name name in the report, must stay valid
+ * @param cb reads the gauge
+ * @param arg passed to cb
+ * @return ESP_OK, or ESP_ERR_NO_MEM if METRICS_MAX_GAUGES are registered
+ */
+esp_err_t metrics_register_gauge(const char *name, metrics_gauge_cb_t cb, void *arg);
+
+/**
+ * Adds the number of messages waiting in a queue as a gauge.
+ * @param name name in the report, must stay valid
+ * @param queue the queue
+ * @return as metrics_register_gauge
+ */
+esp_err_t metrics_register_queue(const char *name, QueueHandle_t queue);
+
+/**
+ * Writes the report as JSON.
+ * @param buff receives the report, NUL terminated
+ * @param size size of buff, METRICS_REPORT_MAX_LEN fits every report
+ * @param len receives the length of the report
+ * @return ESP_OK, or ESP_ERR_NO_MEM if buff is too small
+ */
+esp_err_t metrics_report_json(char *buff, size_t size, size_t *len);
+
+#endif /* MAIN_METRICS_H_ */
@@ -19,11 +19,4 @@ void check_reset_reason() {
         case ESP_RST_UNKNOWN: ESP_LOGI(HEALTH_MONITOR_TAG, "Other reason"); break;
         default: ESP_LOGI(HEALTH_MONITOR_TAG, "Unknown reason"); break;
     }
-}
-
-void monitor_system_health(void *pvParameters) {
-    while (1) {
-        ESP_LOGI(HEALTH_MONITOR_TAG, "Free heap: %lu bytes", esp_get_free_heap_size());
-        vTaskDelay(pdMS_TO_TICKS(30000)); // Log every 30 seconds
-    }
 }
\ No newline at end of file
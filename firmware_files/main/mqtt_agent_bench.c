@@ -0,0 +1,239 @@
+/*
+ * mqtt_agent_bench.c
+ *
+ * Producer tasks take a command, post it and loop; a consumer task on the
+ * agent core receives and releases commands, like the agent does, and counts
+ * them. The same load is run through the agent command pool and message ring
+ * and through a pair of FreeRTOS queues (free commands and posted commands),
+ * which is how the agent port worked before the ring.
+ */
+
+#include <stdbool.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "core_mqtt_agent.h"
+#include "freertos_agent_message.h"
+#include "freertos_command_pool.h"
+
+#include "mqtt_agent_bench.h"
+#include "tasks_common.h"
+
+static const char TAG[] = "mqtt_agent_bench";
+
+// How long producers and the consumer wait before checking whether the run is over
+#define MQTT_AGENT_BENCH_BLOCK_MS	10
+
+// Command hand-off under test
+typedef struct mqtt_agent_bench_ops
+{
+	MQTTAgentCommand_t *(*get)(uint32_t block_time_ms);
+	bool (*send)(MQTTAgentCommand_t *command, uint32_t block_time_ms);
+	bool (*recv)(MQTTAgentCommand_t **command, uint32_t block_time_ms);
+	bool (*release)(MQTTAgentCommand_t *command);
+} mqtt_agent_bench_ops_t;
+
+// Agent port: lock-free command pool and message ring
+static MQTTAgentMessageContext_t bench_ring;
+
+// Baseline: free commands and posted commands in FreeRTOS queues
+static MQTTAgentCommand_t bench_queue_commands[MQTT_COMMAND_CONTEXTS_POOL_SIZE];
+static QueueHandle_t bench_free_queue;
+static QueueHandle_t bench_message_queue;
+
+// Set when producers should stop, given by each producer as it exits
+static volatile bool bench_stop;
+static SemaphoreHandle_t bench_producer_done;
+
+// Task waiting in mqtt_agent_bench_run
+static TaskHandle_t bench_caller;
+
+static bool mqtt_agent_bench_ring_send(MQTTAgentCommand_t *command, uint32_t block_time_ms)
+{
+	return Agent_MessageSend(&bench_ring, &command, block_time_ms);
+}
+
+static bool mqtt_agent_bench_ring_recv(MQTTAgentCommand_t **command, uint32_t block_time_ms)
+{
+	return Agent_MessageReceive(&bench_ring, command, block_time_ms);
+}
+
+static MQTTAgentCommand_t *mqtt_agent_bench_queue_get(uint32_t block_time_ms)
+{
+	MQTTAgentCommand_t *command = NULL;
+
+	xQueueReceive(bench_free_queue, &command, pdMS_TO_TICKS(block_time_ms));
+	return command;
+}
+
+static bool mqtt_agent_bench_queue_send(MQTTAgentCommand_t *command, uint32_t block_time_ms)
+{
+	return xQueueSendToBack(bench_message_queue, &command, pdMS_TO_TICKS(block_time_ms)) == pdPASS;
+}
+
+static bool mqtt_agent_bench_queue_recv(MQTTAgentCommand_t **command, uint32_t block_time_ms)
+{
+	return xQueueReceive(bench_message_queue, command, pdMS_TO_TICKS(block_time_ms)) == pdPASS;
+}
+
+static bool mqtt_agent_bench_queue_release(MQTTAgentCommand_t *command)
+{
+	return xQueueSendToBack(bench_free_queue, &command, 0) == pdPASS;
+}
+
+static const mqtt_agent_bench_ops_t bench_ring_ops = {
+	.get = Agent_GetCommand,
+	.send = mqtt_agent_bench_ring_send,
+	.recv = mqtt_agent_bench_ring_recv,
+	.release = Agent_ReleaseCommand,
+};
+
+static const mqtt_agent_bench_ops_t bench_queue_ops = {
+	.get = mqtt_agent_bench_queue_get,
+	.send = mqtt_agent_bench_queue_send,
+	.recv = mqtt_agent_bench_queue_recv,
+	.release = mqtt_agent_bench_queue_release,
+};
+
+/**
+ * Producer task: posts commands as fast as it can get them.
+ * @param pvParameters hand-off under test
+ */
+static void mqtt_agent_bench_producer_task(void *pvParameters)
+{
+	const mqtt_agent_bench_ops_t *ops = pvParameters;
+	MQTTAgentCommand_t *command;
+
+	while (!bench_stop)
+	{
+		command = ops->get(MQTT_AGENT_BENCH_BLOCK_MS);
+		if (command == NULL)
+		{
+			continue;
+		}
+
+		command->commandType = PUBLISH;
+		if (!ops->send(command, MQTT_AGENT_BENCH_BLOCK_MS))
+		{
+			ops->release(command);
+		}
+	}
+
+	xSemaphoreGive(bench_producer_done);
+	vTaskDelete(NULL);
+}
+
+/**
+ * Runs one measurement.
+ * @param ops hand-off under test
+ * @param producers number of producer tasks, alternately pinned to core 0 and 1
+ * @return commands received per second
+ */
+static uint32_t mqtt_agent_bench_measure(const mqtt_agent_bench_ops_t *ops, int producers)
+{
+	MQTTAgentCommand_t *command;
+	uint32_t received = 0;
+	int64_t start_us;
+	int64_t now_us;
+	int done;
+	int i;
+
+	bench_stop = false;
+	for (i = 0; i < producers; i++)
+	{
+		xTaskCreatePinnedToCore(&mqtt_agent_bench_producer_task, "mqtt_bench_prod",
+								MQTT_AGENT_BENCH_PRODUCER_STACK_SIZE, (void *) ops,
+								MQTT_AGENT_BENCH_PRODUCER_PRIORITY, NULL, i % 2);
+	}
+
+	start_us = esp_timer_get_time();
+	do
+	{
+		if (ops->recv(&command, MQTT_AGENT_BENCH_BLOCK_MS))
+		{
+			ops->release(command);
+			received++;
+		}
+		now_us = esp_timer_get_time();
+	} while (now_us - start_us < MQTT_AGENT_BENCH_RUN_MS * 1000LL);
+
+	// Keep consuming until every producer has left, so none is stuck holding a command
+	bench_stop = true;
+	for (done = 0; done < producers;)
+	{
+		if (xSemaphoreTake(bench_producer_done, 0) == pdTRUE)
+		{
+			done++;
+		}
+		else if (ops->recv(&command, 1))
+		{
+			ops->release(command);
+		}
+	}
+	while (ops->recv(&command, 0))
+	{
+		ops->release(command);
+	}
+
+	return (uint32_t) (((uint64_t) received * 1000000ULL) / (uint64_t) (now_us - start_us));
+}
+
+/**
+ * Consumer task, pinned to the agent core: runs every measurement and logs
+ * the results.
+ */
+static void mqtt_agent_bench_task(void *pvParameters)
+{
+	uint32_t ring_rate;
+	uint32_t queue_rate;
+	MQTTAgentCommand_t *command;
+	int producers;
+	int i;
+
+	Agent_InitializePool();
+	Agent_MessageInit(&bench_ring);
+
+	bench_free_queue = xQueueCreate(MQTT_COMMAND_CONTEXTS_POOL_SIZE, sizeof(MQTTAgentCommand_t *));
+	bench_message_queue = xQueueCreate(MQTT_AGENT_COMMAND_QUEUE_LENGTH, sizeof(MQTTAgentCommand_t *));
+	bench_producer_done = xSemaphoreCreateCounting(MQTT_AGENT_BENCH_MAX_PRODUCERS, 0);
+	for (i = 0; i < MQTT_COMMAND_CONTEXTS_POOL_SIZE; i++)
+	{
+		command = &bench_queue_commands[i];
+		xQueueSendToBack(bench_free_queue, &command, 0);
+	}
+
+	ESP_LOGI(TAG, "%d commands in flight, %d ms per run", MQTT_COMMAND_CONTEXTS_POOL_SIZE, MQTT_AGENT_BENCH_RUN_MS);
+	ESP_LOGI(TAG, "producers | ring cmd/s | queue cmd/s");
+	for (producers = 1; producers <= MQTT_AGENT_BENCH_MAX_PRODUCERS; producers++)
+	{
+		ring_rate = mqtt_agent_bench_measure(&bench_ring_ops, producers);
+		// Let the idle tasks run between measurements
+		vTaskDelay(pdMS_TO_TICKS(100));
+		queue_rate = mqtt_agent_bench_measure(&bench_queue_ops, producers);
+		vTaskDelay(pdMS_TO_TICKS(100));
+
+		ESP_LOGI(TAG, "%9d | %10u | %11u", producers, (unsigned int) ring_rate, (unsigned int) queue_rate);
+	}
+
+	vQueueDelete(bench_free_queue);
+	vQueueDelete(bench_message_queue);
+	vSemaphoreDelete(bench_producer_done);
+
+	xTaskNotifyGive(bench_caller);
+	vTaskDelete(NULL);
+}
+
+void mqtt_agent_bench_run(void)
+{
+	bench_caller = xTaskGetCurrentTaskHandle();
+
+	xTaskCreatePinnedToCore(&mqtt_agent_bench_task, "mqtt_bench_task", MQTT_AGENT_BENCH_TASK_STACK_SIZE, NULL,
+							MQTT_AGENT_BENCH_TASK_PRIORITY, NULL, MQTT_AGENT_BENCH_TASK_CORE_ID);
+
+	ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
@@ -0,0 +1,25 @@
+/*
+ * mqtt_agent_bench.h
+ *
+ * On-device benchmark of the path application tasks use to hand commands to
+ * the MQTT agent: command pool plus message ring, against a FreeRTOS queue.
+ */
+
+#ifndef MAIN_MQTT_AGENT_BENCH_H_
+#define MAIN_MQTT_AGENT_BENCH_H_
+
+// Length of each measurement
+#define MQTT_AGENT_BENCH_RUN_MS			1000
+
+// Producer tasks are added one at a time up to this count
+#define MQTT_AGENT_BENCH_MAX_PRODUCERS	4
+
+/**
+ * Measures commands per second for 1 to MQTT_AGENT_BENCH_MAX_PRODUCERS
+ * producer tasks spread over both cores and logs the results. Blocks for
+ * about two runs per producer count. Must be called before the MQTT agent is
+ * started since it borrows the agent command pool.
+ */
+void mqtt_agent_bench_run(void);
+
+#endif /* MAIN_MQTT_AGENT_BENCH_H_ */
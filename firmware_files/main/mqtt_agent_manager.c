@@ -0,0 +1,616 @@
+/*
+ * mqtt_agent_manager.c
+ *
+ * AWS IoT connection built on coreMQTT-Agent. The agent task owns the TLS
+ * connection and the MQTT context; every other task talks to the broker by
+ * posting commands to it, so publishes from different producers are
+ * pipelined on one connection instead of waiting on each other.
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "core_mqtt.h"
+#include "core_mqtt_agent.h"
+#include "freertos_agent_message.h"
+#include "freertos_command_pool.h"
+#include "transport_mbedtls.h"
+
+#include "aws_iot.h"
+#include "metrics.h"
+#include "mqtt_agent_manager.h"
+#include "tasks_common.h"
+#include "wifi_app.h"
+
+static const char TAG[] = "mqtt_agent";
+
+/**
+ * CA Root certificate, device ("Thing") certificate and device ("Thing") key.
+ * "Embedded Certs" are loaded from files in "certs/", converted from PEM to DER at build time
+ * and embedded into the app binary, so the TLS layer can parse them in place from flash.
+ */
+extern const uint8_t aws_root_ca_der_start[] asm("_binary_aws_root_ca_der_start");
+extern const uint8_t certificate_der_start[] asm("_binary_certificate_der_start");
+extern const uint8_t private_key_der_start[] asm("_binary_private_key_der_start");
+
+// Event group bit set while the agent holds an MQTT connection
+#define MQTT_AGENT_CONNECTED_BIT	BIT0
+
+/**
+ * Completion context of a command issued by an application task. The agent
+ * stores the result and notifies the waiting task.
+ */
+struct MQTTAgentCommandContext
+{
+	TaskHandle_t task;
+	MQTTStatus_t status;
+};
+
+// Registered topic filter and its callback
+typedef struct mqtt_agent_subscription
+{
+	const char *topic_filter;
+	uint16_t topic_filter_len;
+	MQTTQoS_t qos;
+	mqtt_agent_incoming_cb_t callback;
+	void *arg;
+} mqtt_agent_subscription_t;
+
+// Agent task handle
+static TaskHandle_t task_mqtt_agent = NULL;
+
+// Agent, MQTT and transport state, owned by the agent task
+static MQTTAgentContext_t agent_context;
+static MQTTAgentMessageContext_t agent_message_context;
+static NetworkContext_t network_context;
+static uint8_t network_buffer[MQTT_AGENT_MANAGER_NETWORK_BUFFER_SIZE];
+static MQTTPubAckInfo_t outgoing_publish_records[MQTT_AGENT_MAX_OUTSTANDING_ACKS];
+static MQTTPubAckInfo_t incoming_publish_records[MQTT_AGENT_MAX_OUTSTANDING_ACKS];
+
+static EventGroupHandle_t mqtt_agent_event_group;
+
+// Subscription table. Entries are only ever appended, and an entry is complete
+// before subscription_count covers it, so readers only need the count under the mutex.
+static SemaphoreHandle_t subscription_mutex;
+static mqtt_agent_subscription_t subscriptions[MQTT_AGENT_MANAGER_MAX_SUBSCRIPTIONS];
+static size_t subscription_count = 0;
+static bool agent_connected = false;
+
+// Set by a task whose command is stuck; the agent's next socket read fails and drops the connection
+static atomic_bool agent_drop_requested = false;
+
+// Arguments of the SUBSCRIBE sent by the agent after a new session starts
+static MQTTSubscribeInfo_t resubscribe_info[MQTT_AGENT_MANAGER_MAX_SUBSCRIPTIONS];
+static MQTTAgentSubscribeArgs_t resubscribe_args;
+
+/**
+ * Millisecond clock for coreMQTT.
+ */
+static uint32_t mqtt_agent_manager_get_time_ms(void)
+{
+	return (uint32_t) (esp_timer_get_time() / 1000);
+}
+
+/**
+ * Completion callback of commands issued by application tasks.
+ * @param pCmdCallbackContext context of the waiting task
+ * @param pReturnInfo result of the command
+ */
+static void mqtt_agent_manager_command_complete(MQTTAgentCommandContext_t *pCmdCallbackContext,
+												MQTTAgentReturnInfo_t *pReturnInfo)
+{
+	pCmdCallbackContext->status = pReturnInfo->returnCode;
+
+	// A SUBACK can carry a per-filter failure even though the packet itself was fine
+	if (pReturnInfo->returnCode == MQTTSuccess && pReturnInfo->pSubackCodes != NULL &&
+		pReturnInfo->pSubackCodes[0] == MQTTSubAckFailure)
+	{
+		pCmdCallbackContext->status = MQTTServerRefused;
+	}
+
+	xTaskNotifyGive(pCmdCallbackContext->task);
+}
+
+/**
+ * Completion callback of the SUBSCRIBE issued by the agent on a new session.
+ * @param pCmdCallbackContext unused
+ * @param pReturnInfo result of the command
+ */
+static void mqtt_agent_manager_resubscribe_complete(MQTTAgentCommandContext_t *pCmdCallbackContext,
+													MQTTAgentReturnInfo_t *pReturnInfo)
+{
+	(void) pCmdCallbackContext;
+
+	if (pReturnInfo->returnCode != MQTTSuccess)
+	{
+		ESP_LOGE(TAG, "mqtt_agent_manager_resubscribe_complete: SUBSCRIBE failed (%s)",
+				 MQTT_Status_strerror(pReturnInfo->returnCode));
+		return;
+	}
+
+	for (size_t i = 0; i < resubscribe_args.numSubscriptions; i++)
+	{
+		if (pReturnInfo->pSubackCodes[i] == MQTTSubAckFailure)
+		{
+			ESP_LOGE(TAG, "mqtt_agent_manager_resubscribe_complete: broker rejected %.*s",
+					 resubscribe_info[i].topicFilterLength, resubscribe_info[i].pTopicFilter);
+		}
+	}
+}
+
+/**
+ * Dispatches an incoming publish to the callbacks of matching topic filters.
+ * Runs in the agent task.
+ */
+static void mqtt_agent_manager_incoming_publish(MQTTAgentContext_t *pMqttAgentContext, uint16_t packetId,
+												MQTTPublishInfo_t *pPublishInfo)
+{
+	bool matched = false;
+	bool is_match;
+	size_t count;
+
+	(void) pMqttAgentContext;
+	(void) packetId;
+
+	xSemaphoreTake(subscription_mutex, portMAX_DELAY);
+	count = subscription_count;
+	xSemaphoreGive(subscription_mutex);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		is_match = false;
+		MQTT_MatchTopic(pPublishInfo->pTopicName, pPublishInfo->topicNameLength,
+						subscriptions[i].topic_filter, subscriptions[i].topic_filter_len, &is_match);
+		if (is_match)
+		{
+			subscriptions[i].callback(pPublishInfo, subscriptions[i].arg);
+			matched = true;
+		}
+	}
+
+	if (!matched)
+	{
+		ESP_LOGW(TAG, "mqtt_agent_manager_incoming_publish: no handler for %.*s",
+				 pPublishInfo->topicNameLength, pPublishInfo->pTopicName);
+	}
+}
+
+/**
+ * Opens the TLS connection and sends CONNECT.
+ * @param clean_session request a clean session
+ * @param session_present set to whether the broker resumed a previous session
+ * @return ESP_OK on success
+ */
+static esp_err_t mqtt_agent_manager_connect(bool clean_session, bool *session_present)
+{
+	MQTTConnectInfo_t connect_info = {0};
+	MQTTStatus_t status;
+	TLSConnectParams tls_params = {
+		.pRootCALocation = (const char *) aws_root_ca_der_start,
+		.pDeviceCertLocation = (const char *) certificate_der_start,
+		.pDevicePrivateKeyLocation = (const char *) private_key_der_start,
+		.pDestinationURL = CONFIG_AWS_IOT_MQTT_HOST,
+		.DestinationPort = CONFIG_AWS_IOT_MQTT_PORT,
+		.timeout_ms = MQTT_AGENT_MANAGER_TLS_TIMEOUT_MS,
+		.ServerVerificationFlag = true,
+	};
+
+	if (transport_mbedtls_connect(&network_context, &tls_params) != SUCCESS)
+	{
+		return ESP_FAIL;
+	}
+
+	/* Client ID is set in aws_iot.h and AKA your Thing's Name in AWS IoT */
+	connect_info.cleanSession = clean_session;
+	connect_info.pClientIdentifier = CONFIG_AWS_EXAMPLE_CLIENT_ID;
+	connect_info.clientIdentifierLength = (uint16_t) strlen(CONFIG_AWS_EXAMPLE_CLIENT_ID);
+	connect_info.keepAliveSeconds = MQTT_AGENT_MANAGER_KEEP_ALIVE_SEC;
+
+	status = MQTT_Connect(&agent_context.mqttContext, &connect_info, NULL,
+						  MQTT_AGENT_MANAGER_CONNACK_TIMEOUT_MS, session_present);
+	if (status != MQTTSuccess)
+	{
+		ESP_LOGE(TAG, "mqtt_agent_manager_connect: MQTT_Connect failed (%s)", MQTT_Status_strerror(status));
+		transport_mbedtls_disconnect(&network_context);
+		return ESP_FAIL;
+	}
+
+	return ESP_OK;
+}
+
+/**
+ * Marks the agent connected and, when the broker did not keep the previous
+ * session, queues one SUBSCRIBE for every registered topic filter. The
+ * command is processed as soon as the command loop starts.
+ * @param session_present whether the broker resumed the previous session
+ */
+static void mqtt_agent_manager_on_connected(bool session_present)
+{
+	MQTTAgentCommandInfo_t command_info = {
+		.cmdCompleteCallback = mqtt_agent_manager_resubscribe_complete,
+		.pCmdCompleteCallbackContext = NULL,
+		.blockTimeMs = 0,
+	};
+	MQTTStatus_t status;
+
+	xSemaphoreTake(subscription_mutex, portMAX_DELAY);
+
+	agent_connected = true;
+
+	if (!session_present && subscription_count > 0)
+	{
+		for (size_t i = 0; i < subscription_count; i++)
+		{
+			resubscribe_info[i].pTopicFilter = subscriptions[i].topic_filter;
+			resubscribe_info[i].topicFilterLength = subscriptions[i].topic_filter_len;
+			resubscribe_info[i].qos = subscriptions[i].qos;
+		}
+		resubscribe_args.pSubscribeInfo = resubscribe_info;
+		resubscribe_args.numSubscriptions = subscription_count;
+
+		status = MQTTAgent_Subscribe(&agent_context, &resubscribe_args, &command_info);
+		if (status != MQTTSuccess)
+		{
+			ESP_LOGE(TAG, "mqtt_agent_manager_on_connected: could not queue SUBSCRIBE (%s)",
+					 MQTT_Status_strerror(status));
+		}
+	}
+
+	xSemaphoreGive(subscription_mutex);
+
+	xEventGroupSetBits(mqtt_agent_event_group, MQTT_AGENT_CONNECTED_BIT);
+}
+
+/**
+ * Marks the agent disconnected and fails the queued and unacknowledged
+ * commands back to their tasks, so none of them waits for the reconnect.
+ */
+static void mqtt_agent_manager_on_disconnected(void)
+{
+	xEventGroupClearBits(mqtt_agent_event_group, MQTT_AGENT_CONNECTED_BIT);
+
+	xSemaphoreTake(subscription_mutex, portMAX_DELAY);
+	agent_connected = false;
+	xSemaphoreGive(subscription_mutex);
+
+	MQTTAgent_CancelAll(&agent_context);
+
+	// The canceled publishes are never resent, so a resumed session must not find them either
+	memset(outgoing_publish_records, 0, sizeof(outgoing_publish_records));
+}
+
+/**
+ * Waits while the agent has no connection, failing the commands that other
+ * tasks queue meanwhile every MQTT_AGENT_MANAGER_DRAIN_INTERVAL_MS.
+ * @param wait_ms how long to wait, or 0 to wait until the station has an IP
+ */
+static void mqtt_agent_manager_wait_offline(uint32_t wait_ms)
+{
+	int64_t end = esp_timer_get_time() + (int64_t) wait_ms * 1000;
+
+	for (;;)
+	{
+		if (wait_ms == 0)
+		{
+			if (wifi_app_wait_connected(pdMS_TO_TICKS(MQTT_AGENT_MANAGER_DRAIN_INTERVAL_MS)))
+			{
+				return;
+			}
+		}
+		else
+		{
+			int64_t left_ms = (end - esp_timer_get_time()) / 1000;
+
+			if (left_ms <= 0)
+			{
+				return;
+			}
+			vTaskDelay(pdMS_TO_TICKS(MIN(left_ms, MQTT_AGENT_MANAGER_DRAIN_INTERVAL_MS)));
+		}
+
+		MQTTAgent_CancelAll(&agent_context);
+	}
+}
+
+/**
+ * Transport read of the agent. Fails once a task has asked for the
+ * connection to be dropped; the command loop reads the socket on every pass,
+ * so it exits within one pass and the commands are failed back.
+ */
+static int32_t mqtt_agent_manager_recv(NetworkContext_t *pNetworkContext, void *pBuffer, size_t bytesToRecv)
+{
+	if (atomic_load(&agent_drop_requested))
+	{
+		return -1;
+	}
+
+	return transport_mbedtls_recv(pNetworkContext, pBuffer, bytesToRecv);
+}
+
+/**
+ * Waits for the agent to complete a command issued by the calling task. The
+ * agent references the command's arguments until then, so the caller cannot
+ * return earlier. If the command is still pending after
+ * MQTT_AGENT_MANAGER_COMMAND_TIMEOUT_MS the connection is stuck (e.g. the
+ * broker stopped acknowledging), so the agent is asked to drop it, which
+ * fails the command within one pass of its loop. This needs no room in the
+ * command queue. If even that does not complete the command, the agent task
+ * itself is wedged and the device restarts.
+ * @param func name of the calling function, for the log
+ */
+static void mqtt_agent_manager_wait_complete(const char *func)
+{
+	if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_AGENT_MANAGER_COMMAND_TIMEOUT_MS)) != 0)
+	{
+		return;
+	}
+
+	ESP_LOGW(TAG, "%s: no completion after %d ms, dropping the connection", func,
+			 MQTT_AGENT_MANAGER_COMMAND_TIMEOUT_MS);
+	atomic_store(&agent_drop_requested, true);
+
+	if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_AGENT_MANAGER_COMMAND_TIMEOUT_MS)) == 0)
+	{
+		ESP_LOGE(TAG, "%s: agent task not responding", func);
+		abort();
+	}
+}
+
+/**
+ * Sets up the agent context: message ring, command pool, transport and
+ * QoS 1 state records.
+ */
+static void mqtt_agent_manager_init(void)
+{
+	MQTTAgentMessageInterface_t message_interface = {
+		.pMsgCtx = &agent_message_context,
+		.send = Agent_MessageSend,
+		.recv = Agent_MessageReceive,
+		.getCommand = Agent_GetCommand,
+		.releaseCommand = Agent_ReleaseCommand,
+	};
+	TransportInterface_t transport = {
+		.pNetworkContext = &network_context,
+		.recv = mqtt_agent_manager_recv,
+		.send = transport_mbedtls_send,
+		.writev = transport_mbedtls_writev,
+	};
+	MQTTFixedBuffer_t fixed_buffer = {
+		.pBuffer = network_buffer,
+		.size = sizeof(network_buffer),
+	};
+	MQTTStatus_t status;
+
+	Agent_MessageInit(&agent_message_context);
+	Agent_InitializePool();
+
+	status = MQTTAgent_Init(&agent_context, &message_interface, &fixed_buffer, &transport,
+							mqtt_agent_manager_get_time_ms, mqtt_agent_manager_incoming_publish, NULL);
+	if (status == MQTTSuccess)
+	{
+		status = MQTT_InitStatefulQoS(&agent_context.mqttContext,
+									  outgoing_publish_records, MQTT_AGENT_MAX_OUTSTANDING_ACKS,
+									  incoming_publish_records, MQTT_AGENT_MAX_OUTSTANDING_ACKS);
+	}
+
+	if (status != MQTTSuccess)
+	{
+		ESP_LOGE(TAG, "mqtt_agent_manager_init: agent initialisation failed (%s)", MQTT_Status_strerror(status));
+		abort();
+	}
+}
+
+/**
+ * Gauge of the commands waiting in the agent's message ring.
+ * @param arg unused
+ * @return commands posted and not yet received by the agent task
+ */
+static uint32_t mqtt_agent_manager_queue_depth(void *arg)
+{
+	// tail first: head only grows and never falls behind it, so the difference cannot wrap
+	uint32_t tail = __atomic_load_n(&agent_message_context.tail, __ATOMIC_ACQUIRE);
+
+	return atomic_load(&agent_message_context.head) - tail;
+}
+
+/**
+ * Agent task: connects, runs the command loop until the connection drops,
+ * then reconnects with exponential backoff and resumes the session.
+ */
+static void mqtt_agent_manager_task(void *pvParameters)
+{
+	uint32_t backoff_ms = CONFIG_AWS_IOT_MQTT_MIN_RECONNECT_WAIT_INTERVAL;
+	bool clean_session = true;
+	bool session_present = false;
+	MQTTStatus_t status;
+
+	mqtt_agent_manager_init();
+
+	for (;;)
+	{
+		// Attempts without a network would only push the backoff up
+		mqtt_agent_manager_wait_offline(0);
+
+		// Commands stuck on the previous connection have been failed back by now
+		atomic_store(&agent_drop_requested, false);
+
+		ESP_LOGI(TAG, "Connecting to AWS...");
+		if (mqtt_agent_manager_connect(clean_session, &session_present) != ESP_OK)
+		{
+			ESP_LOGW(TAG, "Connection failed, retrying in %u ms", (unsigned int) backoff_ms);
+			metrics_count(METRICS_MQTT_CONNECT_FAILURES);
+			mqtt_agent_manager_wait_offline(backoff_ms);
+			backoff_ms = MIN(backoff_ms * 2, (uint32_t) CONFIG_AWS_IOT_MQTT_MAX_RECONNECT_WAIT_INTERVAL);
+			continue;
+		}
+
+		ESP_LOGI(TAG, "Connected to %s (session %s)", CONFIG_AWS_IOT_MQTT_HOST,
+				 session_present ? "resumed" : "new");
+		backoff_ms = CONFIG_AWS_IOT_MQTT_MIN_RECONNECT_WAIT_INTERVAL;
+
+		// Keep the session on the broker from now on so subscriptions and QoS 1
+		// messages to the device survive a reconnect
+		clean_session = false;
+
+		// Outgoing commands were already failed back when the connection dropped,
+		// so this only resets the agent's session state
+		MQTTAgent_ResumeSession(&agent_context, session_present);
+		mqtt_agent_manager_on_connected(session_present);
+
+		status = MQTTAgent_CommandLoop(&agent_context);
+
+		mqtt_agent_manager_on_disconnected();
+		ESP_LOGW(TAG, "Command loop exited (%s), reconnecting", MQTT_Status_strerror(status));
+		metrics_count(METRICS_MQTT_RECONNECTS);
+
+		transport_mbedtls_disconnect(&network_context);
+		agent_context.mqttContext.connectStatus = MQTTNotConnected;
+		agent_context.mqttContext.index = 0;
+	}
+}
+
+void mqtt_agent_manager_start(void)
+{
+	if (task_mqtt_agent == NULL)
+	{
+		mqtt_agent_event_group = xEventGroupCreate();
+		subscription_mutex = xSemaphoreCreateMutex();
+		metrics_register_gauge("mqtt_agent_commands", mqtt_agent_manager_queue_depth, NULL);
+
+		xTaskCreatePinnedToCore(&mqtt_agent_manager_task, "mqtt_agent_task", MQTT_AGENT_TASK_STACK_SIZE, NULL,
+								MQTT_AGENT_TASK_PRIORITY, &task_mqtt_agent, MQTT_AGENT_TASK_CORE_ID);
+	}
+}
+
+bool mqtt_agent_manager_wait_connected(TickType_t ticks_to_wait)
+{
+	EventBits_t bits = xEventGroupWaitBits(mqtt_agent_event_group, MQTT_AGENT_CONNECTED_BIT, pdFALSE, pdTRUE,
+										   ticks_to_wait);
+
+	return (bits & MQTT_AGENT_CONNECTED_BIT) != 0;
+}
+
+esp_err_t mqtt_agent_manager_publish(const char *topic, const void *payload, size_t payload_len,
+									 MQTTQoS_t qos, uint32_t enqueue_timeout_ms)
+{
+	MQTTAgentCommandContext_t command_context = {
+		.task = xTaskGetCurrentTaskHandle(),
+		.status = MQTTSuccess,
+	};
+	MQTTAgentCommandInfo_t command_info = {
+		.cmdCompleteCallback = mqtt_agent_manager_command_complete,
+		.pCmdCompleteCallbackContext = &command_context,
+		.blockTimeMs = enqueue_timeout_ms,
+	};
+	MQTTPublishInfo_t publish_info = {
+		.qos = qos,
+		.pTopicName = topic,
+		.topicNameLength = (uint16_t) strlen(topic),
+		.pPayload = payload,
+		.payloadLength = payload_len,
+	};
+	MQTTStatus_t status;
+	int64_t start = esp_timer_get_time();
+
+	status = MQTTAgent_Publish(&agent_context, &publish_info, &command_info);
+	if (status != MQTTSuccess)
+	{
+		ESP_LOGW(TAG, "mqtt_agent_manager_publish: could not queue publish to %s (%s)",
+				 topic, MQTT_Status_strerror(status));
+		metrics_count(METRICS_MQTT_PUBLISH_ERRORS);
+		return ESP_ERR_TIMEOUT;
+	}
+
+	// The agent references publish_info and payload until the command completes
+	mqtt_agent_manager_wait_complete("mqtt_agent_manager_publish");
+	metrics_observe(METRICS_MQTT_PUBLISH_MS, (esp_timer_get_time() - start) / 1000);
+
+	if (command_context.status != MQTTSuccess)
+	{
+		ESP_LOGW(TAG, "mqtt_agent_manager_publish: publish to %s failed (%s)",
+				 topic, MQTT_Status_strerror(command_context.status));
+		metrics_count(METRICS_MQTT_PUBLISH_ERRORS);
+		return ESP_FAIL;
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t mqtt_agent_manager_subscribe(const char *topic_filter, MQTTQoS_t qos,
+									   mqtt_agent_incoming_cb_t callback, void *arg)
+{
+	MQTTAgentCommandContext_t command_context = {
+		.task = xTaskGetCurrentTaskHandle(),
+		.status = MQTTSuccess,
+	};
+	MQTTAgentCommandInfo_t command_info = {
+		.cmdCompleteCallback = mqtt_agent_manager_command_complete,
+		.pCmdCompleteCallbackContext = &command_context,
+		.blockTimeMs = MQTT_AGENT_MANAGER_SUBSCRIBE_TIMEOUT_MS,
+	};
+	MQTTSubscribeInfo_t subscribe_info;
+	MQTTAgentSubscribeArgs_t subscribe_args;
+	MQTTStatus_t status;
+	bool connected;
+
+	xSemaphoreTake(subscription_mutex, portMAX_DELAY);
+
+	if (subscription_count == MQTT_AGENT_MANAGER_MAX_SUBSCRIPTIONS)
+	{
+		xSemaphoreGive(subscription_mutex);
+		ESP_LOGE(TAG, "mqtt_agent_manager_subscribe: subscription table full, %s not added", topic_filter);
+		return ESP_ERR_NO_MEM;
+	}
+
+	subscriptions[subscription_count].topic_filter = topic_filter;
+	subscriptions[subscription_count].topic_filter_len = (uint16_t) strlen(topic_filter);
+	subscriptions[subscription_count].qos = qos;
+	subscriptions[subscription_count].callback = callback;
+	subscriptions[subscription_count].arg = arg;
+	subscription_count++;
+
+	// If the agent connects after this point it subscribes to the new entry itself
+	connected = agent_connected;
+
+	xSemaphoreGive(subscription_mutex);
+
+	if (!connected)
+	{
+		ESP_LOGI(TAG, "mqtt_agent_manager_subscribe: %s will be subscribed on connect", topic_filter);
+		return ESP_OK;
+	}
+
+	subscribe_info.pTopicFilter = topic_filter;
+	subscribe_info.topicFilterLength = (uint16_t) strlen(topic_filter);
+	subscribe_info.qos = qos;
+	subscribe_args.pSubscribeInfo = &subscribe_info;
+	subscribe_args.numSubscriptions = 1;
+
+	status = MQTTAgent_Subscribe(&agent_context, &subscribe_args, &command_info);
+	if (status != MQTTSuccess)
+	{
+		ESP_LOGE(TAG, "mqtt_agent_manager_subscribe: could not queue SUBSCRIBE (%s)", MQTT_Status_strerror(status));
+		return ESP_FAIL;
+	}
+
+	mqtt_agent_manager_wait_complete("mqtt_agent_manager_subscribe");
+
+	if (command_context.status != MQTTSuccess)
+	{
+		ESP_LOGE(TAG, "mqtt_agent_manager_subscribe: subscribe to %s failed (%s)",
+				 topic_filter, MQTT_Status_strerror(command_context.status));
+		return ESP_FAIL;
+	}
+
+	ESP_LOGI(TAG, "Subscribed to %s", topic_filter);
+	return ESP_OK;
+}
@@ -0,0 +1,107 @@
+/*
+ * mqtt_agent_manager.h
+ *
+ * Owns the AWS IoT MQTT connection. A single agent task runs the
+ * coreMQTT-Agent command loop; application tasks publish and subscribe
+ * through it concurrently instead of sharing one blocking client.
+ */
+
+#ifndef MAIN_MQTT_AGENT_MANAGER_H_
+#define MAIN_MQTT_AGENT_MANAGER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "core_mqtt.h"
+
+// Maximum number of topic filters that clients can register
+#define MQTT_AGENT_MANAGER_MAX_SUBSCRIPTIONS	8
+
+// Size of the coreMQTT network buffer. Publishes are sent with writev so this
+// only has to hold packet headers and incoming messages; with MQTT OTA that
+// includes a 4 KB firmware block and its topic.
+#if CONFIG_MQTT_OTA
+#define MQTT_AGENT_MANAGER_NETWORK_BUFFER_SIZE	(4096 + 512)
+#else
+#define MQTT_AGENT_MANAGER_NETWORK_BUFFER_SIZE	1024
+#endif
+
+// MQTT keep alive and CONNACK timeout. In low power mode the pings are
+// spread out so they do not wake the radio between telemetry batches.
+#if CONFIG_POWER_SAVE
+#define MQTT_AGENT_MANAGER_KEEP_ALIVE_SEC		120
+#else
+#define MQTT_AGENT_MANAGER_KEEP_ALIVE_SEC		10
+#endif
+#define MQTT_AGENT_MANAGER_CONNACK_TIMEOUT_MS	20000
+
+// TLS handshake timeout
+#define MQTT_AGENT_MANAGER_TLS_TIMEOUT_MS		5000
+
+// How long a subscribe waits for room in the agent command queue
+#define MQTT_AGENT_MANAGER_SUBSCRIBE_TIMEOUT_MS	5000
+
+// While the agent has no connection, commands queued by other tasks are failed
+// back to them at this interval instead of waiting for the reconnect
+#define MQTT_AGENT_MANAGER_DRAIN_INTERVAL_MS	1000
+
+// How long a publish or subscribe waits for the agent to complete it before
+// the connection is considered stuck and dropped. Longer than a connect
+// attempt (TLS handshake and CONNACK) plus one drain interval.
+#define MQTT_AGENT_MANAGER_COMMAND_TIMEOUT_MS	30000
+
+/**
+ * Callback for publishes arriving on a subscribed topic filter.
+ * Runs in the agent task, so it must not block; hand longer work to another task.
+ * @param pPublishInfo incoming publish; topic and payload are only valid during the call
+ * @param arg argument given to mqtt_agent_manager_subscribe
+ */
+typedef void (*mqtt_agent_incoming_cb_t)(MQTTPublishInfo_t *pPublishInfo, void *arg);
+
+/**
+ * Starts the MQTT agent task, which connects to AWS IoT as soon as WiFi has
+ * an IP and keeps the connection alive. Call after wifi_app_start; the agent
+ * is set up while WiFi associates. Safe to call more than once.
+ */
+void mqtt_agent_manager_start(void);
+
+/**
+ * Blocks until the agent is connected to the broker.
+ * @param ticks_to_wait maximum time to wait
+ * @return true if connected
+ */
+bool mqtt_agent_manager_wait_connected(TickType_t ticks_to_wait);
+
+/**
+ * Publishes a message through the agent and waits for it to complete: sent
+ * for QoS 0, acknowledged for QoS 1. Several tasks may publish at once. A
+ * publish that is still pending when the connection drops, or that is queued
+ * while the agent is disconnected, fails instead of waiting for the reconnect.
+ * @param topic topic name
+ * @param payload message payload, must stay valid until the call returns
+ * @param payload_len payload length in bytes
+ * @param qos MQTTQoS0 or MQTTQoS1
+ * @param enqueue_timeout_ms how long to wait for room in the agent command queue
+ * @return ESP_OK, ESP_ERR_TIMEOUT if the command could not be queued, ESP_FAIL if the publish failed
+ */
+esp_err_t mqtt_agent_manager_publish(const char *topic, const void *payload, size_t payload_len,
+									 MQTTQoS_t qos, uint32_t enqueue_timeout_ms);
+
+/**
+ * Registers a callback for a topic filter and subscribes to it. The
+ * subscription is restored automatically whenever the session is not resumed
+ * after a reconnect. If the agent is not connected yet, the subscribe is sent
+ * once it is.
+ * @param topic_filter topic filter, must be a string that stays valid (e.g. a literal)
+ * @param qos maximum QoS of the subscription
+ * @param callback called for each matching incoming publish
+ * @param arg passed to the callback
+ * @return ESP_OK, ESP_ERR_NO_MEM if the subscription table is full, ESP_FAIL if the broker rejected it
+ */
+esp_err_t mqtt_agent_manager_subscribe(const char *topic_filter, MQTTQoS_t qos,
+									   mqtt_agent_incoming_cb_t callback, void *arg);
+
+#endif /* MAIN_MQTT_AGENT_MANAGER_H_ */
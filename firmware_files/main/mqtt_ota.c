@@ -0,0 +1,802 @@
+/*
+ * mqtt_ota.c
+ *
+ * The OTA task owns the update; the MQTT agent callbacks only hand messages
+ * over to it. A start-next response is copied into the job buffer and an
+ * event is posted. A data block is decoded straight from the agent's network
+ * buffer into a free block slot and the slot is posted; with no free slot the
+ * block is dropped and requested again later.
+ *
+ * While downloading, the task keeps up to CONFIG_MQTT_OTA_WINDOW blocks
+ * requested and not yet received, asking for runs of missing blocks in one
+ * request where it can. Each block received is written to its own sector,
+ * marked in the done bitmap and replaced by a request for the next missing
+ * block. If nothing arrives for MQTT_OTA_BLOCK_TIMEOUT_MS the outstanding
+ * blocks are requested again. The bitmap, with the job id, image size and
+ * partition it belongs to, is saved to NVS every few blocks; after a reboot
+ * start-next returns the same job and only the missing blocks are fetched.
+ *
+ * A delta patch or compressed image has to be unpacked from its start, so a
+ * new download first fetches block 0 alone to tell a plain image from a
+ * packed one. A packed file goes through ota_writer_write in order: a block
+ * that arrives ahead of its turn stays in its slot until the blocks before it
+ * are written, with one slot always left for the block everything is waiting
+ * on. Packed files are not resumed.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_image_format.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "nvs.h"
+
+#include "core_json.h"
+#include "jobs.h"
+#include "MQTTFileDownloader.h"
+#include "MQTTFileDownloader_defaults.h"
+#include "ota_job_processor.h"
+
+#include "mqtt_agent_manager.h"
+#include "mqtt_ota.h"
+#include "ota_writer.h"
+#include "tasks_common.h"
+
+static const char TAG[] = "mqtt_ota";
+
+_Static_assert(MQTT_OTA_BLOCK_SIZE == mqttFileDownloader_CONFIG_BLOCK_SIZE, "stream blocks must be one flash sector");
+
+// The thing name is the MQTT client ID
+#define MQTT_OTA_THING_NAME		CONFIG_AWS_CLIENT_ID
+
+static const char MQTT_OTA_NEXT_JOB_TOPIC[] = JOBS_API_SUBSCRIBE_NEXTJOBCHANGED(MQTT_OTA_THING_NAME);
+static const char MQTT_OTA_START_NEXT_TOPIC[] = JOBS_API_PUBLISH_STARTNEXT(MQTT_OTA_THING_NAME);
+static const char MQTT_OTA_START_NEXT_ACCEPTED_TOPIC[] =
+	JOBS_TOPIC_COMMON(MQTT_OTA_THING_NAME, JOBS_API_JOBID_NULL, JOBS_API_STARTNEXT JOBS_API_SUCCESS);
+static const char MQTT_OTA_STREAM_DATA_TOPIC[] = MQTT_API_THINGS MQTT_OTA_THING_NAME MQTT_API_STREAMS "+" MQTT_API_DATA_CBOR;
+
+// NVS namespace and key of the resume record
+static const char MQTT_OTA_NVS_NAMESPACE[] = "mqttOta";
+static const char MQTT_OTA_NVS_RESUME_KEY[] = "resume";
+
+#define MQTT_OTA_BITMAP_LEN		(MQTT_OTA_MAX_BLOCKS / 8)
+
+#define MQTT_OTA_BIT_TEST(map, n)	(((map)[(n) / 8] & (1U << ((n) % 8))) != 0)
+#define MQTT_OTA_BIT_SET(map, n)	((map)[(n) / 8] |= (uint8_t) (1U << ((n) % 8)))
+#define MQTT_OTA_BIT_CLEAR(map, n)	((map)[(n) / 8] &= (uint8_t) ~(1U << ((n) % 8)))
+
+// Events for the OTA task
+typedef enum mqtt_ota_event_type
+{
+	MQTT_OTA_EVENT_NEXT_JOB = 0,	// A job may be pending, ask for it
+	MQTT_OTA_EVENT_JOB,				// Start-next response in the job buffer
+	MQTT_OTA_EVENT_BLOCK,			// Decoded block in a slot
+} mqtt_ota_event_type_e;
+
+typedef struct mqtt_ota_event
+{
+	mqtt_ota_event_type_e type;
+	int slot;
+} mqtt_ota_event_t;
+
+// How the file of a download is written
+typedef enum mqtt_ota_mode
+{
+	MQTT_OTA_MODE_UNKNOWN = 0,		// Waiting for block 0
+	MQTT_OTA_MODE_BLOCKS,			// Image, sectors written in any order
+	MQTT_OTA_MODE_IN_ORDER,			// Patch, streamed through the writer
+} mqtt_ota_mode_e;
+
+// A decoded data block waiting to be written
+typedef struct mqtt_ota_slot
+{
+	int32_t file_id;
+	int32_t block_id;
+	size_t len;
+	uint8_t data[MQTT_OTA_BLOCK_SIZE];
+} mqtt_ota_slot_t;
+
+// Saved in NVS as one blob so it is always consistent
+typedef struct mqtt_ota_resume
+{
+	char job_id[JOBS_JOBID_MAX_LENGTH + 1];
+	uint32_t file_size;
+	uint32_t partition_address;
+	uint8_t done[MQTT_OTA_BITMAP_LEN];
+} mqtt_ota_resume_t;
+
+// OTA task handle
+static TaskHandle_t task_mqtt_ota = NULL;
+
+static QueueHandle_t mqtt_ota_event_queue;
+
+// Block slots, allocated with the first download and kept, since the agent
+// callback may still be decoding into one when a download ends
+static mqtt_ota_slot_t *mqtt_ota_slots;
+static QueueHandle_t mqtt_ota_free_slots;
+
+// Start-next response; set busy by the callback that fills it, cleared by the task
+static char mqtt_ota_job_msg[MQTT_OTA_JOB_MSG_MAX_LEN];
+static size_t mqtt_ota_job_msg_len;
+static atomic_bool mqtt_ota_job_msg_busy;
+
+// Stream topics of the current download, and whether blocks are wanted
+static MqttFileDownloaderContext_t mqtt_ota_downloader;
+static atomic_bool mqtt_ota_downloading;
+
+// Job being run; only used by the OTA task
+static char mqtt_ota_job_id[JOBS_JOBID_MAX_LENGTH + 1];
+static char mqtt_ota_job_version[16];
+static mqtt_ota_resume_t mqtt_ota_resume;
+static uint8_t mqtt_ota_requested[MQTT_OTA_BITMAP_LEN];
+static uint32_t mqtt_ota_stalls;
+
+// In order, slots of blocks ahead of the next one to write
+static int mqtt_ota_held[CONFIG_MQTT_OTA_WINDOW];
+static uint32_t mqtt_ota_held_count;
+static uint32_t mqtt_ota_next_block;
+
+/**
+ * Posts an event to the OTA task without blocking.
+ * @return true if the event was queued
+ */
+static bool mqtt_ota_post(mqtt_ota_event_type_e type, int slot)
+{
+	mqtt_ota_event_t event = { .type = type, .slot = slot };
+
+	return xQueueSend(mqtt_ota_event_queue, &event, 0) == pdTRUE;
+}
+
+/**
+ * notify-next callback: the next pending job changed. Runs in the agent task.
+ */
+static void mqtt_ota_next_job_callback(MQTTPublishInfo_t *pPublishInfo, void *arg)
+{
+	(void) pPublishInfo;
+	(void) arg;
+
+	mqtt_ota_post(MQTT_OTA_EVENT_NEXT_JOB, -1);
+}
+
+/**
+ * start-next/accepted callback: copies the response for the OTA task.
+ * Runs in the agent task.
+ */
+static void mqtt_ota_start_next_callback(MQTTPublishInfo_t *pPublishInfo, void *arg)
+{
+	bool idle = false;
+
+	(void) arg;
+
+	if (pPublishInfo->payloadLength > sizeof(mqtt_ota_job_msg))
+	{
+		ESP_LOGE(TAG, "mqtt_ota_start_next_callback: job message too long (%u bytes)",
+				(unsigned int) pPublishInfo->payloadLength);
+		return;
+	}
+
+	// Busy while a job runs; start-next returns it again once that is over
+	if (!atomic_compare_exchange_strong(&mqtt_ota_job_msg_busy, &idle, true))
+	{
+		return;
+	}
+
+	memcpy(mqtt_ota_job_msg, pPublishInfo->pPayload, pPublishInfo->payloadLength);
+	mqtt_ota_job_msg_len = pPublishInfo->payloadLength;
+	if (!mqtt_ota_post(MQTT_OTA_EVENT_JOB, -1))
+	{
+		atomic_store(&mqtt_ota_job_msg_busy, false);
+	}
+}
+
+/**
+ * Stream data callback: decodes a block into a free slot. Runs in the agent task.
+ */
+static void mqtt_ota_data_callback(MQTTPublishInfo_t *pPublishInfo, void *arg)
+{
+	mqtt_ota_slot_t *slot;
+	int32_t block_size;
+	int index;
+
+	(void) arg;
+
+	if (!atomic_load(&mqtt_ota_downloading) ||
+		mqttDownloader_isDataBlockReceived(&mqtt_ota_downloader, pPublishInfo->pTopicName,
+										   pPublishInfo->topicNameLength) != MQTTFileDownloaderSuccess)
+	{
+		return;
+	}
+
+	if (xQueueReceive(mqtt_ota_free_slots, &index, 0) != pdTRUE)
+	{
+		ESP_LOGD(TAG, "mqtt_ota_data_callback: no free slot, block dropped");
+		return;
+	}
+
+	slot = &mqtt_ota_slots[index];
+	slot->len = sizeof(slot->data);
+	if (mqttDownloader_processReceivedDataBlock(&mqtt_ota_downloader, (uint8_t *) pPublishInfo->pPayload,
+												pPublishInfo->payloadLength, &slot->file_id, &slot->block_id,
+												&block_size, slot->data, &slot->len) != MQTTFileDownloaderSuccess ||
+		!mqtt_ota_post(MQTT_OTA_EVENT_BLOCK, index))
+	{
+		ESP_LOGW(TAG, "mqtt_ota_data_callback: bad block dropped");
+		xQueueSend(mqtt_ota_free_slots, &index, 0);
+	}
+}
+
+/**
+ * Asks the Jobs service for the next pending job; the answer arrives on
+ * start-next/accepted.
+ */
+static void mqtt_ota_request_next_job(void)
+{
+	char msg[64];
+	size_t msg_len;
+
+	msg_len = Jobs_StartNextMsg(MQTT_OTA_THING_NAME, strlen(MQTT_OTA_THING_NAME), msg, sizeof(msg));
+	if (mqtt_agent_manager_publish(MQTT_OTA_START_NEXT_TOPIC, msg, msg_len, MQTTQoS1,
+								   MQTT_OTA_ENQUEUE_TIMEOUT_MS) != ESP_OK)
+	{
+		ESP_LOGW(TAG, "mqtt_ota_request_next_job: start-next publish failed");
+	}
+}
+
+/**
+ * Reports the final status of the running job.
+ * @param status Succeeded, Failed or Rejected
+ */
+static void mqtt_ota_update_job(JobCurrentStatus_t status)
+{
+	char topic[JOBS_API_MAX_LENGTH(sizeof(MQTT_OTA_THING_NAME) - 1)];
+	char msg[96];
+	size_t topic_len;
+	size_t msg_len;
+
+	if (Jobs_Update(topic, sizeof(topic), MQTT_OTA_THING_NAME, (uint16_t) strlen(MQTT_OTA_THING_NAME),
+					mqtt_ota_job_id, (uint16_t) strlen(mqtt_ota_job_id), &topic_len) != JobsSuccess)
+	{
+		return;
+	}
+
+	msg_len = Jobs_UpdateMsg(status, mqtt_ota_job_version, strlen(mqtt_ota_job_version), msg, sizeof(msg));
+	if (msg_len == 0 ||
+		mqtt_agent_manager_publish(topic, msg, msg_len, MQTTQoS1, MQTT_OTA_ENQUEUE_TIMEOUT_MS) != ESP_OK)
+	{
+		ESP_LOGW(TAG, "mqtt_ota_update_job: status update for %s failed", mqtt_ota_job_id);
+	}
+}
+
+/**
+ * Loads the resume record for this job, or starts a new one if there is
+ * none or it belongs to another job, image size or partition.
+ * @param file_size image size
+ * @param partition_address flash offset of the update partition
+ * @return number of blocks already written
+ */
+static uint32_t mqtt_ota_resume_load(uint32_t file_size, uint32_t partition_address)
+{
+	size_t len = sizeof(mqtt_ota_resume);
+	uint32_t done = 0;
+	nvs_handle_t handle;
+	esp_err_t err;
+
+	err = nvs_open(MQTT_OTA_NVS_NAMESPACE, NVS_READONLY, &handle);
+	if (err == ESP_OK)
+	{
+		err = nvs_get_blob(handle, MQTT_OTA_NVS_RESUME_KEY, &mqtt_ota_resume, &len);
+		nvs_close(handle);
+	}
+
+	if (err != ESP_OK || len != sizeof(mqtt_ota_resume) ||
+		strncmp(mqtt_ota_resume.job_id, mqtt_ota_job_id, sizeof(mqtt_ota_resume.job_id)) != 0 ||
+		mqtt_ota_resume.file_size != file_size || mqtt_ota_resume.partition_address != partition_address)
+	{
+		memset(&mqtt_ota_resume, 0, sizeof(mqtt_ota_resume));
+		strlcpy(mqtt_ota_resume.job_id, mqtt_ota_job_id, sizeof(mqtt_ota_resume.job_id));
+		mqtt_ota_resume.file_size = file_size;
+		mqtt_ota_resume.partition_address = partition_address;
+		return 0;
+	}
+
+	for (uint32_t block = 0; block < MQTT_OTA_MAX_BLOCKS; block++)
+	{
+		if (MQTT_OTA_BIT_TEST(mqtt_ota_resume.done, block))
+		{
+			done++;
+		}
+	}
+	ESP_LOGI(TAG, "mqtt_ota_resume_load: resuming %s with %u blocks written", mqtt_ota_job_id, (unsigned int) done);
+
+	return done;
+}
+
+/**
+ * Saves the resume record, or erases it.
+ * @param keep false to erase it
+ */
+static void mqtt_ota_resume_save(bool keep)
+{
+	nvs_handle_t handle;
+	esp_err_t err;
+
+	err = nvs_open(MQTT_OTA_NVS_NAMESPACE, NVS_READWRITE, &handle);
+	if (err == ESP_OK)
+	{
+		if (keep)
+		{
+			err = nvs_set_blob(handle, MQTT_OTA_NVS_RESUME_KEY, &mqtt_ota_resume, sizeof(mqtt_ota_resume));
+		}
+		else
+		{
+			err = nvs_erase_key(handle, MQTT_OTA_NVS_RESUME_KEY);
+			err = (err == ESP_ERR_NVS_NOT_FOUND) ? ESP_OK : err;
+		}
+		if (err == ESP_OK)
+		{
+			err = nvs_commit(handle);
+		}
+		nvs_close(handle);
+	}
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGW(TAG, "mqtt_ota_resume_save: Error (%s) writing resume record", esp_err_to_name(err));
+	}
+}
+
+/**
+ * Requests missing blocks until the window is full. Consecutive missing
+ * blocks go in one request.
+ * @param fields job document fields of the file
+ * @param block_count blocks in the file
+ * @param window blocks that may be requested or held at once
+ * @param outstanding blocks requested and not received, updated
+ */
+static void mqtt_ota_fill_window(const AfrOtaJobDocumentFields_t *fields, uint32_t block_count, uint32_t window,
+								 uint32_t *outstanding)
+{
+	char request[GET_STREAM_REQUEST_BUFFER_SIZE];
+	size_t request_len;
+	uint32_t first = 0;
+	uint32_t count;
+
+	while (*outstanding + mqtt_ota_held_count < window)
+	{
+		while (first < block_count &&
+			   (MQTT_OTA_BIT_TEST(mqtt_ota_resume.done, first) || MQTT_OTA_BIT_TEST(mqtt_ota_requested, first)))
+		{
+			first++;
+		}
+		if (first == block_count)
+		{
+			return;
+		}
+
+		count = 0;
+		while (first + count < block_count && *outstanding + mqtt_ota_held_count + count < window &&
+			   !MQTT_OTA_BIT_TEST(mqtt_ota_resume.done, first + count) &&
+			   !MQTT_OTA_BIT_TEST(mqtt_ota_requested, first + count))
+		{
+			count++;
+		}
+
+		request_len = mqttDownloader_createGetDataBlockRequest(DATA_TYPE_CBOR, (uint16_t) fields->fileId,
+															   MQTT_OTA_BLOCK_SIZE, (uint16_t) first, count,
+															   request, sizeof(request));
+		if (request_len == 0 ||
+			mqtt_agent_manager_publish(mqtt_ota_downloader.topicGetStream, request, request_len, MQTTQoS0,
+									   MQTT_OTA_ENQUEUE_TIMEOUT_MS) != ESP_OK)
+		{
+			// The block timeout asks again
+			return;
+		}
+
+		for (uint32_t block = first; block < first + count; block++)
+		{
+			MQTT_OTA_BIT_SET(mqtt_ota_requested, block);
+		}
+		*outstanding += count;
+	}
+}
+
+/**
+ * Picks the mode from the first block of a new download and starts the
+ * writer for it.
+ * @param slot block 0 of the file
+ * @param file_size size of the file
+ * @param mode set to the mode chosen
+ * @return ESP_OK or the error from starting the writer
+ */
+static esp_err_t mqtt_ota_begin_mode(const mqtt_ota_slot_t *slot, uint32_t file_size, mqtt_ota_mode_e *mode)
+{
+	uint32_t partition_address;
+
+	if (slot->data[0] == ESP_IMAGE_HEADER_MAGIC)
+	{
+		*mode = MQTT_OTA_MODE_BLOCKS;
+		return ota_writer_begin_blocks(file_size, &partition_address);
+	}
+
+	ESP_LOGI(TAG, "mqtt_ota_begin_mode: file is packed, writing in order");
+	*mode = MQTT_OTA_MODE_IN_ORDER;
+	return ota_writer_begin();
+}
+
+/**
+ * Writes a received block. In order, a block ahead of the next one is kept
+ * in its slot until the blocks before it have been written, and the blocks
+ * it was holding up are written after it.
+ * @param index slot of the block
+ * @param mode how the file is written
+ * @param held set to true if the slot was kept
+ * @return ESP_OK or the error from the writer
+ */
+static esp_err_t mqtt_ota_write_block(int index, mqtt_ota_mode_e mode, bool *held)
+{
+	mqtt_ota_slot_t *slot = &mqtt_ota_slots[index];
+	esp_err_t err;
+	uint32_t i = 0;
+
+	*held = false;
+
+	if (mode == MQTT_OTA_MODE_BLOCKS)
+	{
+		return ota_writer_write_block((size_t) slot->block_id * MQTT_OTA_BLOCK_SIZE, slot->data, slot->len);
+	}
+
+	if ((uint32_t) slot->block_id != mqtt_ota_next_block)
+	{
+		mqtt_ota_held[mqtt_ota_held_count++] = index;
+		*held = true;
+		return ESP_OK;
+	}
+
+	err = ota_writer_write(slot->data, slot->len);
+	mqtt_ota_next_block++;
+
+	while (err == ESP_OK && i < mqtt_ota_held_count)
+	{
+		slot = &mqtt_ota_slots[mqtt_ota_held[i]];
+		if ((uint32_t) slot->block_id != mqtt_ota_next_block)
+		{
+			i++;
+			continue;
+		}
+
+		err = ota_writer_write(slot->data, slot->len);
+		mqtt_ota_next_block++;
+		xQueueSend(mqtt_ota_free_slots, &mqtt_ota_held[i], 0);
+		mqtt_ota_held[i] = mqtt_ota_held[--mqtt_ota_held_count];
+		i = 0;
+	}
+
+	return err;
+}
+
+/**
+ * Downloads and writes the file of a job, then validates the image and
+ * makes it the boot partition. An image is written block by block in any
+ * order and can resume; a patch or compressed image is unpacked in order and
+ * starts over.
+ * @param fields job document fields of the file
+ * @return ESP_OK, ESP_ERR_TIMEOUT if the stream stopped sending, or the
+ * error from writing or validating the image
+ */
+static esp_err_t mqtt_ota_download(const AfrOtaJobDocumentFields_t *fields)
+{
+	uint32_t block_count = (fields->fileSize + MQTT_OTA_BLOCK_SIZE - 1) / MQTT_OTA_BLOCK_SIZE;
+	const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+	mqtt_ota_mode_e mode = MQTT_OTA_MODE_UNKNOWN;
+	uint32_t partition_address;
+	uint32_t outstanding = 0;
+	uint32_t since_save = 0;
+	uint32_t timeouts = 0;
+	uint32_t done;
+	mqtt_ota_event_t event;
+	mqtt_ota_slot_t *slot;
+	size_t expected_len;
+	bool held;
+	esp_err_t err = ESP_OK;
+
+	if (block_count == 0 || block_count > MQTT_OTA_MAX_BLOCKS || partition == NULL)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	if (mqttDownloader_init(&mqtt_ota_downloader, fields->imageRef, fields->imageRefLen, MQTT_OTA_THING_NAME,
+							strlen(MQTT_OTA_THING_NAME), DATA_TYPE_CBOR) != MQTTFileDownloaderSuccess)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (mqtt_ota_slots == NULL)
+	{
+		mqtt_ota_slots = calloc(CONFIG_MQTT_OTA_WINDOW, sizeof(mqtt_ota_slot_t));
+		if (mqtt_ota_slots == NULL)
+		{
+			return ESP_ERR_NO_MEM;
+		}
+		for (int index = 0; index < CONFIG_MQTT_OTA_WINDOW; index++)
+		{
+			xQueueSend(mqtt_ota_free_slots, &index, 0);
+		}
+	}
+
+	// Only images leave a resume record, so with one the mode is known
+	done = mqtt_ota_resume_load(fields->fileSize, partition->address);
+	if (done > 0)
+	{
+		mode = MQTT_OTA_MODE_BLOCKS;
+		err = ota_writer_begin_blocks(fields->fileSize, &partition_address);
+		if (err != ESP_OK)
+		{
+			return err;
+		}
+	}
+
+	memset(mqtt_ota_requested, 0, sizeof(mqtt_ota_requested));
+	mqtt_ota_held_count = 0;
+	mqtt_ota_next_block = 0;
+	atomic_store(&mqtt_ota_downloading, true);
+
+	ESP_LOGI(TAG, "mqtt_ota_download: %.*s, %u bytes in %u blocks", (int) fields->imageRefLen, fields->imageRef,
+			(unsigned int) fields->fileSize, (unsigned int) block_count);
+
+	while (done < block_count)
+	{
+		// Until block 0 tells a plain image from a packed one, ask for nothing else
+		mqtt_ota_fill_window(fields, block_count, (mode == MQTT_OTA_MODE_UNKNOWN) ? 1 : CONFIG_MQTT_OTA_WINDOW,
+							 &outstanding);
+
+		if (xQueueReceive(mqtt_ota_event_queue, &event, pdMS_TO_TICKS(MQTT_OTA_BLOCK_TIMEOUT_MS)) != pdTRUE)
+		{
+			if (++timeouts > MQTT_OTA_MAX_TIMEOUTS)
+			{
+				err = ESP_ERR_TIMEOUT;
+				break;
+			}
+			ESP_LOGW(TAG, "mqtt_ota_download: no block for %d ms, requesting %u again",
+					MQTT_OTA_BLOCK_TIMEOUT_MS, (unsigned int) outstanding);
+			memset(mqtt_ota_requested, 0, sizeof(mqtt_ota_requested));
+			outstanding = 0;
+			continue;
+		}
+
+		if (event.type != MQTT_OTA_EVENT_BLOCK)
+		{
+			// Job notifications wait until this one is over
+			continue;
+		}
+
+		slot = &mqtt_ota_slots[event.slot];
+		held = false;
+		if (slot->block_id >= 0 && (uint32_t) slot->block_id < block_count)
+		{
+			if (MQTT_OTA_BIT_TEST(mqtt_ota_requested, slot->block_id))
+			{
+				MQTT_OTA_BIT_CLEAR(mqtt_ota_requested, slot->block_id);
+				outstanding--;
+			}
+
+			expected_len = ((uint32_t) slot->block_id == block_count - 1)
+						   ? fields->fileSize - (block_count - 1) * MQTT_OTA_BLOCK_SIZE
+						   : MQTT_OTA_BLOCK_SIZE;
+			// In order, the last free slot is kept for the block everything waits on
+			if (slot->file_id == (int32_t) fields->fileId && slot->len == expected_len &&
+				!MQTT_OTA_BIT_TEST(mqtt_ota_resume.done, slot->block_id) &&
+				(mode != MQTT_OTA_MODE_UNKNOWN || slot->block_id == 0) &&
+				(mode != MQTT_OTA_MODE_IN_ORDER || (uint32_t) slot->block_id == mqtt_ota_next_block ||
+				 mqtt_ota_held_count < CONFIG_MQTT_OTA_WINDOW - 1))
+			{
+				if (mode == MQTT_OTA_MODE_UNKNOWN && (err = mqtt_ota_begin_mode(slot, fields->fileSize, &mode)) != ESP_OK)
+				{
+					mode = MQTT_OTA_MODE_UNKNOWN;
+					xQueueSend(mqtt_ota_free_slots, &event.slot, 0);
+					break;
+				}
+
+				err = mqtt_ota_write_block(event.slot, mode, &held);
+				if (err != ESP_OK)
+				{
+					xQueueSend(mqtt_ota_free_slots, &event.slot, 0);
+					break;
+				}
+				MQTT_OTA_BIT_SET(mqtt_ota_resume.done, slot->block_id);
+				done++;
+				timeouts = 0;
+				if (mode == MQTT_OTA_MODE_BLOCKS && ++since_save == MQTT_OTA_SAVE_INTERVAL_BLOCKS)
+				{
+					mqtt_ota_resume_save(true);
+					since_save = 0;
+				}
+			}
+		}
+		if (!held)
+		{
+			xQueueSend(mqtt_ota_free_slots, &event.slot, 0);
+		}
+	}
+
+	atomic_store(&mqtt_ota_downloading, false);
+
+	while (mqtt_ota_held_count > 0)
+	{
+		xQueueSend(mqtt_ota_free_slots, &mqtt_ota_held[--mqtt_ota_held_count], 0);
+	}
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "mqtt_ota_download: stopped with %u of %u blocks (%s)",
+				(unsigned int) done, (unsigned int) block_count, esp_err_to_name(err));
+		if (mode == MQTT_OTA_MODE_BLOCKS)
+		{
+			ota_writer_abort_blocks();
+			mqtt_ota_resume_save(true);
+		}
+		else if (mode == MQTT_OTA_MODE_IN_ORDER)
+		{
+			ota_writer_abort();
+		}
+		return err;
+	}
+
+	if (mode == MQTT_OTA_MODE_IN_ORDER)
+	{
+		return ota_writer_finish(NULL);
+	}
+
+	// Whatever the outcome, these blocks are not worth resuming
+	mqtt_ota_resume_save(false);
+
+	return ota_writer_finish_blocks();
+}
+
+/**
+ * Runs the job in the job buffer, if there is one and it is an OTA update.
+ */
+static void mqtt_ota_run_job(void)
+{
+	AfrOtaJobDocumentFields_t fields = {0};
+	const char *job_id;
+	const char *job_doc;
+	const char *version;
+	size_t job_id_len;
+	size_t job_doc_len;
+	size_t version_len = 0;
+	esp_err_t err;
+
+	job_id_len = Jobs_GetJobId(mqtt_ota_job_msg, mqtt_ota_job_msg_len, &job_id);
+	job_doc_len = Jobs_GetJobDocument(mqtt_ota_job_msg, mqtt_ota_job_msg_len, &job_doc);
+	if (job_id_len == 0 || job_id_len > JOBS_JOBID_MAX_LENGTH || job_doc_len == 0)
+	{
+		// No pending job
+		atomic_store(&mqtt_ota_job_msg_busy, false);
+		return;
+	}
+
+	memcpy(mqtt_ota_job_id, job_id, job_id_len);
+	mqtt_ota_job_id[job_id_len] = '\0';
+	mqtt_ota_job_version[0] = '\0';
+	if (JSON_SearchConst(mqtt_ota_job_msg, mqtt_ota_job_msg_len, "execution.versionNumber",
+						 strlen("execution.versionNumber"), &version, &version_len, NULL) == JSONSuccess &&
+		version_len < sizeof(mqtt_ota_job_version))
+	{
+		memcpy(mqtt_ota_job_version, version, version_len);
+		mqtt_ota_job_version[version_len] = '\0';
+	}
+
+	ESP_LOGI(TAG, "mqtt_ota_run_job: job %s", mqtt_ota_job_id);
+
+	// Only a single file streamed over MQTT is supported; HTTP jobs carry an auth scheme
+	if (otaParser_parseJobDocFile(job_doc, job_doc_len, 0, &fields) < 0 ||
+		fields.authScheme != NULL || fields.imageRefLen == 0 || fields.imageRefLen > STREAM_NAME_MAX_LEN)
+	{
+		ESP_LOGE(TAG, "mqtt_ota_run_job: %s is not an MQTT OTA job for this device", mqtt_ota_job_id);
+		mqtt_ota_update_job(Rejected);
+		atomic_store(&mqtt_ota_job_msg_busy, false);
+		mqtt_ota_request_next_job();
+		return;
+	}
+
+	err = mqtt_ota_download(&fields);
+	atomic_store(&mqtt_ota_job_msg_busy, false);
+
+	// A stalled stream is usually a dropped connection; the job is still in
+	// progress, so start-next returns it and the download resumes
+	if (err == ESP_ERR_TIMEOUT && ++mqtt_ota_stalls <= MQTT_OTA_MAX_STALLS)
+	{
+		ESP_LOGW(TAG, "mqtt_ota_run_job: job %s stalled, resuming once connected", mqtt_ota_job_id);
+		mqtt_agent_manager_wait_connected(portMAX_DELAY);
+		mqtt_ota_request_next_job();
+		return;
+	}
+	mqtt_ota_stalls = 0;
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "mqtt_ota_run_job: job %s failed (%s)", mqtt_ota_job_id, esp_err_to_name(err));
+		mqtt_ota_resume_save(false);
+		mqtt_ota_update_job(Failed);
+		mqtt_ota_request_next_job();
+		return;
+	}
+
+	mqtt_ota_update_job(Succeeded);
+	ESP_LOGI(TAG, "mqtt_ota_run_job: job %s done, restarting", mqtt_ota_job_id);
+	vTaskDelay(pdMS_TO_TICKS(MQTT_OTA_RESTART_DELAY_MS));
+	esp_restart();
+}
+
+/**
+ * OTA task: subscribes, asks for a pending job and runs jobs as they come.
+ * @param parameter unused
+ */
+static void mqtt_ota_task(void *parameter)
+{
+	mqtt_ota_event_t event;
+
+	if (mqtt_agent_manager_subscribe(MQTT_OTA_NEXT_JOB_TOPIC, MQTTQoS1, mqtt_ota_next_job_callback, NULL) == ESP_ERR_NO_MEM ||
+		mqtt_agent_manager_subscribe(MQTT_OTA_START_NEXT_ACCEPTED_TOPIC, MQTTQoS1, mqtt_ota_start_next_callback, NULL) == ESP_ERR_NO_MEM ||
+		mqtt_agent_manager_subscribe(MQTT_OTA_STREAM_DATA_TOPIC, MQTTQoS0, mqtt_ota_data_callback, NULL) == ESP_ERR_NO_MEM)
+	{
+		ESP_LOGE(TAG, "mqtt_ota_task: Error subscribing, MQTT OTA disabled");
+		task_mqtt_ota = NULL;
+		vTaskDelete(NULL);
+	}
+
+	mqtt_agent_manager_wait_connected(portMAX_DELAY);
+	mqtt_ota_request_next_job();
+
+	for (;;)
+	{
+		if (xQueueReceive(mqtt_ota_event_queue, &event, portMAX_DELAY) != pdTRUE)
+		{
+			continue;
+		}
+
+		switch (event.type)
+		{
+			case MQTT_OTA_EVENT_NEXT_JOB:
+				mqtt_ota_request_next_job();
+				break;
+
+			case MQTT_OTA_EVENT_JOB:
+				mqtt_ota_run_job();
+				break;
+
+			case MQTT_OTA_EVENT_BLOCK:
+				// Arrived after its download ended
+				xQueueSend(mqtt_ota_free_slots, &event.slot, 0);
+				break;
+
+			default:
+				break;
+		}
+	}
+}
+
+void mqtt_ota_start(void)
+{
+	if (task_mqtt_ota != NULL)
+	{
+		return;
+	}
+
+	if (mqtt_ota_event_queue == NULL)
+	{
+		mqtt_ota_event_queue = xQueueCreate(CONFIG_MQTT_OTA_WINDOW + 4, sizeof(mqtt_ota_event_t));
+		mqtt_ota_free_slots = xQueueCreate(CONFIG_MQTT_OTA_WINDOW, sizeof(int));
+	}
+
+	xTaskCreatePinnedToCore(&mqtt_ota_task, "mqtt_ota_task", MQTT_OTA_TASK_STACK_SIZE, NULL,
+							MQTT_OTA_TASK_PRIORITY, &task_mqtt_ota, MQTT_OTA_TASK_CORE_ID);
+}
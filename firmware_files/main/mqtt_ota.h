@@ -0,0 +1,51 @@
+/*
+ * mqtt_ota.h
+ *
+ * Fleet firmware updates over the MQTT connection. OTA jobs created in AWS
+ * IoT Jobs are picked up with start-next, and the image is downloaded from
+ * the job's MQTT stream in CBOR blocks. Several blocks are requested ahead
+ * so a download is limited by bandwidth rather than by round trips; blocks
+ * are written to flash in whatever order they arrive, and the set of blocks
+ * already written is kept in NVS so an interrupted download resumes where
+ * it stopped. The stream may also hold a delta patch from tools/ota_delta.py
+ * or a compressed image from tools/ota_pack.py, which is unpacked in order.
+ */
+
+#ifndef MAIN_MQTT_OTA_H_
+#define MAIN_MQTT_OTA_H_
+
+// Bytes per stream block, one flash sector
+#define MQTT_OTA_BLOCK_SIZE				4096
+
+// Largest image that can be downloaded, the size of an OTA partition rounded up
+#define MQTT_OTA_MAX_BLOCKS				512
+
+// Time without a block before the outstanding requests are sent again
+#define MQTT_OTA_BLOCK_TIMEOUT_MS		5000
+
+// Timeouts in a row after which the download fails
+#define MQTT_OTA_MAX_TIMEOUTS			10
+
+// Stalled downloads of a job resumed before it is failed
+#define MQTT_OTA_MAX_STALLS				3
+
+// Blocks written between saves of the resume record
+#define MQTT_OTA_SAVE_INTERVAL_BLOCKS	16
+
+// Largest start-next response accepted, which carries the job document
+#define MQTT_OTA_JOB_MSG_MAX_LEN		2048
+
+// How long a publish may wait for room in the agent command queue
+#define MQTT_OTA_ENQUEUE_TIMEOUT_MS		1000
+
+// Delay between a successful update and the restart into it
+#define MQTT_OTA_RESTART_DELAY_MS		2000
+
+/**
+ * Starts the OTA task, which subscribes to the job and stream topics, asks
+ * for the next pending job once connected and runs the updates. Safe to call
+ * more than once.
+ */
+void mqtt_ota_start(void);
+
+#endif /* MAIN_MQTT_OTA_H_ */
@@ -0,0 +1,343 @@
+/*
+ * ota_patch.c
+ *
+ * The patch body is inflated with the miniz inflater in ROM into a 32 KB
+ * dictionary that wraps around, and each run of inflated bytes is run
+ * through the record parser straight from the dictionary. Diff bytes are
+ * added to the old image read from the running partition in small pieces;
+ * extra bytes go to the output unchanged. Every control triple is checked
+ * against the sizes in the header, so a corrupt patch can neither read
+ * outside the old image nor write past the end of the new one.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "miniz.h"
+#include "sys/param.h"
+
+#include "ota_patch.h"
+
+static const char TAG[] = "ota_patch";
+
+// Length of the SHA-256 appended to an image
+#define OTA_PATCH_SHA256_LEN	32
+
+// Length of a record's control triple
+#define OTA_PATCH_CONTROL_LEN	12
+
+typedef struct __attribute__((packed)) ota_patch_header
+{
+	char magic[4];
+	uint32_t old_size;
+	uint32_t new_size;
+	uint8_t old_sha256[OTA_PATCH_SHA256_LEN];
+} ota_patch_header_t;
+
+// Part of a record being parsed
+typedef enum ota_patch_field
+{
+	OTA_PATCH_FIELD_CONTROL = 0,
+	OTA_PATCH_FIELD_DIFF,
+	OTA_PATCH_FIELD_EXTRA,
+} ota_patch_field_e;
+
+typedef struct ota_patch
+{
+	tinfl_decompressor inflater;
+	uint8_t dict[TINFL_LZ_DICT_SIZE];
+	size_t dict_ofs;
+	bool inflated;
+
+	ota_patch_header_t header;
+	size_t header_len;
+
+	ota_patch_field_e field;
+	uint8_t control[OTA_PATCH_CONTROL_LEN];
+	size_t control_len;
+	uint32_t diff_left;
+	uint32_t extra_left;
+	int32_t seek;
+
+	const esp_partition_t *running;
+	uint32_t old_pos;
+	uint32_t new_len;
+	uint8_t old[OTA_PATCH_READ_SIZE];
+
+	ota_patch_output_t output;
+} ota_patch_t;
+
+static ota_patch_t *ota_patch;
+
+/**
+ * Checks the header against the running image.
+ * @return ESP_OK, ESP_ERR_INVALID_RESPONSE if it is not a patch, or
+ * ESP_ERR_INVALID_VERSION if it is for another image
+ */
+static esp_err_t ota_patch_check_header(void)
+{
+	const ota_patch_header_t *header = &ota_patch->header;
+	uint8_t old_sha256[OTA_PATCH_SHA256_LEN];
+
+	if (memcmp(header->magic, OTA_PATCH_MAGIC, sizeof(header->magic)) != 0 || header->new_size == 0)
+	{
+		ESP_LOGE(TAG, "ota_patch_check_header: not a patch");
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+
+	if (header->old_size == 0)
+	{
+		ESP_LOGI(TAG, "ota_patch_check_header: unpacking %" PRIu32 " byte image", header->new_size);
+		return ESP_OK;
+	}
+
+	ota_patch->running = esp_ota_get_running_partition();
+	if (header->old_size < OTA_PATCH_SHA256_LEN || header->old_size > ota_patch->running->size ||
+		esp_partition_read(ota_patch->running, header->old_size - OTA_PATCH_SHA256_LEN, old_sha256,
+						   sizeof(old_sha256)) != ESP_OK ||
+		memcmp(old_sha256, header->old_sha256, sizeof(old_sha256)) != 0)
+	{
+		ESP_LOGE(TAG, "ota_patch_check_header: patch is for another image");
+		return ESP_ERR_INVALID_VERSION;
+	}
+
+	ESP_LOGI(TAG, "ota_patch_check_header: patching %" PRIu32 " byte image to %" PRIu32 " bytes",
+			header->old_size, header->new_size);
+
+	return ESP_OK;
+}
+
+/**
+ * Moves on to the next field once the current one is used up, applying the
+ * seek at the end of a record.
+ * @return ESP_OK, or ESP_ERR_INVALID_RESPONSE if the seek leaves the old image
+ */
+static esp_err_t ota_patch_next_field(void)
+{
+	int64_t old_pos;
+
+	if (ota_patch->field == OTA_PATCH_FIELD_DIFF && ota_patch->diff_left == 0)
+	{
+		ota_patch->field = OTA_PATCH_FIELD_EXTRA;
+	}
+
+	if (ota_patch->field == OTA_PATCH_FIELD_EXTRA && ota_patch->extra_left == 0)
+	{
+		old_pos = (int64_t) ota_patch->old_pos + ota_patch->seek;
+		if (old_pos < 0 || old_pos > ota_patch->header.old_size)
+		{
+			return ESP_ERR_INVALID_RESPONSE;
+		}
+		ota_patch->old_pos = (uint32_t) old_pos;
+		ota_patch->field = OTA_PATCH_FIELD_CONTROL;
+		ota_patch->control_len = 0;
+	}
+
+	return ESP_OK;
+}
+
+/**
+ * Parses a control triple and checks it against the image sizes.
+ * @return ESP_OK or ESP_ERR_INVALID_RESPONSE
+ */
+static esp_err_t ota_patch_parse_control(void)
+{
+	uint32_t words[3];
+
+	memcpy(words, ota_patch->control, sizeof(words));
+	ota_patch->diff_left = words[0];
+	ota_patch->extra_left = words[1];
+	ota_patch->seek = (int32_t) words[2];
+
+	if ((uint64_t) ota_patch->old_pos + ota_patch->diff_left > ota_patch->header.old_size ||
+		(uint64_t) ota_patch->new_len + ota_patch->diff_left + ota_patch->extra_left > ota_patch->header.new_size)
+	{
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+
+	ota_patch->field = OTA_PATCH_FIELD_DIFF;
+
+	return ota_patch_next_field();
+}
+
+/**
+ * Runs inflated bytes through the record parser.
+ * @param data inflated bytes
+ * @param len length of data
+ * @return ESP_OK, ESP_ERR_INVALID_RESPONSE, or the error from flash or the output
+ */
+static esp_err_t ota_patch_apply(const uint8_t *data, size_t len)
+{
+	esp_err_t err = ESP_OK;
+	size_t n;
+
+	while (len > 0 && err == ESP_OK)
+	{
+		switch (ota_patch->field)
+		{
+			case OTA_PATCH_FIELD_CONTROL:
+				n = MIN(len, OTA_PATCH_CONTROL_LEN - ota_patch->control_len);
+				memcpy(ota_patch->control + ota_patch->control_len, data, n);
+				ota_patch->control_len += n;
+				if (ota_patch->control_len == OTA_PATCH_CONTROL_LEN)
+				{
+					err = ota_patch_parse_control();
+				}
+				break;
+
+			case OTA_PATCH_FIELD_DIFF:
+				n = MIN(MIN(len, ota_patch->diff_left), sizeof(ota_patch->old));
+				err = esp_partition_read(ota_patch->running, ota_patch->old_pos, ota_patch->old, n);
+				if (err != ESP_OK)
+				{
+					break;
+				}
+				for (size_t i = 0; i < n; i++)
+				{
+					ota_patch->old[i] += data[i];
+				}
+				err = ota_patch->output(ota_patch->old, n);
+				ota_patch->old_pos += n;
+				ota_patch->new_len += n;
+				ota_patch->diff_left -= n;
+				if (err == ESP_OK)
+				{
+					err = ota_patch_next_field();
+				}
+				break;
+
+			case OTA_PATCH_FIELD_EXTRA:
+			default:
+				n = MIN(len, ota_patch->extra_left);
+				err = ota_patch->output(data, n);
+				ota_patch->new_len += n;
+				ota_patch->extra_left -= n;
+				if (err == ESP_OK)
+				{
+					err = ota_patch_next_field();
+				}
+				break;
+		}
+
+		data += n;
+		len -= n;
+	}
+
+	return err;
+}
+
+esp_err_t ota_patch_begin(ota_patch_output_t output)
+{
+	ota_patch_abort();
+
+	ota_patch = malloc(sizeof(ota_patch_t));
+	if (ota_patch == NULL)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+
+	tinfl_init(&ota_patch->inflater);
+	ota_patch->dict_ofs = 0;
+	ota_patch->inflated = false;
+	ota_patch->header_len = 0;
+	ota_patch->field = OTA_PATCH_FIELD_CONTROL;
+	ota_patch->control_len = 0;
+	ota_patch->old_pos = 0;
+	ota_patch->new_len = 0;
+	ota_patch->output = output;
+
+	return ESP_OK;
+}
+
+esp_err_t ota_patch_feed(const void *data, size_t len)
+{
+	const uint8_t *src = data;
+	tinfl_status status = TINFL_STATUS_NEEDS_MORE_INPUT;
+	size_t in_len;
+	size_t out_len;
+	size_t n;
+	esp_err_t err;
+
+	if (ota_patch->header_len < sizeof(ota_patch->header))
+	{
+		n = MIN(len, sizeof(ota_patch->header) - ota_patch->header_len);
+		memcpy((uint8_t *) &ota_patch->header + ota_patch->header_len, src, n);
+		ota_patch->header_len += n;
+		src += n;
+		len -= n;
+
+		if (ota_patch->header_len == sizeof(ota_patch->header) && (err = ota_patch_check_header()) != ESP_OK)
+		{
+			return err;
+		}
+	}
+
+	// Keep going while the dictionary fills up, even with no input left
+	while (len > 0 || status == TINFL_STATUS_HAS_MORE_OUTPUT)
+	{
+		if (ota_patch->inflated)
+		{
+			ESP_LOGE(TAG, "ota_patch_feed: data after the end of the patch");
+			return ESP_ERR_INVALID_RESPONSE;
+		}
+
+		in_len = len;
+		out_len = TINFL_LZ_DICT_SIZE - ota_patch->dict_ofs;
+		status = tinfl_decompress(&ota_patch->inflater, src, &in_len, ota_patch->dict,
+								  ota_patch->dict + ota_patch->dict_ofs, &out_len,
+								  TINFL_FLAG_HAS_MORE_INPUT | TINFL_FLAG_PARSE_ZLIB_HEADER);
+		src += in_len;
+		len -= in_len;
+
+		if (status < TINFL_STATUS_DONE)
+		{
+			ESP_LOGE(TAG, "ota_patch_feed: corrupt patch (inflate status %d)", (int) status);
+			return ESP_ERR_INVALID_RESPONSE;
+		}
+
+		err = ota_patch_apply(ota_patch->dict + ota_patch->dict_ofs, out_len);
+		if (err != ESP_OK)
+		{
+			if (err == ESP_ERR_INVALID_RESPONSE)
+			{
+				ESP_LOGE(TAG, "ota_patch_feed: bad record at new image offset %" PRIu32, ota_patch->new_len);
+			}
+			return err;
+		}
+		ota_patch->dict_ofs = (ota_patch->dict_ofs + out_len) & (TINFL_LZ_DICT_SIZE - 1);
+
+		if (status == TINFL_STATUS_DONE)
+		{
+			ota_patch->inflated = true;
+		}
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t ota_patch_finish(void)
+{
+	esp_err_t err = ESP_OK;
+
+	if (!ota_patch->inflated || ota_patch->field != OTA_PATCH_FIELD_CONTROL || ota_patch->control_len != 0 ||
+		ota_patch->new_len != ota_patch->header.new_size)
+	{
+		ESP_LOGE(TAG, "ota_patch_finish: patch ended after %" PRIu32 " image bytes", ota_patch->new_len);
+		err = ESP_ERR_INVALID_SIZE;
+	}
+
+	ota_patch_abort();
+
+	return err;
+}
+
+void ota_patch_abort(void)
+{
+	free(ota_patch);
+	ota_patch = NULL;
+}
@@ -0,0 +1,70 @@
+/*
+ * ota_patch.h
+ *
+ * Applies a delta update: a patch made by tools/ota_delta.py from the running
+ * image and the new one. The new image is rebuilt from the running partition
+ * as the patch streams in and handed on in pieces, so neither image has to be
+ * held in RAM and only the patch is transferred. A patch against an empty old
+ * image is simply the new image compressed (tools/ota_pack.py), which applies
+ * whatever build is running.
+ *
+ * Patch layout, little endian:
+ *   header  "GSD1", old image size, new image size, SHA-256 appended to the
+ *           old image (its last 32 bytes); old size 0 for a compressed image
+ *   body    zlib stream of records, each a control triple of diff length,
+ *           extra length and old seek, followed by diff bytes that are added
+ *           to the old image and extra bytes that are copied as they are
+ */
+
+#ifndef MAIN_OTA_PATCH_H_
+#define MAIN_OTA_PATCH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+// First bytes of a patch
+#define OTA_PATCH_MAGIC		"GSD1"
+
+// Old image bytes read from flash at a time
+#define OTA_PATCH_READ_SIZE	512
+
+/**
+ * Receives a piece of the new image.
+ * @param data image data, only valid during the call
+ * @param len length of data
+ * @return ESP_OK to continue, or an error that stops the patch
+ */
+typedef esp_err_t (*ota_patch_output_t)(const void *data, size_t len);
+
+/**
+ * Allocates the decompressor and starts a patch.
+ * @param output called with the new image, in order
+ * @return ESP_OK or ESP_ERR_NO_MEM
+ */
+esp_err_t ota_patch_begin(ota_patch_output_t output);
+
+/**
+ * Applies the next piece of the patch. The header is checked against the
+ * running image as soon as it is complete.
+ * @param data patch data, may be reused once the call returns
+ * @param len length of data
+ * @return ESP_OK, ESP_ERR_INVALID_VERSION if the patch is for another image,
+ * ESP_ERR_INVALID_RESPONSE if it is corrupt, or the error from output
+ */
+esp_err_t ota_patch_feed(const void *data, size_t len);
+
+/**
+ * Checks that the whole patch was applied and frees the decompressor.
+ * @return ESP_OK, or ESP_ERR_INVALID_SIZE if the patch or the new image is
+ * incomplete
+ */
+esp_err_t ota_patch_finish(void);
+
+/**
+ * Frees the decompressor without checking anything.
+ */
+void ota_patch_abort(void);
+
+#endif /* MAIN_OTA_PATCH_H_ */
@@ -0,0 +1,491 @@
+/*
+ * ota_writer.c
+ *
+ * Two buffers pass between the caller and the writer task over a pair of
+ * queues: the free queue holds buffers the caller may fill, the full queue
+ * buffers waiting for flash. The writer task takes a full buffer, writes it
+ * with esp_ota_write (which erases each sector as it reaches it, since the
+ * partition is opened for sequential writes), adds it to the SHA-256 and
+ * returns it to the free queue. After an error it keeps returning buffers
+ * unwritten so the caller never blocks, and the caller sees the error on its
+ * next call.
+ *
+ * A stream that does not start with the image magic is a delta patch or a
+ * compressed image: it is fed to ota_patch, which rebuilds or unpacks the
+ * image and hands it to the same buffers, so the writer task never sees the
+ * difference.
+ *
+ * Block updates skip the buffers and the writer task: the caller already
+ * holds whole sectors, so each one is erased and written in place with the
+ * partition API and the image is only checked once it is complete.
+ */
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_app_desc.h"
+#include "esp_image_format.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "mbedtls/sha256.h"
+#include "spi_flash_mmap.h"
+#include "sys/param.h"
+
+#include "ota_patch.h"
+#include "ota_writer.h"
+#include "tasks_common.h"
+
+static const char TAG[] = "ota_writer";
+
+// Sent on the full queue to stop the writer task
+#define OTA_WRITER_STOP		(-1)
+
+// Image bytes needed to check the header against the running firmware
+#define OTA_WRITER_HEADER_LEN	(sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t))
+
+// Set while an update is running
+static atomic_bool ota_writer_busy;
+
+static uint8_t *ota_writer_buffers[2];
+static size_t ota_writer_buffer_len[2];
+
+// Buffer indices; created on the first update and kept
+static QueueHandle_t ota_writer_free_queue;
+static QueueHandle_t ota_writer_full_queue;
+
+// Given by the writer task when it exits
+static SemaphoreHandle_t ota_writer_done;
+
+// Buffer the caller is filling, or -1
+static int ota_writer_fill = -1;
+
+// First error seen by the writer task
+static volatile esp_err_t ota_writer_err;
+
+static const esp_partition_t *ota_writer_partition;
+static esp_ota_handle_t ota_writer_handle;
+static mbedtls_sha256_context ota_writer_sha;
+static size_t ota_writer_received;
+static size_t ota_writer_written;
+
+// Set while the stream is a patch
+static bool ota_writer_patched;
+
+/**
+ * Checks that an image is for this chip and this project before any of it is
+ * written, so a wrong file does not erase the partition.
+ * @param data start of the image
+ * @param len bytes available at data
+ * @return ESP_OK or ESP_ERR_OTA_VALIDATE_FAILED
+ */
+static esp_err_t ota_writer_check_header(const uint8_t *data, size_t len)
+{
+	const esp_image_header_t *header = (const esp_image_header_t *) data;
+	const esp_app_desc_t *new_desc;
+	const esp_app_desc_t *running_desc = esp_app_get_description();
+
+	if (len < OTA_WRITER_HEADER_LEN)
+	{
+		ESP_LOGE(TAG, "ota_writer_check_header: image too short (%u bytes)", (unsigned int) len);
+		return ESP_ERR_OTA_VALIDATE_FAILED;
+	}
+
+	if (header->magic != ESP_IMAGE_HEADER_MAGIC || header->chip_id != CONFIG_IDF_FIRMWARE_CHIP_ID)
+	{
+		ESP_LOGE(TAG, "ota_writer_check_header: not an image for this chip");
+		return ESP_ERR_OTA_VALIDATE_FAILED;
+	}
+
+	new_desc = (const esp_app_desc_t *) (data + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t));
+	if (new_desc->magic_word != ESP_APP_DESC_MAGIC_WORD ||
+		strncmp(new_desc->project_name, running_desc->project_name, sizeof(new_desc->project_name)) != 0)
+	{
+		ESP_LOGE(TAG, "ota_writer_check_header: image is not %s", running_desc->project_name);
+		return ESP_ERR_OTA_VALIDATE_FAILED;
+	}
+
+	ESP_LOGI(TAG, "ota_writer_check_header: updating %s to %.32s", running_desc->version, new_desc->version);
+
+	return ESP_OK;
+}
+
+/**
+ * Writes full buffers to flash until told to stop.
+ * @param parameter unused
+ */
+static void ota_writer_task(void *parameter)
+{
+	esp_err_t err;
+	int index;
+
+	for (;;)
+	{
+		xQueueReceive(ota_writer_full_queue, &index, portMAX_DELAY);
+		if (index == OTA_WRITER_STOP)
+		{
+			break;
+		}
+
+		if (ota_writer_err == ESP_OK)
+		{
+			err = ESP_OK;
+			if (ota_writer_written == 0)
+			{
+				err = ota_writer_check_header(ota_writer_buffers[index], ota_writer_buffer_len[index]);
+			}
+			if (err == ESP_OK)
+			{
+				err = esp_ota_write(ota_writer_handle, ota_writer_buffers[index], ota_writer_buffer_len[index]);
+			}
+			if (err == ESP_OK)
+			{
+				mbedtls_sha256_update(&ota_writer_sha, ota_writer_buffers[index], ota_writer_buffer_len[index]);
+				ota_writer_written += ota_writer_buffer_len[index];
+			}
+			else
+			{
+				ESP_LOGE(TAG, "ota_writer_task: write at offset %u failed (%s)",
+						(unsigned int) ota_writer_written, esp_err_to_name(err));
+				ota_writer_err = err;
+			}
+		}
+
+		xQueueSend(ota_writer_free_queue, &index, portMAX_DELAY);
+	}
+
+	xSemaphoreGive(ota_writer_done);
+	vTaskDelete(NULL);
+}
+
+/**
+ * Takes the buffers off the free queue and frees them.
+ */
+static void ota_writer_free_buffers(void)
+{
+	int index;
+
+	while (xQueueReceive(ota_writer_free_queue, &index, 0) == pdTRUE)
+	{
+	}
+	ota_writer_fill = -1;
+
+	for (index = 0; index < 2; index++)
+	{
+		free(ota_writer_buffers[index]);
+		ota_writer_buffers[index] = NULL;
+	}
+}
+
+/**
+ * Stops the writer task once it has written everything queued, and frees the buffers.
+ */
+static void ota_writer_stop(void)
+{
+	int stop = OTA_WRITER_STOP;
+
+	xQueueSend(ota_writer_full_queue, &stop, portMAX_DELAY);
+	xSemaphoreTake(ota_writer_done, portMAX_DELAY);
+
+	ota_writer_free_buffers();
+}
+
+esp_err_t ota_writer_begin(void)
+{
+	bool idle = false;
+	esp_err_t err;
+	int index;
+
+	if (!atomic_compare_exchange_strong(&ota_writer_busy, &idle, true))
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	if (ota_writer_free_queue == NULL)
+	{
+		ota_writer_free_queue = xQueueCreate(2, sizeof(int));
+		ota_writer_full_queue = xQueueCreate(3, sizeof(int));
+		ota_writer_done = xSemaphoreCreateBinary();
+	}
+
+	for (index = 0; index < 2; index++)
+	{
+		ota_writer_buffers[index] = malloc(OTA_WRITER_BUFFER_SIZE);
+	}
+	if (ota_writer_buffers[0] == NULL || ota_writer_buffers[1] == NULL)
+	{
+		ota_writer_free_buffers();
+		atomic_store(&ota_writer_busy, false);
+		return ESP_ERR_NO_MEM;
+	}
+
+	ota_writer_partition = esp_ota_get_next_update_partition(NULL);
+	err = esp_ota_begin(ota_writer_partition, OTA_WITH_SEQUENTIAL_WRITES, &ota_writer_handle);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "ota_writer_begin: esp_ota_begin failed (%s)", esp_err_to_name(err));
+		ota_writer_free_buffers();
+		atomic_store(&ota_writer_busy, false);
+		return err;
+	}
+	ESP_LOGI(TAG, "ota_writer_begin: writing to partition subtype %d at offset 0x%" PRIx32,
+			ota_writer_partition->subtype, ota_writer_partition->address);
+
+	mbedtls_sha256_init(&ota_writer_sha);
+	mbedtls_sha256_starts(&ota_writer_sha, 0);
+	ota_writer_err = ESP_OK;
+	ota_writer_received = 0;
+	ota_writer_written = 0;
+	ota_writer_patched = false;
+	ota_writer_fill = -1;
+	for (index = 0; index < 2; index++)
+	{
+		xQueueSend(ota_writer_free_queue, &index, 0);
+	}
+
+	if (xTaskCreatePinnedToCore(&ota_writer_task, "ota_writer_task", OTA_WRITER_TASK_STACK_SIZE, NULL,
+			OTA_WRITER_TASK_PRIORITY, NULL, OTA_WRITER_TASK_CORE_ID) != pdPASS)
+	{
+		ota_writer_free_buffers();
+		mbedtls_sha256_free(&ota_writer_sha);
+		esp_ota_abort(ota_writer_handle);
+		atomic_store(&ota_writer_busy, false);
+		return ESP_ERR_NO_MEM;
+	}
+
+	return ESP_OK;
+}
+
+/**
+ * Copies image data into the buffers, queueing each one for the writer task
+ * as it fills. Also the output of the patch stage.
+ * @param data image data
+ * @param len length of data
+ * @return ESP_OK or the first error seen by the writer task
+ */
+static esp_err_t ota_writer_buffer_image(const void *data, size_t len)
+{
+	const uint8_t *src = data;
+	size_t n;
+
+	while (len > 0)
+	{
+		if (ota_writer_fill < 0)
+		{
+			if (ota_writer_err != ESP_OK)
+			{
+				return ota_writer_err;
+			}
+			xQueueReceive(ota_writer_free_queue, &ota_writer_fill, portMAX_DELAY);
+			ota_writer_buffer_len[ota_writer_fill] = 0;
+		}
+
+		n = MIN(len, OTA_WRITER_BUFFER_SIZE - ota_writer_buffer_len[ota_writer_fill]);
+		memcpy(ota_writer_buffers[ota_writer_fill] + ota_writer_buffer_len[ota_writer_fill], src, n);
+		ota_writer_buffer_len[ota_writer_fill] += n;
+		src += n;
+		len -= n;
+
+		if (ota_writer_buffer_len[ota_writer_fill] == OTA_WRITER_BUFFER_SIZE)
+		{
+			xQueueSend(ota_writer_full_queue, &ota_writer_fill, portMAX_DELAY);
+			ota_writer_fill = -1;
+		}
+	}
+
+	return ota_writer_err;
+}
+
+esp_err_t ota_writer_write(const void *data, size_t len)
+{
+	esp_err_t err;
+
+	if (len == 0)
+	{
+		return ota_writer_err;
+	}
+
+	if (ota_writer_received == 0 && ((const uint8_t *) data)[0] != ESP_IMAGE_HEADER_MAGIC)
+	{
+		err = ota_patch_begin(ota_writer_buffer_image);
+		if (err != ESP_OK)
+		{
+			return err;
+		}
+		ota_writer_patched = true;
+	}
+	ota_writer_received += len;
+
+	if (ota_writer_patched)
+	{
+		err = ota_patch_feed(data, len);
+		return (err != ESP_OK) ? err : ota_writer_err;
+	}
+
+	return ota_writer_buffer_image(data, len);
+}
+
+esp_err_t ota_writer_finish(const uint8_t *expected_sha256)
+{
+	uint8_t sha256[OTA_WRITER_SHA256_LEN];
+	esp_err_t patch_err = ESP_OK;
+	esp_err_t err;
+
+	if (ota_writer_patched)
+	{
+		patch_err = ota_patch_finish();
+		ota_writer_patched = false;
+	}
+
+	if (ota_writer_fill >= 0 && ota_writer_buffer_len[ota_writer_fill] > 0)
+	{
+		xQueueSend(ota_writer_full_queue, &ota_writer_fill, portMAX_DELAY);
+		ota_writer_fill = -1;
+	}
+	ota_writer_stop();
+
+	mbedtls_sha256_finish(&ota_writer_sha, sha256);
+	mbedtls_sha256_free(&ota_writer_sha);
+
+	err = (ota_writer_err != ESP_OK) ? ota_writer_err : patch_err;
+	if (err == ESP_OK && ota_writer_written == 0)
+	{
+		err = ESP_ERR_OTA_VALIDATE_FAILED;
+	}
+	if (err == ESP_OK && expected_sha256 != NULL && memcmp(sha256, expected_sha256, sizeof(sha256)) != 0)
+	{
+		ESP_LOGE(TAG, "ota_writer_finish: SHA-256 mismatch");
+		ESP_LOG_BUFFER_HEX_LEVEL(TAG, sha256, sizeof(sha256), ESP_LOG_ERROR);
+		err = ESP_ERR_INVALID_CRC;
+	}
+
+	if (err != ESP_OK)
+	{
+		esp_ota_abort(ota_writer_handle);
+		atomic_store(&ota_writer_busy, false);
+		return err;
+	}
+
+	// Verifies the whole image in flash, including its appended hash and signature
+	err = esp_ota_end(ota_writer_handle);
+	if (err == ESP_OK)
+	{
+		err = esp_ota_set_boot_partition(ota_writer_partition);
+	}
+	if (err == ESP_OK)
+	{
+		ESP_LOGI(TAG, "ota_writer_finish: %u bytes written, next boot from offset 0x%" PRIx32,
+				(unsigned int) ota_writer_written, ota_writer_partition->address);
+	}
+	else
+	{
+		ESP_LOGE(TAG, "ota_writer_finish: image rejected (%s)", esp_err_to_name(err));
+	}
+
+	atomic_store(&ota_writer_busy, false);
+
+	return err;
+}
+
+void ota_writer_abort(void)
+{
+	if (ota_writer_patched)
+	{
+		ota_patch_abort();
+		ota_writer_patched = false;
+	}
+	ota_writer_stop();
+	mbedtls_sha256_free(&ota_writer_sha);
+	esp_ota_abort(ota_writer_handle);
+	atomic_store(&ota_writer_busy, false);
+}
+
+size_t ota_writer_bytes_received(void)
+{
+	return ota_writer_received;
+}
+
+esp_err_t ota_writer_begin_blocks(size_t image_size, uint32_t *partition_address)
+{
+	bool idle = false;
+	const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+
+	if (partition == NULL || image_size == 0 || image_size > partition->size)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	if (!atomic_compare_exchange_strong(&ota_writer_busy, &idle, true))
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	ota_writer_partition = partition;
+	ota_writer_received = 0;
+	*partition_address = partition->address;
+
+	return ESP_OK;
+}
+
+esp_err_t ota_writer_write_block(size_t offset, const void *data, size_t len)
+{
+	size_t erase_len = (len + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1);
+	esp_err_t err;
+
+	if ((offset % SPI_FLASH_SEC_SIZE) != 0 || len == 0 || offset + erase_len > ota_writer_partition->size)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (offset == 0 && (err = ota_writer_check_header(data, len)) != ESP_OK)
+	{
+		return err;
+	}
+
+	err = esp_partition_erase_range(ota_writer_partition, offset, erase_len);
+	if (err == ESP_OK)
+	{
+		err = esp_partition_write(ota_writer_partition, offset, data, len);
+	}
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "ota_writer_write_block: write at offset %u failed (%s)", (unsigned int) offset, esp_err_to_name(err));
+		return err;
+	}
+
+	ota_writer_received += len;
+
+	return ESP_OK;
+}
+
+esp_err_t ota_writer_finish_blocks(void)
+{
+	esp_err_t err;
+
+	// Verifies the whole image in flash before switching to it
+	err = esp_ota_set_boot_partition(ota_writer_partition);
+	if (err == ESP_OK)
+	{
+		ESP_LOGI(TAG, "ota_writer_finish_blocks: next boot from offset 0x%" PRIx32, ota_writer_partition->address);
+	}
+	else
+	{
+		ESP_LOGE(TAG, "ota_writer_finish_blocks: image rejected (%s)", esp_err_to_name(err));
+	}
+
+	atomic_store(&ota_writer_busy, false);
+
+	return err;
+}
+
+void ota_writer_abort_blocks(void)
+{
+	atomic_store(&ota_writer_busy, false);
+}
@@ -0,0 +1,109 @@
+/*
+ * ota_writer.h
+ *
+ * Streams a firmware image into the next OTA partition. The caller hands over
+ * the image in pieces of any size; they are collected into two buffers, and
+ * while the caller fills one a writer task erases and writes the other, so
+ * receiving the next chunk overlaps with flash. The image is hashed with
+ * SHA-256 on the way and validated before it is made the boot partition.
+ * Instead of an image the caller may hand over a delta patch or a compressed
+ * image (ota_patch.h), which is unpacked on the way.
+ * Downloads whose blocks arrive out of order, or that resume after a reboot,
+ * use the block functions instead, which write each sector in place.
+ * One update can run at a time.
+ */
+
+#ifndef MAIN_OTA_WRITER_H_
+#define MAIN_OTA_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Size of each of the two flash write buffers; a multiple of the 4 KB sector
+#define OTA_WRITER_BUFFER_SIZE	(8 * 1024)
+
+// Length of a SHA-256 digest
+#define OTA_WRITER_SHA256_LEN	32
+
+/**
+ * Starts an update: allocates the buffers, opens the next OTA partition and
+ * starts the writer task. The partition is erased sector by sector as the
+ * image is written.
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if an update is already running,
+ * ESP_ERR_NO_MEM, or the error from esp_ota_begin
+ */
+esp_err_t ota_writer_begin(void);
+
+/**
+ * Appends image data. Blocks only while both buffers are waiting for flash.
+ * The header of the image is checked against the running firmware before
+ * anything is written. If the first byte is not the image magic the data
+ * is taken for a patch.
+ * @param data image or patch data, may be reused once the call returns
+ * @param len length of data
+ * @return ESP_OK, or the first error seen by the writer task, after which
+ * the update can only be aborted
+ */
+esp_err_t ota_writer_write(const void *data, size_t len);
+
+/**
+ * Writes the rest of the image, checks its digest and validates it, and on
+ * success sets it as the boot partition. Ends the update either way.
+ * @param expected_sha256 SHA-256 of the whole image, the new one for a patch,
+ * or NULL to skip the check
+ * @return ESP_OK, ESP_ERR_INVALID_CRC if the digest differs, ESP_ERR_INVALID_SIZE
+ * if a patch is incomplete, or the error from writing or validating the image
+ */
+esp_err_t ota_writer_finish(const uint8_t *expected_sha256);
+
+/**
+ * Ends the update without touching the boot partition.
+ */
+void ota_writer_abort(void);
+
+/**
+ * Returns the number of image or patch bytes accepted so far.
+ */
+size_t ota_writer_bytes_received(void);
+
+/**
+ * Starts an update written in blocks of whole flash sectors, in any order.
+ * Nothing is erased up front, so blocks written by an earlier, interrupted
+ * update to the same partition are kept.
+ * @param image_size size of the image, to check that it fits
+ * @param partition_address set to the flash offset of the update partition,
+ * which tells an interrupted update whether it can resume
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if an update is already running, or
+ * ESP_ERR_INVALID_SIZE if the image does not fit the partition
+ */
+esp_err_t ota_writer_begin_blocks(size_t image_size, uint32_t *partition_address);
+
+/**
+ * Erases the sectors under a block and writes it. The block at offset 0 is
+ * checked against the running firmware first, like ota_writer_write does.
+ * @param offset offset of the block in the image, a multiple of the sector size
+ * @param data block data
+ * @param len length of data; only the last block of the image may be short
+ * of a whole number of sectors
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a misaligned or oversized block,
+ * or the error from the header check or flash
+ */
+esp_err_t ota_writer_write_block(size_t offset, const void *data, size_t len);
+
+/**
+ * Validates the image once every block is written, including its appended
+ * hash and signature, and on success sets it as the boot partition. Ends the
+ * update either way.
+ * @return ESP_OK, or ESP_ERR_OTA_VALIDATE_FAILED if the image is not valid
+ */
+esp_err_t ota_writer_finish_blocks(void);
+
+/**
+ * Ends a block update without touching the boot partition. The blocks
+ * written so far stay in flash.
+ */
+void ota_writer_abort_blocks(void);
+
+#endif /* MAIN_OTA_WRITER_H_ */
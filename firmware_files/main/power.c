@@ -0,0 +1,74 @@
+/*
+ * power.c
+ *
+ * With light sleep enabled, FreeRTOS skips ticks while idle and the chip
+ * sleeps until the next task timeout or esp_timer; drivers that need their
+ * clocks, such as I2C during a transfer, hold a PM lock meanwhile. The
+ * station's listen interval, set in wifi_app_connect_sta, decides how many
+ * beacons the radio sleeps through.
+ */
+
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_wifi.h"
+
+#include "power.h"
+
+static const char TAG[] = "power";
+
+// Lowest CPU clock, the crystal frequency
+#define POWER_MIN_FREQ_MHZ		40
+
+void power_start(void)
+{
+#if CONFIG_POWER_SAVE
+	esp_pm_config_t config = {
+		.max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+		.min_freq_mhz = POWER_MIN_FREQ_MHZ,
+		.light_sleep_enable = true,
+	};
+	esp_err_t err;
+
+	err = esp_pm_configure(&config);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "power_start: cannot enable light sleep: %s", esp_err_to_name(err));
+		return;
+	}
+
+	ESP_LOGI(TAG, "power_start: %d-%d MHz with automatic light sleep", POWER_MIN_FREQ_MHZ,
+			 CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+#endif
+}
+
+void power_set_wifi_sleep(bool enable)
+{
+#if CONFIG_POWER_SAVE
+	esp_err_t err;
+
+	if (enable)
+	{
+		err = esp_wifi_set_mode(WIFI_MODE_STA);
+		if (err == ESP_OK)
+		{
+			err = esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
+		}
+	}
+	else
+	{
+		err = esp_wifi_set_ps(WIFI_PS_NONE);
+		if (err == ESP_OK)
+		{
+			err = esp_wifi_set_mode(WIFI_MODE_APSTA);
+		}
+	}
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGW(TAG, "power_set_wifi_sleep: %s failed: %s", enable ? "enable" : "disable", esp_err_to_name(err));
+		return;
+	}
+
+	ESP_LOGI(TAG, "power_set_wifi_sleep: modem sleep %s, SoftAP %s", enable ? "on" : "off", enable ? "off" : "on");
+#endif
+}
@@ -0,0 +1,31 @@
+/*
+ * power.h
+ *
+ * Power management for battery-backed installations (CONFIG_POWER_SAVE).
+ * The CPU scales its clock down and enters light sleep automatically
+ * whenever every task is blocked, and the station uses modem sleep, so the
+ * radio only wakes for the AP's DTIM beacons, for telemetry batches and for
+ * MQTT keep-alive. Sampling keeps running because its task wakes on timers.
+ * Without CONFIG_POWER_SAVE these functions do nothing.
+ */
+
+#ifndef MAIN_POWER_H_
+#define MAIN_POWER_H_
+
+#include <stdbool.h>
+
+/**
+ * Enables dynamic frequency scaling and automatic light sleep.
+ */
+void power_start(void);
+
+/**
+ * Turns modem sleep for the station on once it has an IP, or off again as
+ * soon as the link is lost. Modem sleep does not work while the SoftAP is
+ * up, so turning it on also switches WiFi to station only; turning it off
+ * brings the SoftAP back for provisioning.
+ * @param enable true to let the radio sleep
+ */
+void power_set_wifi_sleep(bool enable);
+
+#endif /* MAIN_POWER_H_ */
@@ -0,0 +1,66 @@
+/*
+ * prediction.c
+ *
+ * The label is found with coreJSON, which returns a pointer into the payload
+ * instead of building a tree, and is then matched against the known class
+ * names.
+ */
+
+#include <string.h>
+
+#include "core_json.h"
+
+#include "prediction.h"
+
+// Path of the label inside a prediction message
+static const char PREDICTION_LABEL_QUERY[] = "prediction[0]";
+
+// Model class names, indexed by prediction_label_t
+static const char *const prediction_label_names[] = {
+	[PREDICTION_NORMAL] = "normal",
+	[PREDICTION_THEFT_C1] = "c1",
+	[PREDICTION_THEFT_C2] = "c2",
+	[PREDICTION_THEFT_C3] = "c3",
+};
+
+esp_err_t prediction_decode(const char *payload, size_t len, prediction_label_t *label)
+{
+	const char *value;
+	size_t value_len;
+	JSONTypes_t type;
+	int i;
+
+	if (JSON_Validate(payload, len) != JSONSuccess)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if ((JSON_SearchConst(payload, len, PREDICTION_LABEL_QUERY, sizeof(PREDICTION_LABEL_QUERY) - 1,
+						  &value, &value_len, &type) != JSONSuccess) || (type != JSONString))
+	{
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	*label = PREDICTION_NORMAL;
+	for (i = PREDICTION_THEFT_C1; i <= PREDICTION_THEFT_C3; i++)
+	{
+		if ((strlen(prediction_label_names[i]) == value_len) &&
+			(memcmp(prediction_label_names[i], value, value_len) == 0))
+		{
+			*label = (prediction_label_t) i;
+			break;
+		}
+	}
+
+	return ESP_OK;
+}
+
+const char *prediction_label_name(prediction_label_t label)
+{
+	if ((unsigned int) label >= sizeof(prediction_label_names) / sizeof(prediction_label_names[0]))
+	{
+		return "unknown";
+	}
+
+	return prediction_label_names[label];
+}
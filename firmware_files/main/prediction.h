@@ -0,0 +1,50 @@
+/*
+ * prediction.h
+ *
+ * Decodes the theft predictions the cloud publishes on "smartmeter/prediction",
+ * e.g. {"prediction":["c2"]}. Decoding works in place on the MQTT payload and
+ * never touches the heap, so it can run directly in the agent task.
+ */
+
+#ifndef MAIN_PREDICTION_H_
+#define MAIN_PREDICTION_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+// Class labels emitted by the model; c1 to c3 are the theft classes
+typedef enum prediction_label
+{
+	PREDICTION_NORMAL = 0,
+	PREDICTION_THEFT_C1,
+	PREDICTION_THEFT_C2,
+	PREDICTION_THEFT_C3,
+} prediction_label_t;
+
+/**
+ * Reads the label from a prediction message. Labels other than c1, c2 and c3
+ * decode as PREDICTION_NORMAL.
+ * @param payload prediction JSON, need not be NUL terminated
+ * @param len length of payload
+ * @param label decoded label
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if payload is not valid JSON, or
+ * ESP_ERR_NOT_FOUND if it has no string at prediction[0]
+ */
+esp_err_t prediction_decode(const char *payload, size_t len, prediction_label_t *label);
+
+/**
+ * Returns true for the theft classes.
+ */
+static inline bool prediction_is_theft(prediction_label_t label)
+{
+	return label != PREDICTION_NORMAL;
+}
+
+/**
+ * Returns the model's name for a label, e.g. "c2".
+ */
+const char *prediction_label_name(prediction_label_t label);
+
+#endif /* MAIN_PREDICTION_H_ */
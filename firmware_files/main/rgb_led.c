@@ -12,6 +12,8 @@
  #include <stdint.h>
  #include <stdio.h>
  #include "driver/ledc.h"
+ #include "freertos/FreeRTOS.h"
+ #include "freertos/semphr.h"
  #include "hal/ledc_types.h"
  #include "rgb_led.h"
  
@@ -21,6 +23,16 @@
  // Flag to indicate whether PWM has been initialized
  bool g_pwm_init_handle = false;
  
+ // Serialises colour changes from the WiFi task and the alert timer
+ static SemaphoreHandle_t rgb_led_mutex;
+ static StaticSemaphore_t rgb_led_mutex_buffer;
+ 
+ // Colour of the current system state, shown again when an alert ends
+ static uint8_t g_status_colour[3];
+ 
+ // Set while an alert pattern owns the LED
+ static bool g_alert_active = false;
+ 
  /*
   * Initialize the LEDC peripheral for controlling the RGB LED.
   * Configures each channel for PWM output and sets up the timer.
@@ -64,8 +76,12 @@
  
  /*
   * Centralize initialization check to avoid redundant calls.
+  * The first call must come from app_main, before other tasks use the LED.
   */
- static void rgb_led_initialize(void) {
+ void rgb_led_initialize(void) {
+     if (rgb_led_mutex == NULL) {
+         rgb_led_mutex = xSemaphoreCreateMutexStatic(&rgb_led_mutex_buffer);
+     }
      if (!g_pwm_init_handle) {
          rgb_led_pwm_init();
      }
@@ -91,19 +107,48 @@
      ledc_update_duty(ledc_ch[2].mode, ledc_ch[2].channel);
  }
  
+ /*
+  * Record the colour of the current system state and show it, unless an
+  * alert is being shown; it then appears when the alert ends.
+  */
+ static void rgb_led_set_status(uint8_t red, uint8_t green, uint8_t blue) {
+     rgb_led_initialize();
+ 
+     xSemaphoreTake(rgb_led_mutex, portMAX_DELAY);
+     g_status_colour[0] = red;
+     g_status_colour[1] = green;
+     g_status_colour[2] = blue;
+     if (!g_alert_active) {
+         rgb_led_set_colour(red, green, blue);
+     }
+     xSemaphoreGive(rgb_led_mutex);
+ }
+ 
  /* System State Indication Functions */
  void rgb_led_wifi_app_started(void) {
-     rgb_led_initialize();
-     rgb_led_set_colour(255, 0, 0); // Red
+     rgb_led_set_status(255, 0, 0); // Red
  }
  
  void rgb_led_http_server_started(void) {
-     rgb_led_initialize();
-     rgb_led_set_colour(0, 0, 255); // Blue
+     rgb_led_set_status(0, 0, 255); // Blue
  }
  
  void rgb_led_wifi_connected(void) {
-     rgb_led_initialize();
-     rgb_led_set_colour(0, 255, 255); // Cyan
+     rgb_led_set_status(0, 255, 255); // Cyan
+ }
+ 
+ /* Alert Pattern Functions */
+ void rgb_led_alert_colour(uint8_t red, uint8_t green, uint8_t blue) {
+     xSemaphoreTake(rgb_led_mutex, portMAX_DELAY);
+     g_alert_active = true;
+     rgb_led_set_colour(red, green, blue);
+     xSemaphoreGive(rgb_led_mutex);
+ }
+ 
+ void rgb_led_alert_end(void) {
+     xSemaphoreTake(rgb_led_mutex, portMAX_DELAY);
+     g_alert_active = false;
+     rgb_led_set_colour(g_status_colour[0], g_status_colour[1], g_status_colour[2]);
+     xSemaphoreGive(rgb_led_mutex);
  }
  
\ No newline at end of file
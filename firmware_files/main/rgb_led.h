@@ -11,6 +11,8 @@
 #ifndef MAIN_RGB_LED_H_
 #define MAIN_RGB_LED_H_
 
+#include <stdint.h>
+
 // Define GPIO pins for the RGB LED
 #define RGB_LED_RED_GPIO       13  // GPIO pin for Red channel
 #define RGB_LED_GREEN_GPIO     12  // GPIO pin for Green channel
@@ -27,9 +29,16 @@ typedef struct {
     int timer_index;   // Timer index used for the channel
 } ledc_info_t;
 
+// Configure the LEDC channels; called on first use, but the first call must come from app_main
+void rgb_led_initialize(void);
+
 // Function prototypes for indicating system states using RGB LED
 void rgb_led_wifi_app_started(void);    // Indicate WiFi app started (Red)
 void rgb_led_http_server_started(void); // Indicate HTTP server started (Blue)
 void rgb_led_wifi_connected(void);      // Indicate WiFi connected (Cyan)
 
+// Alert patterns (alert.c) take over the LED from the state colour until they end
+void rgb_led_alert_colour(uint8_t red, uint8_t green, uint8_t blue); // Show one step of an alert pattern
+void rgb_led_alert_end(void);           // Give the LED back to the current state colour
+
 #endif /* MAIN_RGB_LED_H_ */
@@ -0,0 +1,251 @@
+/*
+ * snapshot.c
+ *
+ * The snapshot is encoded straight into the caller's buffer with TinyCBOR,
+ * the encoder the MQTT file streams library already brings in. History
+ * points are encoded from the history_query callback as the store reads
+ * them, so no copy of the series is kept.
+ */
+
+#include <time.h>
+
+#include "cbor.h"
+#include "esp_app_desc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+
+#include "acquisition.h"
+#include "history.h"
+#include "snapshot.h"
+
+// Samples older than 2024 were taken before SNTP set the clock
+#define SNAPSHOT_MIN_TIME	1704067200
+
+/**
+ * State of the history points array being encoded
+ */
+typedef struct snapshot_history
+{
+	CborEncoder *points;
+	CborError err;
+} snapshot_history_t;
+
+/**
+ * Encodes the newest sample and the aggregates over every sample in the ring.
+ * @param map top level map
+ * @return CborNoError or the encoder errors
+ */
+static CborError snapshot_encode_samples(CborEncoder *map)
+{
+	acquisition_sample_t sample;
+	acquisition_sample_t latest;
+	float value[HISTORY_CHANNELS];
+	float min[HISTORY_CHANNELS];
+	float max[HISTORY_CHANNELS];
+	float sum[HISTORY_CHANNELS] = {0};
+	uint32_t next = acquisition_next_seq();
+	uint32_t seq = (next > ACQUISITION_RING_LEN) ? next - ACQUISITION_RING_LEN : 0;
+	uint32_t count = 0;
+	CborEncoder array;
+	CborEncoder channel;
+	CborError err = CborNoError;
+
+	// The ring keeps moving while it is read; stop at the sample that was newest at the start
+	while (seq < next && acquisition_read(seq, &sample, 0) == ESP_OK)
+	{
+		value[HISTORY_FEEDER_VOLTAGE] = sample.feeder_line_voltage;
+		value[HISTORY_FEEDER_CURRENT] = sample.feeder_current;
+		value[HISTORY_TRANSFORMER1_CURRENT] = sample.transformer_current[0];
+		value[HISTORY_TRANSFORMER2_CURRENT] = sample.transformer_current[1];
+		value[HISTORY_TRANSFORMER3_CURRENT] = sample.transformer_current[2];
+
+		for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+		{
+			min[ch] = (count == 0 || value[ch] < min[ch]) ? value[ch] : min[ch];
+			max[ch] = (count == 0 || value[ch] > max[ch]) ? value[ch] : max[ch];
+			sum[ch] += value[ch];
+		}
+		count++;
+		latest = sample;
+		seq = sample.seq + 1;
+	}
+
+	if (count == 0)
+	{
+		return CborNoError;
+	}
+
+	err |= cbor_encode_uint(map, SNAPSHOT_KEY_LATEST);
+	err |= cbor_encoder_create_array(map, &array, 11);
+	err |= cbor_encode_uint(&array, latest.seq);
+	err |= cbor_encode_int(&array, latest.timestamp_ms);
+	err |= cbor_encode_float(&array, latest.feeder_line_voltage);
+	err |= cbor_encode_float(&array, latest.feeder_shunt_voltage);
+	err |= cbor_encode_float(&array, latest.feeder_current);
+	for (int i = 0; i < INA3221_BUS_NUMBER; i++)
+	{
+		err |= cbor_encode_float(&array, latest.transformer_shunt_voltage[i]);
+	}
+	for (int i = 0; i < INA3221_BUS_NUMBER; i++)
+	{
+		err |= cbor_encode_float(&array, latest.transformer_current[i]);
+	}
+	err |= cbor_encoder_close_container(map, &array);
+
+	err |= cbor_encode_uint(map, SNAPSHOT_KEY_AGGREGATES);
+	err |= cbor_encoder_create_array(map, &array, HISTORY_CHANNELS);
+	for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+	{
+		err |= cbor_encoder_create_array(&array, &channel, 3);
+		err |= cbor_encode_float(&channel, min[ch]);
+		err |= cbor_encode_float(&channel, sum[ch] / count);
+		err |= cbor_encode_float(&channel, max[ch]);
+		err |= cbor_encoder_close_container(&array, &channel);
+	}
+	err |= cbor_encoder_close_container(map, &array);
+
+	return err;
+}
+
+/**
+ * Encodes the counters and health maps.
+ * @param map top level map
+ * @return CborNoError or the encoder errors
+ */
+static CborError snapshot_encode_status(CborEncoder *map)
+{
+	wifi_ap_record_t ap;
+	CborEncoder inner;
+	CborError err = CborNoError;
+
+	err |= cbor_encode_uint(map, SNAPSHOT_KEY_COUNTERS);
+	err |= cbor_encoder_create_map(map, &inner, 2);
+	err |= cbor_encode_uint(&inner, SNAPSHOT_COUNTER_SAMPLES);
+	err |= cbor_encode_uint(&inner, acquisition_next_seq());
+	err |= cbor_encode_uint(&inner, SNAPSHOT_COUNTER_UPTIME_S);
+	err |= cbor_encode_uint(&inner, esp_timer_get_time() / 1000000);
+	err |= cbor_encoder_close_container(map, &inner);
+
+	err |= cbor_encode_uint(map, SNAPSHOT_KEY_HEALTH);
+	err |= cbor_encoder_create_map(map, &inner, CborIndefiniteLength);
+	err |= cbor_encode_uint(&inner, SNAPSHOT_HEALTH_FREE_HEAP);
+	err |= cbor_encode_uint(&inner, esp_get_free_heap_size());
+	err |= cbor_encode_uint(&inner, SNAPSHOT_HEALTH_MIN_FREE_HEAP);
+	err |= cbor_encode_uint(&inner, esp_get_minimum_free_heap_size());
+	err |= cbor_encode_uint(&inner, SNAPSHOT_HEALTH_RESET_REASON);
+	err |= cbor_encode_uint(&inner, esp_reset_reason());
+	if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK)
+	{
+		err |= cbor_encode_uint(&inner, SNAPSHOT_HEALTH_WIFI_RSSI);
+		err |= cbor_encode_int(&inner, ap.rssi);
+	}
+	err |= cbor_encode_uint(&inner, SNAPSHOT_HEALTH_FIRMWARE);
+	err |= cbor_encode_text_stringz(&inner, esp_app_get_description()->version);
+	err |= cbor_encoder_close_container(map, &inner);
+
+	return err;
+}
+
+/**
+ * Encodes one history point as [time, min, mean, max].
+ * @param point point from the store
+ * @param arg the channel's snapshot_history_t
+ * @return ESP_OK; encoder errors are kept in the snapshot_history_t
+ */
+static esp_err_t snapshot_history_point(const history_point_t *point, void *arg)
+{
+	snapshot_history_t *history = arg;
+	CborEncoder array;
+
+	history->err |= cbor_encoder_create_array(history->points, &array, 4);
+	history->err |= cbor_encode_uint(&array, point->time);
+	history->err |= cbor_encode_float(&array, point->min);
+	history->err |= cbor_encode_float(&array, point->mean);
+	history->err |= cbor_encode_float(&array, point->max);
+	history->err |= cbor_encoder_close_container(history->points, &array);
+
+	return ESP_OK;
+}
+
+/**
+ * Encodes the recent history of every channel. Left out while the clock is
+ * not set; without a history partition the series are empty.
+ * @param map top level map
+ * @param now current Unix time
+ * @return CborNoError or the encoder errors
+ */
+static CborError snapshot_encode_history(CborEncoder *map, uint32_t now)
+{
+	snapshot_history_t history = {0};
+	CborEncoder array;
+	CborEncoder channel;
+	CborEncoder points;
+	uint32_t step;
+	esp_err_t err;
+
+	if (now < SNAPSHOT_MIN_TIME)
+	{
+		return CborNoError;
+	}
+
+	history.err |= cbor_encode_uint(map, SNAPSHOT_KEY_HISTORY);
+	history.err |= cbor_encoder_create_array(map, &array, HISTORY_CHANNELS);
+	for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+	{
+		step = SNAPSHOT_HISTORY_STEP_S;
+		history.points = &points;
+
+		// The step goes after the points since the store may settle on a longer one
+		history.err |= cbor_encoder_create_array(&array, &channel, 2);
+		history.err |= cbor_encoder_create_array(&channel, &points, CborIndefiniteLength);
+		err = history_query(now - SNAPSHOT_HISTORY_RANGE_S, now, &step, ch, snapshot_history_point, &history);
+		history.err |= cbor_encoder_close_container(&channel, &points);
+		history.err |= cbor_encode_uint(&channel, step);
+		history.err |= cbor_encoder_close_container(&array, &channel);
+
+		if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+		{
+			history.err |= CborErrorInternalError;
+		}
+	}
+	history.err |= cbor_encoder_close_container(map, &array);
+
+	return history.err;
+}
+
+esp_err_t snapshot_encode(uint8_t *buff, size_t size, bool with_history, size_t *len)
+{
+	CborEncoder encoder;
+	CborEncoder map;
+	CborError err = CborNoError;
+	uint32_t now = time(NULL);
+
+	cbor_encoder_init(&encoder, buff, size, 0);
+
+	err |= cbor_encoder_create_map(&encoder, &map, CborIndefiniteLength);
+	err |= cbor_encode_uint(&map, SNAPSHOT_KEY_VERSION);
+	err |= cbor_encode_uint(&map, SNAPSHOT_VERSION);
+	err |= cbor_encode_uint(&map, SNAPSHOT_KEY_TIME);
+	err |= cbor_encode_uint(&map, (now >= SNAPSHOT_MIN_TIME) ? now : 0);
+	err |= snapshot_encode_samples(&map);
+	err |= snapshot_encode_status(&map);
+	if (with_history)
+	{
+		err |= snapshot_encode_history(&map, now);
+	}
+	err |= cbor_encoder_close_container(&encoder, &map);
+
+	// The encoder keeps counting after running out of room, so only that error means a small buffer
+	if (err == CborErrorOutOfMemory)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+	if (err != CborNoError)
+	{
+		return ESP_FAIL;
+	}
+
+	*len = cbor_encoder_get_buffer_size(&encoder, buff);
+	return ESP_OK;
+}
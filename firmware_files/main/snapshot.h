@@ -0,0 +1,91 @@
+/*
+ * snapshot.h
+ *
+ * Compact binary snapshot of the whole meter state, for a handheld tool or
+ * gateway to read out in one request (/snapshot.cbor) and for the MQTT uplink
+ * ("smartmeter/snapshot"). The snapshot is a CBOR map with small integer keys
+ * so it stays compact without a separate schema compiler; the layout is:
+ *
+ *   SNAPSHOT_KEY_VERSION     uint, SNAPSHOT_VERSION
+ *   SNAPSHOT_KEY_TIME        uint, Unix time, 0 while the clock is not set
+ *   SNAPSHOT_KEY_LATEST      array, the newest sample: [seq, timestamp_ms,
+ *                            line V, shunt mV, current mA, 3 x transformer
+ *                            shunt mV, 3 x transformer mA]
+ *   SNAPSHOT_KEY_AGGREGATES  array, per history channel over the samples
+ *                            still in the acquisition ring: [min, mean, max]
+ *   SNAPSHOT_KEY_COUNTERS    map, SNAPSHOT_COUNTER_* to uint
+ *   SNAPSHOT_KEY_HEALTH      map, SNAPSHOT_HEALTH_* to int or text
+ *   SNAPSHOT_KEY_HISTORY     array, per history channel: [[[time, min, mean,
+ *                            max], ...], step] over the last
+ *                            SNAPSHOT_HISTORY_RANGE_S; left out on request
+ *                            and while the clock is not set
+ *
+ * Channels are in history_channel_e order. Decoders should skip keys they do
+ * not know; new fields only ever get new keys.
+ */
+
+#ifndef MAIN_SNAPSHOT_H_
+#define MAIN_SNAPSHOT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Format version, raised only for changes old decoders cannot skip over
+#define SNAPSHOT_VERSION			1
+
+// Buffer that holds a snapshot with history
+#define SNAPSHOT_MAX_LEN			8192
+
+// History included: the last hour at one point per minute
+#define SNAPSHOT_HISTORY_RANGE_S	3600
+#define SNAPSHOT_HISTORY_STEP_S		60
+
+/**
+ * Top level keys
+ */
+typedef enum snapshot_key
+{
+	SNAPSHOT_KEY_VERSION = 0,
+	SNAPSHOT_KEY_TIME,
+	SNAPSHOT_KEY_LATEST,
+	SNAPSHOT_KEY_AGGREGATES,
+	SNAPSHOT_KEY_COUNTERS,
+	SNAPSHOT_KEY_HEALTH,
+	SNAPSHOT_KEY_HISTORY,
+} snapshot_key_e;
+
+/**
+ * Keys of the counters map
+ */
+typedef enum snapshot_counter
+{
+	SNAPSHOT_COUNTER_SAMPLES = 0,	///> Samples taken since boot
+	SNAPSHOT_COUNTER_UPTIME_S,		///> Seconds since boot
+} snapshot_counter_e;
+
+/**
+ * Keys of the health map
+ */
+typedef enum snapshot_health
+{
+	SNAPSHOT_HEALTH_FREE_HEAP = 0,	///> Bytes
+	SNAPSHOT_HEALTH_MIN_FREE_HEAP,	///> Lowest free heap since boot, bytes
+	SNAPSHOT_HEALTH_RESET_REASON,	///> esp_reset_reason_t
+	SNAPSHOT_HEALTH_WIFI_RSSI,		///> dBm, left out while not connected to an AP
+	SNAPSHOT_HEALTH_FIRMWARE,		///> Application version, text
+} snapshot_health_e;
+
+/**
+ * Encodes a snapshot of the current state.
+ * @param buff receives the snapshot
+ * @param size size of buff, SNAPSHOT_MAX_LEN fits every snapshot
+ * @param with_history true to include the recent history, which is most of the size
+ * @param len receives the length of the snapshot
+ * @return ESP_OK, ESP_ERR_NO_MEM if buff is too small, or ESP_FAIL
+ */
+esp_err_t snapshot_encode(uint8_t *buff, size_t size, bool with_history, size_t *len);
+
+#endif /* MAIN_SNAPSHOT_H_ */
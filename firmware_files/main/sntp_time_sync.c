@@ -1,19 +1,32 @@
 #include "esp_log.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
 #include "lwip/apps/sntp.h"
 
-#include "tasks_common.h"
-#include "aws_iot.h"
 #include "http_server.h"
 #include "sntp_time_sync.h"
-#include "wifi_app.h"
 
 static const char TAG[] = "sntp_time_sync";
 
 // SNTP operating mode set status
 static bool sntp_op_mode_set = false;
 
+/**
+ * Called by the SNTP client every time it sets the clock.
+ * @param tv the time it was set to
+ */
+static void sntp_time_sync_notification(struct timeval *tv)
+{
+    static bool first = true;
+
+    if (first)
+    {
+        ESP_LOGI(TAG, "Time synchronized %lld ms after boot", (long long)(esp_timer_get_time() / 1000));
+        first = false;
+    }
+}
+
 /**
  * Initialise SNTP service using SNTP_OPMODE_POLL mode
  */
@@ -25,6 +38,7 @@ static void sntp_time_sync_init_sntp(void)
     {
         // Set the operating mode
         sntp_setoperatingmode(SNTP_OPMODE_POLL);
+        sntp_set_time_sync_notification_cb(sntp_time_sync_notification);
         sntp_op_mode_set = true;
     }
 
@@ -37,69 +51,20 @@ static void sntp_time_sync_init_sntp(void)
     http_server_monitor_send_message(HTTP_MSG_TIME_SERVICE_INITIALISED);
 }
 
-/**
- * Gets the current time and if the current time is not up to date,
- * the sntp_time_sync_init_sntp function is called
- */
-void sntp_time_sync_obtain_time(void)
+void sntp_time_sync_start(void)
 {
-    time_t now = 0;
-    struct tm time_info = {0};
+    // The timezone does not depend on the clock being set
+    setenv("TZ", CONFIG_APP_TIMEZONE, 1);
+    tzset();
 
-    time(&now);
-    localtime_r(&now, &time_info);
-
-    if (time_info.tm_year < (2025 - 1900)) {
+    // Once started the client keeps the clock in sync by itself, also across reconnects
+    if (!sntp_time_synced() && !sntp_enabled())
+    {
         ESP_LOGI(TAG, "Time not set. Initialising SNTP...");
-
         sntp_time_sync_init_sntp();
-
-        // Wait until time is synced
-        int retry = 0;
-        const int retry_count = 10;
-
-        while (time_info.tm_year < (2025 - 1900) && ++retry < retry_count) {
-            ESP_LOGI(TAG, "Waiting for system time to be set... (%d/%d)", retry, retry_count);
-            vTaskDelay(2000 / portTICK_PERIOD_MS);
-        }
-
-        // Set local timezone only after time is synced
-        ESP_LOGI(TAG, "System time synchronized successfully.");
-        // CONFIGURATION PATCH: Use Kconfig value for timezone
-        setenv("TZ", CONFIG_APP_TIMEZONE, 1);
-        tzset();
     }
 }
 
-/**
- * The SNTP time synchronisation task
- * @return arg pvParam
- */
-static void sntp_time_sync(void *pvParam) 
-{
-    int retry = 0;
-    const int retry_count = 5;
-
-    ESP_LOGI(TAG, "Waiting for time synchronization...");
-
-    sntp_time_sync_obtain_time();  // initialize SNTP
-
-    while (!sntp_time_synced() && ++retry < retry_count) {
-        ESP_LOGW(TAG, "Time not synchronized yet... (%d/%d)", retry, retry_count);
-        vTaskDelay(2000 / portTICK_PERIOD_MS);
-    }
-
-    if (sntp_time_synced()) {
-        ESP_LOGI(TAG, "Time synchronized!");
-        aws_iot_start();  // Start AWS IoT service and initiate sensor readings through AWS
-    } else {
-        ESP_LOGE(TAG, "Failed to synchronize time after retries");
-    }
-
-    vTaskDelete(NULL);
-}
-
-
 bool sntp_time_synced() {
     time_t now;
     struct tm time_info;
@@ -134,8 +99,3 @@ char* sntp_time_sync_get_time(void)
 
     return time_buffer;
 }
-
-void sntp_time_sync_task_start(void)
-{
-    xTaskCreatePinnedToCore(&sntp_time_sync, "sntp_time_sync", SNTP_TIME_SYNC_TASK_STACK_SIZE, NULL, SNTP_TIME_SYNC_TASK_PRIORITY, NULL, SNTP_TIME_SYNC_TASK_CORE_ID);
-}
\ No newline at end of file
@@ -2,9 +2,10 @@
 #define MAIN_SNTP_TIME_SYNC_H
 
 /**
- * Starts the SNTP server synchronisation task
+ * Sets the timezone and starts the SNTP client if the clock is not set yet.
+ * Returns without waiting for the time; see sntp_time_synced.
  */
-void sntp_time_sync_task_start(void);
+void sntp_time_sync_start(void);
 
 /**
  * Returns local time if set
@@ -8,6 +8,21 @@
 #define HTTP_SERVER_TASK_PRIORITY       4
 #define HTTP_SERVER_TASK_CORE_ID        0
 
+// Live telemetry stream tasks, one per /stream client (CONFIG_HTTP_STREAM_MAX_CLIENTS)
+#define HTTP_STREAM_TASK_STACK_SIZE     4096
+#define HTTP_STREAM_TASK_PRIORITY       3
+#define HTTP_STREAM_TASK_CORE_ID        0
+
+// Firmware upload task, receives a /OTAupdate body outside the HTTP server task
+#define HTTP_OTA_TASK_STACK_SIZE        4096
+#define HTTP_OTA_TASK_PRIORITY          3
+#define HTTP_OTA_TASK_CORE_ID           0
+
+// OTA writer task, erases and writes flash while the next chunk is received
+#define OTA_WRITER_TASK_STACK_SIZE      4096
+#define OTA_WRITER_TASK_PRIORITY        4
+#define OTA_WRITER_TASK_CORE_ID         1
+
 // HTTP Server Monitor task
 #define HTTP_SERVER_MONITOR_STACK_SIZE  4096
 #define HTTP_SERVER_MONITOR_PRIORITY    3
@@ -18,6 +33,16 @@
 #define WIFI_RESET_BUTTON_TASK_PRIORITY 4
 #define WIFI_RESET_BUTTON_TASK_CORE_ID  0
 
+// Sensor acquisition task, samples all sensors into the ring every CONFIG_ACQUISITION_PERIOD_MS
+#define ACQUISITION_TASK_STACK_SIZE     4096
+#define ACQUISITION_TASK_PRIORITY       5
+#define ACQUISITION_TASK_CORE_ID        1
+
+// History recorder task, rolls samples up into the on-flash minute and hour logs
+#define HISTORY_TASK_STACK_SIZE         4096
+#define HISTORY_TASK_PRIORITY           2
+#define HISTORY_TASK_CORE_ID            1
+
 // INA219 Sensor Task
 #define INA219_TASK_STACK_SIZE          4096  
 #define INA219_TASK_PRIORITY            5
@@ -28,12 +53,34 @@
 #define INA3221_TASK_PRIORITY           5
 #define INA3221_TASK_CORE_ID            1
 
-// SNTP Time Sync task
-#define SNTP_TIME_SYNC_TASK_STACK_SIZE  8192  
-#define SNTP_TIME_SYNC_TASK_PRIORITY    4
-#define SNTP_TIME_SYNC_TASK_CORE_ID     1
+// Metrics task, samples queue depths, tasks and heap for the health report
+#define METRICS_TASK_STACK_SIZE         3072
+#define METRICS_TASK_PRIORITY           1
+#define METRICS_TASK_CORE_ID            0
 
-// AWS IoT task
-#define AWS_IOT_TASK_STACK_SIZE         12288
+// MQTT agent task (owns the TLS connection)
+#define MQTT_AGENT_TASK_STACK_SIZE      8192
+#define MQTT_AGENT_TASK_PRIORITY        5
+#define MQTT_AGENT_TASK_CORE_ID         1
+
+// AWS IoT telemetry publisher task
+#define AWS_IOT_TASK_STACK_SIZE         6144
 #define AWS_IOT_TASK_PRIORITY           4   
 #define AWS_IOT_TASK_CORE_ID            1
+
+// Device Defender report task (CONFIG_DEVICE_DEFENDER)
+#define DEVICE_DEFENDER_TASK_STACK_SIZE         4096
+#define DEVICE_DEFENDER_TASK_PRIORITY           1
+#define DEVICE_DEFENDER_TASK_CORE_ID            0
+
+// MQTT OTA task, runs AWS IoT Jobs updates streamed over MQTT (CONFIG_MQTT_OTA)
+#define MQTT_OTA_TASK_STACK_SIZE        4096
+#define MQTT_OTA_TASK_PRIORITY          3
+#define MQTT_OTA_TASK_CORE_ID           1
+
+// MQTT agent benchmark consumer and producer tasks (CONFIG_MQTT_AGENT_BENCHMARK)
+#define MQTT_AGENT_BENCH_TASK_STACK_SIZE        3072
+#define MQTT_AGENT_BENCH_TASK_PRIORITY          5
+#define MQTT_AGENT_BENCH_TASK_CORE_ID           1
+#define MQTT_AGENT_BENCH_PRODUCER_STACK_SIZE    2048
+#define MQTT_AGENT_BENCH_PRODUCER_PRIORITY      4
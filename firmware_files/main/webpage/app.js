@@ -4,6 +4,14 @@
 let wifiConnectStatusInterval = null;
 let networkIntervalId = null;
 let statusMessageTimeout = null;
+let liveStream = null;
+let liveTrace = [];
+
+// Samples kept in the live trace, a minute at the default 250 ms sampling period
+const LIVE_TRACE_LEN = 240;
+
+// Trace colors for the feeder and the three transformers
+const LIVE_TRACE_COLORS = ['rgb(89, 152, 255)', 'rgb(16, 185, 129)', 'rgb(245, 158, 11)', 'rgb(244, 63, 94)'];
 
 /**
  * Initialize functions here.
@@ -40,6 +48,7 @@ function initializeESP32() {
     // Get initial data
     getUpdateStatus();
     getConnectInfo();
+    startLiveStream();
     
     console.log("ESP32 dashboard initialized");
 }
@@ -494,4 +503,70 @@ function getLocalTime() {
             console.error('Error getting local time:', error);
             document.getElementById('local_time').textContent = '--:--:--';
         });
-}
\ No newline at end of file
+}
+
+/**
+ * Subscribes to the live sensor stream. The browser reconnects by itself after
+ * a dropped connection; if the device turns us away (too many clients) try
+ * again later.
+ */
+function startLiveStream() {
+    if (!window.EventSource) {
+        $('#live_status').text('Live readings need a browser with EventSource support');
+        return;
+    }
+
+    liveStream = new EventSource('/stream');
+
+    liveStream.onmessage = function(event) {
+        const sample = JSON.parse(event.data);
+        const feeder = sample.feeder;
+
+        $('#live_feeder').text(feeder.line_voltage.toFixed(2) + ' V  ' + feeder.current.toFixed(1) + ' mA');
+        $('#live_transformers').text(sample.transformer_current.map(i => i.toFixed(1)).join(' / ') + ' mA');
+        $('#live_status').text('Sample ' + sample.seq);
+
+        liveTrace.push([feeder.current].concat(sample.transformer_current));
+        if (liveTrace.length > LIVE_TRACE_LEN) {
+            liveTrace.shift();
+        }
+        drawLiveTrace();
+    };
+
+    liveStream.onerror = function() {
+        if (liveStream.readyState === EventSource.CLOSED) {
+            $('#live_status').text('Live readings unavailable, retrying...');
+            liveStream = null;
+            setTimeout(startLiveStream, 10000);
+        } else {
+            $('#live_status').text('Reconnecting to the sensor stream...');
+        }
+    };
+}
+
+/**
+ * Draws the feeder and transformer currents in the live trace, scaled to the largest one shown.
+ */
+function drawLiveTrace() {
+    const canvas = document.getElementById('live_trace');
+    const ctx = canvas.getContext('2d');
+    const width = canvas.width = canvas.clientWidth;
+    const height = canvas.height;
+    const max = Math.max(1, ...liveTrace.map(currents => Math.max(...currents)));
+
+    ctx.clearRect(0, 0, width, height);
+    for (let line = 0; line < LIVE_TRACE_COLORS.length; line++) {
+        ctx.strokeStyle = LIVE_TRACE_COLORS[line];
+        ctx.beginPath();
+        liveTrace.forEach(function(currents, i) {
+            const x = width * i / (LIVE_TRACE_LEN - 1);
+            const y = height - 1 - (height - 2) * Math.max(0, currents[line]) / max;
+            if (i === 0) {
+                ctx.moveTo(x, y);
+            } else {
+                ctx.lineTo(x, y);
+            }
+        });
+        ctx.stroke();
+    }
+}
@@ -11,12 +11,18 @@
 
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "lwip/netdb.h"
+#include "mbedtls/pkcs5.h"
 //#include <esp_wifi_types_generic.h>
 
 #include "app_nvs.h"
+#include "backoff_algorithm.h"
 #include "http_server.h"
+#include "metrics.h"
+#include "power.h"
 #include "rgb_led.h"
 #include "tasks_common.h"
 #include "wifi_app.h"
@@ -30,8 +36,18 @@ static wifi_connected_event_callback_t wifi_connected_event_cb;
 // Used forreturning the wifi configuration
 wifi_config_t *wifi_config = NULL;
 
-// Used to track the number of retries when a connection attempt fails
-static int g_retry_number;
+// Last AP connected to with the saved credentials, see app_nvs_sta_cache_t
+static app_nvs_sta_cache_t wifi_app_sta_cache;
+static bool wifi_app_sta_cache_valid = false;
+
+// The attempt in progress went straight to the cached BSSID
+static bool wifi_app_fast_attempt = false;
+
+// Delays between failed connection attempts
+static BackoffAlgorithmContext_t wifi_app_backoff;
+
+// Starts the next attempt once the backoff delay is over
+static esp_timer_handle_t wifi_app_retry_timer;
 
 /**
  * Wifi application event group handle and status bits
@@ -94,14 +110,8 @@ esp_netif_t* esp_netif_ap = NULL;
                  // UPDATED: Replaced printf with ESP_LOGW
                  ESP_LOGW(TAG, "WIFI_EVENT_STA_DISCONNECTED, reason code %d", wifi_event_sta_disconnected->reason);
  
-                 if (g_retry_number < MAX_CONNECTION_RETRIES)
-                 {
-                     esp_wifi_connect();
-                     g_retry_number++;
-                 }
-                 else {
-                     wifi_app_send_message(WIFI_APP_MSG_STA_DISCONNECTED);
-                 }
+                 // The WiFi application task decides whether and when to try again
+                 wifi_app_send_message(WIFI_APP_MSG_STA_LINK_LOST);
                  break;
          }
      }
@@ -112,8 +122,6 @@ esp_netif_t* esp_netif_ap = NULL;
              case IP_EVENT_STA_GOT_IP:
                  ESP_LOGI(TAG, "IP_EVENT_STA_GOT_IP");
  
-                 // Reset retry counter upon successful connection
-                 g_retry_number = 0;
                  wifi_app_send_message(WIFI_APP_MSG_STA_CONNECTED_GOT_IP);
                  break;
          }   
@@ -190,12 +198,175 @@ static void wifi_app_soft_ap_config(void)
 }
 
 /**
- * Connects the ESP32 to an external AP using the updated station configuration
+ * Connects the ESP32 to an external AP using the updated station configuration.
+ * A fast attempt goes straight to the cached BSSID on its channel with the
+ * cached PMK, skipping both the scan of every channel and the 4096 round key
+ * derivation; otherwise every channel is scanned for the strongest AP with
+ * the SSID.
+ * @param fast true to use the connection cache, ignored if there is none
+ */
+static void wifi_app_connect_sta(bool fast)
+{
+    static const char hex[] = "0123456789abcdef";
+    wifi_config_t config = *wifi_app_get_wifi_config();
+    esp_err_t err;
+
+    wifi_app_fast_attempt = fast && wifi_app_sta_cache_valid;
+    if (wifi_app_fast_attempt)
+    {
+        memcpy(config.sta.bssid, wifi_app_sta_cache.bssid, sizeof(config.sta.bssid));
+        config.sta.bssid_set = true;
+        config.sta.channel = wifi_app_sta_cache.channel;
+        config.sta.scan_method = WIFI_FAST_SCAN;
+
+        // 64 hex digits in place of the password are taken as the PMK
+        if (wifi_app_sta_cache.has_pmk)
+        {
+            for (size_t i = 0; i < sizeof(wifi_app_sta_cache.pmk); i++)
+            {
+                config.sta.password[2 * i] = hex[wifi_app_sta_cache.pmk[i] >> 4];
+                config.sta.password[2 * i + 1] = hex[wifi_app_sta_cache.pmk[i] & 0x0f];
+            }
+        }
+    }
+    else
+    {
+        config.sta.bssid_set = false;
+        config.sta.channel = 0;
+        config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    }
+
+#if CONFIG_POWER_SAVE
+    // Beacon intervals the radio sleeps through between wake-ups while in modem sleep
+    config.sta.listen_interval = CONFIG_POWER_SAVE_LISTEN_INTERVAL;
+#endif
+
+    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &config));
+
+    err = esp_wifi_connect();
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "wifi_app_connect_sta: esp_wifi_connect failed (%s)", esp_err_to_name(err));
+    }
+}
+
+/**
+ * Cancels a pending retry and starts counting failed attempts again.
+ * @param attempts attempts allowed before giving up, or BACKOFF_ALGORITHM_RETRY_FOREVER
  */
-static void wifi_app_connect_sta(void)
+static void wifi_app_reset_backoff(uint32_t attempts)
 {
-    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, wifi_app_get_wifi_config()));
-	ESP_ERROR_CHECK(esp_wifi_connect());
+    esp_timer_stop(wifi_app_retry_timer);
+    BackoffAlgorithm_InitializeParams(&wifi_app_backoff, WIFI_APP_RECONNECT_BACKOFF_BASE_MS,
+                                      WIFI_APP_RECONNECT_BACKOFF_MAX_MS, attempts);
+}
+
+/**
+ * Backoff timer callback, runs the next attempt in the WiFi application task.
+ * It runs in the esp_timer task, which must not block, so if the queue is
+ * full the timer is re-armed instead of waiting for room.
+ * @param arg unused
+ */
+static void wifi_app_retry_timer_callback(void *arg)
+{
+    wifi_app_queue_message_t msg = { .msgID = WIFI_APP_MSG_STA_RETRY };
+
+    if (xQueueSend(wifi_app_queue_handle, &msg, 0) != pdTRUE)
+    {
+        esp_timer_start_once(wifi_app_retry_timer, WIFI_APP_RETRY_REPOST_MS * 1000);
+    }
+}
+
+/**
+ * Remembers the AP the station is connected to for the next fast attempt.
+ * The PMK only depends on the SSID and password, so it is derived once per
+ * set of credentials; the cache is only written when something changed.
+ */
+static void wifi_app_update_sta_cache(void)
+{
+    wifi_config_t *wifi_config = wifi_app_get_wifi_config();
+    app_nvs_sta_cache_t cache = {0};
+    wifi_ap_record_t ap;
+    size_t password_len = strnlen((const char *)wifi_config->sta.password, sizeof(wifi_config->sta.password));
+    bool psk;
+
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK)
+    {
+        return;
+    }
+
+    if (wifi_app_sta_cache_valid)
+    {
+        cache = wifi_app_sta_cache;
+    }
+    memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+    cache.channel = ap.primary;
+
+    // WPA3 (SAE) does not use a PMK derived from the password, and a 64 digit password already is one
+    psk = (ap.authmode == WIFI_AUTH_WPA_PSK || ap.authmode == WIFI_AUTH_WPA2_PSK ||
+           ap.authmode == WIFI_AUTH_WPA_WPA2_PSK) && password_len < sizeof(wifi_config->sta.password);
+    if (!psk)
+    {
+        cache.has_pmk = false;
+    }
+    else if (!cache.has_pmk)
+    {
+        cache.has_pmk = mbedtls_pkcs5_pbkdf2_hmac_ext(MBEDTLS_MD_SHA1, wifi_config->sta.password, password_len,
+                                                      wifi_config->sta.ssid,
+                                                      strnlen((const char *)wifi_config->sta.ssid, sizeof(wifi_config->sta.ssid)),
+                                                      4096, sizeof(cache.pmk), cache.pmk) == 0;
+    }
+
+    if (wifi_app_sta_cache_valid && memcmp(&cache, &wifi_app_sta_cache, sizeof(cache)) == 0)
+    {
+        return;
+    }
+
+    if (app_nvs_save_sta_cache(&cache) == ESP_OK)
+    {
+        wifi_app_sta_cache = cache;
+        wifi_app_sta_cache_valid = true;
+    }
+}
+
+/**
+ * Handles a connection attempt that failed for good or a disconnection the user asked for.
+ */
+static void wifi_app_sta_disconnected(void)
+{
+    EventBits_t eventBits = xEventGroupGetBits(wifi_app_event_group);
+
+    if (eventBits & WIFI_APP_CONNECTING_USING_SAVED_CREDS_BIT)
+    {
+        ESP_LOGI(TAG, "WIFI_APP_MSG_STA_DISCONNECTED: ATTEMPT USING SAVED CREDENTIALS");
+        xEventGroupClearBits(wifi_app_event_group, WIFI_APP_CONNECTING_USING_SAVED_CREDS_BIT);
+        app_nvs_clear_sta_creds();
+    }
+    else if (eventBits & WIFI_APP_CONNECTING_FROM_HTTP_SERVER_BIT)
+    {
+        ESP_LOGI(TAG, "WIFI_APP_MSG_STA_DISCONNECTED: ATTEMPT FROM THE HTTP SERVER");
+        xEventGroupClearBits(wifi_app_event_group, WIFI_APP_CONNECTING_FROM_HTTP_SERVER_BIT);
+        http_server_monitor_send_message(HTTP_MSG_WIFI_CONNECT_FAIL);
+    }
+    else if (eventBits & WIFI_APP_USER_REQUESTED_STA_DISCONNECT_BIT)
+    {
+        ESP_LOGI(TAG, "WIFI_APP_MSG_USER_REQUESTED_STA_DISCONNECT: USER REQESTED DISCONNECTION");
+        xEventGroupClearBits(wifi_app_event_group, WIFI_APP_USER_REQUESTED_STA_DISCONNECT_BIT);
+        http_server_monitor_send_message(HTTP_MSG_WIFI_USER_DISCONNECT);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "WIFI_APP_MSG_STA_DISCONNECTED: ATTEMPT FAILED, CHECK WIFI ACCESS POINT AVAILABILITY");
+    }
+
+    if(eventBits & WIFI_APP_STA_CONNECTED_GOT_IP_BIT)
+    {
+        xEventGroupClearBits(wifi_app_event_group, WIFI_APP_STA_CONNECTED_GOT_IP_BIT);
+    }
+
+    // Bring the SoftAP back so the device can be provisioned again
+    power_set_wifi_sleep(false);
 }
 
 
@@ -207,6 +378,7 @@ static void wifi_app_task(void *pvParameters)
 {
     wifi_app_queue_message_t msg;
     EventBits_t eventBits;
+    uint16_t backoff_ms;
 
     // Initialize the event handler
     wifi_app_event_handler_init();
@@ -235,7 +407,11 @@ static void wifi_app_task(void *pvParameters)
                     if (app_nvs_load_sta_creds())
                     {
                         ESP_LOGI(TAG, "Loaded station configuration");
-                        wifi_app_connect_sta();
+
+                        // Saved credentials are never given up on, the AP may just be down for a while
+                        wifi_app_sta_cache_valid = app_nvs_load_sta_cache(&wifi_app_sta_cache);
+                        wifi_app_reset_backoff(BACKOFF_ALGORITHM_RETRY_FOREVER);
+                        wifi_app_connect_sta(true);
                         xEventGroupSetBits(wifi_app_event_group, WIFI_APP_CONNECTING_USING_SAVED_CREDS_BIT);
                     }
                     else
@@ -261,11 +437,12 @@ static void wifi_app_task(void *pvParameters)
 
                     xEventGroupSetBits(wifi_app_event_group, WIFI_APP_CONNECTING_FROM_HTTP_SERVER_BIT);
 
-                    // Attempt a connection
-                    wifi_app_connect_sta();
+                    // New credentials, so the cache for the old ones is of no use
+                    wifi_app_sta_cache_valid = false;
 
-                    // Set current number of retries to zero
-                    g_retry_number = 0;
+                    // Attempt a connection, giving up after MAX_CONNECTION_RETRIES
+                    wifi_app_reset_backoff(MAX_CONNECTION_RETRIES);
+                    wifi_app_connect_sta(false);
 
                     // Let the HTTP server know about the connection attempt
                     http_server_monitor_send_message(HTTP_MSG_WIFI_CONNECT_INIT);
@@ -295,6 +472,11 @@ static void wifi_app_task(void *pvParameters)
                         xEventGroupClearBits(wifi_app_event_group, WIFI_APP_CONNECTING_FROM_HTTP_SERVER_BIT);
                     }
 
+                    // These credentials work, so a later drop is retried for as long as it takes
+                    wifi_app_reset_backoff(BACKOFF_ALGORITHM_RETRY_FOREVER);
+                    wifi_app_update_sta_cache();
+                    power_set_wifi_sleep(true);
+
                     // Check for connection callback
                     if (wifi_connected_event_cb)
                     {
@@ -311,10 +493,11 @@ static void wifi_app_task(void *pvParameters)
                     if(eventBits & WIFI_APP_STA_CONNECTED_GOT_IP_BIT){
                         xEventGroupSetBits(wifi_app_event_group, WIFI_APP_USER_REQUESTED_STA_DISCONNECT_BIT);
 
-                        g_retry_number = MAX_CONNECTION_RETRIES;
+                        esp_timer_stop(wifi_app_retry_timer);
     
                         ESP_ERROR_CHECK(esp_wifi_disconnect());
                         app_nvs_clear_sta_creds();
+                        wifi_app_sta_cache_valid = false;
                         rgb_led_http_server_started(); //! rename status led to more meaningful name
                     }
 
@@ -323,35 +506,51 @@ static void wifi_app_task(void *pvParameters)
                 case WIFI_APP_MSG_STA_DISCONNECTED:
                     ESP_LOGI(TAG, "WIFI_APP_MSG_STA_DISCONNECTED");
 
+                    wifi_app_sta_disconnected();
+
+                    break;
+
+                case WIFI_APP_MSG_STA_LINK_LOST:
+                    ESP_LOGI(TAG, "WIFI_APP_MSG_STA_LINK_LOST");
+
                     eventBits = xEventGroupGetBits(wifi_app_event_group);
-                    if (eventBits & WIFI_APP_CONNECTING_USING_SAVED_CREDS_BIT)
+                    if (eventBits & WIFI_APP_USER_REQUESTED_STA_DISCONNECT_BIT)
                     {
-                        ESP_LOGI(TAG, "WIFI_APP_MSG_STA_DISCONNECTED: ATTEMPT USING SAVED CREDENTIALS");
-                        xEventGroupClearBits(wifi_app_event_group, WIFI_APP_CONNECTING_USING_SAVED_CREDS_BIT);
-                        app_nvs_clear_sta_creds();
+                        wifi_app_sta_disconnected();
                     }
-                    else if (eventBits & WIFI_APP_CONNECTING_FROM_HTTP_SERVER_BIT)
+                    else if (eventBits & WIFI_APP_STA_CONNECTED_GOT_IP_BIT)
                     {
-                        ESP_LOGI(TAG, "WIFI_APP_MSG_STA_DISCONNECTED: ATTEMPT FROM THE HTTP SERVER");
-                        xEventGroupClearBits(wifi_app_event_group, WIFI_APP_CONNECTING_FROM_HTTP_SERVER_BIT);
-                        http_server_monitor_send_message(HTTP_MSG_WIFI_CONNECT_FAIL);
+                        // A brownout or AP reboot: the AP usually comes back with the same BSSID and channel
+                        metrics_count(METRICS_WIFI_RECONNECTS);
+                        xEventGroupClearBits(wifi_app_event_group, WIFI_APP_STA_CONNECTED_GOT_IP_BIT);
+
+                        // Saved credentials are retried forever, so bring the SoftAP back now in case
+                        // the AP is gone for good or its password changed; the next IP drops it again
+                        power_set_wifi_sleep(false);
+                        wifi_app_connect_sta(true);
                     }
-                    else if (eventBits & WIFI_APP_USER_REQUESTED_STA_DISCONNECT_BIT)
+                    else if (wifi_app_fast_attempt)
                     {
-                        ESP_LOGI(TAG, "WIFI_APP_MSG_USER_REQUESTED_STA_DISCONNECT: USER REQESTED DISCONNECTION");
-                        xEventGroupClearBits(wifi_app_event_group, WIFI_APP_USER_REQUESTED_STA_DISCONNECT_BIT);
-                        http_server_monitor_send_message(HTTP_MSG_WIFI_USER_DISCONNECT);
+                        // The cached AP did not answer, look for the SSID on every channel right away
+                        wifi_app_connect_sta(false);
                     }
-                    else
+                    else if (BackoffAlgorithm_GetNextBackoff(&wifi_app_backoff, esp_random(), &backoff_ms) == BackoffAlgorithmSuccess)
                     {
-                        ESP_LOGI(TAG, "WIFI_APP_MSG_STA_DISCONNECTED: ATTEMPT FAILED, CHECK WIFI ACCESS POINT AVAILABILITY");
+                        ESP_LOGI(TAG, "WIFI_APP_MSG_STA_LINK_LOST: next attempt in %u ms", (unsigned int)backoff_ms);
+                        esp_timer_start_once(wifi_app_retry_timer, (uint64_t)backoff_ms * 1000);
                     }
-
-                    if(eventBits & WIFI_APP_STA_CONNECTED_GOT_IP_BIT)
+                    else
                     {
-                        xEventGroupClearBits(wifi_app_event_group, WIFI_APP_STA_CONNECTED_GOT_IP_BIT);
+                        wifi_app_sta_disconnected();
                     }
-                                      
+
+                    break;
+
+                case WIFI_APP_MSG_STA_RETRY:
+                    ESP_LOGI(TAG, "WIFI_APP_MSG_STA_RETRY");
+
+                    wifi_app_connect_sta(true);
+
                     break;
 
                 default:
@@ -389,6 +588,13 @@ void wifi_app_call_callback(void)
     wifi_connected_event_cb();
 }
 
+bool wifi_app_wait_connected(TickType_t ticks_to_wait)
+{
+    EventBits_t eventBits = xEventGroupWaitBits(wifi_app_event_group, WIFI_APP_STA_CONNECTED_GOT_IP_BIT, pdFALSE, pdTRUE, ticks_to_wait);
+
+    return (eventBits & WIFI_APP_STA_CONNECTED_GOT_IP_BIT) != 0;
+}
+
 void wifi_app_start(void)
 {
     ESP_LOGI(TAG, "STARTING WIFI APPLICATION");
@@ -405,6 +611,14 @@ void wifi_app_start(void)
 
     // Create message queue
     wifi_app_queue_handle = xQueueCreate(3, sizeof(wifi_app_queue_message_t));
+    metrics_register_queue("wifi_app", wifi_app_queue_handle);
+
+    // Create the reconnect backoff timer
+    const esp_timer_create_args_t retry_timer_args = {
+        .callback = &wifi_app_retry_timer_callback,
+        .name = "wifi_app_retry"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&retry_timer_args, &wifi_app_retry_timer));
 
     // Create wifi application event group
     wifi_app_event_group = xEventGroupCreate();
@@ -2,6 +2,7 @@
 #ifndef MAIN_WIFI_APP_H_
 #define MAIN_WIFI_APP_H_
 
+#include "freertos/FreeRTOS.h"
 #include "esp_wifi.h"
 #include "esp_netif.h"
 
@@ -23,7 +24,10 @@ typedef void (*wifi_connected_event_callback_t)(void);
 #define WIFI_STA_POWER_SAVE		WIFI_PS_NONE	            // Power-saving mode for station
 #define MAX_SSID_LENGTH			32				            // Maximum SSID length
 #define MAX_PASSWORD_LENGTH		64				            // Maximum password length
-#define MAX_CONNECTION_RETRIES	5				            // Maximum retries for connection
+#define MAX_CONNECTION_RETRIES	5				            // Attempts for credentials entered on the web page
+#define WIFI_APP_RECONNECT_BACKOFF_BASE_MS	500			// First delay after a failed reconnect
+#define WIFI_APP_RECONNECT_BACKOFF_MAX_MS	30000		// Longest delay between reconnects
+#define WIFI_APP_RETRY_REPOST_MS		100			// Retry timer re-arm delay while the queue is full
 
 // Network interface objects for station and AP modes
 extern esp_netif_t *esp_netif_sta;
@@ -37,7 +41,9 @@ typedef enum wifi_app_message
     WIFI_APP_MSG_STA_CONNECTED_GOT_IP,           // Station connected and obtained IP
     WIFI_APP_MSG_STA_DISCONNECTED,                 // Station disconnected 
     WIFI_APP_MSG_USER_REQUESTED_STA_DISCONNECT,
-    WIFI_APP_MSG_LOAD_SAVED_CREDENTIALS
+    WIFI_APP_MSG_LOAD_SAVED_CREDENTIALS,
+    WIFI_APP_MSG_STA_LINK_LOST,                  // Connection attempt failed or connection dropped
+    WIFI_APP_MSG_STA_RETRY                       // Backoff delay after a failed attempt is over
 } wifi_app_message_e;
 
 // Structure for task queue messages
@@ -61,6 +67,13 @@ void wifi_app_start(void);
  */
 wifi_config_t* wifi_app_get_wifi_config(void);
 
+/**
+ * Blocks until the station has an IP address.
+ * @param ticks_to_wait maximum time to wait
+ * @return true if connected
+ */
+bool wifi_app_wait_connected(TickType_t ticks_to_wait);
+
 /**
  * Sets the callback function
  */
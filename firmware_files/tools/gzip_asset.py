@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""
+gzip_asset.py
+
+Build-time helper that gzips a web page asset from main/webpage/ before it is
+embedded, so the HTTP server can send it as it is with Content-Encoding: gzip.
+The output does not depend on the time of the build, so an unchanged asset
+keeps its ETag (the CRC-32 of the compressed file) across firmware updates.
+
+Assets named after the output are compressed first and their references in
+the input, such as src="app.js", get "?v=" and that CRC-32 appended. A page
+that links its scripts and styles this way lets the browser cache them as
+immutable, since any change to one also changes the URL the page asks for.
+
+Usage: gzip_asset.py <input> <output.gz> [<versioned_asset.gz> ...]
+"""
+import gzip
+import os
+import sys
+import zlib
+
+
+def version_references(data, assets):
+    for asset in assets:
+        with open(asset, "rb") as f:
+            crc = zlib.crc32(f.read())
+        name = os.path.basename(asset)[:-len(".gz")].encode()
+        quoted = b'"' + name + b'"'
+        if quoted not in data:
+            raise ValueError("no reference to %s" % name.decode())
+        data = data.replace(quoted, b'"%s?v=%08x"' % (name, crc))
+    return data
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.stderr.write("usage: gzip_asset.py <input> <output.gz> [<versioned_asset.gz> ...]\n")
+        return 1
+
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+
+    try:
+        data = version_references(data, sys.argv[3:])
+    except ValueError as e:
+        sys.stderr.write("gzip_asset.py: %s: %s\n" % (sys.argv[1], e))
+        return 1
+
+    with open(sys.argv[2], "wb") as f:
+        f.write(gzip.compress(data, compresslevel=9, mtime=0))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+"""
+ota_delta.py
+
+Makes a delta patch that turns one build of gridsentry_firmware into another,
+for uploading to /OTAupdate or streaming in an OTA job instead of the whole
+image. The device rebuilds the new image from the one it is running, so the
+patch only applies to a device running exactly the old build.
+
+The diff works like bsdiff: regions of the new image are matched against the
+old one, each match is stored as the bytewise difference from the old bytes
+(mostly zeros, since code that moved only differs in the addresses it holds)
+and whatever does not match is stored as it is. The records are compressed
+with zlib. See main/ota_patch.h for the layout.
+
+The patch is applied again here before it is written, and the SHA-256 of the
+new image is printed for the X-OTA-SHA256 header.
+
+Usage: ota_delta.py <old.bin> <new.bin> <output.patch>
+"""
+import hashlib
+import struct
+import sys
+import zlib
+
+MAGIC = b"GSD1"
+HEADER = struct.Struct("<4sII32s")
+CONTROL = struct.Struct("<IIi")
+
+IMAGE_MAGIC = 0xE9
+HASH_APPENDED_OFFSET = 23
+SHA256_LEN = 32
+
+# Shortest exact match worth a record, and how densely the old image is indexed
+SEED_LEN = 16
+SEED_STEP = 4
+MAX_CANDIDATES = 8
+
+# An approximate match ends once this many bytes pass without improving it
+APPROX_SLACK = 64
+
+
+def build_index(old):
+    index = {}
+    for pos in range(0, len(old) - SEED_LEN + 1, SEED_STEP):
+        entries = index.setdefault(old[pos:pos + SEED_LEN], [])
+        if len(entries) < MAX_CANDIDATES:
+            entries.append(pos)
+    return index
+
+
+def exact_len(old, old_pos, new, new_pos):
+    """Length of the exact match at old_pos/new_pos."""
+    n = 0
+    limit = min(len(old) - old_pos, len(new) - new_pos)
+    step = 256
+    while step > 0:
+        while n + step <= limit and old[old_pos + n:old_pos + n + step] == new[new_pos + n:new_pos + n + step]:
+            n += step
+        step //= 4
+    return n
+
+
+def approx_len(old, old_pos, new, new_pos):
+    """Length that keeps at least half the bytes equal, as bsdiff extends matches."""
+    limit = min(len(old) - old_pos, len(new) - new_pos)
+    score = best_score = best_len = 0
+    n = 0
+    while n < limit and n - best_len < APPROX_SLACK:
+        score += 1 if old[old_pos + n] == new[new_pos + n] else -1
+        n += 1
+        if score > best_score:
+            best_score, best_len = score, n
+    return best_len
+
+
+def find_matches(old, new):
+    """Returns (new_pos, old_pos, length) for each match, in order."""
+    if len(old) < SEED_LEN:
+        return []
+
+    index = build_index(old)
+    matches = []
+    new_pos = 0
+    last_end = 0
+    offset = None
+
+    while new_pos + SEED_LEN <= len(new):
+        candidates = list(index.get(new[new_pos:new_pos + SEED_LEN], ()))
+        if offset is not None:
+            # Code after an insertion usually continues at the same shift
+            candidates.insert(0, new_pos + offset)
+
+        best_pos, best_len = -1, 0
+        for old_pos in candidates:
+            if 0 <= old_pos <= len(old) - SEED_LEN:
+                n = exact_len(old, old_pos, new, new_pos)
+                if n > best_len:
+                    best_pos, best_len = old_pos, n
+        if best_len < SEED_LEN:
+            new_pos += 1
+            continue
+
+        # Grow back into the unmatched bytes before it
+        while new_pos > last_end and best_pos > 0 and old[best_pos - 1] == new[new_pos - 1]:
+            new_pos -= 1
+            best_pos -= 1
+            best_len += 1
+
+        best_len += approx_len(old, best_pos + best_len, new, new_pos + best_len)
+        matches.append((new_pos, best_pos, best_len))
+        offset = best_pos - new_pos
+        new_pos += best_len
+        last_end = new_pos
+
+    return matches
+
+
+def make_patch(old, new):
+    matches = find_matches(old, new)
+    body = bytearray()
+
+    # The first record only carries the bytes before the first match
+    first_new, first_old = (matches[0][0], matches[0][1]) if matches else (len(new), 0)
+    body += CONTROL.pack(0, first_new, first_old)
+    body += new[:first_new]
+
+    for i, (new_pos, old_pos, length) in enumerate(matches):
+        next_new, next_old = (matches[i + 1][0], matches[i + 1][1]) if i + 1 < len(matches) else (len(new), old_pos + length)
+        diff = bytes((a - b) & 0xFF for a, b in zip(new[new_pos:new_pos + length], old[old_pos:old_pos + length]))
+        extra = new[new_pos + length:next_new]
+        body += CONTROL.pack(length, len(extra), next_old - (old_pos + length))
+        body += diff
+        body += extra
+
+    header = HEADER.pack(MAGIC, len(old), len(new), old[-SHA256_LEN:])
+    return header + zlib.compress(bytes(body), 9)
+
+
+def apply_patch(old, patch):
+    magic, old_size, new_size, old_sha256 = HEADER.unpack_from(patch)
+    if magic != MAGIC or old_size != len(old) or (old_size > 0 and old_sha256 != old[-SHA256_LEN:]):
+        raise ValueError("patch is not for this image")
+
+    body = zlib.decompress(patch[HEADER.size:])
+    new = bytearray()
+    pos = old_pos = 0
+    while pos < len(body):
+        diff_len, extra_len, seek = CONTROL.unpack_from(body, pos)
+        pos += CONTROL.size
+        if old_pos + diff_len > old_size or len(new) + diff_len + extra_len > new_size:
+            raise ValueError("bad record")
+        new += bytes((a + b) & 0xFF for a, b in zip(body[pos:pos + diff_len], old[old_pos:old_pos + diff_len]))
+        pos += diff_len
+        new += body[pos:pos + extra_len]
+        pos += extra_len
+        old_pos += diff_len + seek
+        if not 0 <= old_pos <= old_size:
+            raise ValueError("bad seek")
+
+    if len(new) != new_size:
+        raise ValueError("patch is incomplete")
+    return bytes(new)
+
+
+def check_image(name, data):
+    if len(data) < 64 or data[0] != IMAGE_MAGIC:
+        raise ValueError(f"{name} is not an app image")
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.stderr.write("usage: ota_delta.py <old.bin> <new.bin> <output.patch>\n")
+        return 1
+
+    with open(sys.argv[1], "rb") as f:
+        old = f.read()
+    with open(sys.argv[2], "rb") as f:
+        new = f.read()
+
+    try:
+        check_image(sys.argv[1], old)
+        check_image(sys.argv[2], new)
+        if old[HASH_APPENDED_OFFSET] != 1:
+            sys.stderr.write(f"warning: {sys.argv[1]} has no appended SHA-256, the patch is matched on its last {SHA256_LEN} bytes\n")
+        patch = make_patch(old, new)
+        if apply_patch(old, patch) != new:
+            raise ValueError("patch does not rebuild the new image")
+    except ValueError as e:
+        sys.stderr.write(f"ota_delta.py: {e}\n")
+        return 1
+
+    with open(sys.argv[3], "wb") as f:
+        f.write(patch)
+
+    print(f"{len(new)} byte image, {len(patch)} byte patch ({100 * len(patch) / len(new):.1f}%)")
+    print(f"X-OTA-SHA256: {hashlib.sha256(new).hexdigest()}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+"""
+ota_pack.py
+
+Compresses a gridsentry_firmware image for OTA. Unlike a delta patch from
+ota_delta.py the result applies whatever build the device is running, so it
+suits devices whose build is not known; an app image typically packs to about
+half its size.
+
+The packed file is a patch against an empty old image: one record whose extra
+bytes are the whole image, compressed with zlib. The device inflates it
+straight into the update partition through a 32 KB window. Upload it to
+/OTAupdate or stream it in an OTA job like the image itself.
+
+Usage: ota_pack.py <image.bin> <output.bin>
+"""
+import hashlib
+import sys
+
+from ota_delta import apply_patch, check_image, make_patch
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write("usage: ota_pack.py <image.bin> <output.bin>\n")
+        return 1
+
+    with open(sys.argv[1], "rb") as f:
+        image = f.read()
+
+    try:
+        check_image(sys.argv[1], image)
+        packed = make_patch(b"", image)
+        if apply_patch(b"", packed) != image:
+            raise ValueError("packed file does not unpack to the image")
+    except ValueError as e:
+        sys.stderr.write(f"ota_pack.py: {e}\n")
+        return 1
+
+    with open(sys.argv[2], "wb") as f:
+        f.write(packed)
+
+    print(f"{len(image)} byte image, {len(packed)} bytes packed ({100 * len(packed) / len(image):.1f}%)")
+    print(f"X-OTA-SHA256: {hashlib.sha256(image).hexdigest()}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+"""
+pem_to_der.py
+
+Build-time helper that converts the PEM credentials in main/certs/ into raw DER
+so the firmware can hand them to mbedTLS without base64 decoding at boot.
+
+Every PEM block found in the input is decoded and the DER blobs are written
+back-to-back, so a CA bundle with several certificates stays loadable. Only the
+standard library is used because this runs inside the ESP-IDF python env.
+
+Usage: pem_to_der.py <input.pem> <output.der>
+"""
+import base64
+import re
+import sys
+
+PEM_BLOCK = re.compile(
+    rb"-----BEGIN ([A-Z0-9 ]+)-----\s*(.*?)\s*-----END \1-----", re.DOTALL
+)
+
+
+def pem_to_der(pem_data):
+    blocks = PEM_BLOCK.findall(pem_data)
+    if not blocks:
+        raise ValueError("no PEM block found")
+
+    der = b""
+    for label, body in blocks:
+        if b"ENCRYPTED" in label or b"Proc-Type:" in body:
+            raise ValueError("encrypted PEM blocks are not supported")
+        der += base64.b64decode(b"".join(body.split()), validate=True)
+    return der
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write("usage: pem_to_der.py <input.pem> <output.der>\n")
+        return 1
+
+    with open(sys.argv[1], "rb") as f:
+        pem_data = f.read()
+
+    try:
+        der = pem_to_der(pem_data)
+    except ValueError as e:
+        sys.stderr.write("pem_to_der.py: %s: %s\n" % (sys.argv[1], e))
+        return 1
+
+    with open(sys.argv[2], "wb") as f:
+        f.write(der)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())